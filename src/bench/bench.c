@@ -0,0 +1,141 @@
+#include <dirent.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "src/bench/manifest.h"
+#include "src/bench/server.h"
+#include "src/server/constants.h"
+#include "src/server/stats.h"
+
+// Intervalo entre pedidos de relatório ao servidor enquanto os jobs correm
+#define POLL_INTERVAL_MS 10
+
+// Verifica se o servidor já executou todos os comandos dos jobs
+static int finished(const BenchManifest* manifest, const BenchSummary summary[STATS_OP_COUNT]) {
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    if (summary[op].count < manifest->count[op]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Remove os resultados de uma execução anterior (.out, .bck e relatórios)
+static void clean_results(const char* dir) {
+  DIR* d = opendir(dir);
+  if (d == NULL) {
+    return;
+  }
+
+  struct dirent* entry;
+  char path[PATH_MAX];
+  while ((entry = readdir(d)) != NULL) {
+    const char* dot = strrchr(entry->d_name, '.');
+    int output = dot != NULL && (strcmp(dot, ".out") == 0 || strcmp(dot, ".bck") == 0);
+    if (output || strcmp(entry->d_name, STATS_FILE_NAME) == 0 || strcmp(entry->d_name, LOCKPROF_FILE_NAME) == 0) {
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      unlink(path);
+    }
+  }
+  closedir(d);
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-t max_threads] [-b max_backups] [-k kvs_binary] <jobs_dir>\n", name);
+}
+
+int main(int argc, char** argv) {
+  const char* threads = "4";
+  const char* backups = "2";
+  const char* kvs = "src/server/kvs";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:b:k:")) != -1) {
+    switch (opt) {
+      case 't':
+        threads = optarg;
+        break;
+      case 'b':
+        backups = optarg;
+        break;
+      case 'k':
+        kvs = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  const char* dir = argv[optind];
+
+  BenchManifest manifest;
+  if (bench_manifest_read(dir, &manifest) != 0) {
+    return 1;
+  }
+  clean_results(dir);
+
+  char fifo[32], latency_path[PATH_MAX];
+  snprintf(fifo, sizeof(fifo), "bench%d", (int)getpid());
+  snprintf(latency_path, sizeof(latency_path), "%s/%s", dir, STATS_FILE_NAME);
+
+  uint64_t start = stats_now();
+  pid_t server = bench_server_start(kvs, dir, threads, backups, fifo);
+  if (server == -1) {
+    return 1;
+  }
+
+  // Pede relatórios até o servidor ter registado todos os comandos dos jobs
+  BenchSummary summary[STATS_OP_COUNT];
+  uint64_t end;
+  while (1) {
+    kill(server, SIGUSR2);
+    bench_sleep_ms(POLL_INTERVAL_MS);
+    if (waitpid(server, NULL, WNOHANG) == server) {
+      fprintf(stderr, "Server exited before finishing the jobs\n");
+      return 1;
+    }
+    if (bench_read_latency(latency_path, summary) == 0 && finished(&manifest, summary)) {
+      end = stats_now();
+      break;
+    }
+  }
+
+  // Ao terminar, o servidor escreve os relatórios finais
+  struct rusage usage_info;
+  if (bench_server_stop(server, &usage_info) != 0) {
+    return 1;
+  }
+  if (bench_read_latency(latency_path, summary) != 0) {
+    fprintf(stderr, "Server did not write %s\n", latency_path);
+    return 1;
+  }
+
+  uint64_t ops = 0;
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    ops += manifest.count[op];
+  }
+  double seconds = (double)(end - start) / 1e9;
+
+  printf("threads %s backups %s\n", threads, backups);
+  printf("elapsed_s %.3f (+/- %d ms)\n", seconds, POLL_INTERVAL_MS);
+  printf("ops %" PRIu64 "\n", ops);
+  printf("ops_per_s %.0f\n", (double)ops / seconds);
+  printf("peak_rss_kb %ld\n", usage_info.ru_maxrss);
+  printf("%-8s %10s %10s %10s %10s %10s %10s\n", "op", "count", "mean_ns", "p50_ns", "p99_ns", "p999_ns", "max_ns");
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    BenchSummary* s = &summary[op];
+    printf("%-8s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+           stats_op_name((enum StatsOp)op), s->count, s->mean, s->p50, s->p99, s->p999, s->max);
+  }
+  return 0;
+}
@@ -0,0 +1,249 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "src/bench/manifest.h"
+#include "src/server/constants.h"
+
+// Chaves escritas por comando no preenchimento inicial
+#define PREFILL_BATCH 32
+
+typedef struct {
+  const char* dir;
+  unsigned jobs;
+  unsigned long ops;  // comandos por job, sem contar o preenchimento
+  unsigned long keys;
+  int zipf;
+  double theta;
+  unsigned value_size;
+  unsigned mix[3];  // pesos de leituras, escritas e remoções
+  unsigned long backup_every;
+  uint64_t seed;
+} Options;
+
+// Gerador xorshift64*: reprodutível entre máquinas, ao contrário do rand() da libc
+static uint64_t next_random(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ull;
+}
+
+static double next_unit(uint64_t* state) { return (double)(next_random(state) >> 11) / (double)(1ull << 53); }
+
+static void random_value(uint64_t* state, unsigned size, char* value) {
+  for (unsigned i = 0; i < size; i++) {
+    value[i] = (char)('a' + next_random(state) % 26);
+  }
+  value[size] = '\0';
+}
+
+// Distribuição acumulada de Zipf(theta) sobre as chaves; a chave de ordem i tem peso 1/(i+1)^theta
+static double* zipf_table(unsigned long keys, double theta) {
+  double* cdf = malloc(keys * sizeof(double));
+  if (cdf == NULL) {
+    return NULL;
+  }
+
+  double sum = 0;
+  for (unsigned long i = 0; i < keys; i++) {
+    sum += 1.0 / pow((double)(i + 1), theta);
+    cdf[i] = sum;
+  }
+  for (unsigned long i = 0; i < keys; i++) {
+    cdf[i] /= sum;
+  }
+  return cdf;
+}
+
+static unsigned long pick_key(const Options* options, const double* cdf, uint64_t* state) {
+  if (cdf == NULL) {
+    return next_random(state) % options->keys;
+  }
+
+  // Primeira posição cuja probabilidade acumulada não é menor que u
+  double u = next_unit(state);
+  unsigned long low = 0, high = options->keys - 1;
+  while (low < high) {
+    unsigned long mid = low + (high - low) / 2;
+    if (cdf[mid] < u) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static int generate_job(const Options* options, unsigned job, const double* cdf, BenchManifest* manifest) {
+  char path[MAX_JOB_FILE_NAME_SIZE];
+  snprintf(path, sizeof(path), "%s/b%03u.job", options->dir, job);
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  // Cada job usa a sua sequência, para que o resultado não dependa do número de jobs gerados antes
+  uint64_t state = options->seed * 0x9E3779B97F4A7C15ull + job + 1;
+  char key[MAX_STRING_SIZE];
+  char* value = malloc(options->value_size + 1);
+  if (value == NULL) {
+    fclose(file);
+    return 1;
+  }
+
+  // Preenchimento: o job escreve as chaves job, job + jobs, ..., para que as leituras encontrem
+  // valores mesmo quando os jobs correm por outra ordem
+  unsigned long in_batch = 0;
+  for (unsigned long i = job; i < options->keys; i += options->jobs) {
+    bench_key_name(i, key);
+    random_value(&state, options->value_size, value);
+    fprintf(file, "%s(%s,%s)", in_batch == 0 ? "WRITE [" : "", key, value);
+    if (++in_batch == PREFILL_BATCH) {
+      fprintf(file, "]\n");
+      manifest->count[STATS_WRITE]++;
+      in_batch = 0;
+    }
+  }
+  if (in_batch > 0) {
+    fprintf(file, "]\n");
+    manifest->count[STATS_WRITE]++;
+  }
+
+  unsigned total = options->mix[0] + options->mix[1] + options->mix[2];
+  for (unsigned long op = 1; op <= options->ops; op++) {
+    bench_key_name(pick_key(options, cdf, &state), key);
+
+    unsigned r = (unsigned)(next_random(&state) % total);
+    if (r < options->mix[0]) {
+      fprintf(file, "READ [%s]\n", key);
+      manifest->count[STATS_READ]++;
+    } else if (r < options->mix[0] + options->mix[1]) {
+      random_value(&state, options->value_size, value);
+      fprintf(file, "WRITE [(%s,%s)]\n", key, value);
+      manifest->count[STATS_WRITE]++;
+    } else {
+      fprintf(file, "DELETE [%s]\n", key);
+      manifest->count[STATS_DELETE]++;
+    }
+
+    if (options->backup_every > 0 && op % options->backup_every == 0) {
+      fprintf(file, "BACKUP\n");
+      manifest->count[STATS_BACKUP]++;
+    }
+  }
+  free(value);
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to write %s\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s -o <jobs_dir> [-j jobs] [-n ops_per_job] [-k keys] [-d uniform|zipf] [-z theta]\n"
+          "          [-v value_size] [-m read:write:delete] [-B backup_every] [-s seed]\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  Options options = {NULL, 4, 10000, 1000, 0, 0.99, 8, {50, 40, 10}, 0, 1};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:j:n:k:d:z:v:m:B:s:")) != -1) {
+    switch (opt) {
+      case 'o':
+        options.dir = optarg;
+        break;
+      case 'j':
+        options.jobs = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        options.ops = strtoul(optarg, NULL, 10);
+        break;
+      case 'k':
+        options.keys = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        if (strcmp(optarg, "zipf") == 0) {
+          options.zipf = 1;
+        } else if (strcmp(optarg, "uniform") != 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'z':
+        options.theta = strtod(optarg, NULL);
+        break;
+      case 'v':
+        options.value_size = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        if (sscanf(optarg, "%u:%u:%u", &options.mix[0], &options.mix[1], &options.mix[2]) != 3) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'B':
+        options.backup_every = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        options.seed = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (options.dir == NULL || options.jobs == 0 || options.keys == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (options.value_size == 0 || options.value_size > MAX_VALUE_SIZE) {
+    fprintf(stderr, "Value size must be between 1 and %d\n", MAX_VALUE_SIZE);
+    return 1;
+  }
+  if (options.mix[0] + options.mix[1] + options.mix[2] == 0) {
+    fprintf(stderr, "Invalid operation mix\n");
+    return 1;
+  }
+
+  if (mkdir(options.dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Failed to create %s: %s\n", options.dir, strerror(errno));
+    return 1;
+  }
+
+  double* cdf = NULL;
+  if (options.zipf) {
+    cdf = zipf_table(options.keys, options.theta);
+    if (cdf == NULL) {
+      fprintf(stderr, "Failed to allocate the key distribution\n");
+      return 1;
+    }
+  }
+
+  BenchManifest manifest = {{0}};
+  int res = 0;
+  for (unsigned job = 0; job < options.jobs && res == 0; job++) {
+    res = generate_job(&options, job, cdf, &manifest);
+  }
+  free(cdf);
+
+  if (res == 0) {
+    res = bench_manifest_write(options.dir, &manifest);
+  }
+  if (res == 0) {
+    printf("%u jobs: %lu writes, %lu reads, %lu deletes, %lu backups\n", options.jobs, manifest.count[STATS_WRITE],
+           manifest.count[STATS_READ], manifest.count[STATS_DELETE], manifest.count[STATS_BACKUP]);
+  }
+  return res;
+}
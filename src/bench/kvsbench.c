@@ -0,0 +1,402 @@
+#define _GNU_SOURCE  // syscall(), para o perf_event_open
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "src/bench/manifest.h"
+#include "src/server/kvs.h"
+#include "src/server/stats.h"
+
+#define MAX_LIST 16
+#define VALUE "benchval"
+
+// Valor escrito por todas as operações; a tabela só guarda referências para ele
+static KvsValue* bench_value = NULL;
+
+enum Benchmark { BENCH_INSERT, BENCH_UPDATE, BENCH_READ_HIT, BENCH_READ_MISS, BENCH_DELETE, BENCH_ITERATE, BENCH_COUNT };
+
+static const char* const bench_names[BENCH_COUNT] = {"insert", "update", "read_hit", "read_miss", "delete", "iterate"};
+
+// Contadores do CPU lidos em grupo, pela ordem em que são abertos
+enum Counter { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_CACHE_MISSES, COUNTER_BRANCH_MISSES, COUNTER_COUNT };
+
+static const uint64_t counter_configs[COUNTER_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+// Uma configuração a medir e o estado partilhado pelas threads
+typedef struct {
+  enum Benchmark bench;
+  unsigned long size;
+  unsigned threads;
+  unsigned long ops;         // operações por thread (update e leituras)
+  unsigned long iterations;  // percursos completos por thread (iterate)
+  HashTable* table;
+  char (*keys)[MAX_STRING_SIZE];       // chaves existentes
+  char (*miss_keys)[MAX_STRING_SIZE];  // chaves com o mesmo tamanho que não existem
+  pthread_barrier_t start;
+} Run;
+
+typedef struct {
+  Run* run;
+  unsigned id;
+  int counters_ok;
+  uint64_t counters[COUNTER_COUNT];
+  unsigned long checksum;  // impede que o compilador elimine o percurso do iterate
+  uint64_t started;
+  uint64_t finished;
+} Worker;
+
+static long perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+  return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// Abre os contadores da thread atual num grupo. Devolve o descritor do líder, -1 se o kernel não
+// os disponibiliza (por exemplo com perf_event_paranoid alto ou numa máquina virtual)
+static int counters_open(int fds[COUNTER_COUNT]) {
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = counter_configs[i];
+    attr.disabled = i == 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    fds[i] = (int)perf_event_open(&attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+    if (fds[i] == -1) {
+      for (int j = 0; j < i; j++) {
+        close(fds[j]);
+      }
+      return -1;
+    }
+  }
+  return fds[0];
+}
+
+static int counters_read(int fds[COUNTER_COUNT], uint64_t values[COUNTER_COUNT]) {
+  uint64_t buffer[1 + COUNTER_COUNT];
+  ssize_t n = read(fds[0], buffer, sizeof(buffer));
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    close(fds[i]);
+  }
+  if (n != (ssize_t)sizeof(buffer) || buffer[0] != COUNTER_COUNT) {
+    return 1;
+  }
+  memcpy(values, buffer + 1, sizeof(uint64_t) * COUNTER_COUNT);
+  return 0;
+}
+
+static uint64_t next_random(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ull;
+}
+
+// Chave i com 'length' caracteres: o nome gerado completado com 'pad', que não aparece nos nomes,
+// para que as chaves continuem distintas
+static void make_key(unsigned long i, size_t length, char pad, char key[MAX_STRING_SIZE]) {
+  bench_key_name(i, key);
+  size_t len = strlen(key);
+  while (len < length && len < MAX_STRING_SIZE - 1) {
+    key[len++] = pad;
+  }
+  key[len] = '\0';
+}
+
+// Operações de uma thread, com os trincos usados pelo operations.c
+static void run_ops(Worker* worker) {
+  Run* run = worker->run;
+  HashTable* ht = run->table;
+  uint64_t state = 0x9E3779B97F4A7C15ull * (worker->id + 1);
+
+  // Inserções e remoções dividem as chaves pelas threads; as restantes escolhem-nas ao acaso
+  unsigned long first = run->size * worker->id / run->threads;
+  unsigned long last = run->size * (worker->id + 1) / run->threads;
+
+  switch (run->bench) {
+    case BENCH_INSERT:
+      for (unsigned long i = first; i < last; i++) {
+        pthread_rwlock_wrlock(&ht->tablelock);
+        write_pair(ht, run->keys[i], bench_value);
+        pthread_rwlock_unlock(&ht->tablelock);
+      }
+      break;
+
+    case BENCH_UPDATE:
+      for (unsigned long i = 0; i < run->ops; i++) {
+        pthread_rwlock_wrlock(&ht->tablelock);
+        write_pair(ht, run->keys[next_random(&state) % run->size], bench_value);
+        pthread_rwlock_unlock(&ht->tablelock);
+      }
+      break;
+
+    case BENCH_READ_HIT:
+    case BENCH_READ_MISS: {
+      char(*keys)[MAX_STRING_SIZE] = run->bench == BENCH_READ_HIT ? run->keys : run->miss_keys;
+      for (unsigned long i = 0; i < run->ops; i++) {
+        pthread_rwlock_rdlock(&ht->tablelock);
+        value_unref(read_pair(ht, keys[next_random(&state) % run->size]));
+        pthread_rwlock_unlock(&ht->tablelock);
+      }
+      break;
+    }
+
+    case BENCH_DELETE:
+      for (unsigned long i = first; i < last; i++) {
+        pthread_rwlock_wrlock(&ht->tablelock);
+        delete_pair(ht, run->keys[i]);
+        pthread_rwlock_unlock(&ht->tablelock);
+      }
+      break;
+
+    case BENCH_ITERATE:
+      // Percurso completo como o do SHOW e do backup, lendo chave e valor de cada nó
+      for (unsigned long it = 0; it < run->iterations; it++) {
+        pthread_rwlock_rdlock(&ht->tablelock);
+        for (int b = 0; b < TABLE_SIZE; b++) {
+          for (KeyNode* node = ht->table[b]; node != NULL; node = node->next) {
+            worker->checksum += (unsigned char)node->key[0] + (unsigned char)node->value->chunks[0][0];
+          }
+        }
+        pthread_rwlock_unlock(&ht->tablelock);
+      }
+      break;
+
+    case BENCH_COUNT:
+      break;
+  }
+}
+
+static void* run_worker(void* arg) {
+  Worker* worker = arg;
+  int fds[COUNTER_COUNT];
+  int leader = counters_open(fds);
+
+  pthread_barrier_wait(&worker->run->start);
+  if (leader != -1) {
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // Cada thread mede o seu intervalo: com menos CPUs que threads, as primeiras podem terminar
+  // antes de a thread principal voltar a correr depois da barreira
+  worker->started = stats_now();
+  run_ops(worker);
+  worker->finished = stats_now();
+
+  if (leader != -1) {
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    worker->counters_ok = counters_read(fds, worker->counters) == 0;
+  }
+  return NULL;
+}
+
+// Operações feitas por uma repetição, para normalizar os tempos e os contadores
+static unsigned long run_total_ops(const Run* run) {
+  switch (run->bench) {
+    case BENCH_INSERT:
+    case BENCH_DELETE:
+      return run->size;
+    case BENCH_ITERATE:
+      return run->size * run->iterations * run->threads;
+    case BENCH_UPDATE:
+    case BENCH_READ_HIT:
+    case BENCH_READ_MISS:
+    case BENCH_COUNT:
+      break;
+  }
+  return run->ops * run->threads;
+}
+
+// Executa uma repetição, com a tabela preparada fora da medição. Devolve o tempo em nanossegundos
+static uint64_t run_once(Run* run, uint64_t counters[COUNTER_COUNT], int* counters_ok) {
+  run->table = create_hash_table();
+  if (run->bench != BENCH_INSERT) {
+    for (unsigned long i = 0; i < run->size; i++) {
+      write_pair(run->table, run->keys[i], bench_value);
+    }
+  }
+
+  Worker workers[run->threads];
+  pthread_t threads[run->threads];
+  pthread_barrier_init(&run->start, NULL, run->threads + 1);
+  for (unsigned i = 0; i < run->threads; i++) {
+    workers[i] = (Worker){run, i, 0, {0}, 0, 0, 0};
+    pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+  }
+
+  pthread_barrier_wait(&run->start);
+  uint64_t start = UINT64_MAX, end = 0;
+  for (unsigned i = 0; i < run->threads; i++) {
+    pthread_join(threads[i], NULL);
+    start = workers[i].started < start ? workers[i].started : start;
+    end = workers[i].finished > end ? workers[i].finished : end;
+  }
+  pthread_barrier_destroy(&run->start);
+
+  *counters_ok = 1;
+  for (unsigned i = 0; i < run->threads; i++) {
+    *counters_ok &= workers[i].counters_ok;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+      counters[c] += workers[i].counters[c];
+    }
+  }
+
+  free_table(run->table);
+  return end - start;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+static size_t parse_list(const char* text, unsigned long list[MAX_LIST]) {
+  size_t count = 0;
+  char* end;
+  while (count < MAX_LIST) {
+    list[count++] = strtoul(text, &end, 10);
+    if (*end != ',') {
+      break;
+    }
+    text = end + 1;
+  }
+  return count;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [-n sizes] [-l key_lengths] [-t threads] [-b benchmarks] [-o ops_per_thread]\n"
+          "          [-i iterations] [-r repetitions] [-w warmup]\n"
+          "Lists are comma separated. Benchmarks: insert,update,read_hit,read_miss,delete,iterate\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  unsigned long sizes[MAX_LIST] = {100, 1000, 10000}, lengths[MAX_LIST] = {8, 32}, threads[MAX_LIST] = {1, 4};
+  size_t num_sizes = 3, num_lengths = 2, num_threads = 2;
+  int enabled[BENCH_COUNT] = {1, 1, 1, 1, 1, 1};
+  unsigned long ops = 100000, iterations = 10, repetitions = 5, warmup = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:l:t:b:o:i:r:w:")) != -1) {
+    switch (opt) {
+      case 'n':
+        num_sizes = parse_list(optarg, sizes);
+        break;
+      case 'l':
+        num_lengths = parse_list(optarg, lengths);
+        break;
+      case 't':
+        num_threads = parse_list(optarg, threads);
+        break;
+      case 'b':
+        for (int b = 0; b < BENCH_COUNT; b++) {
+          enabled[b] = strstr(optarg, bench_names[b]) != NULL;
+        }
+        break;
+      case 'o':
+        ops = strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        repetitions = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        warmup = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (num_sizes == 0 || num_lengths == 0 || num_threads == 0 || repetitions == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  bench_value = value_create(VALUE, strlen(VALUE));
+  if (bench_value == NULL) {
+    return 1;
+  }
+
+  printf("%-10s %7s %6s %7s %10s %10s %10s %10s %10s %10s\n", "bench", "size", "keylen", "threads", "ns/op",
+         "min_ns/op", "cycles/op", "instr/op", "llc_miss/op", "br_miss/op");
+
+  for (size_t s = 0; s < num_sizes; s++) {
+    unsigned long size = sizes[s];
+    char(*keys)[MAX_STRING_SIZE] = malloc(size * MAX_STRING_SIZE);
+    char(*miss_keys)[MAX_STRING_SIZE] = malloc(size * MAX_STRING_SIZE);
+    if (size == 0 || keys == NULL || miss_keys == NULL) {
+      fprintf(stderr, "Invalid table size %lu\n", size);
+      return 1;
+    }
+
+    for (size_t l = 0; l < num_lengths; l++) {
+      for (unsigned long i = 0; i < size; i++) {
+        make_key(i, lengths[l], '_', keys[i]);
+        make_key(i, lengths[l] > strlen(keys[i]) ? lengths[l] : strlen(keys[i]) + 1, '-', miss_keys[i]);
+      }
+
+      for (size_t t = 0; t < num_threads; t++) {
+        for (int b = 0; b < BENCH_COUNT; b++) {
+          if (!enabled[b] || threads[t] == 0) {
+            continue;
+          }
+
+          Run run = {.bench = (enum Benchmark)b,
+                     .size = size,
+                     .threads = (unsigned)threads[t],
+                     .ops = ops,
+                     .iterations = iterations,
+                     .keys = keys,
+                     .miss_keys = miss_keys};
+          uint64_t times[repetitions];
+          uint64_t counters[COUNTER_COUNT] = {0};
+          int counters_ok = 1;
+
+          for (unsigned long r = 0; r < warmup; r++) {
+            uint64_t discarded[COUNTER_COUNT] = {0};
+            int ok;
+            run_once(&run, discarded, &ok);
+          }
+          for (unsigned long r = 0; r < repetitions; r++) {
+            int ok;
+            times[r] = run_once(&run, counters, &ok);
+            counters_ok &= ok;
+          }
+          qsort(times, repetitions, sizeof(uint64_t), compare_u64);
+
+          double total_ops = (double)run_total_ops(&run);
+          printf("%-10s %7lu %6lu %7lu %10.1f %10.1f", bench_names[b], size, lengths[l], threads[t],
+                 (double)times[repetitions / 2] / total_ops, (double)times[0] / total_ops);
+          if (counters_ok) {
+            double measured = total_ops * (double)repetitions;
+            printf(" %10.1f %10.1f %10.2f %10.2f\n", (double)counters[COUNTER_CYCLES] / measured,
+                   (double)counters[COUNTER_INSTRUCTIONS] / measured,
+                   (double)counters[COUNTER_CACHE_MISSES] / measured,
+                   (double)counters[COUNTER_BRANCH_MISSES] / measured);
+          } else {
+            printf(" %10s %10s %10s %10s\n", "-", "-", "-", "-");
+          }
+          fflush(stdout);
+        }
+      }
+    }
+    free(keys);
+    free(miss_keys);
+  }
+  return 0;
+}
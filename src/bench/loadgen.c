@@ -0,0 +1,389 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "src/bench/manifest.h"
+#include "src/bench/server.h"
+#include "src/client/api.h"
+#include "src/client/notify.h"
+#include "src/common/protocol.h"
+#include "src/server/constants.h"
+#include "src/server/stats.h"
+
+// Chaves escritas por comando no job de preparação
+#define SETUP_BATCH 32
+
+// Tempo sem novas notificações, depois da última escrita, ao fim do qual as que faltam são
+// consideradas perdidas
+#define DRAIN_TIMEOUT_MS 1000
+
+#define LOADGEN_LATENCY_FILE "loadgen.latency"
+
+typedef struct {
+  const char* dir;
+  const char* kvs;
+  unsigned clients;
+  unsigned long keys;
+  unsigned fanout;          // clientes subscritos a cada chave
+  unsigned long writes;     // escritas por cliente
+  unsigned window;          // escritas por responder, por cliente
+  unsigned long rate;       // escritas por segundo, por cliente (0 sem limite)
+  enum KvsTransport transport;
+} Options;
+
+// Cliente simulado: uma sessão, com o seu dispatcher de notificações e a sua thread de escritas
+typedef struct {
+  unsigned id;
+  KvsSession* session;
+  NotificationDispatcher* dispatcher;
+  pthread_t notifier;
+  pthread_t writer;
+  sem_t window;  // vagas para pedidos sem resposta
+} Client;
+
+static const Options* options;
+
+static _Atomic uint64_t received = 0;
+static _Atomic uint64_t last_received_at = 0;
+static _Atomic uint64_t failed_requests = 0;
+
+// Regista a latência de cada notificação: o valor escrito é o instante em que a escrita foi enviada
+static void on_notifications(const KvsNotification* batch, size_t count, void* arg) {
+  (void)arg;
+
+  for (size_t i = 0; i < count; i++) {
+    if (batch[i].deleted || batch[i].value_len >= MAX_STRING_SIZE) {
+      continue;
+    }
+
+    char value[MAX_STRING_SIZE];
+    memcpy(value, batch[i].value, batch[i].value_len);
+    value[batch[i].value_len] = '\0';
+    uint64_t sent_at = strtoull(value, NULL, 10);
+    if (sent_at != 0) {
+      stats_record(STATS_NOTIFY, sent_at);
+    }
+  }
+
+  atomic_fetch_add(&received, count);
+  atomic_store(&last_received_at, stats_now());
+}
+
+static void* run_notifier(void* arg) {
+  Client* client = arg;
+  if (notify_dispatch(client->dispatcher) != 0) {
+    perror("Failed to read notifications");
+  }
+  return NULL;
+}
+
+// Liberta a vaga de um pedido respondido
+static void on_response(KvsSession* session, const KvsResult* result, void* arg) {
+  (void)session;
+  Client* client = arg;
+  if (result->status != 0 && result->op_code == OP_CODE_WRITE) {
+    atomic_fetch_add(&failed_requests, 1);
+  }
+  sem_post(&client->window);
+}
+
+// Pedidos de subscrição: o servidor responde com 1 quando a chave foi subscrita
+static void on_subscribed(KvsSession* session, const KvsResult* result, void* arg) {
+  (void)session;
+  Client* client = arg;
+  if (result->status != 1) {
+    atomic_fetch_add(&failed_requests, 1);
+  }
+  sem_post(&client->window);
+}
+
+// Espera que todos os pedidos do cliente tenham resposta
+static void drain_window(Client* client) {
+  for (unsigned i = 0; i < options->window; i++) {
+    sem_wait(&client->window);
+  }
+  for (unsigned i = 0; i < options->window; i++) {
+    sem_post(&client->window);
+  }
+}
+
+// A chave j é subscrita pelos clientes (j + i) % clients < fanout, ou seja, por exatamente
+// 'fanout' clientes
+static int subscribe_keys(Client* client) {
+  char key[1][MAX_STRING_SIZE];
+  for (unsigned long j = 0; j < options->keys; j++) {
+    if ((j + client->id) % options->clients >= options->fanout) {
+      continue;
+    }
+
+    bench_key_name(j, key[0]);
+    sem_wait(&client->window);
+    if (kvs_submit(client->session, OP_CODE_SUBSCRIBE, 1, key, NULL, on_subscribed, client, NULL) != 0) {
+      sem_post(&client->window);
+      return 1;
+    }
+  }
+  drain_window(client);
+  return 0;
+}
+
+static void* run_writer(void* arg) {
+  Client* client = arg;
+  uint64_t state = 0x9E3779B97F4A7C15ull * (client->id + 1);
+  uint64_t start = stats_now();
+
+  char key[1][MAX_STRING_SIZE], value[1][MAX_STRING_SIZE];
+  for (unsigned long n = 0; n < options->writes; n++) {
+    if (options->rate > 0) {
+      uint64_t due = start + n * 1000000000ull / options->rate;
+      uint64_t now = stats_now();
+      if (due > now) {
+        bench_sleep_ms((unsigned)((due - now) / 1000000));
+      }
+    }
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    bench_key_name((state * 2685821657736338717ull) % options->keys, key[0]);
+
+    sem_wait(&client->window);
+    snprintf(value[0], MAX_STRING_SIZE, "%" PRIu64, stats_now());
+    if (kvs_submit(client->session, OP_CODE_WRITE, 1, key, value, on_response, client, NULL) != 0) {
+      sem_post(&client->window);
+      atomic_fetch_add(&failed_requests, 1);
+    }
+  }
+  drain_window(client);
+  return NULL;
+}
+
+// Job que cria todas as chaves antes de os clientes as subscreverem
+static int write_setup_job(unsigned long* commands) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/setup.job", options->dir);
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  char key[MAX_STRING_SIZE];
+  *commands = 0;
+  for (unsigned long j = 0; j < options->keys; j++) {
+    bench_key_name(j, key);
+    fprintf(file, "%s(%s,0)", j % SETUP_BATCH == 0 ? "WRITE [" : "", key);
+    if (j % SETUP_BATCH == SETUP_BATCH - 1 || j == options->keys - 1) {
+      fprintf(file, "]\n");
+      (*commands)++;
+    }
+  }
+  return fclose(file) != 0;
+}
+
+// Espera que o servidor tenha executado o job de preparação
+static int wait_setup(pid_t server, unsigned long commands) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", options->dir, STATS_FILE_NAME);
+  BenchSummary summary[STATS_OP_COUNT];
+  while (1) {
+    kill(server, SIGUSR2);
+    bench_sleep_ms(10);
+    if (waitpid(server, NULL, WNOHANG) == server) {
+      fprintf(stderr, "Server exited before running the setup job\n");
+      return 1;
+    }
+    if (bench_read_latency(path, summary) == 0 && summary[STATS_WRITE].count >= commands) {
+      return 0;
+    }
+  }
+}
+
+static int open_client(Client* client, const char* server_pipe) {
+  char req[64], resp[64], notif[64];
+  snprintf(req, sizeof(req), "/tmp/req033lg%d_%u", (int)getpid(), client->id);
+  snprintf(resp, sizeof(resp), "/tmp/resp033lg%d_%u", (int)getpid(), client->id);
+  snprintf(notif, sizeof(notif), "/tmp/notif033lg%d_%u", (int)getpid(), client->id);
+
+  client->session = kvs_session_open(req, resp, server_pipe, notif, options->transport);
+  if (client->session == NULL) {
+    fprintf(stderr, "Client %u failed to connect\n", client->id);
+    return 1;
+  }
+
+  client->dispatcher = notify_dispatcher_create(client->session);
+  if (client->dispatcher == NULL) {
+    return 1;
+  }
+  notify_register(client->dispatcher, NULL, on_notifications, client);
+  sem_init(&client->window, 0, options->window);
+  return pthread_create(&client->notifier, NULL, run_notifier, client) != 0;
+}
+
+static void print_summary(const char* name, const BenchSummary* s) {
+  printf("%-10s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n", name,
+         s->count, s->mean, s->p50, s->p99, s->p999, s->max);
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [-c clients] [-k keys] [-f fanout] [-w writes_per_client] [-p window] [-r rate]\n"
+          "          [-T fifo|shm|socket] [-S kvs_binary] [-d jobs_dir]\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  static Options parsed = {"/tmp/kvsload", "src/server/kvs", MAX_SESSION_COUNT, 100, MAX_SESSION_COUNT, 10000, 16, 0,
+                           KVS_TRANSPORT_FIFO};
+  options = &parsed;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:k:f:w:p:r:T:S:d:")) != -1) {
+    switch (opt) {
+      case 'c':
+        parsed.clients = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      case 'k':
+        parsed.keys = strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        parsed.fanout = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        parsed.writes = strtoul(optarg, NULL, 10);
+        break;
+      case 'p':
+        parsed.window = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        parsed.rate = strtoul(optarg, NULL, 10);
+        break;
+      case 'T':
+        if (strcmp(optarg, "shm") == 0) {
+          parsed.transport = KVS_TRANSPORT_SHM;
+        } else if (strcmp(optarg, "socket") == 0) {
+          parsed.transport = KVS_TRANSPORT_SOCKET;
+        } else if (strcmp(optarg, "fifo") != 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'S':
+        parsed.kvs = optarg;
+        break;
+      case 'd':
+        parsed.dir = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (parsed.clients == 0 || parsed.clients > MAX_SESSION_COUNT) {
+    fprintf(stderr, "The server accepts between 1 and %d clients\n", MAX_SESSION_COUNT);
+    return 1;
+  }
+  if (parsed.keys == 0 || parsed.window == 0 || parsed.window > MAX_PIPELINE_DEPTH) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (parsed.fanout == 0 || parsed.fanout > parsed.clients) {
+    parsed.fanout = parsed.clients;
+  }
+
+  if (mkdir(parsed.dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Failed to create %s: %s\n", parsed.dir, strerror(errno));
+    return 1;
+  }
+  unsigned long setup_commands;
+  if (write_setup_job(&setup_commands) != 0) {
+    return 1;
+  }
+
+  char fifo[32], server_pipe[64];
+  snprintf(fifo, sizeof(fifo), "load%d", (int)getpid());
+  snprintf(server_pipe, sizeof(server_pipe), "%s%s", BENCH_SERVER_PIPE_PREFIX, fifo);
+  char server_latency[PATH_MAX];
+  snprintf(server_latency, sizeof(server_latency), "%s/%s", parsed.dir, STATS_FILE_NAME);
+  unlink(server_latency);
+
+  pid_t server = bench_server_start(parsed.kvs, parsed.dir, "1", "1", fifo);
+  if (server == -1 || wait_setup(server, setup_commands) != 0) {
+    return 1;
+  }
+
+  Client clients[MAX_SESSION_COUNT];
+  for (unsigned i = 0; i < parsed.clients; i++) {
+    clients[i].id = i;
+    if (open_client(&clients[i], server_pipe) != 0 || subscribe_keys(&clients[i]) != 0) {
+      bench_server_stop(server, &(struct rusage){0});
+      return 1;
+    }
+  }
+  if (atomic_load(&failed_requests) != 0) {
+    fprintf(stderr, "%" PRIu64 " subscriptions failed\n", atomic_load(&failed_requests));
+  }
+
+  uint64_t start = stats_now();
+  for (unsigned i = 0; i < parsed.clients; i++) {
+    pthread_create(&clients[i].writer, NULL, run_writer, &clients[i]);
+  }
+  for (unsigned i = 0; i < parsed.clients; i++) {
+    pthread_join(clients[i].writer, NULL);
+  }
+  uint64_t writes_done = stats_now();
+
+  // Espera pelas notificações que faltam, até deixarem de chegar
+  uint64_t expected = (uint64_t)parsed.clients * parsed.writes * parsed.fanout;
+  atomic_store(&last_received_at, stats_now());
+  while (atomic_load(&received) < expected &&
+         stats_now() - atomic_load(&last_received_at) < DRAIN_TIMEOUT_MS * 1000000ull) {
+    bench_sleep_ms(1);
+  }
+  uint64_t end = atomic_load(&last_received_at);
+
+  for (unsigned i = 0; i < parsed.clients; i++) {
+    kvs_session_disconnect(clients[i].session);
+    pthread_join(clients[i].notifier, NULL);
+    notify_dispatcher_free(clients[i].dispatcher);
+    kvs_session_free(clients[i].session);
+    sem_destroy(&clients[i].window);
+  }
+
+  struct rusage usage_info;
+  bench_server_stop(server, &usage_info);
+
+  char client_latency[PATH_MAX];
+  snprintf(client_latency, sizeof(client_latency), "%s/%s", parsed.dir, LOADGEN_LATENCY_FILE);
+  BenchSummary client_summary[STATS_OP_COUNT], server_summary[STATS_OP_COUNT];
+  if (stats_dump(client_latency) != 0 || bench_read_latency(client_latency, client_summary) != 0 ||
+      bench_read_latency(server_latency, server_summary) != 0) {
+    return 1;
+  }
+
+  uint64_t got = atomic_load(&received);
+  double write_seconds = (double)(writes_done - start) / 1e9;
+  double seconds = (double)(end - start) / 1e9;
+  printf("clients %u keys %lu fanout %u window %u\n", parsed.clients, parsed.keys, parsed.fanout, parsed.window);
+  printf("writes %lu (%" PRIu64 " failed) in %.3f s, %.0f writes/s\n", parsed.clients * parsed.writes,
+         atomic_load(&failed_requests), write_seconds, (double)(parsed.clients * parsed.writes) / write_seconds);
+  printf("notifications %" PRIu64 " of %" PRIu64 " (%" PRIu64 " lost) in %.3f s, %.0f notifications/s\n", got,
+         expected, got < expected ? expected - got : 0, seconds, (double)got / seconds);
+  printf("%-10s %10s %10s %10s %10s %10s %10s\n", "latency", "count", "mean_ns", "p50_ns", "p99_ns", "p999_ns",
+         "max_ns");
+  print_summary("end_to_end", &client_summary[STATS_NOTIFY]);
+  print_summary("kvs_write", &server_summary[STATS_WRITE]);
+  print_summary("notify_fds", &server_summary[STATS_NOTIFY]);
+  return 0;
+}
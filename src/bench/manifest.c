@@ -0,0 +1,55 @@
+#include "manifest.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+void bench_key_name(unsigned long index, char key[MAX_STRING_SIZE]) {
+  size_t len = 0;
+  key[len++] = (char)('a' + index % 26);
+  index /= 26;
+  do {
+    key[len++] = (char)('a' + index % 26);
+    index /= 26;
+  } while (index > 0 && len < MAX_STRING_SIZE - 1);
+  key[len] = '\0';
+}
+
+// Uma linha "<operação> <comandos>" por operação, com os nomes usados em kvs.latency
+int bench_manifest_write(const char* dir, const BenchManifest* manifest) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, BENCH_MANIFEST_FILE);
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    perror("Failed to create manifest");
+    return 1;
+  }
+
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    fprintf(file, "%s %lu\n", stats_op_name((enum StatsOp)op), manifest->count[op]);
+  }
+  return fclose(file) != 0;
+}
+
+int bench_manifest_read(const char* dir, BenchManifest* manifest) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, BENCH_MANIFEST_FILE);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    perror("Failed to open manifest");
+    return 1;
+  }
+
+  memset(manifest, 0, sizeof(BenchManifest));
+  char name[32];
+  unsigned long count;
+  while (fscanf(file, "%31s %lu", name, &count) == 2) {
+    for (int op = 0; op < STATS_OP_COUNT; op++) {
+      if (strcmp(name, stats_op_name((enum StatsOp)op)) == 0) {
+        manifest->count[op] = count;
+      }
+    }
+  }
+  fclose(file);
+  return 0;
+}
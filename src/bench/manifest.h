@@ -0,0 +1,35 @@
+#ifndef BENCH_MANIFEST_H
+#define BENCH_MANIFEST_H
+
+#include "src/common/constants.h"
+#include "src/server/stats.h"
+
+/// Name of the file, inside the jobs directory, that describes generated jobs.
+#define BENCH_MANIFEST_FILE "bench.manifest"
+
+/// Number of commands of each kind in a set of generated jobs. The benchmark
+/// is finished once the server has recorded this many operations.
+typedef struct {
+  unsigned long count[STATS_OP_COUNT];
+} BenchManifest;
+
+/// Name of the generated key with the given index. The first letter changes
+/// with the index, so consecutive keys (the hottest under a Zipf
+/// distribution) land in different buckets of the server's table.
+/// @param index Index of the key.
+/// @param key Set to the name.
+void bench_key_name(unsigned long index, char key[MAX_STRING_SIZE]);
+
+/// Writes the manifest of a jobs directory.
+/// @param dir Jobs directory.
+/// @param manifest Commands generated.
+/// @return 0 on success, 1 otherwise.
+int bench_manifest_write(const char* dir, const BenchManifest* manifest);
+
+/// Reads the manifest of a jobs directory.
+/// @param dir Jobs directory.
+/// @param manifest Set to the commands generated.
+/// @return 0 on success, 1 otherwise.
+int bench_manifest_read(const char* dir, BenchManifest* manifest);
+
+#endif  // BENCH_MANIFEST_H
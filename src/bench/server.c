@@ -0,0 +1,86 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+void bench_sleep_ms(unsigned ms) {
+  struct timespec delay = {ms / 1000, (long)(ms % 1000) * 1000000};
+  nanosleep(&delay, NULL);
+}
+
+pid_t bench_server_start(const char* kvs, const char* dir, const char* threads, const char* backups,
+                         const char* fifo) {
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    return -1;
+  }
+
+  if (pid == 0) {
+    // O servidor escreve uma linha por WAIT e por EOF; só interessa o que vai para o stderr
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd != -1) {
+      dup2(null_fd, STDOUT_FILENO);
+      close(null_fd);
+    }
+    execl(kvs, kvs, dir, threads, backups, fifo, (char*)NULL);
+    perror("Failed to start the server");
+    _exit(127);
+  }
+
+  // O FIFO é criado depois de os manipuladores de sinais estarem instalados: antes disso um
+  // SIGUSR2 ou SIGTERM terminaria o servidor sem relatórios
+  char fifo_path[256];
+  snprintf(fifo_path, sizeof(fifo_path), "%s%s", BENCH_SERVER_PIPE_PREFIX, fifo);
+  struct stat st;
+  while (stat(fifo_path, &st) != 0) {
+    if (waitpid(pid, NULL, WNOHANG) == pid) {
+      fprintf(stderr, "Server exited before starting\n");
+      return -1;
+    }
+    bench_sleep_ms(1);
+  }
+  return pid;
+}
+
+int bench_server_stop(pid_t server, struct rusage* usage) {
+  // O pico de memória dos filhos terminados é o do servidor (os processos de backup são cópias dele)
+  kill(server, SIGTERM);
+  if (waitpid(server, NULL, 0) == -1 || getrusage(RUSAGE_CHILDREN, usage) != 0) {
+    perror("Failed to wait for the server");
+    return 1;
+  }
+  return 0;
+}
+
+int bench_read_latency(const char* path, BenchSummary summary[STATS_OP_COUNT]) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return 1;
+  }
+
+  memset(summary, 0, STATS_OP_COUNT * sizeof(BenchSummary));
+  char line[256], name[32];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    BenchSummary s;
+    if (sscanf(line, "%31s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                     " %" SCNu64,
+               name, &s.count, &s.min, &s.mean, &s.p50, &s.p90, &s.p99, &s.p999, &s.max) != 9) {
+      continue;
+    }
+    for (int op = 0; op < STATS_OP_COUNT; op++) {
+      if (strcmp(name, stats_op_name((enum StatsOp)op)) == 0) {
+        summary[op] = s;
+      }
+    }
+  }
+  fclose(file);
+  return 0;
+}
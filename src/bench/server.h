@@ -0,0 +1,45 @@
+#ifndef BENCH_SERVER_H
+#define BENCH_SERVER_H
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "src/server/stats.h"
+
+/// Prefix the server adds to the name of its FIFO.
+#define BENCH_SERVER_PIPE_PREFIX "/tmp/server033"
+
+/// Summary line of an operation in kvs.latency, in nanoseconds.
+typedef struct {
+  uint64_t count, min, mean, p50, p90, p99, p999, max;
+} BenchSummary;
+
+/// Sleeps for some milliseconds.
+/// @param ms Milliseconds to sleep.
+void bench_sleep_ms(unsigned ms);
+
+/// Starts the server and waits until it accepts signals and clients. Its
+/// standard output is discarded.
+/// @param kvs Path of the server binary.
+/// @param dir Jobs directory.
+/// @param threads Value of max_threads.
+/// @param backups Value of max_backups.
+/// @param fifo Name of the server FIFO, without the prefix.
+/// @return The server pid, -1 if it could not be started.
+pid_t bench_server_start(const char* kvs, const char* dir, const char* threads, const char* backups,
+                         const char* fifo);
+
+/// Stops the server with SIGTERM, so it writes its reports, and waits for it.
+/// @param server Server pid.
+/// @param usage Set to the resource usage of the server.
+/// @return 0 on success, 1 otherwise.
+int bench_server_stop(pid_t server, struct rusage* usage);
+
+/// Reads the summary lines of a latency report written by stats_dump.
+/// @param path Path of the report.
+/// @param summary Set to the summary of each operation (zero if missing).
+/// @return 0 on success, 1 if the report does not exist.
+int bench_read_latency(const char* path, BenchSummary summary[STATS_OP_COUNT]);
+
+#endif  // BENCH_SERVER_H
@@ -2,347 +2,1723 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include "src/client/cache.h"
 #include "src/common/constants.h"
+#include "src/common/io.h"
 #include "src/common/protocol.h"
+#include "src/common/shm.h"
 
-static const char* _req_pipe_path;
-static const char* _resp_pipe_path;
-static const char* _notif_pipe_path;
-int _server_fd, _req_fd, _resp_fd, _notif_fd;
+// Frame recebido que ainda não foi consumido (notificações no socket ou resultados à espera de
+// kvs_session_next_completion)
+typedef struct PendingFrame {
+  struct PendingFrame* next;
+  void* arg;
+  size_t size;
+  char data[];
+} PendingFrame;
 
-// Retorna descritor do fifo de notificações
-int* get_notify_fd() { return &_notif_fd; }
+typedef struct {
+  PendingFrame* head;
+  PendingFrame* tail;
+} FrameQueue;
+
+// Efeito de um pedido do utilizador nas subscrições conhecidas pela cache
+enum Tracking {
+  TRACK_NONE,
+  TRACK_SUBSCRIBE,   // chave acrescentada antes do envio, a esquecer se o servidor recusar
+  TRACK_UNSUBSCRIBE  // chave a retirar se o servidor aceitar
+};
+
+// Pedido enviado cuja resposta ainda não chegou
+typedef struct {
+  int in_use;
+  uint8_t op_code;
+  uint32_t request_id;
+  KvsCallback callback;  // NULL: o resultado vai para a fila de conclusões
+  void* arg;
+  enum Tracking tracking;
+} InFlight;
+
+struct KvsSession {
+  enum KvsTransport transport;
+  int server_fd, req_fd, resp_fd, notif_fd;
+  int sock_fd;     // socket UNIX da sessão (-1 se a sessão usa os FIFOs)
+  ShmRegion* shm;  // região partilhada da sessão (NULL se a sessão usa os FIFOs)
+  char* req_pipe_path;
+  char* resp_pipe_path;
+  char* notif_pipe_path;
+
+  pthread_mutex_t send_lock;  // serializa as escritas de pedidos de várias threads
+  uint32_t next_request_id;   // identificador do próximo pedido enviado ao servidor
+
+  // Protege tudo o que se segue. A thread recetora é a única que lê respostas; as restantes
+  // esperam em 'cond' pelo resultado, por espaço na janela ou por notificações
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  InFlight in_flight[KVS_MAX_IN_FLIGHT];  // indexado por request_id % KVS_MAX_IN_FLIGHT
+  int closed;                             // a sessão terminou; não há mais respostas
+  FrameQueue notifications;               // notificações recebidas no socket
+  FrameQueue completions;                 // resultados de pedidos submetidos sem callback
+  PendingFrame* last_completion;          // último resultado entregue, libertado no seguinte
+
+  int event_fd;
+  pthread_t receiver;
+  int receiver_started;
+  int fds_closed;  // os descritores já foram fechados (depois de uma falha ou do disconnect)
+
+  KvsCache* cache;                           // cache de leituras (NULL se desativada)
+  char (*tracked_keys)[MAX_STRING_SIZE];     // chave de cada pedido com 'tracking', por posição
+  char partial[MAX_STRING_SIZE];     // início de um registo de notificação ainda incompleto
+  size_t partial_len;
+};
+
+// Sessão usada pelas funções sem handle (kvs_connect, kvs_subscribe, ...)
+static KvsSession* _session = NULL;
+static enum KvsTransport _transport = KVS_TRANSPORT_FIFO;
+static int _notif_fd = -1;
+static size_t _cache_capacity = 0;
+
+static void queue_push(FrameQueue* queue, const char* data, size_t size, void* arg) {
+  PendingFrame* frame = malloc(sizeof(PendingFrame) + size);
+  if (frame == NULL) {
+    fprintf(stderr, "Failed to allocate pending frame\n");
+    return;
+  }
+  frame->next = NULL;
+  frame->arg = arg;
+  frame->size = size;
+  memcpy(frame->data, data, size);
+
+  if (queue->tail == NULL) {
+    queue->head = frame;
+  } else {
+    queue->tail->next = frame;
+  }
+  queue->tail = frame;
+}
+
+static PendingFrame* queue_pop(FrameQueue* queue) {
+  PendingFrame* frame = queue->head;
+  if (frame != NULL) {
+    queue->head = frame->next;
+    if (queue->head == NULL) {
+      queue->tail = NULL;
+    }
+  }
+  return frame;
+}
+
+static void queue_clear(FrameQueue* queue) {
+  PendingFrame* frame;
+  while ((frame = queue_pop(queue)) != NULL) {
+    free(frame);
+  }
+}
+
+// Escreve bytes para o servidor, pelo anel de pedidos, pelo socket ou pelo FIFO de pedidos
+static int send_bytes(KvsSession* session, const void* buffer, size_t size) {
+  if (session->shm != NULL) {
+    return shm_ring_write(&session->shm->requests, buffer, size, session->req_fd);
+  }
+  if (session->sock_fd >= 0) {
+    // Cada escrita é uma mensagem do socket, com todos os frames que contém
+    return send_with_fd(session->sock_fd, buffer, size, -1);
+  }
+  return write_all(session->req_fd, buffer, size);
+}
+
+// Lê as próximas respostas do servidor, do anel, do socket (uma mensagem) ou do FIFO de respostas
+static ssize_t recv_bytes(KvsSession* session, void* buffer, size_t size) {
+  if (session->shm != NULL) {
+    return shm_ring_read(&session->shm->responses, buffer, size, session->resp_fd);
+  }
+  if (session->sock_fd >= 0) {
+    return recv(session->sock_fd, buffer, size, 0);
+  }
+  return read(session->resp_fd, buffer, size);
+}
+
+// Entrega o resultado de um pedido: pelo callback, ou pela fila de conclusões e o eventfd
+static void complete_request(KvsSession* session, const InFlight* request, const FrameHeader* header,
+                             const char* payload) {
+  KvsResult result = {request->op_code, header != NULL ? header->status : -1, request->request_id,
+                      payload, header != NULL ? header->payload_len : 0};
+
+  if (request->callback != NULL) {
+    request->callback(session, &result, request->arg);
+    return;
+  }
+
+  // Guarda o frame completo, para que kvs_session_next_completion possa reconstruir o resultado
+  char frame[FRAME_MAX_SIZE];
+  frame_init(frame, request->op_code, 0, request->request_id);
+  if (header != NULL) {
+    memcpy(frame, header, FRAME_HEADER_SIZE);
+    memcpy(frame + FRAME_HEADER_SIZE, payload, header->payload_len);
+  } else {
+    // A sessão terminou sem resposta: o status 0xFF é devolvido como -1
+    frame[offsetof(FrameHeader, status)] = (char)0xFF;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  queue_push(&session->completions, frame, frame_size(frame), request->arg);
+  pthread_mutex_unlock(&session->lock);
+
+  uint64_t one = 1;
+  if (write(session->event_fd, &one, sizeof(one)) == -1) {
+    perror("Failed to signal completion eventfd");
+  }
+}
+
+// Trata um frame recebido do servidor
+static void dispatch_frame(KvsSession* session, const FrameHeader* header, const char* frame) {
+  if (header->op_code == OP_CODE_NOTIFY) {
+    pthread_mutex_lock(&session->lock);
+    queue_push(&session->notifications, frame, FRAME_HEADER_SIZE + header->payload_len, NULL);
+    pthread_cond_broadcast(&session->cond);
+    pthread_mutex_unlock(&session->lock);
+    return;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  InFlight* slot = &session->in_flight[header->request_id % KVS_MAX_IN_FLIGHT];
+  if (!slot->in_use || slot->request_id != header->request_id || slot->op_code != header->op_code) {
+    pthread_mutex_unlock(&session->lock);
+    fprintf(stderr, "Unexpected response for request %u\n", header->request_id);
+    return;
+  }
+  InFlight request = *slot;
+  slot->in_use = 0;
+
+  // Atualiza as subscrições do utilizador antes de entregar o resultado
+  if (request.tracking == TRACK_SUBSCRIBE && header->status != 1) {
+    cache_user_forget(session->cache, session->tracked_keys[header->request_id % KVS_MAX_IN_FLIGHT]);
+  } else if (request.tracking == TRACK_UNSUBSCRIBE && header->status == 0) {
+    cache_user_unsubscribe(session->cache, session->tracked_keys[header->request_id % KVS_MAX_IN_FLIGHT]);
+  }
+  pthread_cond_broadcast(&session->cond);
+  pthread_mutex_unlock(&session->lock);
+
+  complete_request(session, &request, header, frame + FRAME_HEADER_SIZE);
+}
+
+// Termina todos os pedidos pendentes com status -1 e acorda quem espera pela sessão
+static void fail_in_flight(KvsSession* session) {
+  pthread_mutex_lock(&session->lock);
+  session->closed = 1;
+  pthread_cond_broadcast(&session->cond);
+  pthread_mutex_unlock(&session->lock);
+
+  for (size_t i = 0; i < KVS_MAX_IN_FLIGHT; i++) {
+    pthread_mutex_lock(&session->lock);
+    InFlight request = session->in_flight[i];
+    session->in_flight[i].in_use = 0;
+    pthread_cond_broadcast(&session->cond);
+    pthread_mutex_unlock(&session->lock);
+
+    if (request.in_use) {
+      complete_request(session, &request, NULL, NULL);
+    }
+  }
+}
+
+// Thread recetora: lê todas as respostas da sessão e entrega-as a quem as pediu, pela ordem
+// de chegada. No socket separa também as notificações.
+static void* receive_responses(void* arg) {
+  KvsSession* session = arg;
+  char* buffer = malloc(PROTOCOL_MAX_MESSAGE);
+  size_t len = 0;
+
+  while (buffer != NULL) {
+    ssize_t n = recv_bytes(session, buffer + len, PROTOCOL_MAX_MESSAGE - len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    len += (size_t)n;
+
+    // Uma leitura pode conter vários frames (respostas a pedidos em pipeline) ou parte de um
+    FrameHeader header;
+    size_t processed = 0;
+    int parsed;
+    while ((parsed = frame_parse(buffer + processed, len - processed, &header)) == 1) {
+      dispatch_frame(session, &header, buffer + processed);
+      processed += FRAME_HEADER_SIZE + header.payload_len;
+    }
+    if (parsed == -1) {
+      fprintf(stderr, "Invalid response frame\n");
+      break;
+    }
+
+    memmove(buffer, buffer + processed, len - processed);
+    len -= processed;
+  }
+
+  free(buffer);
+  fail_in_flight(session);
+  return NULL;
+}
+
+// Constrói o frame de um pedido; as versões (ou os incrementos de um INCR), quando existem, seguem
+// entre a chave e o valor.
+// Retorna 0 em caso de sucesso, 1 se não couber num frame
+static int build_request(char* frame, size_t cap, uint8_t op_code, uint32_t request_id, size_t num_keys,
+                         char keys[][MAX_STRING_SIZE], const uint64_t versions[], char values[][MAX_STRING_SIZE]) {
+  size_t number_size = op_code == OP_CODE_INCR ? DELTA_FIELD_SIZE : VERSION_FIELD_SIZE;
+  frame_init(frame, op_code, 0, request_id);
+  for (size_t i = 0; i < num_keys; i++) {
+    if (frame_add_field(frame, cap, keys[i], strnlen(keys[i], MAX_STRING_SIZE - 1)) != 0) {
+      return 1;
+    }
+    if (versions != NULL && frame_add_field(frame, cap, &versions[i], number_size) != 0) {
+      return 1;
+    }
+    if (values != NULL && frame_add_field(frame, cap, values[i], strnlen(values[i], MAX_STRING_SIZE - 1)) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Reserva uma posição na janela de pedidos. Tem de ser chamada com 'send_lock', para que os
+// identificadores sejam enviados pela ordem em que são atribuídos.
+// Retorna o identificador reservado, ou 0 se a sessão terminou
+static uint32_t reserve_request(KvsSession* session, uint8_t op_code, KvsCallback callback, void* arg) {
+  pthread_mutex_lock(&session->lock);
+  uint32_t request_id = session->next_request_id;
+  InFlight* slot = &session->in_flight[request_id % KVS_MAX_IN_FLIGHT];
+
+  // Janela cheia: espera pela resposta que ocupa esta posição
+  while (!session->closed && slot->in_use) {
+    pthread_cond_wait(&session->cond, &session->lock);
+  }
+  if (session->closed) {
+    pthread_mutex_unlock(&session->lock);
+    return 0;
+  }
+
+  session->next_request_id++;
+  if (session->next_request_id == 0) {
+    session->next_request_id = 1;
+  }
+  *slot = (InFlight){1, op_code, request_id, callback, arg, TRACK_NONE};
+  pthread_mutex_unlock(&session->lock);
+  return request_id;
+}
+
+// Regista na cache uma subscrição pedida pelo utilizador, antes de o pedido ser enviado, para
+// que as notificações que se lhe seguem nunca sejam tomadas como sendo só da cache
+static void track_request(KvsSession* session, uint32_t request_id, uint8_t op_code, const char* key) {
+  if (session->cache == NULL || (op_code != OP_CODE_SUBSCRIBE && op_code != OP_CODE_UNSUBSCRIBE)) {
+    return;
+  }
+
+  enum Tracking tracking = TRACK_UNSUBSCRIBE;
+  if (op_code == OP_CODE_SUBSCRIBE) {
+    // Se o utilizador já tinha a chave, uma recusa do servidor não a deve retirar
+    tracking = cache_user_subscribe(session->cache, key) == 1 ? TRACK_SUBSCRIBE : TRACK_NONE;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  session->in_flight[request_id % KVS_MAX_IN_FLIGHT].tracking = tracking;
+  strncpy(session->tracked_keys[request_id % KVS_MAX_IN_FLIGHT], key, MAX_STRING_SIZE - 1);
+  pthread_mutex_unlock(&session->lock);
+}
+
+// Anula a reserva de pedidos que não chegaram a ser enviados
+static void cancel_requests(KvsSession* session, uint32_t first_id, size_t count) {
+  pthread_mutex_lock(&session->lock);
+  for (size_t i = 0; i < count; i++) {
+    InFlight* slot = &session->in_flight[(first_id + i) % KVS_MAX_IN_FLIGHT];
+    if (slot->in_use && slot->request_id == first_id + (uint32_t)i) {
+      slot->in_use = 0;
+      if (slot->tracking == TRACK_SUBSCRIBE) {
+        cache_user_forget(session->cache, session->tracked_keys[(first_id + i) % KVS_MAX_IN_FLIGHT]);
+      }
+    }
+  }
+  pthread_cond_broadcast(&session->cond);
+  pthread_mutex_unlock(&session->lock);
+}
+
+// Envia um pedido sem esperar pela resposta. Os pedidos internos (da cache) não alteram as
+// subscrições do utilizador. Retorna 0 se o pedido foi enviado, 1 caso contrário
+static int submit_request(KvsSession* session, uint8_t op_code, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                          const uint64_t versions[], char values[][MAX_STRING_SIZE], KvsCallback callback, void* arg,
+                          uint32_t* request_id, int internal) {
+  static _Thread_local char frame[FRAME_MAX_SIZE];
+
+  pthread_mutex_lock(&session->send_lock);
+  uint32_t id = reserve_request(session, op_code, callback, arg);
+  if (id == 0) {
+    pthread_mutex_unlock(&session->send_lock);
+    return 1;
+  }
+  if (!internal && num_keys > 0) {
+    track_request(session, id, op_code, keys[0]);
+  }
+
+  if (build_request(frame, sizeof(frame), op_code, id, num_keys, keys, versions, values) != 0) {
+    pthread_mutex_unlock(&session->send_lock);
+    cancel_requests(session, id, 1);
+    fprintf(stderr, "Too many keys for request\n");
+    return 1;
+  }
+
+  int res = send_bytes(session, frame, frame_size(frame));
+  pthread_mutex_unlock(&session->send_lock);
+  if (res != 1) {
+    cancel_requests(session, id, 1);
+    fprintf(stderr, "Failed to write to request FIFO\n");
+    return 1;
+  }
+
+  if (request_id != NULL) {
+    *request_id = id;
+  }
+  return 0;
+}
+
+/**
+ * Envia um pedido ao servidor sem esperar pela resposta.
+ *
+ * O resultado é entregue ao callback pela thread recetora da sessão ou, sem callback, colocado
+ * na fila de conclusões e assinalado no eventfd da sessão.
+ *
+ * @return int Retorna 0 se o pedido foi enviado, 1 caso contrário
+ */
+int kvs_submit(KvsSession* session, uint8_t op_code, size_t num_keys, char keys[][MAX_STRING_SIZE],
+               char values[][MAX_STRING_SIZE], KvsCallback callback, void* arg, uint32_t* request_id) {
+  return submit_request(session, op_code, num_keys, keys, NULL, values, callback, arg, request_id, 0);
+}
+
+// Espera pelo resultado de um ou mais pedidos enviados por uma operação bloqueante
+typedef struct {
+  KvsSession* session;
+  size_t remaining;
+  int* statuses;
+  char* payload;  // cópia do payload (apenas para pedidos únicos)
+  size_t payload_len;
+} Waiter;
+
+typedef struct {
+  Waiter* waiter;
+  size_t index;
+} WaiterSlot;
+
+static void waiter_callback(KvsSession* session, const KvsResult* result, void* arg) {
+  WaiterSlot* slot = arg;
+  Waiter* waiter = slot->waiter;
+
+  if (waiter->payload != NULL) {
+    memcpy(waiter->payload, result->payload, result->payload_len);
+    waiter->payload_len = result->payload_len;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  waiter->statuses[slot->index] = result->status;
+  waiter->remaining--;
+  pthread_cond_broadcast(&session->cond);
+  pthread_mutex_unlock(&session->lock);
+}
+
+static void waiter_wait(Waiter* waiter) {
+  KvsSession* session = waiter->session;
+  pthread_mutex_lock(&session->lock);
+  while (waiter->remaining > 0) {
+    pthread_cond_wait(&session->cond, &session->lock);
+  }
+  pthread_mutex_unlock(&session->lock);
+}
+
+// Envia um pedido e espera pelo resultado, cujo payload fica em 'payload'
+// Retorna o status devolvido pelo servidor, ou -1 em caso de erro
+static int transact(KvsSession* session, uint8_t op_code, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                    const uint64_t versions[], char values[][MAX_STRING_SIZE], char* payload, size_t* payload_len) {
+  int status = -1;
+  Waiter waiter = {session, 1, &status, payload, 0};
+  WaiterSlot slot = {&waiter, 0};
+
+  if (submit_request(session, op_code, num_keys, keys, versions, values, waiter_callback, &slot, NULL, 0) != 0) {
+    return -1;
+  }
+  waiter_wait(&waiter);
+
+  if (payload_len != NULL) {
+    *payload_len = waiter.payload_len;
+  }
+  return status;
+}
+
+/**
+ * Envia vários pedidos do mesmo tipo (um por chave) sem esperar pelas respostas.
+ *
+ * Os pedidos são enviados em janelas de até MAX_PIPELINE_DEPTH frames numa só escrita, e só
+ * depois se espera pelas respostas, que a thread recetora entrega à medida que chegam. Assim,
+ * uma janela custa um único round-trip em vez de um por chave.
+ *
+ * @param op_code    Operação a pedir (OP_CODE_SUBSCRIBE ou OP_CODE_UNSUBSCRIBE)
+ * @param num_keys   Número de chaves
+ * @param keys       Chaves a enviar
+ * @param statuses   Onde guardar o status devolvido pelo servidor para cada chave
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro de comunicação
+ */
+static int pipeline_requests(KvsSession* session, uint8_t op_code, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                             int statuses[]) {
+  static _Thread_local char buffer_request[MAX_PIPELINE_DEPTH * (FRAME_HEADER_SIZE + sizeof(uint16_t) + MAX_STRING_SIZE)];
+  WaiterSlot* slots = malloc(num_keys * sizeof(WaiterSlot));
+  if (slots == NULL) {
+    return 1;
+  }
+
+  Waiter waiter = {session, 0, statuses, NULL, 0};
+  int result = 0;
+
+  for (size_t start = 0; start < num_keys && result == 0; start += MAX_PIPELINE_DEPTH) {
+    size_t window = num_keys - start < MAX_PIPELINE_DEPTH ? num_keys - start : MAX_PIPELINE_DEPTH;
+    uint32_t first_id = 0;
+    size_t len = 0, reserved = 0;
+
+    pthread_mutex_lock(&session->send_lock);
+
+    // Constrói os frames da janela, um a seguir ao outro
+    for (; reserved < window; reserved++) {
+      size_t i = start + reserved;
+      slots[i] = (WaiterSlot){&waiter, i};
+      statuses[i] = -1;
+      uint32_t id = reserve_request(session, op_code, waiter_callback, &slots[i]);
+      if (id == 0) {
+        break;
+      }
+      if (reserved == 0) {
+        first_id = id;
+      }
+      track_request(session, id, op_code, keys[i]);
+      build_request(buffer_request + len, sizeof(buffer_request) - len, op_code, id, 1, &keys[i], NULL, NULL);
+      len += frame_size(buffer_request + len);
+    }
+
+    pthread_mutex_lock(&session->lock);
+    waiter.remaining += reserved;
+    pthread_mutex_unlock(&session->lock);
+
+    // Escreve a janela inteira de uma só vez
+    if (reserved < window || send_bytes(session, buffer_request, len) != 1) {
+      fprintf(stderr, "Failed to write to request FIFO\n");
+      result = 1;
+    }
+    pthread_mutex_unlock(&session->send_lock);
+
+    if (result != 0) {
+      // Os pedidos da janela não foram enviados: não vão ter resposta
+      cancel_requests(session, first_id, reserved);
+      pthread_mutex_lock(&session->lock);
+      waiter.remaining -= reserved;
+      pthread_mutex_unlock(&session->lock);
+    }
+  }
+
+  // Recolhe as respostas, que chegam pela ordem dos pedidos
+  waiter_wait(&waiter);
+  free(slots);
+
+  for (size_t i = 0; i < num_keys && result == 0; i++) {
+    if (statuses[i] < 0) {
+      result = 1;
+    }
+  }
+  return result;
+}
+
+int kvs_session_eventfd(KvsSession* session) { return session->event_fd; }
+
+int kvs_session_next_completion(KvsSession* session, KvsResult* result, void** arg) {
+  pthread_mutex_lock(&session->lock);
+  free(session->last_completion);
+  session->last_completion = queue_pop(&session->completions);
+  PendingFrame* completion = session->last_completion;
+  pthread_mutex_unlock(&session->lock);
+
+  if (completion == NULL) {
+    return 1;
+  }
+
+  FrameHeader header;
+  memcpy(&header, completion->data, FRAME_HEADER_SIZE);
+  result->op_code = header.op_code;
+  result->status = header.status == 0xFF ? -1 : header.status;
+  result->request_id = header.request_id;
+  result->payload = completion->data + FRAME_HEADER_SIZE;
+  result->payload_len = header.payload_len;
+  *arg = completion->arg;
+  return 0;
+}
+
+// Copia para 'record' o registo transportado por um frame OP_CODE_NOTIFY, que é o mesmo que
+// seria escrito no FIFO de notificações. Liberta o frame. Retorna 0 em caso de sucesso, 1 se o
+// frame é inválido
+static int notify_frame_record(PendingFrame* frame, char* record) {
+  FrameHeader header;
+  const char* field;
+  size_t len, offset = 0;
+  int valid = frame_parse(frame->data, frame->size, &header) == 1 &&
+              frame_next_field(frame->data + FRAME_HEADER_SIZE, header.payload_len, &offset, &field, &len) == 1;
+  if (valid) {
+    memset(record, 0, MAX_STRING_SIZE);
+    memcpy(record, field, len < MAX_STRING_SIZE ? len : MAX_STRING_SIZE);
+  }
+  free(frame);
+  return !valid;
+}
+
+// Retira a próxima notificação recebida no socket, esperando por ela se 'wait' for 1
+// Retorna NULL se a sessão terminou ou, sem espera, se não há notificações
+static PendingFrame* next_socket_notification(KvsSession* session, int wait) {
+  pthread_mutex_lock(&session->lock);
+  PendingFrame* frame;
+  while ((frame = queue_pop(&session->notifications)) == NULL && wait && !session->closed) {
+    pthread_cond_wait(&session->cond, &session->lock);
+  }
+  pthread_mutex_unlock(&session->lock);
+  return frame;
+}
+
+int kvs_parse_notification(const char* record, KvsNotification* notification) {
+  size_t len = strnlen(record, MAX_STRING_SIZE);
+  const char* comma = memchr(record, ',', len);
+  if (len < 3 || record[0] != '(' || comma == NULL) {
+    return 1;
+  }
+
+  // Um registo cortado pelo servidor não tem o ')' final. Um que enche o registo até ao limite pode
+  // ter sido cortado logo a seguir a um ')' do valor, por isso também não se sabe se está inteiro
+  int closed = record[len - 1] == ')';
+  size_t end = closed ? len - 1 : len;
+  notification->key = record + 1;
+  notification->key_len = (size_t)(comma - record) - 1;
+  notification->value = comma + 1;
+  notification->value_len = end - (size_t)(comma + 1 - record);
+  notification->deleted =
+      closed && notification->value_len == 7 && memcmp(notification->value, "DELETED", 7) == 0;
+  notification->truncated = !notification->deleted && (!closed || len >= MAX_STRING_SIZE - 1);
+  return 0;
+}
+
+// Aplica uma notificação à cache. Retorna 1 se só a cache a tinha pedido
+static int cache_consume(KvsSession* session, const char* record) {
+  KvsNotification notification;
+  if (kvs_parse_notification(record, &notification) != 0) {
+    return 0;
+  }
+  return cache_notify(session->cache, notification.key, notification.key_len, notification.value,
+                      notification.value_len, notification.deleted, notification.truncated);
+}
+
+static ssize_t read_one_notification(KvsSession* session, void* buffer, size_t size);
+
+ssize_t kvs_session_read_notification(KvsSession* session, void* buffer, size_t size) {
+  while (1) {
+    ssize_t n = read_one_notification(session, buffer, size);
+    if (n <= 0 || session->cache == NULL || size < MAX_STRING_SIZE || !cache_consume(session, buffer)) {
+      return n;
+    }
+  }
+}
+
+static ssize_t read_one_notification(KvsSession* session, void* buffer, size_t size) {
+  if (session->shm != NULL) {
+    // As notificações têm tamanho fixo, por isso só se devolvem registos completos
+    size_t total = 0;
+    while (total < size) {
+      ssize_t n = shm_ring_read(&session->shm->notifications, (char*)buffer + total, size - total,
+                                session->notif_fd);
+      if (n <= 0) {
+        return 0;
+      }
+      total += (size_t)n;
+    }
+    return (ssize_t)size;
+  }
+
+  if (session->sock_fd >= 0) {
+    // A thread recetora separa as notificações das respostas
+    PendingFrame* frame = next_socket_notification(session, 1);
+    if (frame == NULL) {
+      return 0;
+    }
+
+    char record[MAX_STRING_SIZE];
+    if (notify_frame_record(frame, record) != 0) {
+      errno = EIO;
+      return -1;
+    }
+    memset(buffer, 0, size);
+    memcpy(buffer, record, size < MAX_STRING_SIZE ? size : MAX_STRING_SIZE);
+    return (ssize_t)size;
+  }
+  return read(session->notif_fd, buffer, size);
+}
+
+// Lê as notificações disponíveis, sem as separar em registos
+static ssize_t read_notification_bytes(KvsSession* session, void* buffer, size_t size) {
+  if (session->shm != NULL) {
+    // Devolve tudo o que já está no anel, mesmo que o último registo fique partido
+    return shm_ring_read(&session->shm->notifications, buffer, size, session->notif_fd);
+  }
+
+  if (session->sock_fd >= 0) {
+    // Espera apenas pela primeira notificação e junta as restantes que já tenham chegado
+    size_t total = 0;
+    PendingFrame* frame = next_socket_notification(session, 1);
+    while (frame != NULL) {
+      if (notify_frame_record(frame, (char*)buffer + total) != 0) {
+        errno = EIO;
+        return -1;
+      }
+      total += MAX_STRING_SIZE;
+      frame = size - total >= MAX_STRING_SIZE ? next_socket_notification(session, 0) : NULL;
+    }
+    return (ssize_t)total;
+  }
+  return read(session->notif_fd, buffer, size);
+}
+
+ssize_t kvs_session_read_notifications(KvsSession* session, void* buffer, size_t size) {
+  if (session->cache == NULL) {
+    return read_notification_bytes(session, buffer, size);
+  }
+
+  // Com a cache, os registos têm de ser vistos inteiros: o início de um registo partido fica na
+  // sessão até à leitura seguinte, e os registos que só interessam à cache são retirados
+  char* records = buffer;
+  while (1) {
+    memcpy(records, session->partial, session->partial_len);
+    ssize_t n = read_notification_bytes(session, records + session->partial_len, size - session->partial_len);
+    if (n <= 0) {
+      return n;
+    }
+
+    size_t total = session->partial_len + (size_t)n;
+    size_t complete = total - total % MAX_STRING_SIZE;
+    session->partial_len = total - complete;
+    memcpy(session->partial, records + complete, session->partial_len);
+
+    size_t kept = 0;
+    for (size_t offset = 0; offset < complete; offset += MAX_STRING_SIZE) {
+      if (!cache_consume(session, records + offset)) {
+        memmove(records + kept, records + offset, MAX_STRING_SIZE);
+        kept += MAX_STRING_SIZE;
+      }
+    }
+    if (kept > 0) {
+      return (ssize_t)kept;
+    }
+  }
+}
+
+int kvs_session_enable_cache(KvsSession* session, size_t capacity) {
+  session->tracked_keys = calloc(KVS_MAX_IN_FLIGHT, MAX_STRING_SIZE);
+  session->cache = session->tracked_keys != NULL ? cache_create(capacity) : NULL;
+  if (session->cache == NULL) {
+    free(session->tracked_keys);
+    session->tracked_keys = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+// Termina a sessão no socket, acordando a thread recetora
+static void shutdown_socket(KvsSession* session) { shutdown(session->sock_fd, SHUT_RDWR); }
+
+// Fecha os descritores da sessão depois de uma falha de comunicação com o servidor, ou de um
+// connect que não chegou ao fim (os FIFOs que não chegaram a ser abertos ficam a -1)
+static void close_session_fds(KvsSession* session) {
+  if (session->server_fd >= 0 && close(session->server_fd) != 0) {
+    perror("Failed to close server FIFO!");
+  }
+  session->server_fd = -1;
+
+  if (session->fds_closed) {
+    return;
+  }
+  session->fds_closed = 1;
+
+  // A região continua mapeada, porque a thread de notificações pode estar à espera nela
+  if (session->shm != NULL) {
+    shm_region_close(session->shm);
+  }
+  if (session->sock_fd >= 0) {
+    shutdown_socket(session);
+    return;
+  }
+  if (session->req_fd >= 0 && close(session->req_fd) != 0) {
+    perror("Failed to close request FIFO!");
+  }
+  if (session->resp_fd >= 0 && close(session->resp_fd) != 0) {
+    perror("Failed to close response FIFO!");
+  }
+  if (session->notif_fd >= 0 && close(session->notif_fd) != 0) {
+    perror("Failed to close notification FIFO!");
+  }
+}
+
+// Lê diretamente a resposta ao CONNECT, antes de a thread recetora existir
+// Retorna o status devolvido pelo servidor, ou -1 em caso de erro
+static int read_connect_response(KvsSession* session, uint32_t connect_id, uint8_t* flags) {
+  char frame[FRAME_MAX_SIZE];
+  FrameHeader header;
+
+  if (session->sock_fd >= 0) {
+    ssize_t received = recv(session->sock_fd, frame, sizeof(frame), 0);
+    if (received <= 0 || frame_parse(frame, (size_t)received, &header) != 1) {
+      fprintf(stderr, "Failed to read from response FIFO\n");
+      return -1;
+    }
+  } else if (read_all(session->resp_fd, frame, FRAME_HEADER_SIZE, NULL) != 1 ||
+             frame_parse(frame, FRAME_HEADER_SIZE, &header) == -1 ||
+             (header.payload_len > 0 &&
+              read_all(session->resp_fd, frame + FRAME_HEADER_SIZE, header.payload_len, NULL) != 1)) {
+    fprintf(stderr, "Failed to read from response FIFO\n");
+    return -1;
+  }
+
+  // Verifica se o opcode da resposta é o esperado
+  if (header.op_code != OP_CODE_CONNECT || header.request_id != connect_id) {
+    fprintf(stderr, "Opcode not recognized for operation: %s\n", CONNECT);
+    return -1;
+  }
+
+  *flags = header.flags;
+  return header.status;
+}
+
+// Lê a resposta ao CONNECT e adota a região partilhada se o servidor a aceitou
+// Retorna 0 em caso de sucesso, 1 em caso de erro
+static int finish_connect(KvsSession* session, uint32_t connect_id, ShmRegion* region) {
+  printf("Waiting for server response\n");
+
+  // Lê a resposta do servidor
+  uint8_t flags = 0;
+  int status = read_connect_response(session, connect_id, &flags);
 
-int write_to_fd(int fd, const char* str) {
-  size_t len = strlen(str) + 1;
-  ssize_t written = 0;
-  size_t total_written = 0;
+  if (region != NULL) {
+    if (status == 0 && (flags & FRAME_FLAG_SHM)) {
+      session->shm = region;
+    } else {
+      shm_region_release(region);
+    }
+  }
+
+  if (status != 0) {
+    close_session_fds(session);
+  }
+  if (status < 0) {
+    return 1;
+  }
+
+  if (status == 0) {
+    // Resposta do servidor indica sucesso
+    fprintf(stdout, "Server returned 0 for operation: %s\n", CONNECT);
+    fflush(stdout);
+  } else {
+    // Resposta do servidor indica erro na operação
+    fprintf(stdout, "Server returned 1 for operation: %s\n", CONNECT);
+    fprintf(stderr, "Could not connect to server!\n");
+    fflush(stdout);
+    return 1;
+  }
+  return 0;
+}
+
+// Tenta ligar-se ao socket UNIX do servidor, que fica ao lado do seu FIFO
+// Retorna o socket ligado, ou -1 se o servidor não o disponibiliza
+static int connect_server_socket(char const* server_pipe_path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s.sock", server_pipe_path) >= (int)sizeof(addr.sun_path)) {
+    return -1;
+  }
+
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (sock == -1) {
+    return -1;
+  }
+
+  if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+// Estabelece a sessão num socket já ligado: o CONNECT não leva nomes de FIFOs e, com memória
+// partilhada, a região é anónima e o seu descritor segue em anexo (SCM_RIGHTS)
+static int connect_over_socket(KvsSession* session, int sock) {
+  char buffer_request[FRAME_HEADER_SIZE];
+  uint32_t connect_id = session->next_request_id++;
+  frame_init(buffer_request, OP_CODE_CONNECT, 0, connect_id);
+
+  int shm_fd = -1;
+  ShmRegion* region = NULL;
+  if (session->transport == KVS_TRANSPORT_SHM) {
+    region = shm_region_create_anonymous(&shm_fd);
+    if (region == NULL) {
+      fprintf(stderr, "Failed to create shared memory region, using socket\n");
+    } else {
+      frame_set_flags(buffer_request, FRAME_FLAG_SHM);
+    }
+  }
+
+  int res = send_with_fd(sock, buffer_request, FRAME_HEADER_SIZE, shm_fd);
+  if (shm_fd >= 0) {
+    close(shm_fd);
+  }
+  if (res != 1) {
+    if (region != NULL) {
+      shm_region_release(region);
+    }
+    close(sock);
+    return 1;
+  }
+
+  // O socket faz as vezes dos três FIFOs
+  session->sock_fd = session->req_fd = session->resp_fd = session->notif_fd = sock;
+  return finish_connect(session, connect_id, region);
+}
+
+// Remove os FIFOs da sessão, se ainda não foram removidos. Um connect pode ter falhado antes de os
+// criar a todos, por isso os que não existem são ignorados
+static void unlink_session_fifos(KvsSession* session) {
+  if (session->req_pipe_path != NULL && unlink(session->req_pipe_path) != 0 && errno != ENOENT) {
+    perror("Failed to unlink req_pipe_path");
+  }
+  if (session->resp_pipe_path != NULL && unlink(session->resp_pipe_path) != 0 && errno != ENOENT) {
+    perror("Failed to unlink resp_pipe_path");
+  }
+  if (session->notif_pipe_path != NULL && unlink(session->notif_pipe_path) != 0 && errno != ENOENT) {
+    perror("Failed to unlink notif_pipe_path");
+  }
+  free(session->req_pipe_path);
+  free(session->resp_pipe_path);
+  free(session->notif_pipe_path);
+  session->req_pipe_path = session->resp_pipe_path = session->notif_pipe_path = NULL;
+}
+
+// Estabelece a sessão pelos FIFOs: o CONNECT é escrito no FIFO do servidor com os nomes dos três
+// FIFOs do cliente e, com memória partilhada, o nome da região. Em caso de falha, os descritores e
+// os FIFOs ficam registados na sessão, e são fechados e removidos pelo kvs_session_free; a região
+// é libertada aqui
+static int connect_over_fifos(KvsSession* session, char const* req_pipe_path, char const* resp_pipe_path,
+                              char const* server_pipe_path, char const* notif_pipe_path) {
+  char shm_name[MAX_PIPE_PATH_LENGTH];
+  ShmRegion* region = NULL;
+
+  if (unlink(req_pipe_path) != 0 && errno != ENOENT) {
+    // Falha ao remover o FIFO de pedidos. Retorna erro.
+    fprintf(stderr, "Failed to unlink request FIFO!\n");
+    goto fail;
+  }
+
+  if (unlink(resp_pipe_path) != 0 && errno != ENOENT) {
+    // Falha ao remover o FIFO de respostas. Retorna erro.
+    fprintf(stderr, "Failed to unlink response FIFO!\n");
+    goto fail;
+  }
+
+  if (unlink(notif_pipe_path) != 0 && errno != ENOENT) {
+    // Falha ao remover o FIFO de notificações. Retorna erro.
+    fprintf(stderr, "Failed to unlink notification FIFO!\n");
+    goto fail;
+  }
+
+  // Regista os caminhos dos FIFOs utilizados, antes de os criar
+  session->req_pipe_path = strdup(req_pipe_path);
+  session->resp_pipe_path = strdup(resp_pipe_path);
+  session->notif_pipe_path = strdup(notif_pipe_path);
+  if (session->req_pipe_path == NULL || session->resp_pipe_path == NULL || session->notif_pipe_path == NULL) {
+    fprintf(stderr, "Failed to allocate FIFO paths\n");
+    goto fail;
+  }
+
+  // Criação do FIFO para pedidos.
+  if (mkfifo(req_pipe_path, 0640) == -1) {
+    fprintf(stderr, "Failed to create request FIFO!\n");
+    goto fail;
+  }
+
+  // Criação do FIFO para respostas.
+  if (mkfifo(resp_pipe_path, 0640) == -1) {
+    fprintf(stderr, "Failed to create response FIFO\n");
+    goto fail;
+  }
+
+  // Criação do FIFO para notificações.
+  if (mkfifo(notif_pipe_path, 0640) == -1) {
+    fprintf(stderr, "Failed to create notification FIFO\n");
+    goto fail;
+  }
+
+  char buffer_request[FRAME_MAX_SIZE];
+
+  // Abre o FIFO do servidor para escrita
+  session->server_fd = open(server_pipe_path, O_WRONLY);
+  if (session->server_fd < 0) {
+    fprintf(stderr, "Failed to open server FIFO\n");
+    goto fail;
+  }
+
+  const char* req_name = req_pipe_path + 5;
+  const char* resp_name = resp_pipe_path + 5;
+  const char* notif_name = notif_pipe_path + 5;
+
+  // Enviar mensagem de conexão para o servidor (um único write, para ser atómico no FIFO partilhado).
+  uint32_t connect_id = session->next_request_id++;
+  frame_init(buffer_request, OP_CODE_CONNECT, 0, connect_id);
+  frame_add_field(buffer_request, sizeof(buffer_request), req_name, strlen(req_name));
+  frame_add_field(buffer_request, sizeof(buffer_request), resp_name, strlen(resp_name));
+  frame_add_field(buffer_request, sizeof(buffer_request), notif_name, strlen(notif_name));
+
+  // Se foi pedida memória partilhada, cria a região e propõe-na ao servidor. Se não for possível,
+  // a sessão usa simplesmente os FIFOs
+  if (session->transport == KVS_TRANSPORT_SHM) {
+    snprintf(shm_name, sizeof(shm_name), "%s%s", SHM_NAME_PREFIX, req_name);
+    shm_unlink(shm_name);
+    region = shm_region_create(shm_name);
+    if (region == NULL) {
+      fprintf(stderr, "Failed to create shared memory region, using FIFOs\n");
+    } else {
+      frame_set_flags(buffer_request, FRAME_FLAG_SHM);
+      frame_add_field(buffer_request, sizeof(buffer_request), shm_name, strlen(shm_name));
+    }
+  }
+
+  if (write(session->server_fd, buffer_request, frame_size(buffer_request)) < 0) {
+    fprintf(stderr, "Failed to write in FIFO\n");
+    goto fail;
+  }
+
+  // Abre o FIFO de respostas em modo de leitura
+  session->resp_fd = open(resp_pipe_path, O_RDONLY);
+  if (session->resp_fd < 0) {
+    fprintf(stderr, "Failed to open response FIFO\n");
+    goto fail;
+  }
+
+  // Abre o FIFO de notificações em modo de leitura
+  session->notif_fd = open(notif_pipe_path, O_RDONLY);
+  if (session->notif_fd < 0) {
+    fprintf(stderr, "Failed to open notification FIFO\n");
+    goto fail;
+  }
+
+  // Abre o FIFO de pedidos em modo de escrita
+  session->req_fd = open(req_pipe_path, O_WRONLY);
+  if (session->req_fd < 0) {
+    fprintf(stderr, "Failed to open request FIFO\n");
+    goto fail;
+  }
+
+  // Quando o servidor responder já terá mapeado a região (ou recusado-a), por isso o nome deixa
+  // de ser necessário
+  int res = finish_connect(session, connect_id, region);
+  if (region != NULL) {
+    shm_unlink(shm_name);
+  }
+  return res;
+
+fail:
+  // Uma região ainda não entregue ao servidor não serve a mais ninguém
+  if (region != NULL) {
+    shm_region_release(region);
+    shm_unlink(shm_name);
+  }
+  return 1;
+}
+
+/**
+ * Estabelece uma sessão com o servidor KVS.
+ *
+ * Com os transportes KVS_TRANSPORT_SOCKET e KVS_TRANSPORT_SHM tenta primeiro o socket UNIX do
+ * servidor, e só usa os FIFOs (named pipes) se este não estiver disponível. Depois do connect,
+ * uma thread recetora passa a ler todas as respostas da sessão.
+ *
+ * @param req_pipe_path    Caminho para o FIFO de pedidos
+ * @param resp_pipe_path   Caminho para o FIFO de respostas
+ * @param server_pipe_path Caminho para o FIFO do servidor
+ * @param notif_pipe_path  Caminho para o FIFO de notificações
+ * @param transport        Transporte a propor ao servidor
+ *
+ * @return KvsSession* A sessão, ou NULL em caso de erro
+ */
+KvsSession* kvs_session_open(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
+                             char const* notif_pipe_path, enum KvsTransport transport) {
+  KvsSession* session = calloc(1, sizeof(KvsSession));
+  if (session == NULL) {
+    fprintf(stderr, "Failed to allocate session\n");
+    return NULL;
+  }
+
+  session->transport = transport;
+  session->server_fd = session->req_fd = session->resp_fd = session->notif_fd = session->sock_fd = -1;
+  session->next_request_id = 1;
+  pthread_mutex_init(&session->send_lock, NULL);
+  pthread_mutex_init(&session->lock, NULL);
+  pthread_cond_init(&session->cond, NULL);
+
+  session->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (session->event_fd == -1) {
+    perror("Failed to create completion eventfd");
+    kvs_session_free(session);
+    return NULL;
+  }
+
+  int res = 1, connected = 0;
+  if (transport != KVS_TRANSPORT_FIFO) {
+    int sock = connect_server_socket(server_pipe_path);
+    if (sock >= 0) {
+      res = connect_over_socket(session, sock);
+      connected = 1;
+    } else {
+      fprintf(stderr, "Failed to connect to server socket, using FIFOs\n");
+    }
+  }
+  if (!connected) {
+    res = connect_over_fifos(session, req_pipe_path, resp_pipe_path, server_pipe_path, notif_pipe_path);
+  }
+
+  if (res != 0 || pthread_create(&session->receiver, NULL, receive_responses, session) != 0) {
+    kvs_session_free(session);
+    return NULL;
+  }
+  session->receiver_started = 1;
+  return session;
+}
+
+/**
+ * Desconecta uma sessão do servidor KVS.
+ *
+ * Envia uma mensagem de desconexão ao servidor, aguarda confirmação, espera que a thread
+ * recetora termine e fecha os descritores da sessão. A região partilhada só é desmapeada
+ * em kvs_session_free, porque a thread de notificações pode ainda estar à espera nela.
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_session_disconnect(KvsSession* session) {
+  int status = transact(session, OP_CODE_DISCONNECT, 0, NULL, NULL, NULL, NULL, NULL);
+
+  if (status < 0) {
+    fflush(stderr);
+    close_session_fds(session);
+    return 1;
+  }
+
+  if (status == 0) {
+    // Resposta do servidor indica sucesso
+    fprintf(stdout, "Server returned 0 for operation: %s\n", DISCONNECT);
+    fflush(stdout);
+  } else {
+    // Resposta do servidor indica erro na operação
+    fprintf(stdout, "Server returned 1 for operation: %s\n", DISCONNECT);
+    fprintf(stderr, "Could not disconnect from server!\n");
+    fflush(stdout);
+    fflush(stderr);
+    return 1;
+  }
+
+  // Acorda a thread de notificações
+  if (session->shm != NULL) {
+    shm_region_close(session->shm);
+  }
+  if (session->sock_fd >= 0) {
+    shutdown_socket(session);
+  }
+
+  // O servidor fecha a sessão depois de responder, o que termina a thread recetora
+  pthread_join(session->receiver, NULL);
+  session->receiver_started = 0;
+
+  // No socket não há FIFOs a remover, e o socket só é fechado pelo kvs_session_free
+  if (session->sock_fd >= 0) {
+    session->fds_closed = 1;
+    return 0;
+  }
+
+  // Fecha os descritores abertos
+  if (close(session->req_fd) != 0) {
+    perror("Failed to close request FIFO!");
+  }
+
+  if (close(session->resp_fd) != 0) {
+    perror("Failed to close response FIFO!");
+  }
+
+  if (close(session->notif_fd) != 0) {
+    perror("Failed to close notification FIFO!");
+  }
+  session->req_fd = session->resp_fd = session->notif_fd = -1;
+  session->fds_closed = 1;
+
+  if (session->server_fd >= 0 && close(session->server_fd) != 0) {
+    perror("Failed to close server FIFO!");
+  }
+  session->server_fd = -1;
+
+  // Remove os FIFOs utilizados
+  unlink_session_fifos(session);
+  return 0;
+}
+
+void kvs_session_free(KvsSession* session) {
+  // Uma sessão que não foi desconectada de forma ordeira, ou cujo connect falhou, pode ainda ter
+  // descritores abertos e FIFOs criados
+  close_session_fds(session);
+  if (session->receiver_started) {
+    pthread_join(session->receiver, NULL);
+  }
+  unlink_session_fifos(session);
+  if (session->shm != NULL) {
+    shm_region_release(session->shm);
+  }
+  if (session->sock_fd >= 0) {
+    close(session->sock_fd);
+  }
+  if (session->event_fd >= 0) {
+    close(session->event_fd);
+  }
+
+  if (session->cache != NULL) {
+    cache_free(session->cache);
+  }
+  free(session->tracked_keys);
+  queue_clear(&session->notifications);
+  queue_clear(&session->completions);
+  free(session->last_completion);
+  pthread_cond_destroy(&session->cond);
+  pthread_mutex_destroy(&session->lock);
+  pthread_mutex_destroy(&session->send_lock);
+  free(session);
+}
+
+/**
+ * Subscreve várias chaves de uma só vez, com os pedidos em pipeline.
+ *
+ * @param num_keys Número de chaves
+ * @param keys     As chaves que se deseja monitorar
+ *
+ * @return int Retorna 0 se todas as chaves foram subscritas, 1 caso contrário
+ */
+int kvs_session_subscribe_batch(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE]) {
+  int statuses[num_keys];
+  char pending[num_keys][MAX_STRING_SIZE];
+  size_t index[num_keys];
+  size_t num_pending = 0;
+
+  // As chaves que a cache já subscreveu passam para o utilizador sem ir ao servidor
+  for (size_t i = 0; i < num_keys; i++) {
+    if (session->cache != NULL && cache_claim(session->cache, keys[i])) {
+      statuses[i] = 1;
+    } else {
+      memcpy(pending[num_pending], keys[i], MAX_STRING_SIZE);
+      index[num_pending++] = i;
+    }
+  }
+
+  if (num_pending > 0) {
+    int sent[num_pending];
+    if (pipeline_requests(session, OP_CODE_SUBSCRIBE, num_pending, pending, sent) != 0) {
+      return 1;
+    }
+    for (size_t i = 0; i < num_pending; i++) {
+      statuses[index[i]] = sent[i];
+    }
+  }
+
+  int result = 0;
+  for (size_t i = 0; i < num_keys; i++) {
+    if (statuses[i] == 1) {
+      // Resposta do servidor indica sucesso
+      fprintf(stdout, "Server returned 1 for operation: %s\n", SUBSCRIBE);
+    } else {
+      // Resposta do servidor indica erro na operação (chave não encontrada)
+      fprintf(stdout, "Server returned 0 for operation: %s\n", SUBSCRIBE);
+      fprintf(stderr, "Could not subscribe to key! (Key not Found)\n");
+      result = 1;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * Cancela a subscrição de várias chaves de uma só vez, com os pedidos em pipeline.
+ *
+ * @param num_keys Número de chaves
+ * @param keys     As chaves cuja subscrição se deseja cancelar
+ *
+ * @return int Retorna 0 se todas as subscrições foram removidas, 1 caso contrário
+ */
+int kvs_session_unsubscribe_batch(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE]) {
+  int statuses[num_keys];
+  if (pipeline_requests(session, OP_CODE_UNSUBSCRIBE, num_keys, keys, statuses) != 0) {
+    return 1;
+  }
+
+  int result = 0;
+  for (size_t i = 0; i < num_keys; i++) {
+    if (statuses[i] == 0) {
+      // Resposta do servidor indica sucesso
+      fprintf(stdout, "Server returned 0 for operation: %s\n", UNSUBSCRIBE);
+    } else {
+      // Resposta do servidor indica erro na operação (não conseguiu desinscrever)
+      fprintf(stdout, "Server returned 1 for operation: %s\n", UNSUBSCRIBE);
+      fprintf(stderr, "Could not unsubscribe to key!\n");
+      result = 1;
+    }
+  }
+
+  return result;
+}
+
+// Lê os valores de várias chaves do servidor, sem passar pela cache. Se 'cut' não for NULL, marca
+// os valores que não couberam inteiros em 'values'
+static int read_keys(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE],
+                     int found[], int cut[]) {
+  char payload[PROTOCOL_MAX_PAYLOAD];
+  size_t payload_len;
+
+  int status = transact(session, OP_CODE_READ, num_keys, keys, NULL, NULL, payload, &payload_len);
+  if (status < 0) {
+    return 1;
+  }
+
+  if (status != 0) {
+    fprintf(stderr, "Server returned 1 for operation: %s\n", READ);
+    return 1;
+  }
+
+  // Cada campo da resposta é KEY_FOUND/KEY_MISSING seguido do valor. Um valor que não cabe nos
+  // MAX_STRING_SIZE - 1 bytes do cliente vem com MAX_STRING_SIZE, e é cortado aqui
+  size_t offset = 0;
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* field;
+    size_t len;
+    if (frame_next_field(payload, payload_len, &offset, &field, &len) != 1 || len == 0 || len > MAX_STRING_SIZE + 1) {
+      fprintf(stderr, "Invalid response for operation: %s\n", READ);
+      return 1;
+    }
+    found[i] = field[0] == KEY_FOUND;
+    size_t value_len = len - 1 < MAX_STRING_SIZE ? len - 1 : MAX_STRING_SIZE - 1;
+    memcpy(values[i], field + 1, value_len);
+    values[i][value_len] = '\0';
+    if (cut != NULL) {
+      cut[i] = len - 1 == MAX_STRING_SIZE;
+    }
+  }
+
+  return 0;
+}
+
+static void ignore_result(KvsSession* session, const KvsResult* result, void* arg) {
+  (void)session;
+  (void)result;
+  (void)arg;
+}
+
+// Lê do servidor chaves que não estão na cache e guarda-as. Cada chave nova é subscrita antes
+// de ser lida, em pipeline com a leitura, para que qualquer escrita posterior à leitura seja
+// notificada
+static int cache_fetch(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                       char values[][MAX_STRING_SIZE], int found[]) {
+  int reserved[num_keys];
+  int subscribed[num_keys];
+  WaiterSlot slots[num_keys];
+  Waiter waiter = {session, 0, subscribed, NULL, 0};
+  char evicted[1][MAX_STRING_SIZE];
+
+  for (size_t i = 0; i < num_keys; i++) {
+    int owned = 0;
+    reserved[i] = cache_reserve(session->cache, keys[i], &owned, evicted[0]) == 0;
+
+    // A subscrição da entrada despejada deixa de ser necessária
+    if (evicted[0][0] != '\0') {
+      submit_request(session, OP_CODE_UNSUBSCRIBE, 1, evicted, NULL, NULL, ignore_result, NULL, NULL, 1);
+    }
 
-  // Continua a escrever até que toda a string seja enviada
-  while (total_written < len) {
-    written = write(fd, str + total_written, len - total_written);
+    // Chaves já subscritas pelo utilizador não precisam de nova subscrição
+    subscribed[i] = 1;
+    if (reserved[i] && owned) {
+      slots[i] = (WaiterSlot){&waiter, i};
+      subscribed[i] = -1;
+      pthread_mutex_lock(&session->lock);
+      waiter.remaining++;
+      pthread_mutex_unlock(&session->lock);
 
-    // Se houve erro na escrita (written < 0), retorna erro
-    if (written < 0) {
-      return 1;
+      if (submit_request(session, OP_CODE_SUBSCRIBE, 1, &keys[i], NULL, NULL, waiter_callback, &slots[i], NULL, 1) != 0) {
+        pthread_mutex_lock(&session->lock);
+        waiter.remaining--;
+        pthread_mutex_unlock(&session->lock);
+      }
     }
-    total_written += (size_t)written;
   }
 
-  // Retorna 0 para sucesso
-  return 0;
+  int cut[num_keys];
+  int result = read_keys(session, num_keys, keys, values, found, cut);
+  waiter_wait(&waiter);
+
+  // Uma subscrição recusada significa que a chave não existe, e não há nada a guardar
+  for (size_t i = 0; i < num_keys; i++) {
+    if (!reserved[i]) {
+      continue;
+    }
+    if (result != 0 || subscribed[i] != 1) {
+      cache_abort(session->cache, keys[i]);
+    } else {
+      cache_complete(session->cache, keys[i], found[i], cut[i] ? NULL : values[i]);
+    }
+  }
+  return result;
 }
 
 /**
- * Estabelece uma conexão com o servidor KVS através de FIFOs (named pipes).
- *
- * Esta função cria os FIFOs necessários para a comunicação cliente-servidor,
- * estabelece a conexão com o servidor e configura os canais de comunicação.
+ * Lê os valores de várias chaves, da cache quando ativa ou do servidor.
  *
- * @param req_pipe_path    Caminho para o FIFO de pedidos
- * @param resp_pipe_path   Caminho para o FIFO de respostas
- * @param server_pipe_path Caminho para o FIFO do servidor
- * @param notif_pipe_path  Caminho para o FIFO de notificações
+ * @param num_keys Número de chaves
+ * @param keys     As chaves a ler
+ * @param values   Onde guardar os valores (string vazia para chaves inexistentes)
+ * @param found    Preenchido com 1 para cada chave existente e 0 caso contrário
  *
  * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
- *
- * @errors
- *    - Falha ao remover FIFOs existentes
- *    - Falha ao criar novos FIFOs
- *    - Falha ao abrir o FIFO do servidor
- *    - Falha ao escrever no FIFO
- *    - Falha ao abrir FIFOs de resposta ou notificação
- *    - Erro na resposta do servidor
  */
-int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
-                char const* notif_pipe_path) {
-  if (unlink(req_pipe_path) != 0 && errno != ENOENT) {
-    // Falha ao remover o FIFO de pedidos. Retorna erro.
-    fprintf(stderr, "Failed to unlink request FIFO!\n");
-    return 1;
+int kvs_session_read(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                     char values[][MAX_STRING_SIZE], int found[]) {
+  if (session->cache == NULL) {
+    return read_keys(session, num_keys, keys, values, found, NULL);
   }
 
-  if (unlink(resp_pipe_path) != 0 && errno != ENOENT) {
-    // Falha ao remover o FIFO de respostas. Retorna erro.
-    fprintf(stderr, "Failed to unlink response FIFO!\n");
-    return 1;
+  char missing[num_keys][MAX_STRING_SIZE];
+  size_t index[num_keys];
+  size_t num_missing = 0;
+
+  for (size_t i = 0; i < num_keys; i++) {
+    if (cache_lookup(session->cache, keys[i], values[i])) {
+      found[i] = 1;
+    } else {
+      memcpy(missing[num_missing], keys[i], MAX_STRING_SIZE);
+      index[num_missing++] = i;
+    }
   }
 
-  if (unlink(notif_pipe_path) != 0 && errno != ENOENT) {
-    // Falha ao remover o FIFO de notificações. Retorna erro.
-    fprintf(stderr, "Failed to unlink notification FIFO!\n");
-    return 1;
+  // Todas as chaves estavam na cache: não há round-trip ao servidor
+  if (num_missing == 0) {
+    return 0;
   }
 
-  // Criação do FIFO para pedidos.
-  if (mkfifo(req_pipe_path, 0640) == -1) {
-    fprintf(stderr, "Failed to create request FIFO!\n");
+  char missing_values[num_missing][MAX_STRING_SIZE];
+  int missing_found[num_missing];
+  if (cache_fetch(session, num_missing, missing, missing_values, missing_found) != 0) {
     return 1;
   }
 
-  // Criação do FIFO para respostas.
-  if (mkfifo(resp_pipe_path, 0640) == -1) {
-    fprintf(stderr, "Failed to create response FIFO\n");
-    return 1;
+  for (size_t i = 0; i < num_missing; i++) {
+    memcpy(values[index[i]], missing_values[i], MAX_STRING_SIZE);
+    found[index[i]] = missing_found[i];
   }
+  return 0;
+}
 
-  // Criação do FIFO para notificações.
-  if (mkfifo(notif_pipe_path, 0640) == -1) {
-    fprintf(stderr, "Failed to create notification FIFO\n");
+/**
+ * Escreve vários pares (chave, valor) no servidor.
+ *
+ * @param num_pairs Número de pares
+ * @param keys      As chaves a escrever
+ * @param values    Os valores correspondentes
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_session_write(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                      char values[][MAX_STRING_SIZE]) {
+  int status = transact(session, OP_CODE_WRITE, num_pairs, keys, NULL, values, NULL, NULL);
+  if (status < 0) {
     return 1;
   }
 
-  char buffer_request[MAX_CONNECT_STRING];
-
-  // Abre o FIFO do servidor para escrita. Caso não abra, retorna erro e destrói os respetivos fifos
-  _server_fd = open(server_pipe_path, O_WRONLY);
-  if (_server_fd < 0) {
-    fprintf(stderr, "Failed to open server FIFO\n");
-    if (unlink(req_pipe_path) != 0) {
-      perror("Failed to unlink req_pipe_path");
-    }
-    if (unlink(resp_pipe_path) != 0) {
-      perror("Failed to unlink resp_pipe_path");
+  // A escrita fica visível às leituras seguintes desta sessão sem esperar pela notificação
+  if (status == 0 && session->cache != NULL) {
+    for (size_t i = 0; i < num_pairs; i++) {
+      cache_update(session->cache, keys[i], values[i]);
     }
-    if (unlink(notif_pipe_path) != 0) {
-      perror("Failed to unlink notif_pipe_path");
-    }
-    return 1;
   }
 
-  const char* req_name = req_pipe_path + 5;
-  const char* resp_name = resp_pipe_path + 5;
-  const char* notif_name = notif_pipe_path + 5;
+  fprintf(stdout, "Server returned %d for operation: %s\n", status, WRITE);
+  return status != 0;
+}
 
-  // Enviar mensagem de conexão para o servidor.
-  snprintf(buffer_request, MAX_CONNECT_STRING, "%d|%s|%s|%s", OP_CODE_CONNECT, req_name, resp_name, notif_name);
+/**
+ * Remove várias chaves do servidor.
+ *
+ * @param num_keys Número de chaves
+ * @param keys     As chaves a remover
+ * @param deleted  Preenchido com 1 para cada chave removida e 0 para chaves inexistentes
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_session_delete(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE], int deleted[]) {
+  char payload[PROTOCOL_MAX_PAYLOAD];
+  size_t payload_len;
 
-  // Caso não consiga escrever, retorna erro e destrói os respetivos fifos
-  if (write_to_fd(_server_fd, buffer_request) != 0) {
-    fprintf(stderr, "Failed to write in FIFO\n");
-    if (close(_server_fd) != 0) {
-      perror("Failed to close server FIFO!");
-    }
-    if (unlink(req_pipe_path) != 0) {
-      perror("Failed to unlink req_pipe_path");
-    }
-    if (unlink(resp_pipe_path) != 0) {
-      perror("Failed to unlink resp_pipe_path");
-    }
-    if (unlink(notif_pipe_path) != 0) {
-      perror("Failed to unlink notif_pipe_path");
-    }
+  // O status é 1 quando alguma das chaves não existia, o que não é um erro de comunicação
+  if (transact(session, OP_CODE_DELETE, num_keys, keys, NULL, NULL, payload, &payload_len) < 0) {
     return 1;
   }
 
-  // Abre o FIFO de respostas em modo de leitura
-  _resp_fd = open(resp_pipe_path, O_RDONLY);
-  if (_resp_fd < 0) {
-    // Caso não consiga abrir o FIFO de respostas, limpa os recursos e retorna erro
-    fprintf(stderr, "Failed to open response FIFO\n");
-    if (close(_server_fd) != 0) {
-      perror("Failed to close server FIFO!");
-    }
-    if (unlink(req_pipe_path) != 0) {
-      perror("Failed to unlink req_pipe_path");
-    }
-    if (unlink(resp_pipe_path) != 0) {
-      perror("Failed to unlink resp_pipe_path");
+  size_t offset = 0;
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* field;
+    size_t len;
+    if (frame_next_field(payload, payload_len, &offset, &field, &len) != 1 || len != 1) {
+      fprintf(stderr, "Invalid response for operation: %s\n", DELETE);
+      return 1;
     }
-    if (unlink(notif_pipe_path) != 0) {
-      perror("Failed to unlink notif_pipe_path");
+    deleted[i] = field[0] == KEY_FOUND;
+    if (deleted[i] && session->cache != NULL) {
+      cache_invalidate(session->cache, keys[i]);
     }
+  }
+
+  return 0;
+}
+
+/**
+ * Lê os valores e as versões de várias chaves. Vai sempre ao servidor, porque a cache não guarda
+ * versões.
+ *
+ * @param num_keys Número de chaves
+ * @param keys     As chaves a ler
+ * @param values   Onde guardar os valores (string vazia para chaves inexistentes)
+ * @param versions Onde guardar as versões (0 para chaves inexistentes)
+ * @param found    Preenchido com 1 para cada chave existente e 0 caso contrário
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_session_read_versions(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                              char values[][MAX_STRING_SIZE], uint64_t versions[], int found[]) {
+  char payload[PROTOCOL_MAX_PAYLOAD];
+  size_t payload_len;
+
+  int status = transact(session, OP_CODE_READ_VERSION, num_keys, keys, NULL, NULL, payload, &payload_len);
+  if (status < 0) {
     return 1;
   }
 
-  // Abre o FIFO de notificações em modo de leitura
-  _notif_fd = open(notif_pipe_path, O_RDONLY);
-  if (_notif_fd < 0) {
-    // Caso não consiga abrir o FIFO de notificações, limpa os recursos e retorna erro
-    fprintf(stderr, "Failed to open notification FIFO\n");
-    if (close(_server_fd) != 0) {
-      perror("Failed to close server FIFO!");
-    }
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
-    if (unlink(req_pipe_path) != 0) {
-      perror("Failed to unlink req_pipe_path");
-    }
-    if (unlink(resp_pipe_path) != 0) {
-      perror("Failed to unlink resp_pipe_path");
-    }
-    if (unlink(notif_pipe_path) != 0) {
-      perror("Failed to unlink notif_pipe_path");
-    }
+  if (status != 0) {
+    fprintf(stderr, "Server returned 1 for operation: %s\n", VERSION);
     return 1;
   }
 
-  // Abre o FIFO de pedidos em modo de escrita
-  _req_fd = open(req_pipe_path, O_WRONLY);
-  if (_notif_fd < 0) {
-    fprintf(stderr, "Failed to open request FIFO\n");
-    if (close(_server_fd) != 0) {
-      perror("Failed to close server FIFO!");
-    }
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO!");
-    }
-    if (unlink(req_pipe_path) != 0) {
-      perror("Failed to unlink req_pipe_path");
-    }
-    if (unlink(resp_pipe_path) != 0) {
-      perror("Failed to unlink resp_pipe_path");
-    }
-    if (unlink(notif_pipe_path) != 0) {
-      perror("Failed to unlink notif_pipe_path");
+  // Cada campo da resposta é KEY_FOUND/KEY_MISSING, a versão e o valor
+  size_t offset = 0;
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* field;
+    size_t len;
+    if (frame_next_field(payload, payload_len, &offset, &field, &len) != 1 || len < 1 + VERSION_FIELD_SIZE ||
+        len > VERSION_FIELD_SIZE + MAX_STRING_SIZE) {
+      fprintf(stderr, "Invalid response for operation: %s\n", VERSION);
+      return 1;
     }
-    return 1;
+    found[i] = field[0] == KEY_FOUND;
+    memcpy(&versions[i], field + 1, VERSION_FIELD_SIZE);
+    memcpy(values[i], field + 1 + VERSION_FIELD_SIZE, len - 1 - VERSION_FIELD_SIZE);
+    values[i][len - 1 - VERSION_FIELD_SIZE] = '\0';
   }
 
-  printf("Waiting for server response\n");
-  char buffer_response[MAX_CONNECT_STRING], charOPCODE = '0' + OP_CODE_CONNECT;
+  return 0;
+}
 
-  // Lê a resposta do servidor (a leitura é atómica, pois lê menos de 4096 bytes)
-  if (read(_resp_fd, buffer_response, 3) == -1) {
-    fprintf(stderr, "Failed to open response FIFO\n");
+/**
+ * Escreve cada par cuja chave ainda tem a versão esperada. Cada par é comparado e escrito
+ * atomicamente no servidor, independentemente dos outros.
+ *
+ * @param num_pairs Número de pares
+ * @param keys      As chaves a escrever
+ * @param expected  A versão que cada chave tem de ter (0 se não puder existir)
+ * @param values    Os valores correspondentes
+ * @param versions  Preenchido com a versão nova dos pares escritos e a atual dos restantes
+ * @param written   Preenchido com 1 para cada par escrito e 0 caso contrário
+ *
+ * @return int Retorna 0 se o pedido foi processado (mesmo que nada tenha sido escrito), 1 em caso de erro
+ */
+int kvs_session_cas(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t expected[],
+                    char values[][MAX_STRING_SIZE], uint64_t versions[], int written[]) {
+  char payload[PROTOCOL_MAX_PAYLOAD];
+  size_t payload_len;
 
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
-    if (close(_req_fd) != 0) {
-      perror("Failed to close request FIFO!");
-    }
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO!");
-    }
+  // O status é 1 quando algum par não foi escrito, o que não é um erro de comunicação
+  if (transact(session, OP_CODE_CAS, num_pairs, keys, expected, values, payload, &payload_len) < 0) {
     return 1;
   }
 
-  // Verifica se o opcode da resposta é o esperado
-  if (buffer_response[0] == charOPCODE) {
-    if (buffer_response[2] == '0') {
-      // Resposta do servidor indica sucesso
-      fprintf(stdout, "Server returned 0 for operation: %s\n", CONNECT);
-      fflush(stdout);
-    } else {
-      // Resposta do servidor indica erro na operação
-      fprintf(stdout, "Server returned 1 for operation: %s\n", CONNECT);
-      fprintf(stderr, "Could not connect to server!\n");
-      fflush(stdout);
+  size_t offset = 0;
+  for (size_t i = 0; i < num_pairs; i++) {
+    const char* field;
+    size_t len;
+    if (frame_next_field(payload, payload_len, &offset, &field, &len) != 1 || len != 1 + VERSION_FIELD_SIZE) {
+      fprintf(stderr, "Invalid response for operation: %s\n", CAS);
       return 1;
     }
-  } else {
-    // O opcode recebido não corresponde ao esperado
-    fprintf(stderr, "Opcode not recognized for operation: %s\n", CONNECT);
-    fflush(stdout);
-    return 1;
+    written[i] = field[0] == CAS_WRITTEN;
+    memcpy(&versions[i], field + 1, VERSION_FIELD_SIZE);
+    if (written[i] && session->cache != NULL) {
+      cache_update(session->cache, keys[i], values[i]);
+    }
   }
 
-  // Regista os caminhos dos FIFOs utilizados
-  _req_pipe_path = req_pipe_path;
-  _resp_pipe_path = resp_pipe_path;
-  _notif_pipe_path = notif_pipe_path;
-
   return 0;
 }
 
 /**
- * Desconecta o cliente do servidor KVS.
- *
- * Esta função envia uma mensagem de desconexão ao servidor, aguarda confirmação,
- * fecha todos os descritores de arquivo (FIFOs) e limpa os recursos utilizados.
+ * Soma um incremento ao inteiro guardado em cada chave, sem ler o valor antes. Cada chave é
+ * atualizada atomicamente no servidor; uma chave inexistente conta como 0.
  *
- * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
- *
- * @errors
- *    - Falha ao escrever mensagem de desconexão
- *    - Falha ao ler resposta do servidor
- *    - Erro na resposta do servidor
+ * @param num_pairs Número de chaves
+ * @param keys      As chaves a atualizar
+ * @param deltas    O incremento de cada chave (pode ser negativo)
+ * @param results   Preenchido com o valor novo de cada chave atualizada
+ * @param updated   Preenchido com 1 para cada chave atualizada e 0 se o valor não for um inteiro
  *
+ * @return int Retorna 0 se o pedido foi processado (mesmo que nada tenha sido atualizado), 1 em caso de erro
  */
-int kvs_disconnect(void) {
-  // Envia uma mensagem de desconexão para o FIFO de pedidos
-  write(_req_fd, "2", 2);
-  char buffer_response[MAX_CONNECT_STRING], charOPCODE = '0' + OP_CODE_DISCONNECT;
+int kvs_session_incr(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t deltas[],
+                     int64_t results[], int updated[]) {
+  char payload[PROTOCOL_MAX_PAYLOAD];
+  size_t payload_len;
 
-  // Lê a resposta do servidor (a leitura é atómica, pois lê menos de 4096 bytes)
-  if (read(_resp_fd, buffer_response, 3) == -1) {
-    fprintf(stderr, "Failed to read from response FIFO\n");
-    fflush(stderr);
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
-    if (close(_req_fd) != 0) {
-      perror("Failed to close request FIFO!");
-    }
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO!");
-    }
-    if (close(_server_fd) != 0) {
-      perror("Failed to close server FIFO!");
-    }
+  // Os incrementos seguem no lugar das versões, em campos de DELTA_FIELD_SIZE bytes
+  uint64_t fields[num_pairs];
+  memcpy(fields, deltas, num_pairs * sizeof(int64_t));
+
+  // O status é 1 quando alguma chave não foi atualizada, o que não é um erro de comunicação
+  if (transact(session, OP_CODE_INCR, num_pairs, keys, fields, NULL, payload, &payload_len) < 0) {
     return 1;
   }
 
-  // Verifica se o opcode da resposta é o esperado
-  if (buffer_response[0] == charOPCODE) {
-    if (buffer_response[2] == '0') {
-      // Resposta do servidor indica sucesso
-      fprintf(stdout, "Server returned 0 for operation: %s\n", DISCONNECT);
-      fflush(stdout);
-    } else {
-      // Resposta do servidor indica erro na operação
-      fprintf(stdout, "Server returned 1 for operation: %s\n", DISCONNECT);
-      fprintf(stderr, "Could not disconnect from server!\n");
-      fflush(stdout);
-      fflush(stderr);
+  size_t offset = 0;
+  for (size_t i = 0; i < num_pairs; i++) {
+    const char* field;
+    size_t len;
+    if (frame_next_field(payload, payload_len, &offset, &field, &len) != 1 || len != 1 + DELTA_FIELD_SIZE) {
+      fprintf(stderr, "Invalid response for operation: %s\n", INCR);
       return 1;
     }
-  } else {
-    // O opcode recebido não corresponde ao esperado
-    fprintf(stderr, "Opcode not recognized for operation: %s\n", DISCONNECT);
-    fflush(stdout);
-    return 1;
+    updated[i] = field[0] == INCR_DONE;
+    memcpy(&results[i], field + 1, DELTA_FIELD_SIZE);
+    if (updated[i] && session->cache != NULL) {
+      char value[MAX_STRING_SIZE];
+      snprintf(value, sizeof(value), "%" PRId64, results[i]);
+      cache_update(session->cache, keys[i], value);
+    }
   }
 
-  // Fecha os descritores abertos
-  if (close(_req_fd) != 0) {
-    perror("Failed to close request FIFO!");
+  return 0;
+}
+
+/**
+ * Acrescenta um sufixo ao valor de cada chave (criando as que não existem), sem ler o valor antes.
+ *
+ * @param num_pairs Número de pares
+ * @param keys      As chaves a atualizar
+ * @param suffixes  Os sufixos correspondentes
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_session_append(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                       char suffixes[][MAX_STRING_SIZE]) {
+  int status = transact(session, OP_CODE_APPEND, num_pairs, keys, NULL, suffixes, NULL, NULL);
+  if (status < 0) {
+    return 1;
   }
 
-  if (close(_resp_fd) != 0) {
-    perror("Failed to close response FIFO!");
+  // O valor completo só vem na notificação, por isso a cache esquece as chaves
+  if (session->cache != NULL) {
+    for (size_t i = 0; i < num_pairs; i++) {
+      cache_invalidate(session->cache, keys[i]);
+    }
   }
 
-  if (close(_notif_fd) != 0) {
-    perror("Failed to close notification FIFO!");
+  fprintf(stdout, "Server returned %d for operation: %s\n", status, APPEND);
+  return status != 0;
+}
+
+// Retorna descritor do fifo de notificações
+int* get_notify_fd() { return &_notif_fd; }
+
+void kvs_set_transport(enum KvsTransport transport) { _transport = transport; }
+
+void kvs_set_cache(size_t capacity) { _cache_capacity = capacity; }
+
+KvsSession* kvs_default_session(void) { return _session; }
+
+ssize_t kvs_read_notification(void* buffer, size_t size) {
+  if (_session == NULL) {
+    return 0;
   }
+  return kvs_session_read_notification(_session, buffer, size);
+}
 
-  // Remove os FIFOs utilizados
-  if (unlink(_req_pipe_path) != 0) {
-    perror("Failed to unlink req_pipe_path");
+/**
+ * Estabelece uma conexão com o servidor KVS, que passa a ser a sessão usada pelas restantes
+ * funções sem handle.
+ *
+ * @param req_pipe_path    Caminho para o FIFO de pedidos
+ * @param resp_pipe_path   Caminho para o FIFO de respostas
+ * @param server_pipe_path Caminho para o FIFO do servidor
+ * @param notif_pipe_path  Caminho para o FIFO de notificações
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
+                char const* notif_pipe_path) {
+  // Liberta a sessão anterior, que já não pode estar a ser usada
+  if (_session != NULL) {
+    kvs_session_free(_session);
+    _session = NULL;
   }
-  if (unlink(_resp_pipe_path) != 0) {
-    perror("Failed to unlink resp_pipe_path");
+
+  _session = kvs_session_open(req_pipe_path, resp_pipe_path, server_pipe_path, notif_pipe_path, _transport);
+  if (_session == NULL) {
+    return 1;
   }
-  if (unlink(_notif_pipe_path) != 0) {
-    perror("Failed to unlink notif_pipe_path");
+  if (_cache_capacity > 0 && kvs_session_enable_cache(_session, _cache_capacity) != 0) {
+    fprintf(stderr, "Failed to create read cache\n");
   }
-
+  _notif_fd = _session->notif_fd;
   return 0;
 }
 
+/**
+ * Desconecta o cliente do servidor KVS.
+ *
+ * A sessão só é libertada no próximo connect, porque a thread de notificações pode ainda
+ * estar a usá-la.
+ *
+ * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
+ */
+int kvs_disconnect(void) { return kvs_session_disconnect(_session); }
+
 /**
  * Subscreve a notificações de alterações em uma chave específica.
  *
@@ -352,73 +1728,15 @@ int kvs_disconnect(void) {
  * @param key A chave que se deseja monitorar
  *
  * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
- *
- * @errors
- *    - Chave não encontrada no servidor
- *    - Falha ao enviar pedido de subscrição
- *    - Falha ao ler resposta do servidor
- *    - Erro na resposta do servidor
- *
  */
 int kvs_subscribe(const char* key) {
-  // Envia a mensagem de subscrição para o FIFO de pedidos e espera pela resposta no FIFO de resposta
-  char buffer_request[MAX_STRING_SIZE], charOPCODE = '0' + OP_CODE_SUBSCRIBE;
-  snprintf(buffer_request, MAX_STRING_SIZE, "%d|%s", OP_CODE_SUBSCRIBE, key);
-
-  // Escreve a mensagem no FIFO de pedidos
-  if (write(_req_fd, buffer_request, MAX_STRING_SIZE) == -1) {
-    fprintf(stderr, "Failed to write to request FIFO\n");
-
-    if (close(_req_fd) != 0) {
-      perror("Failed to close request FIFO");
-    }
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO");
-    }
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO");
-    }
-
-    return 1;
-  }
-
-  char buffer_response[MAX_STRING_SIZE];
-
-  // Lê a resposta do servidor (a operação de leitura é atómica, pois lê menos de 4096 bytes)
-  if (read(_resp_fd, buffer_response, 3) == -1) {
-    fprintf(stderr, "Failed to read from response FIFO\n");
-
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
-    if (close(_req_fd) != 0) {
-      perror("Failed to close request FIFO!");
-    }
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO!");
-    }
-
-    return 1;
-  }
-
-  // Verifica se o opcode da resposta é o esperado
-  if (buffer_response[0] == charOPCODE) {
-    if (buffer_response[2] == '1') {
-      // Resposta do servidor indica sucesso
-      fprintf(stdout, "Server returned 1 for operation: %s\n", SUBSCRIBE);
-    } else {
-      // Resposta do servidor indica erro na operação (chave não encontrada)
-      fprintf(stdout, "Server returned 0 for operation: %s\n", SUBSCRIBE);
-      fprintf(stderr, "Could not subscribe to key! (Key not Found)\n");
-      return 1;
-    }
-  } else {
-    // O opcode recebido não corresponde ao esperado
-    fprintf(stderr, "Opcode not recognized for operation: %s\n", SUBSCRIBE);
-    return 1;
-  }
+  char keys[1][MAX_STRING_SIZE];
+  snprintf(keys[0], MAX_STRING_SIZE, "%s", key);
+  return kvs_subscribe_batch(1, keys);
+}
 
-  return 0;
+int kvs_subscribe_batch(size_t num_keys, char keys[][MAX_STRING_SIZE]) {
+  return kvs_session_subscribe_batch(_session, num_keys, keys);
 }
 
 /**
@@ -430,71 +1748,44 @@ int kvs_subscribe(const char* key) {
  * @param key A chave para a qual se deseja cancelar a subscrição
  *
  * @return int Retorna 0 em caso de sucesso, 1 em caso de erro
- *
- * @errors
- *    - Falha ao enviar pedido de cancelamento
- *    - Falha ao ler resposta do servidor
- *    - Erro na resposta do servidor
- *    - Cliente não estava subscrito à chave
- *
  */
 int kvs_unsubscribe(const char* key) {
-  // Envia a mensagem de desinscrição para o FIFO de pedidos e espera pela resposta no FIFO de resposta
-  char buffer_request[MAX_STRING_SIZE];
-  snprintf(buffer_request, MAX_STRING_SIZE, "%d|%s", OP_CODE_UNSUBSCRIBE, key);
-
-  // Envia a mensagem de desinscrição para o FIFO de pedidos
-  if (write(_req_fd, buffer_request, MAX_STRING_SIZE) < 0) {
-    fprintf(stderr, "Failed to write to request FIFO\n");
-    if (close(_req_fd) != 0) {
-      perror("Failed to close request FIFO!");
-    }
+  char keys[1][MAX_STRING_SIZE];
+  snprintf(keys[0], MAX_STRING_SIZE, "%s", key);
+  return kvs_unsubscribe_batch(1, keys);
+}
 
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
+int kvs_unsubscribe_batch(size_t num_keys, char keys[][MAX_STRING_SIZE]) {
+  return kvs_session_unsubscribe_batch(_session, num_keys, keys);
+}
 
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO!");
-    }
-    return 1;
-  }
+int kvs_read(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], int found[]) {
+  return kvs_session_read(_session, num_keys, keys, values, found);
+}
 
-  char buffer_response[MAX_STRING_SIZE], charOPCODE = '0' + OP_CODE_UNSUBSCRIBE;
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]) {
+  return kvs_session_write(_session, num_pairs, keys, values);
+}
 
-  // Lê a resposta do servidor (a operação de leitura é atómica, pois lê menos de 4096 bytes)
-  if (read(_resp_fd, buffer_response, 3) == -1) {
-    fprintf(stderr, "Failed to read from response FIFO\n");
-    if (close(_req_fd) != 0) {
-      perror("Failed to close request FIFO!");
-    }
+int kvs_delete(size_t num_keys, char keys[][MAX_STRING_SIZE], int deleted[]) {
+  return kvs_session_delete(_session, num_keys, keys, deleted);
+}
 
-    if (close(_resp_fd) != 0) {
-      perror("Failed to close response FIFO!");
-    }
+int kvs_read_versions(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE],
+                      uint64_t versions[], int found[]) {
+  return kvs_session_read_versions(_session, num_keys, keys, values, versions, found);
+}
 
-    if (close(_notif_fd) != 0) {
-      perror("Failed to close notification FIFO!");
-    }
-    return 1;
-  }
+int kvs_cas(size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t expected[], char values[][MAX_STRING_SIZE],
+            uint64_t versions[], int written[]) {
+  return kvs_session_cas(_session, num_pairs, keys, expected, values, versions, written);
+}
 
-  // Verifica se o opcode da resposta é o esperado
-  if (buffer_response[0] == charOPCODE) {
-    if (buffer_response[2] == '0') {
-      // Resposta do servidor indica sucesso
-      fprintf(stdout, "Server returned 0 for operation: %s\n", UNSUBSCRIBE);
-    } else {
-      // Resposta do servidor indica erro na operação (não conseguiu desinscrever)
-      fprintf(stdout, "Server returned 1 for operation: %s\n", UNSUBSCRIBE);
-      fprintf(stderr, "Could not unsubscribe to key!\n");
-      return 1;
-    }
-  } else {
-    // O opcode recebido não corresponde ao esperado
-    fprintf(stderr, "Opcode not recognized for operation: %s\n", UNSUBSCRIBE);
-    return 1;
-  }
+int kvs_incr(size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t deltas[], int64_t results[],
+             int updated[]) {
+  return kvs_session_incr(_session, num_pairs, keys, deltas, results, updated);
+}
 
-  return 0;
+int kvs_append(size_t num_pairs, char keys[][MAX_STRING_SIZE], char suffixes[][MAX_STRING_SIZE]) {
+  return kvs_session_append(_session, num_pairs, keys, suffixes);
 }
@@ -2,11 +2,175 @@
 #define CLIENT_API_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #include "src/common/constants.h"
 
+/// Maximum number of requests a session can have waiting for a response.
+/// Submitting more blocks until a response arrives.
+#define KVS_MAX_IN_FLIGHT 4096
+
+/// Number of keys cached by the client when the cache is enabled.
+#define KVS_CACHE_DEFAULT_CAPACITY 1024
+
+/// Transports that kvs_connect can negotiate with the server.
+enum KvsTransport {
+  KVS_TRANSPORT_FIFO,   // requests, responses and notifications over the named pipes
+  KVS_TRANSPORT_SHM,    // shared memory rings, falling back to the pipes if refused
+  KVS_TRANSPORT_SOCKET  // a single unix socket per session, falling back to the pipes
+};
+
+/// A connection to a kvs server. A process can open any number of sessions,
+/// and a session can be used by several threads at once.
+typedef struct KvsSession KvsSession;
+
+/// Outcome of a request.
+typedef struct {
+  uint8_t op_code;      // OP_CODE_* of the request
+  int status;           // status returned by the server, -1 if the session ended first
+  uint32_t request_id;  // identifier returned by kvs_submit
+  const char* payload;  // response fields (see protocol.h), valid until the result is released
+  size_t payload_len;
+} KvsResult;
+
+/// A notification record, "(key,value)". The strings point into the record
+/// and are not terminated.
+typedef struct {
+  const char* key;
+  size_t key_len;
+  const char* value;  // "DELETED" when the key was deleted
+  size_t value_len;
+  int deleted;
+  int truncated;  // the record was cut and 'value' is only the start of the value
+} KvsNotification;
+
+/// Called once per request when its response arrives, from the session's
+/// receiver thread. Must not block on other requests of the same session.
+typedef void (*KvsCallback)(KvsSession* session, const KvsResult* result, void* arg);
+
+/// Opens a session with a kvs server.
+/// @param req_pipe_path Path to the name pipe to be created for requests.
+/// @param resp_pipe_path Path to the name pipe to be created for responses.
+/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param notif_pipe_path Path to the name pipe to be created for notifications.
+/// @param transport Transport to propose to the server.
+/// @return The session, NULL if the connection could not be established.
+KvsSession* kvs_session_open(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
+                             char const* notif_pipe_path, enum KvsTransport transport);
+
+/// Disconnects a session. Requests still in flight complete with status -1.
+/// @param session Session to disconnect.
+/// @return 0 in case of success, 1 otherwise.
+int kvs_session_disconnect(KvsSession* session);
+
+/// Frees a disconnected session. No thread may be using it anymore.
+/// @param session Session to free.
+void kvs_session_free(KvsSession* session);
+
+/// Submits a request without waiting for the response.
+/// @param session Session to use.
+/// @param op_code OP_CODE_READ, OP_CODE_WRITE, OP_CODE_DELETE, OP_CODE_SUBSCRIBE or OP_CODE_UNSUBSCRIBE.
+/// @param num_keys Number of keys (1 for subscriptions).
+/// @param keys Keys of the request.
+/// @param values Values of each key for OP_CODE_WRITE, NULL otherwise.
+/// @param callback Called with the result, or NULL to queue the result and
+///        signal the session's eventfd instead.
+/// @param arg Passed to the callback or returned by kvs_session_next_completion.
+/// @param request_id If not NULL, set to the identifier of the request.
+/// @return 0 if the request was sent, 1 otherwise (the callback is not called).
+int kvs_submit(KvsSession* session, uint8_t op_code, size_t num_keys, char keys[][MAX_STRING_SIZE],
+               char values[][MAX_STRING_SIZE], KvsCallback callback, void* arg, uint32_t* request_id);
+
+/// Returns an eventfd that becomes readable when results submitted without a
+/// callback are ready. Read it to reset the counter, then drain the results.
+/// @param session Session to inspect.
+/// @return The eventfd.
+int kvs_session_eventfd(KvsSession* session);
+
+/// Takes the next queued result of a request submitted without a callback.
+/// The previous result returned by the session is released by this call.
+/// @param session Session to inspect.
+/// @param result Where the result is stored.
+/// @param arg Where the argument given to kvs_submit is stored.
+/// @return 0 if a result was returned, 1 if there is none.
+int kvs_session_next_completion(KvsSession* session, KvsResult* result, void** arg);
+
+/// Reads the next notification of a session, whichever transport it uses.
+/// Behaves like read() on the notification pipe.
+/// @param session Session to read from.
+/// @param buffer Where the notification is stored.
+/// @param size Size of a notification record.
+/// @return Number of bytes read, 0 if the session ended, -1 on error.
+ssize_t kvs_session_read_notification(KvsSession* session, void* buffer, size_t size);
+
+/// Reads every notification already available on a session, waiting only
+/// until there is at least one byte. Records of MAX_STRING_SIZE bytes may be
+/// split across calls, so the caller keeps any incomplete tail.
+/// @param session Session to read from.
+/// @param buffer Where the notifications are stored.
+/// @param size Size of the buffer (at least 2 * MAX_STRING_SIZE).
+/// @return Number of bytes read, 0 if the session ended, -1 on error.
+ssize_t kvs_session_read_notifications(KvsSession* session, void* buffer, size_t size);
+
+/// Splits a notification record without copying it.
+/// @param record Record of MAX_STRING_SIZE bytes, as sent by the server.
+/// @param notification Where the key and value are stored.
+/// @return 0 on success, 1 if the record is not valid.
+int kvs_parse_notification(const char* record, KvsNotification* notification);
+
+/// Enables a read cache of up to 'capacity' keys on a session. Keys read are
+/// subscribed, so notifications keep them current, and later reads are served
+/// locally. Notifications of keys subscribed only by the cache are consumed by
+/// the notification reads and never returned. Call before using the session.
+/// The cache only learns of writes by other clients through those reads, so it
+/// is coherent only while some thread keeps reading the session's
+/// notifications; otherwise cached values can be arbitrarily old.
+/// @param session Session to change.
+/// @param capacity Maximum number of cached keys.
+/// @return 0 on success, 1 otherwise.
+int kvs_session_enable_cache(KvsSession* session, size_t capacity);
+
+/// Blocking operations on a session, with the same semantics as the
+/// functions below that use the default session.
+int kvs_session_subscribe_batch(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE]);
+int kvs_session_unsubscribe_batch(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE]);
+int kvs_session_read(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                     char values[][MAX_STRING_SIZE], int found[]);
+int kvs_session_write(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                      char values[][MAX_STRING_SIZE]);
+int kvs_session_delete(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE], int deleted[]);
+int kvs_session_read_versions(KvsSession* session, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                              char values[][MAX_STRING_SIZE], uint64_t versions[], int found[]);
+int kvs_session_cas(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t expected[],
+                    char values[][MAX_STRING_SIZE], uint64_t versions[], int written[]);
+int kvs_session_incr(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t deltas[],
+                     int64_t results[], int updated[]);
+int kvs_session_append(KvsSession* session, size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                       char suffixes[][MAX_STRING_SIZE]);
+
+// The functions below use a default session, opened by kvs_connect.
+
 int* get_notify_fd();
 
+/// Returns the session opened by the last kvs_connect, NULL if there is none.
+KvsSession* kvs_default_session(void);
+
+/// Enables the read cache on the sessions opened by the next kvs_connect.
+/// @param capacity Maximum number of cached keys (0 disables the cache).
+void kvs_set_cache(size_t capacity);
+
+/// Selects the transport proposed by the next kvs_connect.
+/// @param transport Transport to use.
+void kvs_set_transport(enum KvsTransport transport);
+
+/// Reads the next notification sent by the server, whichever transport the
+/// session uses. Behaves like read() on the notification pipe.
+/// @param buffer Where the notification is stored.
+/// @param size Size of a notification record.
+/// @return Number of bytes read, 0 if the session ended, -1 on error.
+ssize_t kvs_read_notification(void* buffer, size_t size);
+
 /// Connects to a kvs server.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
@@ -30,4 +194,90 @@ int kvs_subscribe(const char* key);
 
 int kvs_unsubscribe(const char* key);
 
+/// Requests subscriptions for several keys, sending all requests before
+/// waiting for the responses.
+/// @param num_keys Number of keys
+/// @param keys Keys to be subscribed
+/// @return 0 if every key was subscribed successfully, 1 otherwise.
+int kvs_subscribe_batch(size_t num_keys, char keys[][MAX_STRING_SIZE]);
+
+/// Removes subscriptions for several keys, sending all requests before
+/// waiting for the responses.
+/// @param num_keys Number of keys
+/// @param keys Keys to be unsubscribed
+/// @return 0 if every subscription was removed successfully, 1 otherwise.
+int kvs_unsubscribe_batch(size_t num_keys, char keys[][MAX_STRING_SIZE]);
+
+/// Reads the values of several keys.
+/// @param num_keys Number of keys
+/// @param keys Keys to be read
+/// @param values Where the values are stored (empty string for missing keys)
+/// @param found Set to 1 for each key that exists, 0 otherwise
+/// @return 0 if the keys were read, 1 otherwise.
+int kvs_read(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], int found[]);
+
+/// Writes several key value pairs. Existing keys are updated.
+/// @param num_pairs Number of pairs
+/// @param keys Keys to be written
+/// @param values Values of each key
+/// @return 0 if the pairs were written, 1 otherwise.
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]);
+
+/// Deletes several keys.
+/// @param num_keys Number of keys
+/// @param keys Keys to be deleted
+/// @param deleted Set to 1 for each key that was deleted, 0 if it did not exist
+/// @return 0 if the request was processed, 1 otherwise.
+int kvs_delete(size_t num_keys, char keys[][MAX_STRING_SIZE], int deleted[]);
+
+/// Reads the values of several keys together with their versions. Every
+/// write gives a key a new version, larger than any version seen before in
+/// the server, so a key read at a version has not changed while it keeps it.
+/// Always asks the server, even with the cache enabled.
+/// @param num_keys Number of keys
+/// @param keys Keys to be read
+/// @param values Where the values are stored (empty string for missing keys)
+/// @param versions Where the versions are stored (0 for missing keys)
+/// @param found Set to 1 for each key that exists, 0 otherwise
+/// @return 0 if the keys were read, 1 otherwise.
+int kvs_read_versions(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE],
+                      uint64_t versions[], int found[]);
+
+/// Writes each pair whose key is still at the expected version (compare and
+/// swap). Each pair is compared and written atomically by the server,
+/// independently of the others.
+/// @param num_pairs Number of pairs
+/// @param keys Keys to be written
+/// @param expected Version each key must have, 0 if it must not exist
+/// @param values Values of each key
+/// @param versions Set to the new version of each pair written, and to the
+///                 current version (0 if missing) of the others
+/// @param written Set to 1 for each pair written, 0 otherwise
+/// @return 0 if the request was processed, even if no pair was written, 1
+///         otherwise.
+int kvs_cas(size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t expected[], char values[][MAX_STRING_SIZE],
+            uint64_t versions[], int written[]);
+
+/// Adds a delta to the integer stored in each key, in the server, saving the
+/// read that would otherwise come before the write. Each key is updated
+/// atomically, independently of the others; a missing key counts as 0.
+/// @param num_pairs Number of keys
+/// @param keys Keys to be updated
+/// @param deltas Amount to add to each key, possibly negative
+/// @param results Set to the new value of each key updated
+/// @param updated Set to 1 for each key updated, 0 if its value is not a
+///                64-bit integer or the sum would overflow
+/// @return 0 if the request was processed, even if no key was updated, 1
+///         otherwise.
+int kvs_incr(size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t deltas[], int64_t results[],
+             int updated[]);
+
+/// Appends a suffix to the value of each key, in the server; missing keys are
+/// written with the suffix. Subscribers get one notification per key.
+/// @param num_pairs Number of pairs
+/// @param keys Keys to be updated
+/// @param suffixes Suffix for each key
+/// @return 0 if every suffix was appended, 1 otherwise.
+int kvs_append(size_t num_pairs, char keys[][MAX_STRING_SIZE], char suffixes[][MAX_STRING_SIZE]);
+
 #endif  // CLIENT_API_H
@@ -0,0 +1,364 @@
+#include "cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USER_KEY_BUCKETS 64
+
+enum EntryState {
+  ENTRY_FREE,
+  ENTRY_PENDING,  // à espera do valor lido do servidor
+  ENTRY_VALID,
+  ENTRY_STALE,   // chave apagada por esta sessão, à espera da notificação DELETED
+  ENTRY_UNKNOWN  // chave subscrita cujo valor não coube na última notificação ou leitura
+};
+
+typedef struct {
+  enum EntryState state;
+  int owned;       // a subscrição no servidor foi feita pela cache
+  int referenced;  // bit do CLOCK
+  int notified;    // entrada pendente que recebeu uma notificação, mais recente que a leitura
+  int gone;        // a notificação recebida foi DELETED
+  int cut;         // a notificação recebida não trazia o valor inteiro
+  int next;        // próxima entrada do mesmo bucket (-1 no fim)
+  char key[MAX_STRING_SIZE];
+  char value[MAX_STRING_SIZE];
+} CacheEntry;
+
+// Chave subscrita pelo utilizador
+typedef struct UserKey {
+  struct UserKey* next;
+  char key[MAX_STRING_SIZE];
+} UserKey;
+
+struct KvsCache {
+  pthread_mutex_t lock;
+  size_t capacity;
+  size_t hand;  // ponteiro do CLOCK
+  size_t num_buckets;
+  int* buckets;  // índice da primeira entrada de cada bucket (-1 se vazio)
+  CacheEntry* entries;
+  UserKey* user_keys[USER_KEY_BUCKETS];
+};
+
+static size_t hash_key(const char* key, size_t len) {
+  size_t hash = 5381;
+  for (size_t i = 0; i < len; i++) {
+    hash = hash * 33 + (unsigned char)key[i];
+  }
+  return hash;
+}
+
+static int key_equals(const char* stored, const char* key, size_t len) {
+  return strnlen(stored, MAX_STRING_SIZE) == len && memcmp(stored, key, len) == 0;
+}
+
+// Procura a entrada de uma chave. Retorna o índice, ou -1 se não existe
+static int find_entry(KvsCache* cache, const char* key, size_t len) {
+  int index = cache->buckets[hash_key(key, len) % cache->num_buckets];
+  while (index != -1 && !key_equals(cache->entries[index].key, key, len)) {
+    index = cache->entries[index].next;
+  }
+  return index;
+}
+
+// Retira uma entrada do seu bucket e liberta-a
+static void remove_entry(KvsCache* cache, int index) {
+  CacheEntry* entry = &cache->entries[index];
+  int* link = &cache->buckets[hash_key(entry->key, strnlen(entry->key, MAX_STRING_SIZE)) % cache->num_buckets];
+  while (*link != index) {
+    link = &cache->entries[*link].next;
+  }
+  *link = entry->next;
+  entry->state = ENTRY_FREE;
+}
+
+static UserKey** find_user_key(KvsCache* cache, const char* key, size_t len) {
+  UserKey** link = &cache->user_keys[hash_key(key, len) % USER_KEY_BUCKETS];
+  while (*link != NULL && !key_equals((*link)->key, key, len)) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+static void remove_user_key(KvsCache* cache, const char* key, size_t len) {
+  UserKey** link = find_user_key(cache, key, len);
+  if (*link != NULL) {
+    UserKey* user_key = *link;
+    *link = user_key->next;
+    free(user_key);
+  }
+}
+
+KvsCache* cache_create(size_t capacity) {
+  KvsCache* cache = calloc(1, sizeof(KvsCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  // Duas vezes mais buckets do que entradas, para cadeias curtas
+  cache->capacity = capacity;
+  cache->num_buckets = 2 * capacity;
+  cache->buckets = malloc(cache->num_buckets * sizeof(int));
+  cache->entries = calloc(capacity, sizeof(CacheEntry));
+  if (capacity == 0 || cache->buckets == NULL || cache->entries == NULL) {
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < cache->num_buckets; i++) {
+    cache->buckets[i] = -1;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+void cache_free(KvsCache* cache) {
+  for (size_t i = 0; i < USER_KEY_BUCKETS; i++) {
+    UserKey* user_key = cache->user_keys[i];
+    while (user_key != NULL) {
+      UserKey* next = user_key->next;
+      free(user_key);
+      user_key = next;
+    }
+  }
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache->entries);
+  free(cache);
+}
+
+int cache_lookup(KvsCache* cache, const char* key, char value[MAX_STRING_SIZE]) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, strnlen(key, MAX_STRING_SIZE));
+  int hit = index != -1 && cache->entries[index].state == ENTRY_VALID;
+  if (hit) {
+    cache->entries[index].referenced = 1;
+    memcpy(value, cache->entries[index].value, MAX_STRING_SIZE);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return hit;
+}
+
+// Escolhe a entrada a reutilizar com o algoritmo CLOCK: as entradas usadas desde a última
+// passagem do ponteiro ganham uma segunda oportunidade. Retorna -1 se todas estão pendentes
+static int clock_victim(KvsCache* cache) {
+  for (size_t steps = 0; steps < 2 * cache->capacity; steps++) {
+    size_t index = cache->hand;
+    cache->hand = (cache->hand + 1) % cache->capacity;
+
+    CacheEntry* entry = &cache->entries[index];
+    if (entry->state == ENTRY_FREE) {
+      return (int)index;
+    }
+    if (entry->state == ENTRY_PENDING) {
+      continue;
+    }
+    if (entry->referenced) {
+      entry->referenced = 0;
+      continue;
+    }
+    return (int)index;
+  }
+  return -1;
+}
+
+int cache_reserve(KvsCache* cache, const char* key, int* owned, char evicted[MAX_STRING_SIZE]) {
+  size_t len = strnlen(key, MAX_STRING_SIZE);
+  evicted[0] = '\0';
+
+  pthread_mutex_lock(&cache->lock);
+  int existing = find_entry(cache, key, len);
+  if (existing != -1 && cache->entries[existing].state == ENTRY_UNKNOWN) {
+    // A chave continua subscrita, por isso a leitura basta para voltar a ter o valor
+    CacheEntry* entry = &cache->entries[existing];
+    entry->state = ENTRY_PENDING;
+    entry->notified = entry->gone = entry->cut = 0;
+    *owned = 0;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+  if (existing != -1) {
+    pthread_mutex_unlock(&cache->lock);
+    return 1;
+  }
+
+  int index = clock_victim(cache);
+  if (index == -1) {
+    pthread_mutex_unlock(&cache->lock);
+    return -1;
+  }
+
+  CacheEntry* entry = &cache->entries[index];
+  if (entry->state != ENTRY_FREE) {
+    // Uma chave apagada já não tem subscrição no servidor
+    if ((entry->state == ENTRY_VALID || entry->state == ENTRY_UNKNOWN) && entry->owned) {
+      memcpy(evicted, entry->key, MAX_STRING_SIZE);
+    }
+    remove_entry(cache, index);
+  }
+
+  size_t bucket = hash_key(key, len) % cache->num_buckets;
+  memset(entry, 0, sizeof(CacheEntry));
+  memcpy(entry->key, key, len);
+  entry->state = ENTRY_PENDING;
+  entry->owned = *find_user_key(cache, key, len) == NULL;
+  entry->next = cache->buckets[bucket];
+  cache->buckets[bucket] = index;
+  *owned = entry->owned;
+  pthread_mutex_unlock(&cache->lock);
+  return 0;
+}
+
+void cache_complete(KvsCache* cache, const char* key, int found, const char* value) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, strnlen(key, MAX_STRING_SIZE));
+  if (index != -1 && cache->entries[index].state == ENTRY_PENDING) {
+    CacheEntry* entry = &cache->entries[index];
+    if (entry->gone) {
+      remove_entry(cache, index);
+    } else if (!found) {
+      // A chave foi apagada depois da subscrição: a notificação DELETED ainda vai chegar
+      entry->state = ENTRY_STALE;
+    } else if (entry->notified ? entry->cut : value == NULL) {
+      // Uma notificação recebida entretanto é sempre posterior à subscrição, logo pelo menos
+      // tão recente como a leitura; se nenhuma das duas trouxe o valor inteiro, não há o que servir
+      entry->state = ENTRY_UNKNOWN;
+    } else {
+      if (!entry->notified) {
+        memset(entry->value, 0, MAX_STRING_SIZE);
+        strncpy(entry->value, value, MAX_STRING_SIZE - 1);
+      }
+      entry->state = ENTRY_VALID;
+      entry->referenced = 1;
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_abort(KvsCache* cache, const char* key) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, strnlen(key, MAX_STRING_SIZE));
+  if (index != -1 && cache->entries[index].state == ENTRY_PENDING) {
+    remove_entry(cache, index);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_update(KvsCache* cache, const char* key, const char* value) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, strnlen(key, MAX_STRING_SIZE));
+  if (index != -1 && cache->entries[index].state == ENTRY_VALID) {
+    memset(cache->entries[index].value, 0, MAX_STRING_SIZE);
+    strncpy(cache->entries[index].value, value, MAX_STRING_SIZE - 1);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_invalidate(KvsCache* cache, const char* key) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, strnlen(key, MAX_STRING_SIZE));
+  if (index != -1) {
+    if (cache->entries[index].state == ENTRY_PENDING) {
+      cache->entries[index].notified = cache->entries[index].gone = 1;
+    } else {
+      cache->entries[index].state = ENTRY_STALE;
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+int cache_user_subscribe(KvsCache* cache, const char* key) {
+  size_t len = strnlen(key, MAX_STRING_SIZE);
+  int added = 0;
+
+  pthread_mutex_lock(&cache->lock);
+  UserKey** link = find_user_key(cache, key, len);
+  if (*link == NULL) {
+    *link = calloc(1, sizeof(UserKey));
+    added = *link != NULL ? 1 : -1;
+    if (*link != NULL) {
+      memcpy((*link)->key, key, len);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return added;
+}
+
+void cache_user_forget(KvsCache* cache, const char* key) {
+  pthread_mutex_lock(&cache->lock);
+  remove_user_key(cache, key, strnlen(key, MAX_STRING_SIZE));
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_user_unsubscribe(KvsCache* cache, const char* key) {
+  size_t len = strnlen(key, MAX_STRING_SIZE);
+
+  pthread_mutex_lock(&cache->lock);
+  remove_user_key(cache, key, len);
+  int index = find_entry(cache, key, len);
+  if (index != -1 && cache->entries[index].state != ENTRY_PENDING) {
+    remove_entry(cache, index);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+int cache_claim(KvsCache* cache, const char* key) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, strnlen(key, MAX_STRING_SIZE));
+  int claimed = index != -1 && cache->entries[index].owned && cache->entries[index].state != ENTRY_STALE;
+  if (claimed) {
+    cache->entries[index].owned = 0;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if (claimed && cache_user_subscribe(cache, key) < 0) {
+    return 0;
+  }
+  return claimed;
+}
+
+int cache_notify(KvsCache* cache, const char* key, size_t key_len, const char* value, size_t value_len,
+                 int deleted, int truncated) {
+  pthread_mutex_lock(&cache->lock);
+  int index = find_entry(cache, key, key_len);
+
+  // Uma chave que o utilizador não subscreveu só pode ter sido subscrita pela cache, mesmo que
+  // a entrada já tenha sido despejada e a notificação venha ainda de antes do unsubscribe
+  int cache_only = *find_user_key(cache, key, key_len) == NULL;
+
+  // O servidor apaga as subscrições juntamente com a chave
+  if (deleted) {
+    remove_user_key(cache, key, key_len);
+  }
+
+  if (index == -1) {
+    pthread_mutex_unlock(&cache->lock);
+    return cache_only;
+  }
+
+  CacheEntry* entry = &cache->entries[index];
+  if (deleted) {
+    if (entry->state == ENTRY_PENDING) {
+      entry->notified = entry->gone = 1;
+    } else {
+      remove_entry(cache, index);
+    }
+  } else if (entry->state == ENTRY_PENDING) {
+    memset(entry->value, 0, MAX_STRING_SIZE);
+    memcpy(entry->value, value, value_len < MAX_STRING_SIZE ? value_len : MAX_STRING_SIZE - 1);
+    entry->notified = 1;
+    entry->gone = 0;
+    entry->cut = truncated;
+  } else if (entry->state != ENTRY_STALE) {
+    // Um valor cortado não pode ser servido: a entrada espera por uma notificação ou leitura inteira
+    memset(entry->value, 0, MAX_STRING_SIZE);
+    memcpy(entry->value, value, value_len < MAX_STRING_SIZE ? value_len : MAX_STRING_SIZE - 1);
+    entry->state = truncated ? ENTRY_UNKNOWN : ENTRY_VALID;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return cache_only;
+}
@@ -0,0 +1,113 @@
+#ifndef CLIENT_CACHE_H
+#define CLIENT_CACHE_H
+
+#include <stddef.h>
+
+#include "src/common/constants.h"
+
+/// Bounded map from keys to the values last seen by a session, evicted with
+/// CLOCK. Every function is thread safe.
+///
+/// Each entry is backed by a subscription on the server, so notifications keep
+/// it current. The subscription is either owned by the cache (taken when the
+/// key was first read, and dropped on eviction) or by the user. Entries are
+/// only as current as the last notification handed to cache_notify, so the
+/// cache is coherent only while the session's notifications are being read.
+typedef struct KvsCache KvsCache;
+
+/// Creates an empty cache.
+/// @param capacity Maximum number of entries.
+/// @return The cache, NULL on failure.
+KvsCache* cache_create(size_t capacity);
+
+/// Frees a cache.
+/// @param cache Cache to free.
+void cache_free(KvsCache* cache);
+
+/// Looks up a key and marks it as recently used.
+/// @param cache Cache to search.
+/// @param key Key to look up.
+/// @param value Set to the cached value on a hit.
+/// @return 1 on a hit, 0 otherwise.
+int cache_lookup(KvsCache* cache, const char* key, char value[MAX_STRING_SIZE]);
+
+/// Reserves a pending entry for a key about to be fetched. Pending entries are
+/// not returned by lookups, but record notifications that arrive meanwhile.
+/// @param cache Cache to change.
+/// @param key Key to reserve.
+/// @param owned Set to 1 if the cache must subscribe the key itself, 0 if the
+///        user already did.
+/// @param evicted Set to the key whose cache-owned subscription must be dropped
+///        because its entry was evicted, or to an empty string.
+/// @return 0 if the entry was reserved (an entry whose value is not known is
+///         reserved again, with 'owned' set to 0), 1 if the key has an entry
+///         already, -1 if every entry is pending.
+int cache_reserve(KvsCache* cache, const char* key, int* owned, char evicted[MAX_STRING_SIZE]);
+
+/// Completes a pending entry with the result of the fetch.
+/// @param cache Cache to change.
+/// @param key Key of the pending entry.
+/// @param found 0 if the key does not exist. The entry is then not served, and
+///        waits for the deletion notification.
+/// @param value Value read from the server (a newer notified value wins), NULL
+///        if it was too long to be read whole. The entry is then not served.
+void cache_complete(KvsCache* cache, const char* key, int found, const char* value);
+
+/// Discards a pending entry whose fetch or subscription failed.
+/// @param cache Cache to change.
+/// @param key Key of the pending entry.
+void cache_abort(KvsCache* cache, const char* key);
+
+/// Replaces the value of a cached key after this session wrote it.
+/// @param cache Cache to change.
+/// @param key Key written.
+/// @param value New value.
+void cache_update(KvsCache* cache, const char* key, const char* value);
+
+/// Stops serving a key deleted by this session. The entry stays until the
+/// deletion notification arrives, so that notification is still recognized.
+/// @param cache Cache to change.
+/// @param key Key deleted.
+void cache_invalidate(KvsCache* cache, const char* key);
+
+/// Records that the user subscribed a key. Called before the request is sent,
+/// so notifications that follow the subscription always reach the user.
+/// @param cache Cache to change.
+/// @param key Key subscribed.
+/// @return 1 if the key was added, 0 if the user had subscribed it already,
+///         -1 on failure.
+int cache_user_subscribe(KvsCache* cache, const char* key);
+
+/// Forgets a key added by cache_user_subscribe whose subscription failed.
+/// @param cache Cache to change.
+/// @param key Key to forget.
+void cache_user_forget(KvsCache* cache, const char* key);
+
+/// Records that the user cancelled the subscription of a key, which also drops
+/// its entry, as the server no longer notifies it.
+/// @param cache Cache to change.
+/// @param key Key unsubscribed.
+void cache_user_unsubscribe(KvsCache* cache, const char* key);
+
+/// Hands the subscription of a key to the user, if the cache owns it.
+/// @param cache Cache to change.
+/// @param key Key the user subscribes.
+/// @return 1 if the cache owned the subscription, 0 otherwise.
+int cache_claim(KvsCache* cache, const char* key);
+
+/// Applies a notification sent by the server.
+/// @param cache Cache to change.
+/// @param key Key of the notification (not terminated).
+/// @param key_len Length of the key.
+/// @param value New value (not terminated).
+/// @param value_len Length of the value.
+/// @param deleted 1 if the key was deleted.
+/// @param truncated 1 if the record was cut and does not carry the whole
+///        value. The entry is then no longer served, until a later
+///        notification or read brings the whole value.
+/// @return 1 if the user did not subscribe the key, so the notification is only
+///         meant for the cache (even after the entry was evicted), 0 otherwise.
+int cache_notify(KvsCache* cache, const char* key, size_t key_len, const char* value, size_t value_len, int deleted,
+                 int truncated);
+
+#endif  // CLIENT_CACHE_H
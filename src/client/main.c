@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdio.h>
@@ -9,12 +10,31 @@
 
 #include "parser.h"
 #include "src/client/api.h"
+#include "src/client/notify.h"
 #include "src/common/constants.h"
 #include "src/common/io.h"
 
+/**
+ * Imprime um lote de notificações, no formato "(chave,valor)"
+ * @param batch - Notificações recebidas, por ordem de chegada
+ * @param count - Número de notificações
+ * @param arg - Não utilizado
+ */
+static void print_notifications(const KvsNotification* batch, size_t count, void* arg) {
+  (void)arg;
+
+  // Um único lock do stdout por lote, em vez de um por notificação
+  flockfile(stdout);
+  for (size_t i = 0; i < count; i++) {
+    printf("(%.*s,%.*s)\n", (int)batch[i].key_len, batch[i].key, (int)batch[i].value_len, batch[i].value);
+  }
+  fflush(stdout);
+  funlockfile(stdout);
+}
+
 /**
  * Thread responsável por gerenciar as notificações recebidas do servidor
- * @param arguments - Ponteiro para o fd do arquivo de notificações
+ * @param arguments - Ponteiro para o dispatcher de notificações da sessão
  * @return NULL após a conclusão (não utilizado)
  */
 void* manage_notifications(void* arguments) {
@@ -23,59 +43,32 @@ void* manage_notifications(void* arguments) {
     exit(1);
   }
 
-  int* notify_fd = (int*)arguments;
-  if (*notify_fd < 0) {
-    fprintf(stderr, "Error: Invalid file descriptor\n");
-    exit(1);
-  }
+  NotificationDispatcher* dispatcher = (NotificationDispatcher*)arguments;
 
-  // Ciclo infinito para continuar a receber notificações
-  while (1) {
-    char buffer[MAX_STRING_SIZE];
-    ssize_t bytes_read = read(*notify_fd, buffer, MAX_STRING_SIZE);
-
-    if (bytes_read < 0) {
-      // EINTR: Chamada foi interrompida por um sinal
-      if (errno == EINTR) {
-        continue;
-      }
-      // EAGAIN Não há dados disponíveis
-      else if (errno == EAGAIN) {
-        continue;  // Tenta ler novamente
-      }
-      // EPIPE: Pipe foi fechado do outro lado
-      else if (errno == EPIPE) {
-        printf("Connection lost! (Server received a SIGURS1)\n");
-        exit(1);
-      }
-      // EBADF: File descriptor inválido
-      else if (errno == EBADF) {
-        printf("Error: Invalid notification pipe descriptor!\n");
-        exit(1);
-      }
-      // EIO: Erro de I/O no sistema de ficheiros
-      else if (errno == EIO) {
-        printf("Error: I/O error on notification pipe!\n");
-        exit(1);
-      }
-      // Outros erros não especificados
-      else {
-        printf("Error reading from notification pipe: %s\n", strerror(errno));
-        exit(1);
-      }
-    }
+  // Lê e entrega notificações até a sessão terminar
+  if (notify_dispatch(dispatcher) == 0) {
     // EOF - pipe foi fechado normalmente
-    else if (bytes_read == 0) {
-      printf("Connection lost!\n");
-      exit(1);
-    }
-
-    // Adiciona terminador da string e imprime
-    buffer[bytes_read] = '\0';
-    printf("%s\n", buffer);
+    printf("Connection lost!\n");
+    exit(1);
   }
 
-  return NULL;
+  // EPIPE: Pipe foi fechado do outro lado
+  if (errno == EPIPE) {
+    printf("Connection lost! (Server received a SIGURS1)\n");
+  }
+  // EBADF: File descriptor inválido
+  else if (errno == EBADF) {
+    printf("Error: Invalid notification pipe descriptor!\n");
+  }
+  // EIO: Erro de I/O no sistema de ficheiros
+  else if (errno == EIO) {
+    printf("Error: I/O error on notification pipe!\n");
+  }
+  // Outros erros não especificados
+  else {
+    printf("Error reading from notification pipe: %s\n", strerror(errno));
+  }
+  exit(1);
 }
 
 /**
@@ -88,10 +81,22 @@ void* manage_notifications(void* arguments) {
 int main(int argc, char* argv[]) {
   // Verifica se há argumentos suficientes na linha de comandos
   if (argc < 3) {
-    fprintf(stderr, "Usage: %s <client_unique_id> <register_pipe_path>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <client_unique_id> <register_pipe_path> [shm|socket] [cache]\n", argv[0]);
     return 1;
   }
 
+  // Clientes na mesma máquina podem usar memória partilhada ou um socket UNIX em vez dos FIFOs, e
+  // qualquer cliente pode guardar localmente as chaves lidas
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "shm") == 0) {
+      kvs_set_transport(KVS_TRANSPORT_SHM);
+    } else if (strcmp(argv[i], "socket") == 0) {
+      kvs_set_transport(KVS_TRANSPORT_SOCKET);
+    } else if (strcmp(argv[i], "cache") == 0) {
+      kvs_set_cache(KVS_CACHE_DEFAULT_CAPACITY);
+    }
+  }
+
   /*
   Para garantir a unicidade dos fifos no cluster em que será
   avaliado o projeto adicionamos o nosso numero de grupo.
@@ -102,6 +107,12 @@ int main(int argc, char* argv[]) {
   char server_pipe_path[256] = "/tmp/server033";
 
   char keys[MAX_NUMBER_SUB][MAX_STRING_SIZE] = {0};
+  char values[MAX_NUMBER_SUB][MAX_STRING_SIZE] = {0};
+  int results[MAX_NUMBER_SUB];
+  uint64_t versions[MAX_NUMBER_SUB];
+  uint64_t expected[MAX_NUMBER_SUB];
+  int64_t deltas[MAX_NUMBER_SUB];
+  int64_t sums[MAX_NUMBER_SUB];
   unsigned int delay_ms;
   size_t num;
 
@@ -117,10 +128,16 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  // thread para gestão de notificações
+  // thread para gestão de notificações, que as entrega em lotes ao handler por omissão
+  NotificationDispatcher* dispatcher = notify_dispatcher_create(kvs_default_session());
+  if (dispatcher == NULL) {
+    fprintf(stderr, "Failed to create notification dispatcher\n");
+    return 1;
+  }
+  notify_register(dispatcher, NULL, print_notifications, NULL);
+
   pthread_t thread_notify_me;
-  int* notify_fd = get_notify_fd();
-  pthread_create(&thread_notify_me, NULL, manage_notifications, notify_fd);
+  pthread_create(&thread_notify_me, NULL, manage_notifications, dispatcher);
 
   // Ciclo principal para o processamento de comandos
   while (1) {
@@ -135,34 +152,175 @@ int main(int argc, char* argv[]) {
         // Aguarda a finalização da thread de notificações, dessa forma garantimos que terminamos o programa sem thread
         // zombie
         pthread_join(thread_notify_me, NULL);
+        notify_dispatcher_free(dispatcher);
         return 0;
 
       case CMD_SUBSCRIBE:
-        num = parse_list(STDIN_FILENO, keys, 1, MAX_STRING_SIZE);
+        num = parse_list(STDIN_FILENO, keys, MAX_NUMBER_SUB, MAX_STRING_SIZE);
         if (num == 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (kvs_subscribe(keys[0])) {
+        // Várias chaves na mesma linha são enviadas em pipeline
+        if (kvs_subscribe_batch(num, keys)) {
           fprintf(stderr, "Command subscribe failed\n");
         }
 
         break;
 
       case CMD_UNSUBSCRIBE:
-        num = parse_list(STDIN_FILENO, keys, 1, MAX_STRING_SIZE);
+        num = parse_list(STDIN_FILENO, keys, MAX_NUMBER_SUB, MAX_STRING_SIZE);
         if (num == 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (kvs_unsubscribe(keys[0])) {
+        if (kvs_unsubscribe_batch(num, keys)) {
           fprintf(stderr, "Command unsubscribe failed\n");
         }
 
         break;
 
+      case CMD_READ:
+        num = parse_list(STDIN_FILENO, keys, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_read(num, keys, values, results)) {
+          fprintf(stderr, "Command read failed\n");
+          break;
+        }
+
+        // Mesmo formato usado nos ficheiros .out do servidor
+        printf("[");
+        for (size_t i = 0; i < num; i++) {
+          printf("(%s,%s)", keys[i], results[i] ? values[i] : "KVSERROR");
+        }
+        printf("]\n");
+        break;
+
+      case CMD_WRITE:
+        num = parse_pairs(STDIN_FILENO, keys, values, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_write(num, keys, values)) {
+          fprintf(stderr, "Command write failed\n");
+        }
+        break;
+
+      case CMD_CAS:
+        num = parse_triples(STDIN_FILENO, keys, expected, values, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_cas(num, keys, expected, values, versions, results)) {
+          fprintf(stderr, "Command cas failed\n");
+          break;
+        }
+
+        // Mesmo formato usado nos ficheiros .out do servidor
+        printf("[");
+        for (size_t i = 0; i < num; i++) {
+          if (results[i]) {
+            printf("(%s,%" PRIu64 ")", keys[i], versions[i]);
+          } else {
+            printf("(%s,KVSCONFLICT)", keys[i]);
+          }
+        }
+        printf("]\n");
+        break;
+
+      case CMD_INCR:
+        num = parse_increments(STDIN_FILENO, keys, deltas, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_incr(num, keys, deltas, sums, results)) {
+          fprintf(stderr, "Command incr failed\n");
+          break;
+        }
+
+        printf("[");
+        for (size_t i = 0; i < num; i++) {
+          if (results[i]) {
+            printf("(%s,%" PRId64 ")", keys[i], sums[i]);
+          } else {
+            printf("(%s,KVSERROR)", keys[i]);
+          }
+        }
+        printf("]\n");
+        break;
+
+      case CMD_APPEND:
+        num = parse_pairs(STDIN_FILENO, keys, values, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_append(num, keys, values)) {
+          fprintf(stderr, "Command append failed\n");
+        }
+        break;
+
+      case CMD_VERSION:
+        num = parse_list(STDIN_FILENO, keys, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_read_versions(num, keys, values, versions, results)) {
+          fprintf(stderr, "Command version failed\n");
+          break;
+        }
+
+        printf("[");
+        for (size_t i = 0; i < num; i++) {
+          if (results[i]) {
+            printf("(%s,%" PRIu64 ")", keys[i], versions[i]);
+          } else {
+            printf("(%s,KVSERROR)", keys[i]);
+          }
+        }
+        printf("]\n");
+        break;
+
+      case CMD_DELETE:
+        num = parse_list(STDIN_FILENO, keys, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+        if (num == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (kvs_delete(num, keys, results)) {
+          fprintf(stderr, "Command delete failed\n");
+          break;
+        }
+
+        // Apenas as chaves inexistentes são reportadas, como nos ficheiros .out
+        int missing = 0;
+        for (size_t i = 0; i < num; i++) {
+          if (!results[i]) {
+            printf("%s(%s,KVSMISSING)", missing ? "" : "[", keys[i]);
+            missing = 1;
+          }
+        }
+        if (missing) {
+          printf("]\n");
+        }
+        break;
+
       case CMD_DELAY:
         // Feita completamente no esquelo inicial fornecido
         if (parse_delay(STDIN_FILENO, &delay_ms) == -1) {
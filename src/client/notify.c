@@ -0,0 +1,250 @@
+#define _GNU_SOURCE  // memfd_create(), MAP_ANONYMOUS
+
+#include "notify.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "src/common/constants.h"
+
+#define NOTIFY_HANDLER_BUCKETS 64
+
+// Número máximo de registos completos que uma leitura pode trazer
+#define NOTIFY_MAX_BATCH (NOTIFY_RING_SIZE / MAX_STRING_SIZE + 1)
+
+typedef struct HandlerEntry {
+  struct HandlerEntry* next;
+  KvsNotificationHandler handler;
+  void* arg;
+  size_t key_len;
+  char key[MAX_STRING_SIZE];
+} HandlerEntry;
+
+// Destino de uma notificação, resolvido quando o registo é separado
+typedef struct {
+  KvsNotificationHandler handler;
+  void* arg;
+} Target;
+
+struct NotificationDispatcher {
+  KvsSession* session;
+
+  // Anel mapeado duas vezes seguidas em memória virtual: um registo que passe do fim do anel
+  // continua contíguo na segunda cópia, por isso nunca é preciso copiá-lo para o ler
+  char* ring;
+  uint64_t head;  // bytes lidos da sessão
+  uint64_t tail;  // bytes já entregues
+
+  pthread_mutex_t lock;  // protege os handlers
+  HandlerEntry* buckets[NOTIFY_HANDLER_BUCKETS];
+  Target fallback;
+
+  // Registos da última leitura, por ordem de chegada
+  KvsNotification batch[NOTIFY_MAX_BATCH];
+  Target targets[NOTIFY_MAX_BATCH];
+};
+
+static size_t bucket_of(const char* key, size_t len) {
+  size_t hash = 5381;
+  for (size_t i = 0; i < len; i++) {
+    hash = hash * 33 + (unsigned char)key[i];
+  }
+  return hash % NOTIFY_HANDLER_BUCKETS;
+}
+
+// Reserva 2 * NOTIFY_RING_SIZE bytes de endereços e mapeia o mesmo memfd nas duas metades
+static char* ring_map(void) {
+  int fd = memfd_create("kvs-notify", MFD_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, NOTIFY_RING_SIZE) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  char* base = mmap(NULL, 2 * NOTIFY_RING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < 2; i++) {
+    if (mmap(base + i * NOTIFY_RING_SIZE, NOTIFY_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) ==
+        MAP_FAILED) {
+      munmap(base, 2 * NOTIFY_RING_SIZE);
+      close(fd);
+      return NULL;
+    }
+  }
+
+  // Os mapeamentos mantêm a memória, o descritor já não é necessário
+  close(fd);
+  return base;
+}
+
+NotificationDispatcher* notify_dispatcher_create(KvsSession* session) {
+  NotificationDispatcher* dispatcher = calloc(1, sizeof(NotificationDispatcher));
+  if (dispatcher == NULL) {
+    return NULL;
+  }
+
+  dispatcher->ring = ring_map();
+  if (dispatcher->ring == NULL) {
+    perror("Failed to map notification ring");
+    free(dispatcher);
+    return NULL;
+  }
+
+  dispatcher->session = session;
+  pthread_mutex_init(&dispatcher->lock, NULL);
+  return dispatcher;
+}
+
+void notify_dispatcher_free(NotificationDispatcher* dispatcher) {
+  for (size_t i = 0; i < NOTIFY_HANDLER_BUCKETS; i++) {
+    HandlerEntry* entry = dispatcher->buckets[i];
+    while (entry != NULL) {
+      HandlerEntry* next = entry->next;
+      free(entry);
+      entry = next;
+    }
+  }
+  munmap(dispatcher->ring, 2 * NOTIFY_RING_SIZE);
+  pthread_mutex_destroy(&dispatcher->lock);
+  free(dispatcher);
+}
+
+int notify_register(NotificationDispatcher* dispatcher, const char* key, KvsNotificationHandler handler, void* arg) {
+  if (key == NULL) {
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->fallback = (Target){handler, arg};
+    pthread_mutex_unlock(&dispatcher->lock);
+    return 0;
+  }
+
+  size_t len = strnlen(key, MAX_STRING_SIZE);
+  if (len == MAX_STRING_SIZE) {
+    return 1;
+  }
+  size_t bucket = bucket_of(key, len);
+
+  pthread_mutex_lock(&dispatcher->lock);
+  HandlerEntry* entry = dispatcher->buckets[bucket];
+  while (entry != NULL && (entry->key_len != len || memcmp(entry->key, key, len) != 0)) {
+    entry = entry->next;
+  }
+
+  if (entry == NULL) {
+    entry = malloc(sizeof(HandlerEntry));
+    if (entry == NULL) {
+      pthread_mutex_unlock(&dispatcher->lock);
+      return 1;
+    }
+    memcpy(entry->key, key, len);
+    entry->key_len = len;
+    entry->next = dispatcher->buckets[bucket];
+    dispatcher->buckets[bucket] = entry;
+  }
+  entry->handler = handler;
+  entry->arg = arg;
+  pthread_mutex_unlock(&dispatcher->lock);
+  return 0;
+}
+
+void notify_unregister(NotificationDispatcher* dispatcher, const char* key) {
+  pthread_mutex_lock(&dispatcher->lock);
+  if (key == NULL) {
+    dispatcher->fallback = (Target){NULL, NULL};
+    pthread_mutex_unlock(&dispatcher->lock);
+    return;
+  }
+
+  size_t len = strnlen(key, MAX_STRING_SIZE);
+  HandlerEntry** link = &dispatcher->buckets[bucket_of(key, len)];
+  while (*link != NULL) {
+    HandlerEntry* entry = *link;
+    if (entry->key_len == len && memcmp(entry->key, key, len) == 0) {
+      *link = entry->next;
+      free(entry);
+      break;
+    }
+    link = &entry->next;
+  }
+  pthread_mutex_unlock(&dispatcher->lock);
+}
+
+// Procura o handler de uma chave. Tem de ser chamada com o lock dos handlers
+static Target lookup(NotificationDispatcher* dispatcher, const char* key, size_t len) {
+  for (HandlerEntry* entry = dispatcher->buckets[bucket_of(key, len)]; entry != NULL; entry = entry->next) {
+    if (entry->key_len == len && memcmp(entry->key, key, len) == 0) {
+      return (Target){entry->handler, entry->arg};
+    }
+  }
+  return dispatcher->fallback;
+}
+
+// Separa os registos completos que estão no anel e entrega-os, agrupando os consecutivos
+// que vão para o mesmo handler
+static void deliver_records(NotificationDispatcher* dispatcher) {
+  size_t count = 0;
+
+  // Os handlers são resolvidos todos de uma vez, mas chamados sem o lock, para que possam
+  // registar ou remover handlers
+  pthread_mutex_lock(&dispatcher->lock);
+  while (dispatcher->head - dispatcher->tail >= MAX_STRING_SIZE) {
+    const char* record = dispatcher->ring + dispatcher->tail % NOTIFY_RING_SIZE;
+    dispatcher->tail += MAX_STRING_SIZE;
+
+    KvsNotification* notification = &dispatcher->batch[count];
+    if (kvs_parse_notification(record, notification) != 0) {
+      fprintf(stderr, "Invalid notification record\n");
+      continue;
+    }
+
+    Target target = lookup(dispatcher, notification->key, notification->key_len);
+    if (target.handler != NULL) {
+      dispatcher->targets[count++] = target;
+    }
+  }
+  pthread_mutex_unlock(&dispatcher->lock);
+
+  size_t start = 0;
+  for (size_t i = 1; i <= count; i++) {
+    if (i == count || dispatcher->targets[i].handler != dispatcher->targets[start].handler ||
+        dispatcher->targets[i].arg != dispatcher->targets[start].arg) {
+      dispatcher->targets[start].handler(&dispatcher->batch[start], i - start, dispatcher->targets[start].arg);
+      start = i;
+    }
+  }
+}
+
+int notify_dispatch(NotificationDispatcher* dispatcher) {
+  while (1) {
+    // Depois de cada entrega ficam no anel menos de MAX_STRING_SIZE bytes (um registo partido),
+    // pelo que cada leitura pode trazer quase um anel inteiro de notificações
+    size_t used = (size_t)(dispatcher->head - dispatcher->tail);
+    char* free_space = dispatcher->ring + dispatcher->head % NOTIFY_RING_SIZE;
+    ssize_t n = kvs_session_read_notifications(dispatcher->session, free_space, NOTIFY_RING_SIZE - used);
+
+    if (n < 0) {
+      // EINTR: chamada interrompida por um sinal; EAGAIN: não há dados disponíveis
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return -1;
+    }
+    if (n == 0) {
+      return 0;
+    }
+
+    dispatcher->head += (uint64_t)n;
+    deliver_records(dispatcher);
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef CLIENT_NOTIFY_H
+#define CLIENT_NOTIFY_H
+
+#include <stddef.h>
+
+#include "src/client/api.h"
+
+/// Size of the dispatcher ring, a multiple of the page size. Each read takes
+/// as many notifications as fit, so this also bounds the batch size.
+#define NOTIFY_RING_SIZE 65536
+
+/// Called with consecutive notifications that share the same handler, in the
+/// order the server sent them, from the thread running notify_dispatch. The
+/// notifications point straight into the dispatcher ring, and are only valid
+/// until the handler returns.
+typedef void (*KvsNotificationHandler)(const KvsNotification* batch, size_t count, void* arg);
+
+typedef struct NotificationDispatcher NotificationDispatcher;
+
+/// Creates a dispatcher for the notifications of a session.
+/// @param session Session whose notifications are read.
+/// @return The dispatcher, NULL on failure.
+NotificationDispatcher* notify_dispatcher_create(KvsSession* session);
+
+/// Frees a dispatcher that is no longer running.
+/// @param dispatcher Dispatcher to free.
+void notify_dispatcher_free(NotificationDispatcher* dispatcher);
+
+/// Registers the handler for a key, replacing any previous one. Safe to call
+/// while the dispatcher runs, including from a handler.
+/// @param dispatcher Dispatcher to change.
+/// @param key Key to handle, or NULL for the handler of every other key.
+/// @param handler Handler to call.
+/// @param arg Passed to the handler.
+/// @return 0 on success, 1 otherwise.
+int notify_register(NotificationDispatcher* dispatcher, const char* key, KvsNotificationHandler handler, void* arg);
+
+/// Removes the handler of a key. Its notifications go to the default handler,
+/// or are dropped if there is none.
+/// @param dispatcher Dispatcher to change.
+/// @param key Key to stop handling, or NULL for the default handler.
+void notify_unregister(NotificationDispatcher* dispatcher, const char* key);
+
+/// Reads and delivers notifications until the session ends.
+/// @param dispatcher Dispatcher to run.
+/// @return 0 when the session ended, -1 on a read error (errno is kept).
+int notify_dispatch(NotificationDispatcher* dispatcher);
+
+#endif  // CLIENT_NOTIFY_H
@@ -1,5 +1,6 @@
 #include "parser.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
@@ -117,6 +118,13 @@ enum Command get_next(int fd) {
 
     case 'D':
       if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "DELAY ", 6) != 0) {
+        if (strncmp(buf, "DELETE", 6) == 0) {
+          if (read(fd, buf + 6, 1) != 1 || buf[6] != ' ') {
+            cleanup(fd);
+            return CMD_INVALID;
+          }
+          return CMD_DELETE;
+        }
         if (read(fd, buf + 6, 4) != 4 || strncmp(buf, "DISCONNECT", 10) != 0) {
           cleanup(fd);
           return CMD_INVALID;
@@ -130,6 +138,54 @@ enum Command get_next(int fd) {
 
       return CMD_DELAY;
 
+    case 'R':
+      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_READ;
+
+    case 'W':
+      if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "WRITE ", 6) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_WRITE;
+
+    case 'C':
+      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "CAS ", 4) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_CAS;
+
+    case 'I':
+      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "INCR ", 5) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_INCR;
+
+    case 'A':
+      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "APPEND ", 7) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_APPEND;
+
+    case 'V':
+      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "VERSION ", 8) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_VERSION;
+
     case '#':
       cleanup(fd);
       return CMD_EMPTY;
@@ -181,6 +237,100 @@ size_t parse_list(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t
   return num_keys;
 }
 
+// Lê uma lista de pares ou, com 'versions', de trios com a versão entre a chave e o valor
+static size_t parse_tuples(int fd, char keys[][MAX_STRING_SIZE], uint64_t versions[], char values[][MAX_STRING_SIZE],
+                           size_t max_pairs, size_t max_string_size) {
+  char ch;
+
+  if (read(fd, &ch, 1) != 1 || ch != '[') {
+    cleanup(fd);
+    return 0;
+  }
+
+  if (read(fd, &ch, 1) != 1 || ch != '(') {
+    cleanup(fd);
+    return 0;
+  }
+
+  size_t num_pairs = 0;
+  char key[max_string_size];
+  char version[max_string_size];
+  char value[max_string_size];
+  while (num_pairs < max_pairs) {
+    if (read_string(fd, key, max_string_size) != 0) {
+      cleanup(fd);
+      return 0;
+    }
+
+    if (versions != NULL) {
+      char* end;
+      if (read_string(fd, version, max_string_size) != 0 || version[0] < '0' || version[0] > '9') {
+        cleanup(fd);
+        return 0;
+      }
+      versions[num_pairs] = strtoull(version, &end, 10);
+      if (*end != '\0') {
+        cleanup(fd);
+        return 0;
+      }
+    }
+
+    if (read_string(fd, value, max_string_size) != 1) {
+      cleanup(fd);
+      return 0;
+    }
+
+    strcpy(keys[num_pairs], key);
+    strcpy(values[num_pairs++], value);
+
+    if (read(fd, &ch, 1) != 1 || (ch != '(' && ch != ']')) {
+      cleanup(fd);
+      return 0;
+    }
+
+    if (ch == ']') {
+      break;
+    }
+  }
+
+  if (ch != ']') {
+    cleanup(fd);
+    return 0;
+  }
+
+  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 0;
+  }
+
+  return num_pairs;
+}
+
+size_t parse_pairs(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs,
+                   size_t max_string_size) {
+  return parse_tuples(fd, keys, NULL, values, max_pairs, max_string_size);
+}
+
+size_t parse_triples(int fd, char keys[][MAX_STRING_SIZE], uint64_t versions[], char values[][MAX_STRING_SIZE],
+                     size_t max_pairs, size_t max_string_size) {
+  return parse_tuples(fd, keys, versions, values, max_pairs, max_string_size);
+}
+
+size_t parse_increments(int fd, char keys[][MAX_STRING_SIZE], int64_t deltas[], size_t max_pairs,
+                        size_t max_string_size) {
+  char values[max_pairs][MAX_STRING_SIZE];
+  size_t num_pairs = parse_pairs(fd, keys, values, max_pairs, max_string_size);
+  for (size_t i = 0; i < num_pairs; i++) {
+    char *end;
+    errno = 0;
+    deltas[i] = strtoll(values[i], &end, 10);
+    if (errno != 0 || end == values[i] || *end != '\0') {
+      return 0;
+    }
+  }
+  return num_pairs;
+}
+
 int parse_delay(int fd, unsigned int *delay) {
   char ch;
 
@@ -2,6 +2,7 @@
 #define KVS_PARSER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "src/common/constants.h"
 
@@ -10,6 +11,13 @@ enum Command {
   CMD_SUBSCRIBE,
   CMD_UNSUBSCRIBE,
   CMD_DELAY,
+  CMD_READ,
+  CMD_WRITE,
+  CMD_CAS,
+  CMD_INCR,
+  CMD_APPEND,
+  CMD_VERSION,
+  CMD_DELETE,
   CMD_EMPTY,
   CMD_INVALID,
   EOC  // End of commands
@@ -30,6 +38,40 @@ enum Command get_next(int fd);
 //          of keys parsed
 size_t parse_list(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size);
 
+// Parses a list of key value pairs
+// @param fd File descriptor to read from.
+// @param keys Array to store the keys
+// @param values Array to store the values
+// @param max_pairs Maximum number of pairs it will read.
+// @param max_string_size Maximum string size allowed.
+// @return 0 if the command was not parsed successfully, otherwise return the
+//          of pairs parsed
+size_t parse_pairs(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs,
+                   size_t max_string_size);
+
+// Parses a list of (key,version,value) triples
+// @param fd File descriptor to read from.
+// @param keys Array to store the keys
+// @param versions Array to store the versions
+// @param values Array to store the values
+// @param max_pairs Maximum number of triples it will read.
+// @param max_string_size Maximum string size allowed.
+// @return 0 if the command was not parsed successfully, otherwise return the
+//          of triples parsed
+size_t parse_triples(int fd, char keys[][MAX_STRING_SIZE], uint64_t versions[], char values[][MAX_STRING_SIZE],
+                     size_t max_pairs, size_t max_string_size);
+
+// Parses a list of (key,delta) pairs, the deltas being 64-bit integers
+// @param fd File descriptor to read from.
+// @param keys Array to store the keys
+// @param deltas Array to store the deltas
+// @param max_pairs Maximum number of pairs it will read.
+// @param max_string_size Maximum string size allowed.
+// @return 0 if the command was not parsed successfully, otherwise return the
+//          of pairs parsed
+size_t parse_increments(int fd, char keys[][MAX_STRING_SIZE], int64_t deltas[], size_t max_pairs,
+                        size_t max_string_size);
+
 // Parses a DELAY command.
 // @param fd File descriptor to read from.
 // @param delay Pointer to the variable to store the wait delay in.
@@ -5,7 +5,15 @@
 #define MAX_STRING_SIZE 40
 #define MAX_NUMBER_SUB 10
 #define MAX_CONNECT_STRING 124
+#define MAX_PIPELINE_DEPTH 256  // num max de pedidos enviados antes de ler as respostas
 #define CONNECT "connect"
 #define DISCONNECT "disconnect"
 #define SUBSCRIBE "subscribe"
 #define UNSUBSCRIBE "unsubscribe"
+#define READ "read"
+#define WRITE "write"
+#define DELETE "delete"
+#define CAS "cas"
+#define VERSION "version"
+#define INCR "incr"
+#define APPEND "append"
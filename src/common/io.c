@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -79,3 +80,63 @@ void delay(unsigned int time_ms) {
   struct timespec delay = delay_to_timespec(time_ms);
   nanosleep(&delay, NULL);
 }
+
+int send_with_fd(int sock, const void *buffer, size_t size, int fd) {
+  struct iovec iov = {(void *)buffer, size};
+  struct msghdr msg = {0};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (fd >= 0) {
+    memset(&control, 0, sizeof(control));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+
+  while (sendmsg(sock, &msg, MSG_NOSIGNAL) == -1) {
+    if (errno != EINTR) {
+      perror("Failed to send to socket");
+      return -1;
+    }
+  }
+  return 1;
+}
+
+ssize_t recv_with_fd(int sock, void *buffer, size_t size, int *fd) {
+  struct iovec iov = {buffer, size};
+  struct msghdr msg = {0};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  *fd = -1;
+
+  ssize_t result;
+  while ((result = recvmsg(sock, &msg, 0)) == -1 && errno == EINTR) {
+  }
+
+  if (result > 0) {
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+      memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+  return result;
+}
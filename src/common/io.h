@@ -2,6 +2,7 @@
 #define COMMON_IO_H
 
 #include <stddef.h>
+#include <sys/types.h>
 
 /// Reads a given number of bytes from a file descriptor. Will block until all
 /// bytes are read, or fail if not all bytes could be read.
@@ -24,4 +25,22 @@ int write_all(int fd, const void *buffer, size_t size);
 
 void delay(unsigned int time_ms);
 
+/// Sends a message over a unix socket, optionally passing a file descriptor
+/// along with it (SCM_RIGHTS).
+/// @param sock Connected unix socket.
+/// @param buffer Message to send.
+/// @param size Size of the message.
+/// @param fd File descriptor to pass, or -1 for none.
+/// @return On success, returns 1, on error, returns -1
+int send_with_fd(int sock, const void *buffer, size_t size, int fd);
+
+/// Receives a message from a unix socket, together with a file descriptor if
+/// the peer passed one.
+/// @param sock Connected unix socket.
+/// @param buffer Buffer to receive into.
+/// @param size Size of the buffer.
+/// @param fd Set to the received file descriptor, or -1 if there was none.
+/// @return Number of bytes received, 0 on end of file, -1 on error.
+ssize_t recv_with_fd(int sock, void *buffer, size_t size, int *fd);
+
 #endif  // COMMON_IO_H
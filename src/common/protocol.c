@@ -0,0 +1,88 @@
+#include "protocol.h"
+
+#include <string.h>
+
+void frame_init(void *frame, uint8_t op_code, uint8_t status, uint32_t request_id) {
+  FrameHeader header = {PROTOCOL_VERSION, op_code, status, 0, request_id, 0};
+  memcpy(frame, &header, FRAME_HEADER_SIZE);
+}
+
+void frame_set_flags(void *frame, uint8_t flags) { memcpy((char *)frame + offsetof(FrameHeader, flags), &flags, 1); }
+
+int frame_add_field(void *frame, size_t cap, const void *data, size_t len) {
+  FrameHeader header;
+  memcpy(&header, frame, FRAME_HEADER_SIZE);
+
+  size_t offset = FRAME_HEADER_SIZE + header.payload_len;
+  if (len > UINT16_MAX || header.payload_len + sizeof(uint16_t) + len > PROTOCOL_MAX_PAYLOAD ||
+      offset + sizeof(uint16_t) + len > cap) {
+    return 1;
+  }
+
+  // Cada campo e precedido pelo seu tamanho
+  uint16_t field_len = (uint16_t)len;
+  memcpy((char *)frame + offset, &field_len, sizeof(uint16_t));
+  memcpy((char *)frame + offset + sizeof(uint16_t), data, len);
+
+  header.payload_len += (uint32_t)(sizeof(uint16_t) + len);
+  memcpy(frame, &header, FRAME_HEADER_SIZE);
+  return 0;
+}
+
+size_t frame_size(const void *frame) {
+  FrameHeader header;
+  memcpy(&header, frame, FRAME_HEADER_SIZE);
+  return FRAME_HEADER_SIZE + header.payload_len;
+}
+
+int frame_parse(const void *buf, size_t len, FrameHeader *header) {
+  if (len < FRAME_HEADER_SIZE) {
+    return 0;
+  }
+
+  memcpy(header, buf, FRAME_HEADER_SIZE);
+  if (header->version != PROTOCOL_VERSION || header->payload_len > PROTOCOL_MAX_PAYLOAD) {
+    return -1;
+  }
+
+  return len >= FRAME_HEADER_SIZE + header->payload_len ? 1 : 0;
+}
+
+int frame_next_field(const void *payload, size_t payload_len, size_t *offset, const char **data, size_t *len) {
+  if (*offset == payload_len) {
+    return 0;
+  }
+
+  if (*offset + sizeof(uint16_t) > payload_len) {
+    return -1;
+  }
+
+  uint16_t field_len;
+  memcpy(&field_len, (const char *)payload + *offset, sizeof(uint16_t));
+  if (*offset + sizeof(uint16_t) + field_len > payload_len) {
+    return -1;
+  }
+
+  *data = (const char *)payload + *offset + sizeof(uint16_t);
+  *len = field_len;
+  *offset += sizeof(uint16_t) + field_len;
+  return 1;
+}
+
+int frame_next_string(const void *payload, size_t payload_len, size_t *offset, char *str, size_t max) {
+  const char *data;
+  size_t len;
+
+  int res = frame_next_field(payload, payload_len, offset, &data, &len);
+  if (res != 1) {
+    return res;
+  }
+
+  if (len >= max) {
+    return -1;
+  }
+
+  memcpy(str, data, len);
+  str[len] = '\0';
+  return 1;
+}
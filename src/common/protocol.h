@@ -1,6 +1,9 @@
 #ifndef COMMON_PROTOCOL_H
 #define COMMON_PROTOCOL_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Opcodes for client-server communication
 // estes opcodes sao usados num switch case para determinar o que fazer com a mensagem recebida no server
 // usam estes opcodes tambem nos clientes quando enviam mensagens para o server
@@ -8,8 +11,119 @@ enum {
   OP_CODE_CONNECT = 1,
   OP_CODE_DISCONNECT = 2,
   OP_CODE_SUBSCRIBE = 3,
-  OP_CODE_UNSUBSCRIBE = 4
-  // TODO mais opcodes para cada operacao
+  OP_CODE_UNSUBSCRIBE = 4,
+  OP_CODE_READ = 5,          // pedido: chaves; resposta: um campo por chave (KEY_FOUND/KEY_MISSING + valor,
+                             // cortado a MAX_STRING_SIZE bytes se for maior do que isso)
+  OP_CODE_WRITE = 6,         // pedido: pares chave, valor; resposta: sem payload
+  OP_CODE_DELETE = 7,        // pedido: chaves; resposta: um campo de 1 byte por chave (KEY_FOUND/KEY_MISSING)
+  OP_CODE_NOTIFY = 8,        // servidor -> cliente, apenas no socket: um campo com a notificacao "(chave,valor)"
+  OP_CODE_READ_VERSION = 9,  // pedido: chaves; resposta: como no READ, com a versao entre o 1o byte e o valor
+  OP_CODE_CAS = 10,          // pedido: trios chave, versao esperada, valor; resposta: um campo por par
+                             // (CAS_WRITTEN/CAS_CONFLICT + versao nova ou atual)
+  OP_CODE_INCR = 11,         // pedido: pares chave, incremento de 8 bytes; resposta: um campo por chave
+                             // (INCR_DONE/INCR_FAILED + valor novo de 8 bytes)
+  OP_CODE_APPEND = 12        // pedido: pares chave, sufixo; resposta: sem payload
 };
 
+// Primeiro byte de cada campo das respostas de READ, READ_VERSION e DELETE
+#define KEY_MISSING 0
+#define KEY_FOUND 1
+
+// Primeiro byte de cada campo das respostas de CAS
+#define CAS_CONFLICT 0
+#define CAS_WRITTEN 1
+
+// Primeiro byte de cada campo das respostas de INCR
+#define INCR_FAILED 0
+#define INCR_DONE 1
+
+// As versoes sao campos de 8 bytes (uint64_t); 0 quer dizer que a chave nao existe
+#define VERSION_FIELD_SIZE sizeof(uint64_t)
+
+// Os incrementos do INCR e os valores que devolve sao campos de 8 bytes (int64_t)
+#define DELTA_FIELD_SIZE sizeof(int64_t)
+
+// Versao do formato binario das mensagens. O servidor rejeita frames com outra versao.
+#define PROTOCOL_VERSION 1
+
+// Tamanho maximo do payload de um frame (pedido ou resposta)
+#define PROTOCOL_MAX_PAYLOAD 32768
+
+// Tamanho maximo de um conjunto de frames enviado de uma so vez (uma escrita no FIFO/anel ou uma
+// mensagem no socket). Ambos os lados leem para buffers deste tamanho.
+#define PROTOCOL_MAX_MESSAGE 65536
+
+// Cada mensagem (pedido ou resposta) e um frame composto por um cabecalho fixo seguido de
+// 'payload_len' bytes. O payload e uma sequencia de campos, cada um prefixado pelo seu
+// tamanho (uint16_t). Os inteiros estao na ordem de bytes do host, visto que cliente e
+// servidor correm sempre na mesma maquina.
+typedef struct {
+  uint8_t version;       // PROTOCOL_VERSION
+  uint8_t op_code;       // OP_CODE_*
+  uint8_t status;        // resultado da operacao (apenas nas respostas)
+  uint8_t flags;         // reservado, sempre 0
+  uint32_t request_id;   // atribuido pelo cliente e devolvido na resposta correspondente
+  uint32_t payload_len;  // numero de bytes que se seguem ao cabecalho
+} FrameHeader;
+
+// Flags do cabecalho. No CONNECT, FRAME_FLAG_SHM indica que o cliente criou uma regiao de memoria
+// partilhada (nome no 4o campo); o servidor devolve a flag na resposta se a aceitar, e a partir dai
+// pedidos, respostas e notificacoes passam pelos aneis dessa regiao em vez dos FIFOs.
+// No socket UNIX a regiao nao tem nome: o descritor (memfd) segue junto com o CONNECT (SCM_RIGHTS).
+#define FRAME_FLAG_SHM 0x01
+
+#define FRAME_HEADER_SIZE sizeof(FrameHeader)
+#define FRAME_MAX_SIZE (FRAME_HEADER_SIZE + PROTOCOL_MAX_PAYLOAD)
+
+/// Initializes a frame with an empty payload.
+/// @param frame Buffer of at least FRAME_HEADER_SIZE bytes.
+/// @param op_code Operation code of the frame.
+/// @param status Status of the operation (0 for requests).
+/// @param request_id Identifier of the request.
+void frame_init(void *frame, uint8_t op_code, uint8_t status, uint32_t request_id);
+
+/// Sets the flags of a frame.
+/// @param frame Frame previously initialized with frame_init.
+/// @param flags FRAME_FLAG_* bits.
+void frame_set_flags(void *frame, uint8_t flags);
+
+/// Appends a length-prefixed field to the payload of a frame.
+/// @param frame Frame previously initialized with frame_init.
+/// @param cap Capacity of the frame buffer.
+/// @param data Bytes of the field.
+/// @param len Number of bytes of the field.
+/// @return 0 if the field was appended, 1 if it does not fit.
+int frame_add_field(void *frame, size_t cap, const void *data, size_t len);
+
+/// Returns the total size (header and payload) of a frame.
+/// @param frame Frame to inspect.
+/// @return Size in bytes.
+size_t frame_size(const void *frame);
+
+/// Checks whether a buffer starts with a complete frame.
+/// @param buf Buffer with the received bytes.
+/// @param len Number of bytes in the buffer.
+/// @param header Where the header of the frame is copied to.
+/// @return 1 if a complete frame is available, 0 if more bytes are needed,
+///         -1 if the frame is invalid (wrong version or payload too large).
+int frame_parse(const void *buf, size_t len, FrameHeader *header);
+
+/// Iterates over the fields of a frame payload.
+/// @param payload Start of the payload.
+/// @param payload_len Size of the payload.
+/// @param offset Current position; must start at 0 and is advanced by the call.
+/// @param data Set to the start of the field (not null terminated).
+/// @param len Set to the size of the field.
+/// @return 1 if a field was read, 0 at the end of the payload, -1 if malformed.
+int frame_next_field(const void *payload, size_t payload_len, size_t *offset, const char **data, size_t *len);
+
+/// Copies the next field of a payload into a null terminated string.
+/// @param payload Start of the payload.
+/// @param payload_len Size of the payload.
+/// @param offset Current position; advanced by the call.
+/// @param str Destination buffer.
+/// @param max Size of the destination buffer.
+/// @return 1 if a field was copied, 0 at the end of the payload, -1 if malformed or too long.
+int frame_next_string(const void *payload, size_t payload_len, size_t *offset, char *str, size_t max);
+
 #endif  // COMMON_PROTOCOL_H
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE  // syscall()
+
+#include "shm.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Número de tentativas antes de adormecer no futex: com carga o outro lado responde quase
+// sempre dentro deste intervalo, pelo que não há chamadas ao sistema
+#define SHM_SPIN_LIMIT 4096
+
+// Intervalo entre verificações de que o outro lado continua vivo enquanto se espera
+#define SHM_WAIT_TIMEOUT_MS 100
+
+static void futex_wait(_Atomic uint32_t *addr, uint32_t expected) {
+  struct timespec timeout = {0, SHM_WAIT_TIMEOUT_MS * 1000000L};
+  // Sem FUTEX_PRIVATE_FLAG, pois a palavra é partilhada entre processos
+  syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr) { syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0); }
+
+// Verifica, sem bloquear, se o FIFO associado ao outro lado da sessão ainda está aberto
+static int peer_alive(int peer_fd) {
+  if (peer_fd < 0) {
+    return 1;
+  }
+
+  struct pollfd pfd = {peer_fd, 0, 0};
+  if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+    return 0;
+  }
+  return 1;
+}
+
+// Espera até que 'word' deixe de valer 'expected'. Retorna 0 se o anel foi fechado ou o outro
+// lado desapareceu entretanto.
+static int ring_wait(ShmRing *ring, _Atomic uint32_t *word, _Atomic uint32_t *waiting, uint32_t expected,
+                     int peer_fd) {
+  for (int spins = 0; spins < SHM_SPIN_LIMIT; spins++) {
+    if (atomic_load_explicit(word, memory_order_acquire) != expected) {
+      return 1;
+    }
+  }
+
+  atomic_store(waiting, 1);
+  while (atomic_load(word) == expected) {
+    if (atomic_load(&ring->closed) || !peer_alive(peer_fd)) {
+      atomic_store(waiting, 0);
+      return 0;
+    }
+    futex_wait(word, expected);
+  }
+  atomic_store(waiting, 0);
+  return 1;
+}
+
+// Dimensiona e mapeia a região associada a 'fd', inicializando-a
+static ShmRegion *region_init(int fd) {
+  if (ftruncate(fd, sizeof(ShmRegion)) != 0) {
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  // ftruncate preenche a região com zeros, pelo que os anéis já estão vazios
+  ShmRegion *region = addr;
+  region->magic = SHM_REGION_MAGIC;
+  region->size = sizeof(ShmRegion);
+  return region;
+}
+
+ShmRegion *shm_region_create(const char *name) {
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  ShmRegion *region = region_init(fd);
+  close(fd);
+  if (region == NULL) {
+    shm_unlink(name);
+  }
+  return region;
+}
+
+ShmRegion *shm_region_create_anonymous(int *fd) {
+  // Sem nome no sistema de ficheiros: a região desaparece com o último descritor/mapeamento
+  *fd = memfd_create("kvs-session", MFD_CLOEXEC);
+  if (*fd < 0) {
+    return NULL;
+  }
+
+  ShmRegion *region = region_init(*fd);
+  if (region == NULL) {
+    close(*fd);
+    *fd = -1;
+  }
+  return region;
+}
+
+ShmRegion *shm_region_attach_fd(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(ShmRegion)) {
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  ShmRegion *region = addr;
+  if (region->magic != SHM_REGION_MAGIC || region->size != sizeof(ShmRegion)) {
+    munmap(addr, sizeof(ShmRegion));
+    return NULL;
+  }
+  return region;
+}
+
+ShmRegion *shm_region_attach(const char *name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  ShmRegion *region = shm_region_attach_fd(fd);
+  close(fd);
+  return region;
+}
+
+void shm_region_close(ShmRegion *region) {
+  ShmRing *rings[] = {&region->requests, &region->responses, &region->notifications};
+  for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+    atomic_store(&rings[i]->closed, 1);
+    futex_wake(&rings[i]->head);
+    futex_wake(&rings[i]->tail);
+  }
+}
+
+void shm_region_release(ShmRegion *region) {
+  shm_region_close(region);
+  munmap(region, sizeof(ShmRegion));
+}
+
+int shm_ring_write(ShmRing *ring, const void *buffer, size_t size, int peer_fd) {
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t written = 0;
+
+  while (written < size) {
+    if (atomic_load_explicit(&ring->closed, memory_order_relaxed)) {
+      return -1;
+    }
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t space = SHM_RING_SIZE - (uint32_t)(head - tail);
+    if (space == 0) {
+      // Anel cheio: espera que o consumidor avance 'tail'
+      if (!ring_wait(ring, &ring->tail, &ring->writer_waiting, tail, peer_fd)) {
+        return -1;
+      }
+      continue;
+    }
+
+    size_t n = size - written < space ? size - written : space;
+    size_t pos = head & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - pos ? n : SHM_RING_SIZE - pos;
+    memcpy(ring->data + pos, (const char *)buffer + written, first);
+    memcpy(ring->data, (const char *)buffer + written + first, n - first);
+
+    head += (uint32_t)n;
+    written += n;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    // Só é preciso acordar o consumidor se ele estiver efetivamente a dormir
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->reader_waiting, memory_order_relaxed)) {
+      futex_wake(&ring->head);
+    }
+  }
+  return 1;
+}
+
+ssize_t shm_ring_read(ShmRing *ring, void *buffer, size_t max, int peer_fd) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head;
+
+  while ((head = atomic_load_explicit(&ring->head, memory_order_acquire)) == tail) {
+    // Anel vazio: espera que o produtor avance 'head'
+    if (atomic_load_explicit(&ring->closed, memory_order_relaxed) ||
+        !ring_wait(ring, &ring->head, &ring->reader_waiting, tail, peer_fd)) {
+      return 0;
+    }
+  }
+
+  size_t n = (uint32_t)(head - tail) < max ? (uint32_t)(head - tail) : max;
+  size_t pos = tail & (SHM_RING_SIZE - 1);
+  size_t first = n < SHM_RING_SIZE - pos ? n : SHM_RING_SIZE - pos;
+  memcpy(buffer, ring->data + pos, first);
+  memcpy((char *)buffer + first, ring->data, n - first);
+
+  atomic_store_explicit(&ring->tail, tail + (uint32_t)n, memory_order_release);
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ring->writer_waiting, memory_order_relaxed)) {
+    futex_wake(&ring->tail);
+  }
+  return (ssize_t)n;
+}
@@ -0,0 +1,86 @@
+#ifndef COMMON_SHM_H
+#define COMMON_SHM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Tamanho de cada anel (potência de 2)
+#define SHM_RING_SIZE 65536
+#define SHM_REGION_MAGIC 0x4b565331u  // "KVS1"
+#define SHM_NAME_PREFIX "/kvs033-"
+
+// Anel SPSC de bytes numa região partilhada entre cliente e servidor. Transporta exatamente os
+// mesmos frames que os FIFOs. 'head' e 'tail' são contadores livres (a posição real é o resto da
+// divisão por SHM_RING_SIZE) e servem também de palavra de futex para acordar o outro lado.
+typedef struct {
+  _Atomic uint32_t head;  // bytes escritos pelo produtor
+  char pad_head[60];
+  _Atomic uint32_t tail;  // bytes lidos pelo consumidor
+  char pad_tail[60];
+  _Atomic uint32_t reader_waiting;  // consumidor adormecido em 'head'
+  _Atomic uint32_t writer_waiting;  // produtor adormecido em 'tail'
+  _Atomic uint32_t closed;          // um dos lados terminou a sessão
+  char pad_flags[52];
+  char data[SHM_RING_SIZE];
+} ShmRing;
+
+// Região negociada no connect: pedidos (cliente -> servidor), respostas e notificações
+// (servidor -> cliente)
+typedef struct {
+  uint32_t magic;
+  uint32_t size;
+  char pad[56];
+  ShmRing requests;
+  ShmRing responses;
+  ShmRing notifications;
+} ShmRegion;
+
+/// Creates and maps a new shared memory region.
+/// @param name Name of the region (must start with '/').
+/// @return The mapped region, NULL on failure.
+ShmRegion *shm_region_create(const char *name);
+
+/// Creates and maps a new anonymous shared memory region (memfd), to be handed
+/// to the peer over a unix socket.
+/// @param fd Set to the file descriptor backing the region; the caller closes it.
+/// @return The mapped region, NULL on failure.
+ShmRegion *shm_region_create_anonymous(int *fd);
+
+/// Maps a shared memory region received as a file descriptor.
+/// @param fd File descriptor backing the region (not closed by the call).
+/// @return The mapped region, NULL on failure or if the region is not valid.
+ShmRegion *shm_region_attach_fd(int fd);
+
+/// Maps an existing shared memory region created by the peer.
+/// @param name Name of the region.
+/// @return The mapped region, NULL on failure or if the region is not valid.
+ShmRegion *shm_region_attach(const char *name);
+
+/// Marks every ring of the region as closed, waking up any waiter. The region
+/// stays mapped, so threads still blocked on it can return safely.
+/// @param region Region to close.
+void shm_region_close(ShmRegion *region);
+
+/// Closes the region and unmaps it.
+/// @param region Region to release.
+void shm_region_release(ShmRegion *region);
+
+/// Writes all bytes to a ring, sleeping while it is full.
+/// @param ring Ring to write to.
+/// @param buffer Bytes to write.
+/// @param size Number of bytes (at most SHM_RING_SIZE).
+/// @param peer_fd File descriptor used to detect that the peer died while waiting (may be -1).
+/// @return 1 on success, -1 if the ring was closed or the peer disappeared.
+int shm_ring_write(ShmRing *ring, const void *buffer, size_t size, int peer_fd);
+
+/// Reads the bytes available in a ring, sleeping while it is empty.
+/// @param ring Ring to read from.
+/// @param buffer Destination buffer.
+/// @param max Maximum number of bytes to read.
+/// @param peer_fd File descriptor used to detect that the peer died while waiting (may be -1).
+/// @return Number of bytes read, 0 if the ring was closed or the peer disappeared.
+ssize_t shm_ring_read(ShmRing *ring, void *buffer, size_t max, int peer_fd);
+
+#endif  // COMMON_SHM_H
@@ -0,0 +1,72 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobc.h"
+#include "jobprog.h"
+
+// Compila um .job para um .jobc com o mesmo nome, na mesma diretoria
+static int compile(const char* in_path) {
+  const char* dot = strrchr(in_path, '.');
+  if (dot == NULL || strcmp(dot, ".job") != 0) {
+    fprintf(stderr, "Not a job file: %s\n", in_path);
+    return 1;
+  }
+
+  char out_path[MAX_JOB_FILE_NAME_SIZE];
+  if (snprintf(out_path, sizeof(out_path), "%s%c", in_path, 'c') >= (int)sizeof(out_path)) {
+    fprintf(stderr, "Job file name too long: %s\n", in_path);
+    return 1;
+  }
+
+  int in_fd = open(in_path, O_RDONLY);
+  if (in_fd == -1) {
+    perror(in_path);
+    return 1;
+  }
+  JobProgram program;
+  uint64_t commands[EOC] = {0};
+  int failed = job_program_load(in_fd, &program, commands);
+  close(in_fd);
+  if (failed) {
+    fprintf(stderr, "Failed to parse %s\n", in_path);
+    return 1;
+  }
+
+  // O .jobc só aparece completo, para o servidor nunca correr metade de um job
+  char tmp_path[MAX_JOB_FILE_NAME_SIZE + 4];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", out_path);
+  FILE* file = fopen(tmp_path, "wb");
+  if (file == NULL) {
+    perror(tmp_path);
+    job_program_free(&program);
+    return 1;
+  }
+  failed = jobc_write(file, &program);
+  failed |= fclose(file) != 0;
+  size_t count = program.count;
+  job_program_free(&program);
+  if (failed || rename(tmp_path, out_path) != 0) {
+    perror(out_path);
+    unlink(tmp_path);
+    return 1;
+  }
+
+  printf("%s: %zu commands, %" PRIu64 " invalid\n", out_path, count, commands[CMD_INVALID]);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <job_file>...\n", argv[0]);
+    return 1;
+  }
+
+  int failed = 0;
+  for (int i = 1; i < argc; i++) {
+    failed |= compile(argv[i]);
+  }
+  return failed;
+}
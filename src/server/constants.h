@@ -1,4 +1,16 @@
+#include "src/common/protocol.h"
+
 #define MAX_WRITE_SIZE 256
 #define MAX_READ_SIZE 256
 #define MAX_STRING_SIZE 40
+// Um valor tem de caber inteiro num frame, junto da chave e dos campos que o acompanham
+#define MAX_VALUE_SIZE (PROTOCOL_MAX_PAYLOAD - 2 * MAX_STRING_SIZE)
 #define MAX_JOB_FILE_NAME_SIZE 256
+#define JOBS_PER_THREAD 16
+#define MAX_PENDING_SESSIONS 16
+#define HANDSHAKE_TIMEOUT_MS 1000
+#define HANDSHAKE_RETRY_MS 5
+#define SESSION_QUEUE_SIZE 64
+#define STATS_FILE_NAME "kvs.latency"
+#define LOCKPROF_FILE_NAME "kvs.locks"
+#define JOBSTATS_FILE_NAME "kvs.jobs"
@@ -1,3 +1,6 @@
+#include "io.h"
+
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
@@ -43,3 +46,50 @@ size_t strn_memcpy(char *dest, const char *src, size_t n) {
   memcpy(dest, src, bytes_to_copy);
   return bytes_to_copy;
 }
+
+void iov_batch_init(IovBatch *batch, int fd) {
+  batch->fd = fd;
+  batch->count = 0;
+  batch->failed = 0;
+}
+
+void iov_batch_add(IovBatch *batch, const void *data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  if (batch->count == IOV_BATCH_SIZE) {
+    iov_batch_flush(batch);
+  }
+  batch->iov[batch->count].iov_base = (void *)data;
+  batch->iov[batch->count].iov_len = len;
+  batch->count++;
+}
+
+int iov_batch_flush(IovBatch *batch) {
+  struct iovec *iov = batch->iov;
+  int count = batch->count;
+  batch->count = 0;
+
+  while (count > 0 && !batch->failed) {
+    ssize_t written = writev(batch->fd, iov, count);
+    if (written < 0) {
+      if (errno != EINTR) {
+        batch->failed = 1;
+      }
+      continue;
+    }
+
+    // Salta os buffers escritos por completo e avança dentro do primeiro que ficou a meio
+    size_t done = (size_t)written;
+    while (count > 0 && done >= iov->iov_len) {
+      done -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
+  return batch->failed;
+}
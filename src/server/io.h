@@ -1,8 +1,22 @@
 #ifndef KVS_IO_H
 #define KVS_IO_H
 
+#include <sys/uio.h>
 #include <unistd.h>
 
+/// Number of buffers an IovBatch gathers before writing them.
+#define IOV_BATCH_SIZE 64
+
+/// Buffers gathered to be written with a single writev. The buffers are not
+/// copied, so they must stay valid until the batch is flushed. Only writev is
+/// called, so batches can be used after fork() in a multithreaded process.
+typedef struct {
+  int fd;
+  int count;
+  int failed;
+  struct iovec iov[IOV_BATCH_SIZE];
+} IovBatch;
+
 /// Writes a string to the given file descriptor.
 /// @param fd The file descriptor to write to.
 /// @param str The string to write.
@@ -20,4 +34,20 @@ void write_uint(int fd, int value);
 /// @return Number of bytes copied
 size_t strn_memcpy(char* dest, const char* src, size_t n);
 
+/// Starts an empty batch.
+/// @param batch Batch to initialize.
+/// @param fd File descriptor the batch is written to.
+void iov_batch_init(IovBatch *batch, int fd);
+
+/// Adds a buffer to a batch, writing the batch first if it is full.
+/// @param batch Batch.
+/// @param data Start of the buffer.
+/// @param len Size of the buffer.
+void iov_batch_add(IovBatch *batch, const void *data, size_t len);
+
+/// Writes every buffer in the batch, retrying partial writes.
+/// @param batch Batch, which is empty afterwards.
+/// @return 0 if everything added since iov_batch_init was written, 1 otherwise.
+int iov_batch_flush(IovBatch *batch);
+
 #endif  // KVS_IO_H
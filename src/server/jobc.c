@@ -0,0 +1,243 @@
+#include "jobc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "kvs.h"
+#include "value.h"
+
+// Opcode de cada comando; os EMPTY não chegam aos ficheiros e o EOC é o fim do ficheiro
+static const uint32_t command_opcodes[EOC] = {JOBC_WRITE, JOBC_WRITE_TTL, JOBC_CAS,    JOBC_INCR,    JOBC_APPEND,
+                                              JOBC_READ,  JOBC_VERSION,   JOBC_DELETE, JOBC_SHOW,    JOBC_SCAN,
+                                              JOBC_WAIT,  JOBC_BACKUP,    JOBC_HELP,   JOBC_INVALID, JOBC_INVALID};
+
+// Comando de cada opcode, CMD_EMPTY para os que não existem
+static enum Command opcode_command(uint32_t opcode) {
+  for (int cmd = 0; cmd < EOC; cmd++) {
+    if (cmd != CMD_EMPTY && command_opcodes[cmd] == opcode) {
+      return (enum Command)cmd;
+    }
+  }
+  return CMD_EMPTY;
+}
+
+static int has_values(enum Command cmd) {
+  return cmd == CMD_WRITE || cmd == CMD_WRITE_TTL || cmd == CMD_CAS || cmd == CMD_APPEND;
+}
+
+// Bytes que o registo de um comando ocupa, já com o enchimento até 8
+static size_t record_size(const JobOp *op) {
+  size_t size = sizeof(JobcRecord) + op->count * MAX_STRING_SIZE;
+  if (op->cmd == CMD_CAS || op->cmd == CMD_INCR) {
+    size += op->count * sizeof(uint64_t);
+  }
+  for (size_t i = 0; has_values(op->cmd) && i < op->count; i++) {
+    size += sizeof(uint32_t) + op->values[i]->len;
+  }
+  return (size + 7) & ~(size_t)7;
+}
+
+static int write_op(FILE *file, const JobOp *op) {
+  size_t size = record_size(op);
+  if (size > UINT32_MAX) {
+    fprintf(stderr, "Command too large to compile\n");
+    return 1;
+  }
+  JobcRecord record = {command_opcodes[op->cmd], (uint32_t)op->count, op->arg, (uint32_t)size};
+  size_t written = fwrite(&record, sizeof(record), 1, file) == 1 ? sizeof(record) : 0;
+
+  // As chaves vão limpas depois do '\0', para o mesmo job dar sempre o mesmo ficheiro
+  for (size_t i = 0; i < op->count; i++) {
+    char key[MAX_STRING_SIZE] = {0};
+    strncpy(key, op->keys[i], MAX_STRING_SIZE - 1);
+    written += fwrite(key, MAX_STRING_SIZE, 1, file) * MAX_STRING_SIZE;
+  }
+  if (op->cmd == CMD_CAS || op->cmd == CMD_INCR) {
+    const void *numbers = op->cmd == CMD_CAS ? (const void *)op->versions : (const void *)op->deltas;
+    written += fwrite(numbers, sizeof(uint64_t), op->count, file) * sizeof(uint64_t);
+  }
+  for (size_t i = 0; has_values(op->cmd) && i < op->count; i++) {
+    const KvsValue *value = op->values[i];
+    uint32_t len = (uint32_t)value->len;
+    written += fwrite(&len, sizeof(len), 1, file) * sizeof(len);
+    for (size_t chunk = 0; chunk < value->chunk_count; chunk++) {
+      written += fwrite(value->chunks[chunk], 1, value_chunk_len(value, chunk), file);
+    }
+  }
+
+  // Se alguma escrita falhou, faltam mais bytes do que o enchimento pode ter
+  static const char padding[8] = {0};
+  size_t pad = size - written;
+  return pad >= sizeof(padding) || fwrite(padding, 1, pad, file) != pad;
+}
+
+int jobc_write(FILE *file, const JobProgram *program) {
+  JobcHeader header = {JOBC_MAGIC, JOBC_FORMAT_VERSION, MAX_STRING_SIZE, program->count};
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    return 1;
+  }
+  for (size_t i = 0; i < program->count; i++) {
+    if (write_op(file, &program->ops[i]) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Cria um valor a partir dos bytes do ficheiro, dividido em blocos como o parser faria
+static KvsValue *load_value(const char *data, size_t len) {
+  ValueBuilder builder;
+  value_builder_init(&builder);
+  while (len > 0) {
+    size_t available;
+    char *space = value_builder_space(&builder, &available);
+    if (space == NULL) {
+      value_builder_discard(&builder);
+      return NULL;
+    }
+    size_t part = len < available ? len : available;
+    memcpy(space, data, part);
+    value_builder_commit(&builder, part);
+    data += part;
+    len -= part;
+  }
+  return value_builder_finish(&builder);
+}
+
+// Copia um registo para um comando. Retorna 1 se o registo estiver mal formado ou faltar memória
+static int load_op(const char *record, size_t size, JobOp *op) {
+  JobcRecord header;
+  memcpy(&header, record, sizeof(header));
+  memset(op, 0, sizeof(JobOp));
+  op->cmd = opcode_command(header.opcode);
+  op->count = header.count;
+  op->arg = header.arg;
+
+  // Só os comandos com uma lista têm chaves, e o SCAN tem no máximo duas
+  int listed = op->cmd <= CMD_DELETE || op->cmd == CMD_SCAN;
+  size_t numbers = op->cmd == CMD_CAS || op->cmd == CMD_INCR ? op->count : 0;
+  if (op->cmd == CMD_EMPTY || listed != (op->count > 0) || (op->cmd == CMD_SCAN && op->count > 2) ||
+      op->count > (size - sizeof(header)) / MAX_STRING_SIZE) {
+    return 1;
+  }
+  size_t offset = sizeof(header) + op->count * MAX_STRING_SIZE;
+  if (numbers > (size - offset) / sizeof(uint64_t)) {
+    return 1;
+  }
+  if (op->count == 0) {
+    return 0;
+  }
+
+  op->keys = malloc(op->count * MAX_STRING_SIZE);
+  if (op->keys == NULL) {
+    return 1;
+  }
+  memcpy(op->keys, record + sizeof(header), op->count * MAX_STRING_SIZE);
+  for (size_t i = 0; i < op->count; i++) {
+    // A tabela só aceita chaves que comecem por uma letra ou um algarismo; o SCAN aceita prefixos vazios
+    op->keys[i][MAX_STRING_SIZE - 1] = '\0';
+    if (hash(op->keys[i]) < 0 && (op->cmd != CMD_SCAN || op->keys[i][0] != '\0')) {
+      return 1;
+    }
+  }
+
+  if (numbers > 0) {
+    void *copy = malloc(numbers * sizeof(uint64_t));
+    if (copy == NULL) {
+      return 1;
+    }
+    memcpy(copy, record + offset, numbers * sizeof(uint64_t));
+    offset += numbers * sizeof(uint64_t);
+    if (op->cmd == CMD_CAS) {
+      op->versions = copy;
+    } else {
+      op->deltas = copy;
+    }
+  }
+
+  if (has_values(op->cmd)) {
+    op->values = calloc(op->count, sizeof(KvsValue *));
+    if (op->values == NULL) {
+      return 1;
+    }
+    for (size_t i = 0; i < op->count; i++) {
+      uint32_t len;
+      if (size - offset < sizeof(len)) {
+        return 1;
+      }
+      memcpy(&len, record + offset, sizeof(len));
+      offset += sizeof(len);
+      // O parser não aceita valores maiores do que MAX_VALUE_SIZE, por isso um .jobc também não
+      if (len > MAX_VALUE_SIZE || len > size - offset || (op->values[i] = load_value(record + offset, len)) == NULL) {
+        return 1;
+      }
+      offset += len;
+    }
+  }
+  return 0;
+}
+
+int jobc_load(int fd, JobProgram *program, uint64_t commands[EOC]) {
+  memset(program, 0, sizeof(JobProgram));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror("Failed to open compiled job");
+    return 1;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size < sizeof(JobcHeader)) {
+    fprintf(stderr, "Invalid compiled job\n");
+    return 1;
+  }
+
+  const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("Failed to map compiled job");
+    return 1;
+  }
+  // O ficheiro é lido uma vez, do início ao fim
+  posix_madvise((void *)map, size, POSIX_MADV_SEQUENTIAL);
+
+  JobcHeader header;
+  memcpy(&header, map, sizeof(header));
+  int failed = memcmp(header.magic, JOBC_MAGIC, sizeof(header.magic)) != 0 || header.version != JOBC_FORMAT_VERSION ||
+               header.key_size != MAX_STRING_SIZE;
+
+  size_t offset = sizeof(header);
+  for (uint64_t n = 0; !failed && n < header.count; n++) {
+    JobcRecord record;
+    if (size - offset < sizeof(record)) {
+      failed = 1;
+      break;
+    }
+    memcpy(&record, map + offset, sizeof(record));
+    if (record.size < sizeof(record) || record.size % 8 != 0 || record.size > size - offset) {
+      failed = 1;
+      break;
+    }
+
+    JobOp op;
+    if (load_op(map + offset, record.size, &op) != 0) {
+      job_op_clear(&op);
+      failed = 1;
+      break;
+    }
+    commands[op.cmd]++;
+    if (job_program_add(program, &op) != 0) {
+      failed = 1;
+      break;
+    }
+    offset += record.size;
+  }
+  munmap((void *)map, size);
+
+  if (failed) {
+    fprintf(stderr, "Failed to load compiled job: invalid file or out of memory\n");
+    job_program_free(program);
+    return 1;
+  }
+  return 0;
+}
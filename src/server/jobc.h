@@ -0,0 +1,75 @@
+#ifndef KVS_JOBC_H
+#define KVS_JOBC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "jobprog.h"
+
+/// Extension of compiled jobs, written by kvs-compile.
+#define JOBC_EXTENSION ".jobc"
+
+/// First bytes of a compiled job.
+#define JOBC_MAGIC "KVSJOBC"
+
+/// Version of the format, changed whenever the layout or the opcodes change.
+#define JOBC_FORMAT_VERSION 1
+
+/// A compiled job holds the commands of a .job already parsed, so the server
+/// only copies them out of a mapping of the file. Integers are in host byte
+/// order: a .jobc is meant to be run where it was compiled. The file is a
+/// JobcHeader followed by one record per command:
+/// - a JobcRecord;
+/// - `count` keys of MAX_STRING_SIZE bytes, padded with '\0', so they are
+///   copied as they are into the key arrays of the command;
+/// - CAS: the expected versions; INCR: the deltas; 8 bytes each;
+/// - WRITE, WRITE_TTL, CAS, APPEND: the values, each a 4-byte length followed
+///   by its bytes;
+/// - padding up to a multiple of 8 bytes.
+typedef struct {
+  char magic[8];      // JOBC_MAGIC
+  uint32_t version;   // JOBC_FORMAT_VERSION
+  uint32_t key_size;  // MAX_STRING_SIZE of the compiler
+  uint64_t count;     // records that follow
+} JobcHeader;
+
+typedef struct {
+  uint32_t opcode;  // JobcOpcode
+  uint32_t count;   // keys of the command
+  uint32_t arg;     // time to live of a WRITE_TTL, delay of a WAIT
+  uint32_t size;    // bytes of the record, this header and padding included
+} JobcRecord;
+
+/// Opcodes of the records. Unlike enum Command, their values never change.
+enum JobcOpcode {
+  JOBC_WRITE = 1,
+  JOBC_WRITE_TTL = 2,
+  JOBC_CAS = 3,
+  JOBC_INCR = 4,
+  JOBC_APPEND = 5,
+  JOBC_READ = 6,
+  JOBC_VERSION = 7,
+  JOBC_DELETE = 8,
+  JOBC_SHOW = 9,
+  JOBC_SCAN = 10,
+  JOBC_WAIT = 11,
+  JOBC_BACKUP = 12,
+  JOBC_HELP = 13,
+  JOBC_INVALID = 14,  // a line that failed to parse, reported when the job runs
+};
+
+/// Writes a job in the compiled format.
+/// @param file File to write to.
+/// @param program Commands of the job, without EMPTY ones.
+/// @return 0 on success, 1 on a write error.
+int jobc_write(FILE *file, const JobProgram *program);
+
+/// Loads a compiled job by mapping it.
+/// @param fd File descriptor of the compiled job.
+/// @param program Set to the commands, to be released with job_program_free.
+/// @param commands Counters incremented with the type of each command.
+/// @return 0 on success, 1 if the file is not a valid compiled job or memory
+///         ran out (with an error printed).
+int jobc_load(int fd, JobProgram *program, uint64_t commands[EOC]);
+
+#endif  // KVS_JOBC_H
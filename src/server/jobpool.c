@@ -0,0 +1,101 @@
+#include "jobpool.h"
+
+#include <pthread.h>
+
+#include "lockprof.h"
+
+// Itens de um job que podem correr por qualquer ordem e em qualquer thread de jobs
+typedef struct PoolBatch {
+  PoolItemFn run;
+  void *arg;
+  size_t count;
+  size_t next;                   // primeiro item ainda não reservado
+  size_t finished;               // itens já corridos
+  struct PoolBatch *next_batch;  // fila dos lotes com itens por reservar
+} PoolBatch;
+
+#define POOL_CHUNK 4  // itens reservados de cada vez: poucos, porque cada um pode ter centenas de pares
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;  // lote novo, lote terminado ou thread sem jobs
+static PoolBatch *queue_head = NULL;
+static PoolBatch *queue_tail = NULL;
+static size_t idle_threads = 0;  // threads que já chamaram pool_help
+
+// Reserva itens do lote mais antigo e tira-o da fila quando não sobra nenhum. Chamado com pool_lock
+static PoolBatch *claim(size_t *begin, size_t *end) {
+  PoolBatch *batch = queue_head;
+  if (batch == NULL) {
+    return NULL;
+  }
+
+  *begin = batch->next;
+  *end = batch->count - batch->next > POOL_CHUNK ? batch->next + POOL_CHUNK : batch->count;
+  batch->next = *end;
+  if (batch->next == batch->count) {
+    queue_head = batch->next_batch;
+    if (queue_head == NULL) {
+      queue_tail = NULL;
+    }
+  }
+  return batch;
+}
+
+// Corre os itens reservados sem o trinco. Chamado com pool_lock, que volta a ter no fim
+static void run_claimed(PoolBatch *batch, size_t begin, size_t end) {
+  profiled_mutex_unlock(&pool_lock);
+  for (size_t i = begin; i < end; i++) {
+    batch->run(batch->arg, i);
+  }
+  profiled_mutex_lock(&pool_lock, "pool_lock");
+
+  batch->finished += end - begin;
+  if (batch->finished == batch->count) {
+    pthread_cond_broadcast(&pool_cond);
+  }
+}
+
+void pool_run(PoolItemFn run, void *arg, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  PoolBatch batch = {run, arg, count, 0, 0, NULL};
+
+  profiled_mutex_lock(&pool_lock, "pool_lock");
+  if (queue_tail != NULL) {
+    queue_tail->next_batch = &batch;
+  } else {
+    queue_head = &batch;
+  }
+  queue_tail = &batch;
+  pthread_cond_broadcast(&pool_cond);
+
+  // Enquanto espera pelos seus itens, a thread também ajuda os lotes dos outros jobs
+  size_t begin, end;
+  while (batch.finished < batch.count) {
+    PoolBatch *claimed = claim(&begin, &end);
+    if (claimed != NULL) {
+      run_claimed(claimed, begin, end);
+    } else {
+      profiled_cond_wait(&pool_cond, &pool_lock);
+    }
+  }
+  profiled_mutex_unlock(&pool_lock);
+}
+
+void pool_help(size_t threads) {
+  profiled_mutex_lock(&pool_lock, "pool_lock");
+  idle_threads++;
+  pthread_cond_broadcast(&pool_cond);
+
+  size_t begin, end;
+  while (idle_threads < threads) {
+    PoolBatch *claimed = claim(&begin, &end);
+    if (claimed != NULL) {
+      run_claimed(claimed, begin, end);
+    } else {
+      profiled_cond_wait(&pool_cond, &pool_lock);
+    }
+  }
+  profiled_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,25 @@
+#ifndef KVS_JOBPOOL_H
+#define KVS_JOBPOOL_H
+
+#include <stddef.h>
+
+/// Runs one item of a batch.
+/// @param arg Argument given to pool_run.
+/// @param index Index of the item.
+typedef void (*PoolItemFn)(void *arg, size_t index);
+
+/// Runs every item of a batch. The calling thread runs items too, and the job
+/// threads that wait in pool_run or pool_help take the others. Items are
+/// claimed a few at a time, in order.
+/// @param run Function run for each item.
+/// @param arg Argument passed to run.
+/// @param count Number of items.
+void pool_run(PoolItemFn run, void *arg, size_t count);
+
+/// Makes a job thread that has no job left run items of other jobs until
+/// every one of the job threads has called this function, after which no
+/// batch can be submitted.
+/// @param threads Number of job threads.
+void pool_help(size_t threads);
+
+#endif  // KVS_JOBPOOL_H
@@ -0,0 +1,490 @@
+#include "jobprog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kvs.h"
+
+// Copia 'count' elementos de 'size' bytes para uma alocação nova
+static void *copy_array(const void *src, size_t count, size_t size) {
+  void *copy = malloc(count * size);
+  if (copy != NULL) {
+    memcpy(copy, src, count * size);
+  }
+  return copy;
+}
+
+enum Command job_op_parse(int fd, JobOp *op) {
+  memset(op, 0, sizeof(JobOp));
+  op->cmd = get_next(fd);
+
+  char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  KvsValue *values[MAX_WRITE_SIZE];
+  uint64_t versions[MAX_WRITE_SIZE];
+  int64_t deltas[MAX_WRITE_SIZE];
+  int has_values = 0;
+  size_t count;
+
+  switch (op->cmd) {
+    case CMD_WRITE:
+    case CMD_APPEND:
+      count = parse_write(fd, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      has_values = 1;
+      break;
+
+    case CMD_WRITE_TTL:
+      count = parse_write_ttl(fd, &op->arg, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      has_values = 1;
+      break;
+
+    case CMD_CAS:
+      count = parse_cas(fd, keys, versions, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      has_values = 1;
+      break;
+
+    case CMD_INCR:
+      count = parse_incr(fd, keys, deltas, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      break;
+
+    case CMD_READ:
+    case CMD_VERSION:
+    case CMD_DELETE:
+      count = parse_read_delete(fd, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      break;
+
+    case CMD_SCAN:
+      count = parse_scan(fd, keys, MAX_STRING_SIZE);
+      break;
+
+    case CMD_WAIT:
+      if (parse_wait(fd, &op->arg, NULL) == -1) {
+        op->cmd = CMD_INVALID;
+      }
+      return op->cmd;
+
+    case CMD_SHOW:
+    case CMD_BACKUP:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case EOC:
+      return op->cmd;
+  }
+
+  if (count == 0) {
+    op->cmd = CMD_INVALID;
+    return op->cmd;
+  }
+
+  op->count = count;
+  op->keys = copy_array(keys, count, sizeof(keys[0]));
+  int failed = op->keys == NULL;
+  if (has_values) {
+    op->values = copy_array(values, count, sizeof(KvsValue *));
+    failed |= op->values == NULL;
+  }
+  if (op->cmd == CMD_CAS) {
+    op->versions = copy_array(versions, count, sizeof(uint64_t));
+    failed |= op->versions == NULL;
+  }
+  if (op->cmd == CMD_INCR) {
+    op->deltas = copy_array(deltas, count, sizeof(int64_t));
+    failed |= op->deltas == NULL;
+  }
+
+  if (failed) {
+    fprintf(stderr, "Failed to allocate job command\n");
+    if (op->values == NULL) {
+      for (size_t i = 0; has_values && i < count; i++) {
+        value_unref(values[i]);
+      }
+    }
+    job_op_clear(op);
+    op->cmd = CMD_INVALID;
+  }
+  return op->cmd;
+}
+
+void job_op_clear(JobOp *op) {
+  if (op->values != NULL) {
+    for (size_t i = 0; i < op->count; i++) {
+      value_unref(op->values[i]);
+    }
+  }
+  free(op->keys);
+  free(op->values);
+  free(op->versions);
+  free(op->deltas);
+  free(op->splits);
+  memset(op, 0, sizeof(JobOp));
+}
+
+int job_program_add(JobProgram *program, JobOp *op) {
+  if (program->count == program->capacity) {
+    size_t capacity = program->capacity == 0 ? 64 : program->capacity * 2;
+    JobOp *ops = realloc(program->ops, capacity * sizeof(JobOp));
+    if (ops == NULL) {
+      job_op_clear(op);
+      return 1;
+    }
+    program->ops = ops;
+    program->capacity = capacity;
+  }
+  program->ops[program->count++] = *op;
+  return 0;
+}
+
+int job_program_load(int fd, JobProgram *program, uint64_t commands[EOC]) {
+  program->ops = NULL;
+  program->count = 0;
+  program->capacity = 0;
+
+  JobOp op;
+  enum Command cmd;
+  while ((cmd = job_op_parse(fd, &op)) != EOC) {
+    commands[cmd]++;
+    if (cmd == CMD_EMPTY) {
+      continue;
+    }
+
+    if (job_program_add(program, &op) != 0) {
+      job_program_free(program);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Conjunto de chaves com endereçamento aberto, com dois números por chave para quem o usa.
+// Esvaziá-lo só muda a geração, por isso os esvaziamentos a cada barreira não custam uma passagem
+// pela tabela
+typedef struct {
+  char key[MAX_STRING_SIZE];
+  size_t data[2];           // a zeros quando a chave entra no conjunto
+  unsigned int generation;  // a chave só pertence ao conjunto se for a geração atual
+  int used;
+} KeySlot;
+
+typedef struct {
+  KeySlot *slots;
+  size_t capacity;  // potência de 2
+  size_t used;
+  unsigned int generation;
+} KeySet;
+
+static size_t key_hash(const char *key) {
+  size_t hash = 14695981039346656037u;  // FNV-1a
+  for (; *key != '\0'; key++) {
+    hash = (hash ^ (unsigned char)*key) * 1099511628211u;
+  }
+  return hash;
+}
+
+static KeySlot *keyset_find(KeySet *set, const char *key) {
+  size_t mask = set->capacity - 1;
+  for (size_t i = key_hash(key) & mask;; i = (i + 1) & mask) {
+    if (!set->slots[i].used || strcmp(set->slots[i].key, key) == 0) {
+      return &set->slots[i];
+    }
+  }
+}
+
+static int keyset_init(KeySet *set) {
+  set->capacity = 64;
+  set->used = 0;
+  set->generation = 1;
+  set->slots = calloc(set->capacity, sizeof(KeySlot));
+  return set->slots == NULL;
+}
+
+// Muda a tabela para o dobro do tamanho, ficando só com as chaves da geração atual
+static int keyset_grow(KeySet *set) {
+  KeySet grown = {calloc(set->capacity * 2, sizeof(KeySlot)), set->capacity * 2, 0, set->generation};
+  if (grown.slots == NULL) {
+    return 1;
+  }
+  for (size_t i = 0; i < set->capacity; i++) {
+    if (set->slots[i].used && set->slots[i].generation == set->generation) {
+      *keyset_find(&grown, set->slots[i].key) = set->slots[i];
+      grown.used++;
+    }
+  }
+  free(set->slots);
+  *set = grown;
+  return 0;
+}
+
+// Devolve a entrada de uma chave, NULL se não estiver no conjunto
+static KeySlot *keyset_get(KeySet *set, const char *key) {
+  KeySlot *slot = keyset_find(set, key);
+  return slot->used && slot->generation == set->generation ? slot : NULL;
+}
+
+// Devolve a entrada de uma chave, pondo-a no conjunto se ainda não estiver; NULL se faltar memória
+static KeySlot *keyset_add(KeySet *set, const char *key) {
+  if ((set->used + 1) * 4 > set->capacity * 3 && keyset_grow(set) != 0) {
+    return NULL;
+  }
+  KeySlot *slot = keyset_find(set, key);
+  if (!slot->used) {
+    strcpy(slot->key, key);
+    slot->used = 1;
+    set->used++;
+  }
+  if (slot->generation != set->generation) {
+    slot->data[0] = 0;
+    slot->data[1] = 0;
+    slot->generation = set->generation;
+  }
+  return slot;
+}
+
+static void keyset_remove(KeySet *set, const char *key) {
+  KeySlot *slot = keyset_find(set, key);
+  if (slot->used) {
+    slot->generation = 0;
+  }
+}
+
+static void keyset_clear(KeySet *set) { set->generation++; }
+
+// Tira de um WRITE os pares sem valor, mantendo a ordem dos restantes
+static void drop_pairs(JobOp *op) {
+  size_t kept = 0;
+  for (size_t i = 0; i < op->count; i++) {
+    if (op->values[i] == NULL) {
+      continue;
+    }
+    if (kept != i) {
+      memcpy(op->keys[kept], op->keys[i], MAX_STRING_SIZE);
+      op->values[kept] = op->values[i];
+    }
+    kept++;
+  }
+  op->count = kept;
+  if (kept == 0) {
+    job_op_clear(op);
+    op->cmd = CMD_EMPTY;
+  }
+}
+
+// Percorre o job de trás para a frente com o conjunto das chaves que vão ser reescritas antes de
+// alguém as ver, cada uma com o WRITE e o par da reescrita. Quando um par de um WRITE é reescrito
+// assim, fica com o valor da reescrita e é esta que desaparece: a chave continua a ser criada no
+// mesmo ponto, e o SHOW lista-a na mesma posição da tabela
+static void drop_dead_writes(JobProgram *program) {
+  KeySet shadowed;
+  if (keyset_init(&shadowed) != 0) {
+    return;
+  }
+
+  int dropped = 0;
+  for (size_t n = program->count; n > 0; n--) {
+    JobOp *op = &program->ops[n - 1];
+    switch (op->cmd) {
+      case CMD_WRITE:
+        for (size_t i = op->count; i > 0; i--) {
+          KeySlot *later = keyset_get(&shadowed, op->keys[i - 1]);
+          if (later != NULL) {
+            JobOp *rewrite = &program->ops[later->data[0]];
+            value_unref(op->values[i - 1]);
+            op->values[i - 1] = rewrite->values[later->data[1]];
+            rewrite->values[later->data[1]] = NULL;
+            dropped = 1;
+          }
+          KeySlot *slot = keyset_add(&shadowed, op->keys[i - 1]);
+          if (slot == NULL) {
+            dropped = 1;
+            n = 1;  // sem memória fica-se pelo que já foi feito
+            break;
+          }
+          slot->data[0] = n - 1;
+          slot->data[1] = i - 1;
+        }
+        break;
+
+      // Comandos que leem (ou escrevem de outra forma) só as suas chaves
+      case CMD_READ:
+      case CMD_DELETE:
+      case CMD_WRITE_TTL:
+      case CMD_INCR:
+      case CMD_APPEND:
+        for (size_t i = 0; i < op->count; i++) {
+          keyset_remove(&shadowed, op->keys[i]);
+        }
+        break;
+
+      case CMD_HELP:
+      case CMD_EMPTY:
+      case CMD_INVALID:
+        break;
+
+      case CMD_CAS:
+      case CMD_VERSION:
+      case CMD_SHOW:
+      case CMD_SCAN:
+      case CMD_WAIT:
+      case CMD_BACKUP:
+      case EOC:
+        keyset_clear(&shadowed);
+        break;
+    }
+  }
+  free(shadowed.slots);
+
+  for (size_t n = 0; dropped && n < program->count; n++) {
+    if (program->ops[n].cmd == CMD_WRITE) {
+      drop_pairs(&program->ops[n]);
+    }
+  }
+}
+
+// Junta as chaves (e os valores, se existirem) de 'from' ao fim de 'into'
+static int append_op(JobOp *into, JobOp *from) {
+  size_t count = into->count + from->count;
+  char(*keys)[MAX_STRING_SIZE] = realloc(into->keys, count * sizeof(*keys));
+  if (keys == NULL) {
+    return 1;
+  }
+  into->keys = keys;
+  if (into->values != NULL) {
+    KvsValue **values = realloc(into->values, count * sizeof(KvsValue *));
+    if (values == NULL) {
+      return 1;
+    }
+    into->values = values;
+    memcpy(values + into->count, from->values, from->count * sizeof(KvsValue *));
+    free(from->values);
+    from->values = NULL;  // os valores passaram para 'into'
+  }
+  memcpy(keys + into->count, from->keys, from->count * sizeof(*keys));
+  into->count = count;
+  job_op_clear(from);
+  return 0;
+}
+
+// Junta um READ ao anterior, guardando quantas chaves tinha cada um para o resultado sair em linhas
+// separadas como antes
+static int merge_reads(JobOp *into, JobOp *from) {
+  size_t *splits = realloc(into->splits, (into->split_count + 2) * sizeof(size_t));
+  if (splits == NULL) {
+    return 1;
+  }
+  into->splits = splits;
+  if (into->split_count == 0) {
+    splits[into->split_count++] = into->count;
+  }
+  size_t count = from->count;
+  if (append_op(into, from) != 0) {
+    return 1;
+  }
+  splits[into->split_count++] = count;
+  return 0;
+}
+
+int job_program_prints_versions(const JobProgram *program) {
+  for (size_t i = 0; i < program->count; i++) {
+    if (program->ops[i].cmd == CMD_VERSION || program->ops[i].cmd == CMD_CAS) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+size_t job_program_optimize(JobProgram *program) {
+  size_t before = program->count;
+  if (!job_program_prints_versions(program)) {
+    drop_dead_writes(program);
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < program->count; i++) {
+    JobOp *op = &program->ops[i];
+    if (op->cmd == CMD_EMPTY) {
+      continue;
+    }
+
+    JobOp *last = kept > 0 ? &program->ops[kept - 1] : NULL;
+    if (last != NULL && last->cmd == op->cmd && op->cmd == CMD_WRITE && append_op(last, op) == 0) {
+      continue;
+    }
+    if (last != NULL && last->cmd == op->cmd && op->cmd == CMD_READ && merge_reads(last, op) == 0) {
+      continue;
+    }
+    program->ops[kept++] = *op;
+  }
+  program->count = kept;
+  return before - kept;
+}
+
+int job_op_is_barrier(enum Command cmd) {
+  return cmd == CMD_SHOW || cmd == CMD_SCAN || cmd == CMD_WAIT || cmd == CMD_BACKUP || cmd == CMD_CAS ||
+         cmd == CMD_VERSION;
+}
+
+size_t job_program_levels(const JobProgram *program, size_t begin, size_t end, size_t levels[]) {
+  KeySet touched;
+  if (keyset_init(&touched) != 0) {
+    return SIZE_MAX;
+  }
+
+  // Cada chave guarda o nível da última escrita (data[0]) e o da última leitura (data[1]).
+  // Uma leitura vem depois da última escrita; uma escrita vem depois dessa e de todas as leituras.
+  // As escritas também ficam por ordem dentro de cada lista da tabela: uma chave nova entra no
+  // início da lista, e o SHOW e os backups percorrem-na por essa ordem
+  size_t bucket_levels[TABLE_SIZE] = {0};
+  size_t top = 0;
+  for (size_t n = begin; n < end; n++) {
+    const JobOp *op = &program->ops[n];
+    int reads = op->cmd == CMD_READ;
+    size_t level = 0;
+    if (op->keys != NULL && !job_op_is_barrier(op->cmd)) {
+      for (size_t i = 0; i < op->count; i++) {
+        KeySlot *slot = keyset_get(&touched, op->keys[i]);
+        int bucket = hash(op->keys[i]);
+        if (slot != NULL && slot->data[0] > level) {
+          level = slot->data[0];
+        }
+        if (slot != NULL && !reads && slot->data[1] > level) {
+          level = slot->data[1];
+        }
+        if (!reads && bucket >= 0 && bucket_levels[bucket] > level) {
+          level = bucket_levels[bucket];
+        }
+      }
+      level++;
+
+      for (size_t i = 0; i < op->count; i++) {
+        KeySlot *slot = keyset_add(&touched, op->keys[i]);
+        int bucket = hash(op->keys[i]);
+        if (slot == NULL) {
+          free(touched.slots);
+          return SIZE_MAX;
+        }
+        if (reads) {
+          slot->data[1] = slot->data[1] > level ? slot->data[1] : level;
+          continue;
+        }
+        slot->data[0] = level;
+        if (bucket >= 0) {
+          bucket_levels[bucket] = level;
+        }
+      }
+    }
+    levels[n - begin] = level;
+    top = level > top ? level : top;
+  }
+  free(touched.slots);
+  return top;
+}
+
+void job_program_free(JobProgram *program) {
+  for (size_t i = 0; i < program->count; i++) {
+    job_op_clear(&program->ops[i]);
+  }
+  free(program->ops);
+  program->ops = NULL;
+  program->count = 0;
+  program->capacity = 0;
+}
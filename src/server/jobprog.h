@@ -0,0 +1,98 @@
+#ifndef KVS_JOBPROG_H
+#define KVS_JOBPROG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "parser.h"
+#include "value.h"
+
+/// A command of a job, parsed ahead of its execution. Only the arrays the
+/// command uses are allocated; the others are NULL.
+typedef struct {
+  enum Command cmd;
+  size_t count;                   // pairs or keys of the command
+  char (*keys)[MAX_STRING_SIZE];  // every command with a list, SCAN included
+  KvsValue **values;              // WRITE, WRITE_TTL, CAS, APPEND: one reference each
+  uint64_t *versions;             // CAS: expected versions
+  int64_t *deltas;                // INCR
+  unsigned int arg;               // time to live of a WRITE_TTL, delay of a WAIT
+  size_t *splits;                 // READ: keys of each READ merged into it, NULL if none was
+  size_t split_count;
+} JobOp;
+
+/// The commands of a whole job, in order.
+typedef struct {
+  JobOp *ops;
+  size_t count;
+  size_t capacity;
+} JobProgram;
+
+/// Parses the next command of a job. A command that fails to parse is
+/// returned as CMD_INVALID, with nothing allocated.
+/// @param fd File descriptor of the job.
+/// @param op Set to the command, to be released with job_op_clear.
+/// @return The type of the command, EOC at the end of the job.
+enum Command job_op_parse(int fd, JobOp *op);
+
+/// Releases the arrays and values of a command.
+/// @param op Command to clear.
+void job_op_clear(JobOp *op);
+
+/// Adds a command at the end of a job.
+/// @param program Job, which may start empty (all fields 0).
+/// @param op Command, which now belongs to the job; cleared if memory ran out.
+/// @return 0 on success, 1 if memory ran out.
+int job_program_add(JobProgram *program, JobOp *op);
+
+/// Parses every command of a job. Empty lines and comments are left out.
+/// @param fd File descriptor of the job.
+/// @param program Set to the commands, to be released with job_program_free.
+/// @param commands Counters incremented with the type of each command.
+/// @return 0 on success, 1 if memory ran out.
+int job_program_load(int fd, JobProgram *program, uint64_t commands[EOC]);
+
+/// Tells whether a job prints versions (VERSION, CAS). Those depend on the
+/// order of every write of the job, not only of the writes to the same key.
+/// @param program Job to check.
+/// @return 1 if it does, 0 otherwise.
+int job_program_prints_versions(const JobProgram *program);
+
+/// Rewrites a job into fewer commands with the same output:
+/// - writes overwritten before any command could observe them are dropped;
+/// - consecutive WRITEs become a single WRITE;
+/// - consecutive READs are read together, each still printing its own line.
+/// A key is observed by a READ or DELETE of that key and by every SHOW, SCAN,
+/// BACKUP or WAIT (while a job waits, clients can read). Writes are never
+/// dropped from jobs that print versions (VERSION, CAS), since the versions of
+/// later writes would change.
+/// @param program Job to rewrite.
+/// @return Number of commands merged into others or dropped.
+size_t job_program_optimize(JobProgram *program);
+
+/// Tells whether a command must run alone, after every previous command of
+/// the job and before every following one: SHOW, SCAN, BACKUP and WAIT, which
+/// see the whole table, and VERSION and CAS.
+/// @param cmd Type of the command.
+/// @return 1 if it must, 0 otherwise.
+int job_op_is_barrier(enum Command cmd);
+
+/// Groups commands without barriers between them into levels. Commands of the
+/// same level touch different keys, or only read the keys they share, and
+/// never write to the same list of the table, so they can run in any order
+/// once every command of the lower levels has run and still leave the table
+/// as running them in order would.
+/// Commands that touch no key (HELP, invalid ones) get level 0.
+/// @param program Job.
+/// @param begin First command.
+/// @param end One past the last command.
+/// @param levels Set to the level of each command, from levels[0] for begin.
+/// @return The highest level, SIZE_MAX if memory ran out.
+size_t job_program_levels(const JobProgram *program, size_t begin, size_t end, size_t levels[]);
+
+/// Releases the commands of a job.
+/// @param program Job to release.
+void job_program_free(JobProgram *program);
+
+#endif  // KVS_JOBPROG_H
@@ -0,0 +1,170 @@
+#include "jobsched.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lockprof.h"
+#include "stats.h"
+
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_cond = PTHREAD_COND_INITIALIZER;  // job suspenso, adiado ou terminado
+static SchedEntry **suspended = NULL;  // heap dos jobs suspensos, com o prazo mais próximo à cabeça
+static size_t suspended_count = 0;
+static size_t max_jobs_in_progress = 0;  // tamanho do heap: só os jobs em curso podem estar suspensos
+static size_t jobs_in_progress = 0;      // jobs a correr, suspensos ou adiados
+static int jobs_left = 1;                // 0 quando o diretório já não tem jobs
+static uint64_t next_order = 0;
+static SchedEntry *deferred = NULL;  // jobs à espera de descritores, do mais antigo para o mais recente
+static SchedEntry *deferred_last = NULL;
+static uint64_t jobs_finished = 0;   // jobs terminados até agora
+static uint64_t deferred_mark = 0;   // jobs_finished quando foi adiado o último job
+static uint64_t deferred_retry = 0;  // stats_now() a partir do qual os adiados tentam de novo
+
+int sched_init(size_t max_jobs) {
+  suspended = malloc(max_jobs * sizeof(SchedEntry *));
+  if (suspended == NULL) {
+    return 1;
+  }
+  max_jobs_in_progress = max_jobs;
+  return 0;
+}
+
+void sched_destroy(void) {
+  free(suspended);
+  suspended = NULL;
+}
+
+static int entry_before(const SchedEntry *a, const SchedEntry *b) {
+  return a->deadline < b->deadline || (a->deadline == b->deadline && a->order < b->order);
+}
+
+static void heap_push(SchedEntry *entry) {
+  size_t i = suspended_count++;
+  while (i > 0 && entry_before(entry, suspended[(i - 1) / 2])) {
+    suspended[i] = suspended[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  suspended[i] = entry;
+}
+
+static SchedEntry *heap_pop(void) {
+  SchedEntry *top = suspended[0];
+  SchedEntry *last = suspended[--suspended_count];
+  size_t i = 0;
+  while (2 * i + 1 < suspended_count) {
+    size_t child = 2 * i + 1;
+    if (child + 1 < suspended_count && entry_before(suspended[child + 1], suspended[child])) {
+      child++;
+    }
+    if (!entry_before(suspended[child], last)) {
+      break;
+    }
+    suspended[i] = suspended[child];
+    i = child;
+  }
+  suspended[i] = last;
+  return top;
+}
+
+void sched_job_finished(void) {
+  profiled_mutex_lock(&sched_lock, "sched_lock");
+  jobs_in_progress--;
+  jobs_finished++;
+  pthread_cond_broadcast(&sched_cond);
+  profiled_mutex_unlock(&sched_lock);
+}
+
+void sched_no_more_jobs(void) {
+  profiled_mutex_lock(&sched_lock, "sched_lock");
+  jobs_left = 0;
+  jobs_in_progress--;
+  pthread_cond_broadcast(&sched_cond);
+  profiled_mutex_unlock(&sched_lock);
+}
+
+void sched_suspend(SchedEntry *entry, uint64_t deadline) {
+  entry->deadline = deadline;
+
+  profiled_mutex_lock(&sched_lock, "sched_lock");
+  entry->order = next_order++;
+  heap_push(entry);
+  pthread_cond_broadcast(&sched_cond);
+  profiled_mutex_unlock(&sched_lock);
+}
+
+void sched_defer(SchedEntry *entry) {
+  entry->next = NULL;
+
+  profiled_mutex_lock(&sched_lock, "sched_lock");
+  if (deferred == NULL) {
+    deferred = entry;
+  } else {
+    deferred_last->next = entry;
+  }
+  deferred_last = entry;
+  // Os descritores faltaram agora, por isso só um fim de job ou a espera justificam outra tentativa
+  deferred_mark = jobs_finished;
+  deferred_retry = stats_now() + SCHED_RETRY_NS;
+  profiled_mutex_unlock(&sched_lock);
+}
+
+// Espera até ao prazo 'deadline' do relógio monotónico ou até ser acordada. A condição usa o
+// relógio de tempo real, por isso o prazo é convertido a partir do tempo que falta
+static void wait_until(uint64_t deadline) {
+  uint64_t now = stats_now();
+  uint64_t left = deadline > now ? deadline - now : 0;
+
+  struct timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  uint64_t nsec = (uint64_t)until.tv_nsec + left % 1000000000u;
+  until.tv_sec += (time_t)(left / 1000000000u + nsec / 1000000000u);
+  until.tv_nsec = (long)(nsec % 1000000000u);
+  profiled_cond_timedwait(&sched_cond, &sched_lock, &until);
+}
+
+enum SchedAction sched_next(SchedEntry **entry) {
+  profiled_mutex_lock(&sched_lock, "sched_lock");
+  enum SchedAction action;
+  while (1) {
+    uint64_t now = stats_now();
+    if (suspended_count > 0 && suspended[0]->deadline <= now) {
+      *entry = heap_pop();
+      action = SCHED_RESUME;
+      break;
+    }
+    if (deferred != NULL && (jobs_finished != deferred_mark || now >= deferred_retry)) {
+      *entry = deferred;
+      deferred = deferred->next;
+      action = SCHED_RETRY;
+      break;
+    }
+    // Os jobs que já estão em curso passam à frente dos do diretório
+    if (jobs_left && deferred == NULL && jobs_in_progress < max_jobs_in_progress) {
+      jobs_in_progress++;
+      action = SCHED_START;
+      break;
+    }
+    // Sem jobs em curso, nenhum pode voltar a ser suspenso
+    if (!jobs_left && jobs_in_progress == 0) {
+      action = SCHED_DONE;
+      break;
+    }
+
+    uint64_t wake = UINT64_MAX;
+    if (suspended_count > 0) {
+      wake = suspended[0]->deadline;
+    }
+    if (deferred != NULL && deferred_retry < wake) {
+      wake = deferred_retry;
+    }
+    if (wake == UINT64_MAX) {
+      profiled_cond_wait(&sched_cond, &sched_lock);
+    } else {
+      wait_until(wake);
+    }
+  }
+  profiled_mutex_unlock(&sched_lock);
+  return action;
+}
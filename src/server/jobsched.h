@@ -0,0 +1,61 @@
+#ifndef KVS_JOBSCHED_H
+#define KVS_JOBSCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// How long a job that could not open its files waits before trying again,
+/// if no other job finishes first.
+#define SCHED_RETRY_NS (100 * 1000000u)
+
+/// A job suspended by a WAIT or waiting to open its files, embedded in the
+/// job it belongs to.
+typedef struct SchedEntry {
+  struct SchedEntry *next;  // next job waiting to open its files
+  uint64_t deadline;        // stats_now() at which the job can run again
+  uint64_t order;           // breaks ties between equal deadlines
+} SchedEntry;
+
+/// What a job thread should do next.
+enum SchedAction {
+  SCHED_RESUME,  // run the suspended job whose deadline has passed
+  SCHED_RETRY,   // try again to open the files of a deferred job
+  SCHED_START,   // start the next job of the directory
+  SCHED_DONE,    // every job has finished
+};
+
+/// Sets the number of jobs that can be in progress (running, suspended or
+/// deferred) at once.
+/// @param max_jobs The limit, at least 1.
+/// @return 0 on success, 1 if memory ran out.
+int sched_init(size_t max_jobs);
+
+/// Waits until a job thread has something to do. A SCHED_START reserves a
+/// place for the new job, which is then counted as in progress.
+/// @param entry Set to the job to run on SCHED_RESUME and SCHED_RETRY.
+/// @return The action to take.
+enum SchedAction sched_next(SchedEntry **entry);
+
+/// Gives back the place reserved by a SCHED_START when the directory has no
+/// job left. No SCHED_START is returned from then on.
+void sched_no_more_jobs(void);
+
+/// Counts a job that has finished (or was dropped), freeing its place.
+void sched_job_finished(void);
+
+/// Suspends a job until a deadline. Jobs with the same deadline are woken up
+/// in the order they were suspended.
+/// @param entry Entry of the job, which must not be suspended already.
+/// @param deadline stats_now() at which the job can run again.
+void sched_suspend(SchedEntry *entry, uint64_t deadline);
+
+/// Defers a job that could not open its files because the process is out of
+/// file descriptors. It is handed out again with SCHED_RETRY once another job
+/// finishes, or after SCHED_RETRY_NS.
+/// @param entry Entry of the job, which keeps its place.
+void sched_defer(SchedEntry *entry);
+
+/// Frees the scheduler, once the job threads have stopped.
+void sched_destroy(void);
+
+#endif  // KVS_JOBSCHED_H
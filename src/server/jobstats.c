@@ -0,0 +1,155 @@
+#include "jobstats.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "stats.h"
+
+#define JOBSTATS_SLOWEST 10  // jobs mais lentos listados no resumo
+
+static const char* const command_names[EOC] = {"write", "write_ttl", "cas",    "incr", "append", "read",   "version",
+                                               "delete", "show",     "scan",   "wait", "backup", "help", "empty",
+                                               "invalid"};
+static const char* const time_names[JOB_TIME_COUNT] = {"parse", "table", "output", "backup_wait", "backup", "sleep"};
+
+typedef struct {
+  char name[MAX_JOB_FILE_NAME_SIZE];
+  JobStats stats;
+} SlowJob;
+
+// Resumo dos jobs terminados. Só é tocado no fim de cada job e nos dumps, por isso um trinco
+// simples chega
+static pthread_mutex_t summary_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long jobs_finished = 0;
+static JobStats totals;
+static SlowJob slowest[JOBSTATS_SLOWEST];  // ordenados do mais lento para o mais rápido
+static size_t slowest_count = 0;
+
+uint64_t jobstats_start(JobStats* stats) {
+  memset(stats, 0, sizeof(JobStats));
+  stats->started = stats_now();
+  return stats->started;
+}
+
+uint64_t jobstats_lap(JobStats* stats, enum JobTime phase, uint64_t since) {
+  uint64_t now = stats_now();
+  stats->time[phase] += now - since;
+  return now;
+}
+
+// Escreve os contadores no formato "<nome> <valor>" usado no sidecar e no resumo
+static void print_counters(FILE* file, const JobStats* stats) {
+  fprintf(file, "total_ns %" PRIu64 "\n", stats->total);
+  for (int phase = 0; phase < JOB_TIME_COUNT; phase++) {
+    fprintf(file, "%s_ns %" PRIu64 "\n", time_names[phase], stats->time[phase]);
+  }
+  for (int cmd = 0; cmd < EOC; cmd++) {
+    if (cmd != CMD_EMPTY) {
+      fprintf(file, "cmd_%s %" PRIu64 "\n", command_names[cmd], stats->commands[cmd]);
+    }
+  }
+  fprintf(file, "pairs_written %" PRIu64 "\n", stats->pairs_written);
+  fprintf(file, "pairs_read %" PRIu64 "\n", stats->pairs_read);
+  fprintf(file, "pairs_deleted %" PRIu64 "\n", stats->pairs_deleted);
+  fprintf(file, "commands_folded %" PRIu64 "\n", stats->commands_folded);
+}
+
+// Soma um job ao resumo e mantém-no na lista dos mais lentos se for o caso
+static void add_to_summary(const JobStats* stats, const char* job_name) {
+  pthread_mutex_lock(&summary_lock);
+  jobs_finished++;
+  totals.total += stats->total;
+  for (int phase = 0; phase < JOB_TIME_COUNT; phase++) {
+    totals.time[phase] += stats->time[phase];
+  }
+  for (int cmd = 0; cmd < EOC; cmd++) {
+    totals.commands[cmd] += stats->commands[cmd];
+  }
+  totals.pairs_written += stats->pairs_written;
+  totals.pairs_read += stats->pairs_read;
+  totals.pairs_deleted += stats->pairs_deleted;
+  totals.commands_folded += stats->commands_folded;
+
+  size_t pos = slowest_count;
+  while (pos > 0 && slowest[pos - 1].stats.total < stats->total) {
+    pos--;
+  }
+  if (pos < JOBSTATS_SLOWEST) {
+    size_t last = slowest_count < JOBSTATS_SLOWEST ? slowest_count : JOBSTATS_SLOWEST - 1;
+    memmove(&slowest[pos + 1], &slowest[pos], (last - pos) * sizeof(SlowJob));
+    snprintf(slowest[pos].name, sizeof(slowest[pos].name), "%s", job_name);
+    slowest[pos].stats = *stats;
+    if (slowest_count < JOBSTATS_SLOWEST) {
+      slowest_count++;
+    }
+  }
+  pthread_mutex_unlock(&summary_lock);
+}
+
+int jobstats_finish(JobStats* stats, const char* job_name, const char* path) {
+  stats->total = stats_now() - stats->started;
+  add_to_summary(stats, job_name);
+
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    perror("Failed to open job stats file");
+    return 1;
+  }
+
+  fprintf(file, "job %s\n", job_name);
+  print_counters(file, stats);
+  if (fclose(file) != 0) {
+    perror("Failed to write job stats file");
+    return 1;
+  }
+  return 0;
+}
+
+int jobstats_dump(const char* path) {
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+    fprintf(stderr, "Job stats path too long: %s\n", path);
+    return 1;
+  }
+
+  FILE* file = fopen(tmp_path, "w");
+  if (file == NULL) {
+    perror("Failed to open job stats file");
+    return 1;
+  }
+
+  pthread_mutex_lock(&summary_lock);
+  fprintf(file, "jobs %lu\n", jobs_finished);
+  print_counters(file, &totals);
+
+  fprintf(file, "# slow job total_ns");
+  for (int phase = 0; phase < JOB_TIME_COUNT; phase++) {
+    fprintf(file, " %s_ns", time_names[phase]);
+  }
+  fprintf(file, " commands\n");
+  for (size_t i = 0; i < slowest_count; i++) {
+    const JobStats* stats = &slowest[i].stats;
+    uint64_t commands = 0;
+    for (int cmd = 0; cmd < EOC; cmd++) {
+      commands += cmd == CMD_EMPTY ? 0 : stats->commands[cmd];
+    }
+    fprintf(file, "slow %s %" PRIu64, slowest[i].name, stats->total);
+    for (int phase = 0; phase < JOB_TIME_COUNT; phase++) {
+      fprintf(file, " %" PRIu64, stats->time[phase]);
+    }
+    fprintf(file, " %" PRIu64 "\n", commands);
+  }
+  pthread_mutex_unlock(&summary_lock);
+
+  if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+    perror("Failed to write job stats file");
+    unlink(tmp_path);
+    return 1;
+  }
+  return 0;
+}
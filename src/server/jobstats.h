@@ -0,0 +1,59 @@
+#ifndef KVS_JOBSTATS_H
+#define KVS_JOBSTATS_H
+
+#include <stdint.h>
+
+#include "parser.h"
+
+/// Phases the time of a job is split into.
+enum JobTime {
+  JOB_PARSE,        // reading and parsing commands
+  JOB_TABLE,        // WRITE, READ and DELETE on the table, including the wait for its lock
+  JOB_OUTPUT,       // writing results to the .out file (SHOW too, as it writes while reading)
+  JOB_BACKUP_WAIT,  // waiting for a backup slot to be free
+  JOB_BACKUP,       // starting a backup (locking the table and forking)
+  JOB_SLEEP,        // WAIT commands
+  JOB_TIME_COUNT,
+};
+
+/// Counters of a single job. Only the thread running the job touches them.
+typedef struct {
+  uint64_t commands[EOC];  // by type; commands that fail to parse count as CMD_INVALID
+  uint64_t pairs_written;
+  uint64_t pairs_read;
+  uint64_t pairs_deleted;
+  uint64_t commands_folded;  // merged into others or dropped by job_program_optimize (-O)
+  uint64_t time[JOB_TIME_COUNT];  // nanoseconds spent in each phase
+  uint64_t started;
+  uint64_t total;  // nanoseconds from jobstats_start to jobstats_finish
+} JobStats;
+
+/// Resets the counters of a job about to run.
+/// @param stats Counters of the job.
+/// @return The current time, to be passed to the first jobstats_lap.
+uint64_t jobstats_start(JobStats* stats);
+
+/// Adds the time elapsed since the previous lap to a phase. Laps are chained,
+/// so every nanosecond of the job lands in exactly one phase.
+/// @param stats Counters of the job.
+/// @param phase Phase the elapsed time belongs to.
+/// @param since Value returned by the previous lap (or jobstats_start).
+/// @return The current time.
+uint64_t jobstats_lap(JobStats* stats, enum JobTime phase, uint64_t since);
+
+/// Ends a job: writes its counters to a sidecar file and adds them to the
+/// server-wide summary.
+/// @param stats Counters of the job.
+/// @param job_name Name of the job file.
+/// @param path Path of the sidecar file.
+/// @return 0 if the sidecar was written, 1 otherwise.
+int jobstats_finish(JobStats* stats, const char* job_name, const char* path);
+
+/// Writes the summary of every job finished so far: the number of jobs, the
+/// sum of their counters and the slowest jobs with their time per phase. The
+/// file is replaced atomically.
+/// @param path Path of the file to write.
+/// @return 0 if the file was written, 1 otherwise.
+int jobstats_dump(const char* path);
+
+#endif  // KVS_JOBSTATS_H
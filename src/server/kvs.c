@@ -1,10 +1,14 @@
 #include "kvs.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "stats.h"
 #include "string.h"
 // Hash function based on key initial.
 // @param key Lowercase alphabetical string.
@@ -20,6 +24,86 @@ int hash(const char *key) {
   return -1;  // Invalid index for non-alphabetic or number strings
 }
 
+static int write_notification(int notif_fd, const void *buffer, size_t size) {
+  return write(notif_fd, buffer, size) == -1;
+}
+
+static NotificationSink notification_sink = write_notification;
+
+void set_notification_sink(NotificationSink sink) { notification_sink = sink; }
+
+// Tick da roda de expiração em que cai um instante, arredondado para cima: um timer nunca dispara
+// antes do prazo da chave
+static uint64_t expiry_tick(uint64_t ns) {
+  const uint64_t tick_ns = (uint64_t)EXPIRY_TICK_MS * 1000000u;
+  return (ns + tick_ns - 1) / tick_ns;
+}
+
+// Tick atual da roda de expiração
+static uint64_t current_tick(void) { return stats_now() / ((uint64_t)EXPIRY_TICK_MS * 1000000u); }
+
+// Publica o número de timers para a thread de expiração, que o lê sem o trinco
+static void sync_expiring(HashTable *ht) {
+  atomic_store_explicit(&ht->expiring, ht->expiry.count, memory_order_relaxed);
+}
+
+// Arma, move ou desarma o timer de uma chave
+static void set_expiry(HashTable *ht, KeyNode *keyNode, unsigned int ttl_ms) {
+  if (ttl_ms == 0) {
+    keyNode->expires_ns = 0;
+    timer_wheel_remove(&ht->expiry, &keyNode->expiry);
+  } else {
+    uint64_t now = stats_now();
+    keyNode->expires_ns = now + (uint64_t)ttl_ms * 1000000u;
+    // A roda é posta em dia antes de inserir, para a distância ao disparo ser medida a partir de agora
+    timer_wheel_advance(&ht->expiry, current_tick());
+    timer_wheel_add(&ht->expiry, &keyNode->expiry, expiry_tick(keyNode->expires_ns));
+  }
+  sync_expiring(ht);
+}
+
+// Bytes que um par conta para o limite de memória: nó, chave e valor
+static size_t pair_charge(const KeyNode *keyNode) {
+  return sizeof(KeyNode) + strlen(keyNode->key) + 1 + value_size(keyNode->value);
+}
+
+// Acerta a memória usada quando um par muda de tamanho
+static void recharge(HashTable *ht, KeyNode *keyNode) {
+  size_t charge = pair_charge(keyNode);
+  atomic_fetch_add_explicit(&ht->memory_used, charge, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&ht->memory_used, keyNode->charge, memory_order_relaxed);
+  keyNode->charge = charge;
+}
+
+// Põe um par novo no anel do CLOCK imediatamente atrás do ponteiro, para ser o último a ser visto
+static void clock_insert(HashTable *ht, KeyNode *keyNode) {
+  KeyNode *hand = ht->clock_hand;
+  if (hand == NULL) {
+    keyNode->clock_next = keyNode;
+    keyNode->clock_prev = keyNode;
+    ht->clock_hand = keyNode;
+    return;
+  }
+  keyNode->clock_next = hand;
+  keyNode->clock_prev = hand->clock_prev;
+  hand->clock_prev->clock_next = keyNode;
+  hand->clock_prev = keyNode;
+}
+
+static void clock_remove(HashTable *ht, KeyNode *keyNode) {
+  if (keyNode->clock_next == keyNode) {
+    ht->clock_hand = NULL;
+    return;
+  }
+  if (ht->clock_hand == keyNode) {
+    ht->clock_hand = keyNode->clock_next;
+  }
+  keyNode->clock_prev->clock_next = keyNode->clock_next;
+  keyNode->clock_next->clock_prev = keyNode->clock_prev;
+}
+
+int pair_expired(const KeyNode *node, uint64_t now) { return node->expires_ns != 0 && now >= node->expires_ns; }
+
 struct HashTable *create_hash_table() {
   HashTable *ht = malloc(sizeof(HashTable));
   if (!ht) return NULL;
@@ -27,17 +111,36 @@ struct HashTable *create_hash_table() {
     ht->table[i] = NULL;
   }
   pthread_rwlock_init(&ht->tablelock, NULL);
+  timer_wheel_init(&ht->expiry, current_tick());
+  atomic_init(&ht->expiring, 0);
+  ht->clock_hand = NULL;
+  atomic_init(&ht->memory_used, 0);
+  ht->memory_budget = 0;
+  ht->ordered = NULL;
+  ht->last_version = 0;
   return ht;
 }
 
-int notify_fds(int notifications[MAX_SESSION_COUNT], const char *key, const char *value, int bit) {
+int notify_fds(int notifications[MAX_SESSION_COUNT], const char *key, const KvsValue *value, int bit) {
+  uint64_t start = stats_now();
   // Declaração de um buffer para armazenar a mensagem a ser enviada.
-  char buffer[MAX_STRING_SIZE];
+  // O registo vai sempre inteiro, por isso o resto do buffer fica a zeros
+  char buffer[MAX_STRING_SIZE] = {0};
 
   // Cria a mensagem a ser enviada com base no valor de 'bit'.
   if (bit == 0) {
-    // Caso 'bit' seja 0, indica que a chave foi alterada.
-    snprintf(buffer, MAX_STRING_SIZE, "(%s,%s)", key, value);
+    // Caso 'bit' seja 0, indica que a chave foi alterada. As notificações têm tamanho fixo: um
+    // valor que não cabe segue cortado e sem o ')' final, que é o que diz aos clientes que o
+    // registo não traz o valor inteiro
+    int written = snprintf(buffer, MAX_STRING_SIZE, "(%s,", key);
+    size_t used = written < MAX_STRING_SIZE ? (size_t)written : MAX_STRING_SIZE - 1;
+    size_t room = MAX_STRING_SIZE - 1 - used;
+    if (value->len < room) {
+      used += value_prefix(value, buffer + used, room);
+      buffer[used] = ')';
+    } else {
+      value_prefix(value, buffer + used, room + 1);
+    }
   } else {
     // Caso 'bit' seja diferente de 0, indica que a chave foi eliminada.
     snprintf(buffer, MAX_STRING_SIZE, "(%s,DELETED)", key);
@@ -48,17 +151,24 @@ int notify_fds(int notifications[MAX_SESSION_COUNT], const char *key, const char
     // Verifica se o descritor é válido (maior que 0).
     if (notifications[i] > 0) {
       // Escreve a mensagem no descritor e verifica erros.
-      if (write(notifications[i], buffer, MAX_STRING_SIZE) == -1) {
+      if (notification_sink(notifications[i], buffer, MAX_STRING_SIZE) != 0) {
+        stats_record(STATS_NOTIFY, start);
         return 1;  // Retorna erro se a escrita falhar.
       }
     }
   }
 
+  stats_record(STATS_NOTIFY, start);
   return 0;
 }
 
-int write_pair(HashTable *ht, const char *key, const char *value) {
+int write_pair(HashTable *ht, const char *key, KvsValue *value) { return write_pair_ttl(ht, key, value, 0); }
+
+int write_pair_ttl(HashTable *ht, const char *key, KvsValue *value, unsigned int ttl_ms) {
   int index = hash(key);
+  if (index < 0) {
+    return 1;  // A chave não tem lista na tabela
+  }
 
   // Search for the key node
   KeyNode *keyNode = ht->table[index];
@@ -66,9 +176,14 @@ int write_pair(HashTable *ht, const char *key, const char *value) {
 
   while (keyNode != NULL) {
     if (strcmp(keyNode->key, key) == 0) {
-      // overwrite value
-      free(keyNode->value);
-      keyNode->value = strdup(value);
+      // overwrite value; quem ainda o estiver a escrever mantém a sua referência
+      value_unref(keyNode->value);
+      keyNode->value = value_ref(value);
+      keyNode->version = ++ht->last_version;
+      recharge(ht, keyNode);
+      if (ttl_ms != 0 || keyNode->expires_ns != 0) {
+        set_expiry(ht, keyNode, ttl_ms);
+      }
       notify_fds(keyNode->notifications, key, value, 0);
       return 0;
     }
@@ -78,29 +193,68 @@ int write_pair(HashTable *ht, const char *key, const char *value) {
   // Key not found, create a new key node
   keyNode = malloc(sizeof(KeyNode));
   keyNode->key = strdup(key);      // Allocate memory for the key
-  keyNode->value = strdup(value);  // Allocate memory for the value
+  keyNode->value = value_ref(value);  // The value is shared, not copied
+
+  // O índice ordenado aponta para a chave do nó; se não houver memória para ele, o par não é escrito
+  if (ht->ordered != NULL && skiplist_insert(ht->ordered, keyNode->key, keyNode) != 0) {
+    free(keyNode->key);
+    value_unref(keyNode->value);
+    free(keyNode);
+    return 1;
+  }
+
+  keyNode->version = ++ht->last_version;
 
   // Initializes every entry on notifications as empty with -3
   for (int i = 0; i < MAX_SESSION_COUNT; i++) {
     keyNode->notifications[i] = -3;
   }
 
+  keyNode->expires_ns = 0;
+  timer_entry_init(&keyNode->expiry);
+  if (ttl_ms != 0) {
+    set_expiry(ht, keyNode, ttl_ms);
+  }
+
+  keyNode->charge = 0;
+  recharge(ht, keyNode);
+  // Só as leituras dão uma segunda oportunidade: pares escritos e nunca lidos saem primeiro
+  atomic_init(&keyNode->referenced, 0);
+  clock_insert(ht, keyNode);
+
   keyNode->next = ht->table[index];  // Link to existing nodes
   ht->table[index] = keyNode;        // Place new key node at the start of the list
   return 0;
 }
 
-char *read_pair(HashTable *ht, const char *key) {
+KvsValue *read_pair(HashTable *ht, const char *key) { return read_pair_version(ht, key, NULL); }
+
+KvsValue *read_pair_version(HashTable *ht, const char *key, uint64_t *version) {
   int index = hash(key);
+  if (version != NULL) {
+    *version = 0;
+  }
+  if (index < 0) {
+    return NULL;
+  }
 
   KeyNode *keyNode = ht->table[index];
   KeyNode *previousNode;
-  char *value;
 
   while (keyNode != NULL) {
     if (strcmp(keyNode->key, key) == 0) {
-      value = strdup(keyNode->value);
-      return value;  // Return the value if found
+      // Uma chave expirada que a thread de expiração ainda não removeu já não é encontrada
+      if (keyNode->expires_ns != 0 && pair_expired(keyNode, stats_now())) {
+        return NULL;
+      }
+      // Só escreve o bit quando muda, para leitores concorrentes não disputarem a linha de cache
+      if (!atomic_load_explicit(&keyNode->referenced, memory_order_relaxed)) {
+        atomic_store_explicit(&keyNode->referenced, 1, memory_order_relaxed);
+      }
+      if (version != NULL) {
+        *version = keyNode->version;
+      }
+      return value_ref(keyNode->value);  // Return the value if found
     }
     previousNode = keyNode;
     keyNode = previousNode->next;  // Move to the next node
@@ -109,8 +263,108 @@ char *read_pair(HashTable *ht, const char *key) {
   return NULL;  // Key not found
 }
 
+int cas_pair(HashTable *ht, const char *key, KvsValue *value, uint64_t expected, uint64_t *version) {
+  // Com o trinco de escrita, nada muda entre a comparação e a escrita
+  KvsValue *current = read_pair_version(ht, key, version);
+  value_unref(current);
+  if (*version != expected || write_pair(ht, key, value) != 0) {
+    return 1;
+  }
+  *version = ht->last_version;
+  return 0;
+}
+
+// Nó de uma chave que ainda não expirou, NULL se não existir
+static KeyNode *find_pair(HashTable *ht, const char *key) {
+  int index = hash(key);
+  if (index < 0) {
+    return NULL;
+  }
+  for (KeyNode *keyNode = ht->table[index]; keyNode != NULL; keyNode = keyNode->next) {
+    if (strcmp(keyNode->key, key) == 0) {
+      return keyNode->expires_ns != 0 && pair_expired(keyNode, stats_now()) ? NULL : keyNode;
+    }
+  }
+  return NULL;
+}
+
+// Um valor alterado sem passar por write_pair: nova versão, memória e uma única notificação
+static void pair_changed(HashTable *ht, KeyNode *keyNode) {
+  keyNode->version = ++ht->last_version;
+  recharge(ht, keyNode);
+  notify_fds(keyNode->notifications, keyNode->key, keyNode->value, 0);
+}
+
+// Lê um valor como inteiro decimal de 64 bits
+static int value_to_int(const KvsValue *value, int64_t *number) {
+  char buffer[24];
+  if (value->len == 0 || value->len >= sizeof(buffer)) {
+    return 1;
+  }
+  value_prefix(value, buffer, sizeof(buffer));
+
+  char *end;
+  errno = 0;
+  long long parsed = strtoll(buffer, &end, 10);
+  if (errno != 0 || *end != '\0' || isspace((unsigned char)buffer[0])) {
+    return 1;
+  }
+  *number = parsed;
+  return 0;
+}
+
+int incr_pair(HashTable *ht, const char *key, int64_t delta, int64_t *result) {
+  KeyNode *keyNode = find_pair(ht, key);
+  int64_t current = 0;
+  if (keyNode != NULL && value_to_int(keyNode->value, &current) != 0) {
+    return 1;
+  }
+  if ((delta > 0 && current > INT64_MAX - delta) || (delta < 0 && current < INT64_MIN - delta)) {
+    return 1;
+  }
+  *result = current + delta;
+
+  char number[24];
+  int len = snprintf(number, sizeof(number), "%" PRId64, *result);
+  if (keyNode == NULL) {
+    KvsValue *value = value_create(number, (size_t)len);
+    int failed = value == NULL || write_pair(ht, key, value) != 0;
+    value_unref(value);
+    return failed;
+  }
+
+  KvsValue *value = value_replace(keyNode->value, number, (size_t)len);
+  if (value == NULL) {
+    return 1;
+  }
+  keyNode->value = value;
+  pair_changed(ht, keyNode);
+  return 0;
+}
+
+int append_pair(HashTable *ht, const char *key, KvsValue *suffix, size_t max_len) {
+  KeyNode *keyNode = find_pair(ht, key);
+  if (keyNode == NULL) {
+    return suffix->len > max_len || write_pair(ht, key, suffix) != 0;
+  }
+  if (keyNode->value->len + suffix->len > max_len) {
+    return 1;
+  }
+
+  KvsValue *value = value_append(keyNode->value, suffix);
+  if (value == NULL) {
+    return 1;
+  }
+  keyNode->value = value;
+  pair_changed(ht, keyNode);
+  return 0;
+}
+
 int delete_pair(HashTable *ht, const char *key) {
   int index = hash(key);
+  if (index < 0) {
+    return 1;
+  }
 
   // Search for the key node
   KeyNode *keyNode = ht->table[index];
@@ -130,11 +384,23 @@ int delete_pair(HashTable *ht, const char *key) {
       // Notifies every descriptor of every client subscribed to the key
       notify_fds(keyNode->notifications, key, NULL, 1);
 
+      // Uma chave já expirada é removida na mesma, mas conta como não existente
+      int expired = keyNode->expires_ns != 0 && pair_expired(keyNode, stats_now());
+      if (keyNode->expires_ns != 0) {
+        timer_wheel_remove(&ht->expiry, &keyNode->expiry);
+        sync_expiring(ht);
+      }
+      clock_remove(ht, keyNode);
+      if (ht->ordered != NULL) {
+        skiplist_remove(ht->ordered, keyNode->key);
+      }
+      atomic_fetch_sub_explicit(&ht->memory_used, keyNode->charge, memory_order_relaxed);
+
       // Free the memory allocated for the key and value
       free(keyNode->key);
-      free(keyNode->value);
+      value_unref(keyNode->value);
       free(keyNode);  // Free the key node itself
-      return 0;       // Exit the function
+      return expired;
     }
     prevNode = keyNode;       // Move prevNode to current node
     keyNode = keyNode->next;  // Move to the next node
@@ -143,6 +409,77 @@ int delete_pair(HashTable *ht, const char *key) {
   return 1;
 }
 
+size_t expire_pairs(HashTable *ht, char keys[][MAX_STRING_SIZE], size_t max_keys) {
+  timer_wheel_advance(&ht->expiry, current_tick());
+
+  size_t count = 0;
+  TimerEntry *entry;
+  while (count < max_keys && (entry = timer_wheel_pop_expired(&ht->expiry)) != NULL) {
+    KeyNode *keyNode = (KeyNode *)(void *)((char *)entry - offsetof(KeyNode, expiry));
+    // O nó é libertado pelo delete_pair, por isso a chave é copiada antes
+    snprintf(keys[count], MAX_STRING_SIZE, "%s", keyNode->key);
+    keyNode->expires_ns = 0;
+    delete_pair(ht, keys[count++]);
+  }
+
+  sync_expiring(ht);
+  return count;
+}
+
+int expiry_pending(HashTable *ht) { return atomic_load_explicit(&ht->expiring, memory_order_relaxed) != 0; }
+
+int enable_ordered_index(HashTable *ht) {
+  if (ht->ordered != NULL) {
+    return 0;
+  }
+
+  SkipList *ordered = malloc(sizeof(SkipList));
+  if (ordered == NULL || skiplist_init(ordered) != 0) {
+    free(ordered);
+    return 1;
+  }
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    for (KeyNode *keyNode = ht->table[i]; keyNode != NULL; keyNode = keyNode->next) {
+      if (skiplist_insert(ordered, keyNode->key, keyNode) != 0) {
+        skiplist_destroy(ordered);
+        free(ordered);
+        return 1;
+      }
+    }
+  }
+  ht->ordered = ordered;
+  return 0;
+}
+
+void set_memory_budget(HashTable *ht, size_t bytes) { ht->memory_budget = bytes; }
+
+size_t evict_pairs(HashTable *ht, char keys[][MAX_STRING_SIZE], size_t max_keys) {
+  size_t target = ht->memory_budget - ht->memory_budget / EVICTION_SLACK;
+  uint64_t now = stats_now();
+
+  // Cada volta completa do ponteiro limpa todos os bits, por isso a seguinte encontra sempre vítima
+  size_t count = 0;
+  while (count < max_keys && ht->clock_hand != NULL &&
+         atomic_load_explicit(&ht->memory_used, memory_order_relaxed) > target) {
+    KeyNode *keyNode = ht->clock_hand;
+    if (atomic_load_explicit(&keyNode->referenced, memory_order_relaxed) && !pair_expired(keyNode, now)) {
+      atomic_store_explicit(&keyNode->referenced, 0, memory_order_relaxed);
+      ht->clock_hand = keyNode->clock_next;
+      continue;
+    }
+
+    // O nó é libertado pelo delete_pair, que também avança o ponteiro
+    snprintf(keys[count], MAX_STRING_SIZE, "%s", keyNode->key);
+    delete_pair(ht, keys[count++]);
+  }
+  return count;
+}
+
+int eviction_pending(HashTable *ht) {
+  return ht->memory_budget != 0 &&
+         atomic_load_explicit(&ht->memory_used, memory_order_relaxed) > ht->memory_budget;
+}
+
 void free_table(HashTable *ht) {
   for (int i = 0; i < TABLE_SIZE; i++) {
     KeyNode *keyNode = ht->table[i];
@@ -150,10 +487,14 @@ void free_table(HashTable *ht) {
       KeyNode *temp = keyNode;
       keyNode = keyNode->next;
       free(temp->key);
-      free(temp->value);
+      value_unref(temp->value);
       free(temp);
     }
   }
+  if (ht->ordered != NULL) {
+    skiplist_destroy(ht->ordered);
+    free(ht->ordered);
+  }
   pthread_rwlock_destroy(&ht->tablelock);
   free(ht);
 }
@@ -3,14 +3,34 @@
 #define TABLE_SIZE 26
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "../common/constants.h"  // <- Adjust the path as needed
 #include "src/common/constants.h"
+#include "skiplist.h"
+#include "timerwheel.h"
+#include "value.h"
+
+/// Length of a tick of the expiry wheel.
+#define EXPIRY_TICK_MS 10
+
+/// Once over its memory budget, the table evicts down to 1/EVICTION_SLACK
+/// below it, so it does not evict a pair at a time on every write.
+#define EVICTION_SLACK 16
+
 typedef struct KeyNode {
   char *key;
-  char *value;
+  KvsValue *value;
+  uint64_t version;  // value of the table's version counter at the last write
   int notifications[MAX_SESSION_COUNT];
+  uint64_t expires_ns;         // stats_now() time at which the key expires, 0 without a TTL
+  TimerEntry expiry;           // armed only while the key has a TTL
+  size_t charge;               // bytes counted against the memory budget
+  atomic_bool referenced;      // CLOCK bit, set by reads under the read lock
+  struct KeyNode *clock_next;  // ring of every pair, in insertion order
+  struct KeyNode *clock_prev;
   struct KeyNode *next;
 } KeyNode;
 
@@ -22,26 +42,104 @@ typedef struct KeySubNode {
 typedef struct HashTable {
   KeyNode *table[TABLE_SIZE];
   pthread_rwlock_t tablelock;
+  TimerWheel expiry;           // protected by tablelock, like the lists
+  _Atomic size_t expiring;     // copy of expiry.count that can be read without the lock
+  KeyNode *clock_hand;         // next pair the eviction looks at, NULL when empty
+  _Atomic size_t memory_used;  // sum of the pairs' charges, read without the lock
+  size_t memory_budget;        // 0 without a limit
+  SkipList *ordered;           // every key in order, NULL unless enabled
+  uint64_t last_version;       // last version given to a write
 } HashTable;
 
+/// Delivers a notification to the subscriber identified by a notification fd.
+/// @return 0 on success, 1 otherwise.
+typedef int (*NotificationSink)(int notif_fd, const void *buffer, size_t size);
+
+/// Replaces the function used to deliver notifications (by default, a write
+/// to the notification fd).
+/// @param sink The new delivery function.
+void set_notification_sink(NotificationSink sink);
+
 /// Creates a new KVS hash table.
 /// @return Newly created hash table, NULL on failure
 struct HashTable *create_hash_table();
 
+/// Index of the list of a key in the table.
+/// @param key The key.
+/// @return The index, -1 if the key does not start with a letter or a digit.
+///         The table functions treat such keys as missing and refuse to write
+///         them.
 int hash(const char *key);
 
 // Writes a key value pair in the hash table.
 // @param ht The hash table.
 // @param key The key.
-// @param value The value.
+// @param value The value. The table takes its own reference.
 // @return 0 if successful.
-int write_pair(HashTable *ht, const char *key, const char *value);
+int write_pair(HashTable *ht, const char *key, KvsValue *value);
+
+// Writes a key value pair that expires after the given time. Writing the key
+// again (with or without a TTL) replaces its expiry.
+// @param ht The hash table.
+// @param key The key.
+// @param value The value. The table takes its own reference.
+// @param ttl_ms Time to live in milliseconds, 0 for none.
+// @return 0 if successful.
+int write_pair_ttl(HashTable *ht, const char *key, KvsValue *value, unsigned int ttl_ms);
+
+/// Checks whether a pair has expired, even if it was not removed yet.
+/// @param node Node of the pair.
+/// @param now Current time (stats_now).
+/// @return 1 if expired, 0 otherwise.
+int pair_expired(const KeyNode *node, uint64_t now);
 
-// Reads the value of a given key.
+// Reads the value of a given key. Expired keys are not found.
 // @param ht The hash table.
 // @param key The key.
-// return the value if found, NULL otherwise.
-char *read_pair(HashTable *ht, const char *key);
+// return a new reference to the value (released with value_unref) if found, NULL otherwise.
+KvsValue *read_pair(HashTable *ht, const char *key);
+
+/// Reads the value of a key together with its version. Every write gives the
+/// key the next value of a counter shared by the whole table, so a key that is
+/// deleted and written again never gets back a version it had before.
+/// @param ht The hash table.
+/// @param key The key.
+/// @param version Set to the version of the key, 0 if it is not found.
+/// @return A new reference to the value if found, NULL otherwise.
+KvsValue *read_pair_version(HashTable *ht, const char *key, uint64_t *version);
+
+/// Writes a pair only if the key is at the expected version. Like a write, it
+/// clears any TTL of the key.
+/// @param ht The hash table, write-locked by the caller.
+/// @param key The key.
+/// @param value The value. The table takes its own reference.
+/// @param expected Version the key must have, 0 if it must not exist.
+/// @param version Set to the new version if written, to the current one
+///                (0 if the key does not exist) otherwise.
+/// @return 0 if the pair was written, 1 otherwise.
+int cas_pair(HashTable *ht, const char *key, KvsValue *value, uint64_t expected, uint64_t *version);
+
+/// Adds a delta to the decimal integer stored in a key. The value is updated
+/// in place when no reader holds it; a missing key counts as 0. The TTL of the
+/// key is kept and its subscribers are notified once.
+/// @param ht The hash table, write-locked by the caller.
+/// @param key The key.
+/// @param delta Amount to add, possibly negative.
+/// @param result Set to the new value.
+/// @return 0 on success, 1 if the value is not a 64-bit integer, the sum
+///         overflows or memory ran out.
+int incr_pair(HashTable *ht, const char *key, int64_t delta, int64_t *result);
+
+/// Appends a value to the one stored in a key. The value is extended in place
+/// when no reader holds it; a missing key is written with the suffix. The TTL
+/// of the key is kept and its subscribers are notified once.
+/// @param ht The hash table, write-locked by the caller.
+/// @param key The key.
+/// @param suffix Value to append. A new key takes a reference to it.
+/// @param max_len Longest value allowed.
+/// @return 0 on success, 1 if the value would grow past 'max_len' or memory
+///         ran out.
+int append_pair(HashTable *ht, const char *key, KvsValue *suffix, size_t max_len);
 
 /// Deletes a pair from the table.
 /// @param ht Hash table to read from.
@@ -49,6 +147,47 @@ char *read_pair(HashTable *ht, const char *key);
 /// @return 0 if the node was deleted successfully, 1 otherwise.
 int delete_pair(HashTable *ht, const char *key);
 
+/// Removes the pairs whose TTL ran out, notifying their subscribers as
+/// delete_pair does. Each call removes at most 'max_keys' pairs; the rest are
+/// left for the next call.
+/// @param ht Hash table, write-locked by the caller.
+/// @param keys Array set to the keys removed.
+/// @param max_keys Size of 'keys'.
+/// @return Number of pairs removed.
+size_t expire_pairs(HashTable *ht, char keys[][MAX_STRING_SIZE], size_t max_keys);
+
+/// Checks whether any pair has a TTL, without locking the table.
+/// @param ht Hash table.
+/// @return 1 if some pair may expire, 0 otherwise.
+int expiry_pending(HashTable *ht);
+
+/// Starts keeping the keys of the table in order, in a skip list that is
+/// updated with the lists from then on (at O(log n) per new or deleted key).
+/// @param ht Hash table, write-locked by the caller.
+/// @return 0 on success, 1 if memory ran out.
+int enable_ordered_index(HashTable *ht);
+
+/// Sets the memory budget of the table. Pairs are only evicted by
+/// evict_pairs, so the table can go over it in between.
+/// @param ht Hash table, before it is shared with other threads.
+/// @param bytes Budget in bytes (keys, values and nodes), 0 for none.
+void set_memory_budget(HashTable *ht, size_t bytes);
+
+/// Evicts pairs with CLOCK (second chance) until the table is EVICTION_SLACK
+/// below its budget, notifying their subscribers as delete_pair does. Pairs
+/// read since the hand last passed them are skipped once; expired pairs are
+/// always taken. Each call evicts at most 'max_keys' pairs.
+/// @param ht Hash table, write-locked by the caller.
+/// @param keys Array set to the keys evicted.
+/// @param max_keys Size of 'keys'.
+/// @return Number of pairs evicted.
+size_t evict_pairs(HashTable *ht, char keys[][MAX_STRING_SIZE], size_t max_keys);
+
+/// Checks whether the table is over its memory budget, without locking it.
+/// @param ht Hash table.
+/// @return 1 if some pairs should be evicted, 0 otherwise.
+int eviction_pending(HashTable *ht);
+
 /// Frees the hashtable.
 /// @param ht Hash table to be deleted.
 void free_table(HashTable *ht);
@@ -0,0 +1,298 @@
+#include "lockprof.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#define LOCKPROF_MAX_SITES 128
+#define LOCKPROF_MAX_HELD 16  // trincos que uma thread pode ter ao mesmo tempo
+
+// Estatísticas de um ponto do código que adquire um trinco. Os contadores são partilhados pelas
+// threads e atualizados com operações atómicas relaxadas
+typedef struct {
+  _Atomic int ready;  // publicado depois de os campos abaixo estarem preenchidos
+  const char* file;
+  int line;
+  const char* name;
+  const char* mode;
+
+  _Atomic uint64_t acquisitions;
+  _Atomic uint64_t contended;  // aquisições em que o trinco estava ocupado
+  _Atomic uint64_t wait_total;
+  _Atomic uint64_t wait_max;
+  _Atomic uint64_t hold_total;
+  _Atomic uint64_t hold_max;
+} LockSite;
+
+// Trinco na posse da thread, para medir o tempo de posse quando for libertado
+typedef struct {
+  const void* lock;
+  LockSite* site;
+  uint64_t since;
+} Held;
+
+// Tabela de endereçamento aberto: os pontos só são inseridos (com o trinco), nunca removidos, por
+// isso a procura pode ser feita sem trinco
+static LockSite sites[LOCKPROF_MAX_SITES];
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local Held held[LOCKPROF_MAX_HELD];
+static _Thread_local size_t held_count = 0;
+
+static size_t site_hash(const char* file, int line) {
+  size_t hash = 5381;
+  for (const char* c = file; *c != '\0'; c++) {
+    hash = hash * 33 + (unsigned char)*c;
+  }
+  return (hash * 31 + (size_t)line) % LOCKPROF_MAX_SITES;
+}
+
+static LockSite* find_site(const char* file, int line, const char* name, const char* mode) {
+  size_t start = site_hash(file, line);
+
+  for (size_t i = 0; i < LOCKPROF_MAX_SITES; i++) {
+    LockSite* site = &sites[(start + i) % LOCKPROF_MAX_SITES];
+    if (!atomic_load_explicit(&site->ready, memory_order_acquire)) {
+      break;
+    }
+    if (site->line == line && strcmp(site->file, file) == 0) {
+      return site;
+    }
+  }
+
+  // Primeira aquisição neste ponto: volta a procurar com o trinco, pois outra thread pode tê-lo
+  // inserido entretanto
+  pthread_mutex_lock(&sites_lock);
+  LockSite* found = NULL;
+  for (size_t i = 0; i < LOCKPROF_MAX_SITES && found == NULL; i++) {
+    LockSite* site = &sites[(start + i) % LOCKPROF_MAX_SITES];
+    if (!atomic_load_explicit(&site->ready, memory_order_relaxed)) {
+      site->file = file;
+      site->line = line;
+      site->name = name;
+      site->mode = mode;
+      atomic_store_explicit(&site->ready, 1, memory_order_release);
+      found = site;
+    } else if (site->line == line && strcmp(site->file, file) == 0) {
+      found = site;
+    }
+  }
+  pthread_mutex_unlock(&sites_lock);
+  return found;  // NULL com a tabela cheia: o ponto deixa de ser medido
+}
+
+static void store_max(_Atomic uint64_t* max, uint64_t value) {
+  uint64_t current = atomic_load_explicit(max, memory_order_relaxed);
+  while (value > current &&
+         !atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+  }
+}
+
+// Regista uma aquisição que começou em 'start'. Sem espera não é preciso voltar a ler o relógio
+static void lock_acquired(LockSite* site, const void* lock, uint64_t start, int contended) {
+  if (site == NULL) {
+    return;
+  }
+
+  uint64_t now = contended ? stats_now() : start;
+  atomic_fetch_add_explicit(&site->acquisitions, 1, memory_order_relaxed);
+  if (contended) {
+    atomic_fetch_add_explicit(&site->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->wait_total, now - start, memory_order_relaxed);
+    store_max(&site->wait_max, now - start);
+  }
+
+  if (held_count < LOCKPROF_MAX_HELD) {
+    held[held_count++] = (Held){lock, site, now};
+  }
+}
+
+// Procura um trinco na posse da thread. Normalmente é o último adquirido
+static Held* find_held(const void* lock) {
+  for (size_t i = held_count; i > 0; i--) {
+    if (held[i - 1].lock == lock) {
+      return &held[i - 1];
+    }
+  }
+  return NULL;
+}
+
+// Soma ao ponto onde o trinco foi adquirido o tempo de posse até agora
+static void record_hold(const Held* entry) {
+  uint64_t hold = stats_now() - entry->since;
+  atomic_fetch_add_explicit(&entry->site->hold_total, hold, memory_order_relaxed);
+  store_max(&entry->site->hold_max, hold);
+}
+
+static void lock_released(const void* lock) {
+  Held* entry = find_held(lock);
+  if (entry != NULL) {
+    record_hold(entry);
+    size_t index = (size_t)(entry - held);
+    memmove(entry, entry + 1, (held_count - index - 1) * sizeof(Held));
+    held_count--;
+  }
+}
+
+int lockprof_mutex_lock(pthread_mutex_t* mutex, const char* name, const char* file, int line) {
+  LockSite* site = find_site(file, line, name, "mutex");
+  uint64_t start = stats_now();
+
+  int contended = 0;
+  int res = pthread_mutex_trylock(mutex);
+  if (res == EBUSY) {
+    contended = 1;
+    res = pthread_mutex_lock(mutex);
+  }
+
+  if (res == 0) {
+    lock_acquired(site, mutex, start, contended);
+  }
+  return res;
+}
+
+int lockprof_rwlock_lock(pthread_rwlock_t* rwlock, const char* name, int write, const char* file, int line) {
+  LockSite* site = find_site(file, line, name, write ? "write" : "read");
+  uint64_t start = stats_now();
+
+  int contended = 0;
+  int res = write ? pthread_rwlock_trywrlock(rwlock) : pthread_rwlock_tryrdlock(rwlock);
+  if (res == EBUSY) {
+    contended = 1;
+    res = write ? pthread_rwlock_wrlock(rwlock) : pthread_rwlock_rdlock(rwlock);
+  }
+
+  if (res == 0) {
+    lock_acquired(site, rwlock, start, contended);
+  }
+  return res;
+}
+
+int profiled_mutex_unlock(pthread_mutex_t* mutex) {
+  lock_released(mutex);
+  return pthread_mutex_unlock(mutex);
+}
+
+int profiled_rwlock_unlock(pthread_rwlock_t* rwlock) {
+  lock_released(rwlock);
+  return pthread_rwlock_unlock(rwlock);
+}
+
+// Enquanto a thread espera na condição o trinco está livre, por isso a posse é contada até à espera
+// e volta a contar quando o trinco é readquirido, como parte da mesma aquisição. Só esta thread
+// mexe na sua lista de trincos, que fica igual durante a espera
+int profiled_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+  Held* entry = find_held(mutex);
+  if (entry != NULL) {
+    record_hold(entry);
+  }
+  int res = pthread_cond_wait(cond, mutex);
+  if (entry != NULL) {
+    entry->since = stats_now();
+  }
+  return res;
+}
+
+int profiled_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime) {
+  Held* entry = find_held(mutex);
+  if (entry != NULL) {
+    record_hold(entry);
+  }
+  int res = pthread_cond_timedwait(cond, mutex, abstime);
+  if (entry != NULL) {
+    entry->since = stats_now();
+  }
+  return res;
+}
+
+// Totais de um trinco ou de um ponto, lidos dos contadores
+typedef struct {
+  uint64_t acquisitions;
+  uint64_t contended;
+  uint64_t wait_total;
+  uint64_t wait_max;
+  uint64_t hold_total;
+  uint64_t hold_max;
+} Totals;
+
+static void add_totals(Totals* totals, LockSite* site) {
+  totals->acquisitions += atomic_load_explicit(&site->acquisitions, memory_order_relaxed);
+  totals->contended += atomic_load_explicit(&site->contended, memory_order_relaxed);
+  totals->wait_total += atomic_load_explicit(&site->wait_total, memory_order_relaxed);
+  totals->hold_total += atomic_load_explicit(&site->hold_total, memory_order_relaxed);
+
+  uint64_t wait_max = atomic_load_explicit(&site->wait_max, memory_order_relaxed);
+  uint64_t hold_max = atomic_load_explicit(&site->hold_max, memory_order_relaxed);
+  totals->wait_max = wait_max > totals->wait_max ? wait_max : totals->wait_max;
+  totals->hold_max = hold_max > totals->hold_max ? hold_max : totals->hold_max;
+}
+
+static void print_totals(FILE* file, const Totals* totals) {
+  fprintf(file, " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", totals->acquisitions,
+          totals->contended, totals->wait_total, totals->wait_max, totals->hold_total, totals->hold_max);
+}
+
+int lockprof_dump(const char* path) {
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+    fprintf(stderr, "Lock stats path too long: %s\n", path);
+    return 1;
+  }
+
+  FILE* file = fopen(tmp_path, "w");
+  if (file == NULL) {
+    perror("Failed to open lock stats file");
+    return 1;
+  }
+
+  // Os pontos publicados nunca mudam de nome, por isso não é preciso o trinco da tabela
+  LockSite* ready[LOCKPROF_MAX_SITES];
+  size_t count = 0;
+  for (size_t i = 0; i < LOCKPROF_MAX_SITES; i++) {
+    if (atomic_load_explicit(&sites[i].ready, memory_order_acquire)) {
+      ready[count++] = &sites[i];
+    }
+  }
+
+  fprintf(file, "# lock acquisitions contended wait_ns max_wait_ns hold_ns max_hold_ns\n");
+  for (size_t i = 0; i < count; i++) {
+    // Cada trinco é escrito uma vez, no primeiro ponto em que aparece
+    int seen = 0;
+    for (size_t j = 0; j < i && !seen; j++) {
+      seen = strcmp(ready[j]->name, ready[i]->name) == 0;
+    }
+    if (seen) {
+      continue;
+    }
+
+    Totals totals = {0};
+    for (size_t j = i; j < count; j++) {
+      if (strcmp(ready[j]->name, ready[i]->name) == 0) {
+        add_totals(&totals, ready[j]);
+      }
+    }
+    fprintf(file, "%s", ready[i]->name);
+    print_totals(file, &totals);
+  }
+
+  fprintf(file, "# site lock file:line mode acquisitions contended wait_ns max_wait_ns hold_ns max_hold_ns\n");
+  for (size_t i = 0; i < count; i++) {
+    Totals totals = {0};
+    add_totals(&totals, ready[i]);
+    fprintf(file, "site %s %s:%d %s", ready[i]->name, ready[i]->file, ready[i]->line, ready[i]->mode);
+    print_totals(file, &totals);
+  }
+
+  if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+    perror("Failed to write lock stats file");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef KVS_LOCKPROF_H
+#define KVS_LOCKPROF_H
+
+#include <pthread.h>
+
+/// Locks a mutex, recording how long the caller waited for it and, once it is
+/// unlocked, how long it was held. Statistics are kept per call site and
+/// grouped by lock name in the report.
+/// @param mutex Mutex to lock.
+/// @param name Name of the lock in the report (a string literal).
+/// @return The result of pthread_mutex_lock.
+#define profiled_mutex_lock(mutex, name) lockprof_mutex_lock(mutex, name, __FILE__, __LINE__)
+
+/// Read-locks a rwlock, recording wait and hold time like profiled_mutex_lock.
+#define profiled_rwlock_rdlock(rwlock, name) lockprof_rwlock_lock(rwlock, name, 0, __FILE__, __LINE__)
+
+/// Write-locks a rwlock, recording wait and hold time like profiled_mutex_lock.
+#define profiled_rwlock_wrlock(rwlock, name) lockprof_rwlock_lock(rwlock, name, 1, __FILE__, __LINE__)
+
+/// Unlocks a mutex locked with profiled_mutex_lock.
+/// @param mutex Mutex to unlock.
+/// @return The result of pthread_mutex_unlock.
+int profiled_mutex_unlock(pthread_mutex_t* mutex);
+
+/// Unlocks a rwlock locked with profiled_rwlock_rdlock or profiled_rwlock_wrlock.
+/// @param rwlock Lock to unlock.
+/// @return The result of pthread_rwlock_unlock.
+int profiled_rwlock_unlock(pthread_rwlock_t* rwlock);
+
+/// Waits on a condition with a mutex locked with profiled_mutex_lock. The time
+/// spent waiting, while the mutex is released, is not counted as hold time.
+/// @param cond Condition to wait on.
+/// @param mutex Mutex held by the caller.
+/// @return The result of pthread_cond_wait.
+int profiled_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+
+/// Like profiled_cond_wait, with a deadline.
+/// @param cond Condition to wait on.
+/// @param mutex Mutex held by the caller.
+/// @param abstime Deadline, as for pthread_cond_timedwait.
+/// @return The result of pthread_cond_timedwait.
+int profiled_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime);
+
+/// Implementation of profiled_mutex_lock, given the call site.
+int lockprof_mutex_lock(pthread_mutex_t* mutex, const char* name, const char* file, int line);
+
+/// Implementation of profiled_rwlock_rdlock and profiled_rwlock_wrlock.
+int lockprof_rwlock_lock(pthread_rwlock_t* rwlock, const char* name, int write, const char* file, int line);
+
+/// Writes the statistics of every lock to a file: a line per lock with the
+/// acquisitions, how many of them had to wait, and the total and maximum wait
+/// and hold times in nanoseconds, followed by the same numbers per call site.
+/// The file is replaced atomically.
+/// @param path Path of the file to write.
+/// @return 0 if the file was written, 1 otherwise.
+int lockprof_dump(const char* path);
+
+#endif  // KVS_LOCKPROF_H
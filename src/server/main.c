@@ -2,33 +2,43 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "io.h"
+#include "jobc.h"
+#include "jobpool.h"
+#include "jobprog.h"
+#include "jobsched.h"
+#include "jobstats.h"
 #include "kvs.h"
+#include "lockprof.h"
+#include "mpmc.h"
 #include "operations.h"
 #include "parser.h"
 #include "pthread.h"
-#include "semaphore.h"
 #include "src/common/constants.h"
+#include "src/common/io.h"
 #include "src/common/protocol.h"
+#include "src/common/shm.h"
 #include "src/server/constants.h"
+#include "src/server/stats.h"
 
-int write_server_flag = 0;  // Flag de controlo para indicar se o servidor está pronto para escrever
-int sig_flag = 0;           // Flag para o sinal SIGUSR1
-int read_index = 0;         // Índice de leitura no buffer
-int write_index = 0;        // Índice de escrita no buffer
-sem_t empty;                // Semáforo para indicar espaços vazios no buffer
-sem_t full;                 // Semáforo para indicar espaços preenchidos no buffer
-pthread_mutex_t semExMut = PTHREAD_MUTEX_INITIALIZER;  // Mutex para exclusão mútua no controlo de semáforos
-sem_t consumed;                                        // Semáforo para indicar que os dados foram consumidos
+int sig_flag = 0;     // Flag para o sinal SIGUSR1
+int stats_flag = 0;   // Flag para o sinal SIGUSR2
+int terminate_flag = 0;  // Flag para os sinais SIGINT e SIGTERM
 
 struct SharedData {
   DIR* dir;
@@ -42,11 +52,21 @@ typedef struct Client {
   int client_resp_fd;
   int client_notif_fd;
   KeySubNode* subscriptions;
+  int socket;                  // 1 se a sessão usa um socket UNIX (os três fds são o mesmo socket)
+  ShmRegion* shm;              // Região partilhada negociada no connect (NULL se usa os FIFOs)
+  pthread_mutex_t notif_lock;  // Serializa os produtores do anel de notificações
+  int deliveries;              // Notificações a ser entregues ao cliente (protegido por clients_lock)
 } Client;
 
-// Buffers para armazenar os clientes
-Client* client_server_buffer[MAX_SESSION_COUNT];  // Buffer de clientes a serem servidos
-Client* clients_list[MAX_SESSION_COUNT];          // Lista de clientes conectados
+// Fila de clientes a serem servidos, partilhada entre o listener e as threads gestoras
+MpmcQueue session_queue;
+Client* clients_list[MAX_SESSION_COUNT];  // Lista de clientes conectados
+
+// Protege a clients_list, as listas de subscrições dos clientes e as entregas em curso. Uma entrega
+// não fica com o trinco enquanto escreve: conta-se em 'deliveries', e quem termina a sessão espera
+// que esse contador chegue a zero antes de libertar o cliente
+pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t clients_cond = PTHREAD_COND_INITIALIZER;  // Fim de uma entrega
 
 // Função para inserir uma chave na lista de subscrições
 int key_insert(KeySubNode** head, const char* key) {
@@ -83,6 +103,18 @@ void sig_handle() {
   }
 }
 
+// Função para tratar sinais (SIGUSR2): pede a escrita dos relatórios
+void stats_handle() {
+  stats_flag = 1;
+  if (signal(SIGUSR2, stats_handle) == SIG_ERR) {
+    perror("signal could not be resolved\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Função para tratar sinais (SIGINT e SIGTERM): pede o fim do servidor
+void terminate_handle() { terminate_flag = 1; }
+
 // Função para eliminar uma chave da lista de subscrições
 int key_delete(KeySubNode** head, const char* key) {
   if (head == NULL || key == NULL) return 1;  // Verifica se os parâmetros são válidos
@@ -115,6 +147,8 @@ pthread_mutex_t n_current_backups_lock = PTHREAD_MUTEX_INITIALIZER;
 size_t active_backups = 0;  // Number of active backups
 size_t max_backups;         // Maximum allowed simultaneous backups
 size_t max_threads;         // Maximum allowed simultaneous threads
+int optimize_jobs = 0;      // -O: jobs are rewritten by job_program_optimize before running
+int parallel_jobs = 0;      // -P: independent commands of a job run on every job thread
 char* jobs_directory = NULL;
 char* fifo_server;
 char server_pipe_path[256] = "/tmp/server033";
@@ -127,9 +161,15 @@ int filter_job_files(const struct dirent* entry) {
   return 0;
 }
 
-static int entry_files(const char* dir, struct dirent* entry, char* in_path, char* out_path) {
+// Um .job com um .jobc ao lado não é corrido: o .jobc é a versão compilada do mesmo job
+static int entry_files(const char* dir, struct dirent* entry, char* in_path, char* out_path, char* stats_path,
+                       int* compiled) {
   const char* dot = strrchr(entry->d_name, '.');
-  if (dot == NULL || dot == entry->d_name || strlen(dot) != 4 || strcmp(dot, ".job")) {
+  if (dot == NULL || dot == entry->d_name) {
+    return 1;
+  }
+  *compiled = strcmp(dot, JOBC_EXTENSION) == 0;
+  if (!*compiled && strcmp(dot, ".job") != 0) {
     return 1;
   }
 
@@ -142,484 +182,1630 @@ static int entry_files(const char* dir, struct dirent* entry, char* in_path, cha
   strcat(in_path, "/");
   strcat(in_path, entry->d_name);
 
+  char compiled_path[MAX_JOB_FILE_NAME_SIZE + 1];
+  snprintf(compiled_path, sizeof(compiled_path), "%sc", in_path);
+  if (!*compiled && access(compiled_path, F_OK) == 0) {
+    return 1;
+  }
+
   strcpy(out_path, in_path);
   strcpy(strrchr(out_path, '.'), ".out");
 
+  // ".stats" tem mais dois caracteres que ".job" (e mais um que ".jobc"); stats_path tem esses dois
+  // bytes a mais
+  strcpy(stats_path, in_path);
+  strcpy(strrchr(stats_path, '.'), ".stats");
+
+  return 0;
+}
+
+// Remove as chaves apagadas das listas de subscrições dos clientes. Pode correr ao mesmo tempo em
+// várias threads: DELETEs do mesmo nível com -P, sessões e a thread de manutenção (TTL e despejos)
+static void forget_deleted_subscriptions(size_t num_pairs, char keys[][MAX_STRING_SIZE]) {
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  // Iterar sobre todos os pares de chaves
+  for (size_t i = 0; i < num_pairs; i++) {
+    // Eliminar a chave da lista de subscrições de cada cliente que a tenha
+    for (int j = 0; j < MAX_SESSION_COUNT; j++) {
+      if (clients_list[j] != NULL) {
+        key_delete(&clients_list[j]->subscriptions, keys[i]);
+      }
+    }
+  }
+  profiled_mutex_unlock(&clients_lock);
+}
+
+// Cancela todas as subscrições de um cliente. Retorna 0 se todas foram canceladas, 1 caso contrário
+static int unsubscribe_all(Client* client) {
+  // A lista sai do cliente com o trinco, para que as remoções feitas por outras threads não a
+  // alterem enquanto é percorrida
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  KeySubNode* current = client->subscriptions;
+  client->subscriptions = NULL;
+  profiled_mutex_unlock(&clients_lock);
+
+  int failed = 0;
+  while (current != NULL) {
+    KeySubNode* next = current->next;
+    if (kvs_unsubscription(current->key, client->client_notif_fd) != 0) {
+      fprintf(stderr, "Falha ao cancelar subscrição da chave: %s\n", current->key);
+      failed = 1;
+    }
+    free(current->key);
+    free(current);
+    current = next;  // Avançar para a próxima subscrição
+  }
+  return failed;
+}
+
+// Resultado da parte de um comando que mexe na tabela, guardado até a saída ser escrita. Só
+// existem os vetores que o comando usa
+typedef struct {
+  int failed;
+  int* flags;          // CAS, INCR, APPEND, DELETE: se cada chave foi alterada
+  uint64_t* versions;  // CAS, VERSION
+  int64_t* sums;       // INCR
+  KvsValue** values;   // READ
+  void* block;         // alocação única de onde saem os vetores
+} OpResult;
+
+// Reserva os vetores do resultado de um comando que mexe na tabela
+static int op_result_init(const JobOp* op, OpResult* result) {
+  memset(result, 0, sizeof(OpResult));
+  size_t per_key = (op->cmd == CMD_READ ? sizeof(KvsValue*) : 0) +
+                   (op->cmd == CMD_CAS || op->cmd == CMD_VERSION ? sizeof(uint64_t) : 0) +
+                   (op->cmd == CMD_INCR ? sizeof(int64_t) : 0) + sizeof(int);
+  result->block = malloc(op->count * per_key);
+  if (result->block == NULL) {
+    return 1;
+  }
+
+  // Os vetores de 8 bytes vêm primeiro para ficarem alinhados
+  char* next = result->block;
+  if (op->cmd == CMD_READ) {
+    result->values = (KvsValue**)next;
+    next += op->count * sizeof(KvsValue*);
+  }
+  if (op->cmd == CMD_CAS || op->cmd == CMD_VERSION) {
+    result->versions = (uint64_t*)(void*)next;
+    next += op->count * sizeof(uint64_t);
+  }
+  if (op->cmd == CMD_INCR) {
+    result->sums = (int64_t*)(void*)next;
+    next += op->count * sizeof(int64_t);
+  }
+  result->flags = (int*)(void*)next;
+  return 0;
+}
+
+static void op_result_free(const JobOp* op, OpResult* result) {
+  if (result->values != NULL && !result->failed) {
+    for (size_t i = 0; i < op->count; i++) {
+      value_unref(result->values[i]);
+    }
+  }
+  free(result->block);
+}
+
+// Faz a parte de um comando que mexe na tabela. Não toca no .out nem nas estatísticas do job, por
+// isso pode correr em qualquer thread
+static void op_apply(JobOp* op, OpResult* result) {
+  switch (op->cmd) {
+    case CMD_WRITE:
+    case CMD_WRITE_TTL:
+      result->failed = kvs_write_ttl(op->count, op->keys, op->values, op->arg);
+      break;
+
+    case CMD_CAS:
+      result->failed = kvs_cas(op->count, op->keys, op->values, op->versions, result->versions, result->flags);
+      break;
+
+    case CMD_INCR:
+      result->failed = kvs_incr(op->count, op->keys, op->deltas, result->sums, result->flags);
+      break;
+
+    case CMD_APPEND:
+      result->failed = kvs_append(op->count, op->keys, op->values, result->flags);
+      break;
+
+    case CMD_READ:
+      result->failed = kvs_read_values(op->count, op->keys, result->values);
+      break;
+
+    case CMD_VERSION:
+      result->failed = kvs_read_versions(op->count, op->keys, NULL, result->versions);
+      break;
+
+    case CMD_DELETE:
+      result->failed = kvs_delete_keys(op->count, op->keys, result->flags);
+      forget_deleted_subscriptions(op->count, op->keys);
+      break;
+
+    case CMD_SHOW:
+    case CMD_SCAN:
+    case CMD_WAIT:
+    case CMD_BACKUP:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case EOC:
+      break;
+  }
+}
+
+// Escreve o resultado de um comando que mexe na tabela e conta os pares nas estatísticas do job
+static void op_output(JobOp* op, OpResult* result, int out_fd, JobStats* stats) {
+  switch (op->cmd) {
+    case CMD_WRITE:
+    case CMD_WRITE_TTL:
+      if (result->failed) {
+        write_str(STDERR_FILENO, "Failed to write pair\n");
+      }
+      stats->pairs_written += op->count;
+      break;
+
+    case CMD_CAS:
+    case CMD_INCR:
+    case CMD_APPEND:
+      if (result->failed) {
+        write_str(STDERR_FILENO, "Failed to write pair\n");
+        break;
+      }
+      for (size_t i = 0; i < op->count; i++) {
+        stats->pairs_written += result->flags[i] != 0;
+      }
+      if (op->cmd == CMD_CAS) {
+        kvs_print_cas(out_fd, op->count, op->keys, result->versions, result->flags);
+      } else if (op->cmd == CMD_INCR) {
+        kvs_print_incr(out_fd, op->count, op->keys, result->sums, result->flags);
+      } else {
+        kvs_print_append(out_fd, op->count, op->keys, result->flags);
+      }
+      break;
+
+    case CMD_READ: {
+      if (result->failed) {
+        write_str(STDERR_FILENO, "Failed to read pair\n");
+        break;
+      }
+      stats->pairs_read += op->count;
+
+      // Um READ juntado pelo otimizador escreve uma linha por READ original, por isso o .out não muda
+      size_t first = 0;
+      for (size_t i = 0; i < (op->splits != NULL ? op->split_count : 1); i++) {
+        size_t count = op->splits != NULL ? op->splits[i] : op->count;
+        kvs_print_read(out_fd, count, op->keys + first, result->values + first);
+        first += count;
+      }
+      break;
+    }
+
+    case CMD_VERSION:
+      if (result->failed) {
+        write_str(STDERR_FILENO, "Failed to read pair\n");
+        break;
+      }
+      stats->pairs_read += op->count;
+      kvs_print_versions(out_fd, op->count, op->keys, result->versions);
+      break;
+
+    case CMD_DELETE:
+      stats->pairs_deleted += op->count;
+      if (result->failed) {
+        write_str(STDERR_FILENO, "Failed to delete pair\n");
+      } else {
+        kvs_print_delete(out_fd, op->count, op->keys, result->flags);
+      }
+      break;
+
+    case CMD_SHOW:
+    case CMD_SCAN:
+    case CMD_WAIT:
+    case CMD_BACKUP:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case EOC:
+      break;
+  }
+}
+
+// Até onde correu um job
+enum JobStep {
+  STEP_DONE,   // chegou ao fim, ou ao próximo comando
+  STEP_WAIT,   // parou num WAIT, para ser retomado quando o tempo passar
+  STEP_CHILD,  // processo filho de um BACKUP, que tem de terminar
+};
+
+// Executa um comando de um job. 'now' vem do lap anterior e fica com o último; um WAIT não mede
+// nada, porque o tempo de espera só se conhece quando o job é retomado
+static enum JobStep run_op(JobOp* op, int out_fd, char* filename, size_t* file_backups, JobStats* stats,
+                           uint64_t* now) {
+  switch (op->cmd) {
+    case CMD_WRITE:
+    case CMD_WRITE_TTL:
+    case CMD_CAS:
+    case CMD_INCR:
+    case CMD_APPEND:
+    case CMD_READ:
+    case CMD_VERSION:
+    case CMD_DELETE: {
+      OpResult result;
+      if (op_result_init(op, &result) != 0) {
+        write_str(STDERR_FILENO, "Failed to run command\n");
+        break;
+      }
+      // A mudança na tabela e a escrita do resultado são feitas em separado para medir cada uma
+      op_apply(op, &result);
+      *now = jobstats_lap(stats, JOB_TABLE, *now);
+      op_output(op, &result, out_fd, stats);
+      op_result_free(op, &result);
+      *now = jobstats_lap(stats, JOB_OUTPUT, *now);
+      break;
+    }
+
+    case CMD_SHOW:
+      kvs_show(out_fd);
+      *now = jobstats_lap(stats, JOB_OUTPUT, *now);
+      break;
+
+    case CMD_SCAN: {
+      // Como no SHOW, a procura no índice e a escrita são feitas juntas e contam como saída
+      size_t scanned;
+      if (kvs_scan(out_fd, op->keys[0], op->count == 2 ? op->keys[1] : NULL, &scanned) == 0) {
+        stats->pairs_read += scanned;
+      }
+      *now = jobstats_lap(stats, JOB_OUTPUT, *now);
+      break;
+    }
+
+    case CMD_WAIT:
+      if (op->arg > 0) {
+        printf("Waiting %d seconds\n", op->arg / 1000);
+        return STEP_WAIT;
+      }
+      *now = jobstats_lap(stats, JOB_SLEEP, *now);
+      break;
+
+    case CMD_BACKUP:
+      profiled_mutex_lock(&n_current_backups_lock, "n_current_backups_lock");
+      if (active_backups >= max_backups) {
+        wait(NULL);
+      } else {
+        active_backups++;
+      }
+      profiled_mutex_unlock(&n_current_backups_lock);
+      *now = jobstats_lap(stats, JOB_BACKUP_WAIT, *now);
+      int aux = kvs_backup(++*file_backups, filename, jobs_directory);
+      *now = jobstats_lap(stats, JOB_BACKUP, *now);
+
+      if (aux < 0) {
+        write_str(STDERR_FILENO, "Failed to do backup\n");
+      } else if (aux == 1) {
+        return STEP_CHILD;
+      }
+      break;
+
+    case CMD_INVALID:
+      write_str(STDERR_FILENO, "Invalid command. See HELP for usage\n");
+      break;
+
+    case CMD_HELP:
+      write_str(STDOUT_FILENO,
+                "Available commands:\n"
+                "  WRITE [(key,value)(key2,value2),...]\n"
+                "  WRITE_TTL <ttl_ms> [(key,value)(key2,value2),...]\n"
+                "  CAS [(key,version,value)(key2,version2,value2),...]\n"
+                "  INCR [(key,delta)(key2,delta2),...]\n"
+                "  APPEND [(key,suffix)(key2,suffix2),...]\n"
+                "  READ [key,key2,...]\n"
+                "  VERSION [key,key2,...]\n"
+                "  DELETE [key,key2,...]\n"
+                "  SHOW\n"
+                "  SCAN [prefix] or SCAN [first,last]\n"
+                "  WAIT <delay_ms>\n"
+                "  BACKUP\n"
+                "  HELP\n");
+
+      break;
+
+    case CMD_EMPTY:
+    case EOC:
+      break;
+  }
+  return STEP_DONE;
+}
+
+// Comandos de um troço de um job, partilhados com as threads que ajudam a corrê-lo
+typedef struct {
+  JobOp* ops;
+  OpResult* results;
+  const size_t* order;  // comandos do nível a correr
+} SegmentRun;
+
+static void apply_item(void* arg, size_t index) {
+  SegmentRun* run = arg;
+  size_t n = run->order[index];
+  op_apply(&run->ops[n], &run->results[n]);
+}
+
+// Corre os comandos [begin, end), que não têm barreiras entre si, nível a nível no pool das threads
+// de jobs, e escreve depois os resultados pela ordem do job. Retorna 1, sem ter corrido nada, se
+// faltar memória
+static int run_segment(JobProgram* program, size_t begin, size_t end, int out_fd, char* filename,
+                       size_t* file_backups, JobStats* stats, uint64_t* now) {
+  size_t count = end - begin;
+  size_t* levels = malloc(count * sizeof(size_t));
+  size_t* order = malloc(count * sizeof(size_t));
+  OpResult* results = calloc(count, sizeof(OpResult));
+  size_t top = levels != NULL ? job_program_levels(program, begin, end, levels) : SIZE_MAX;
+  size_t* starts = top != SIZE_MAX ? calloc(top + 2, sizeof(size_t)) : NULL;
+
+  size_t ready = 0;
+  if (order != NULL && results != NULL && starts != NULL) {
+    while (ready < count &&
+           (levels[ready] == 0 || op_result_init(&program->ops[begin + ready], &results[ready]) == 0)) {
+      ready++;
+    }
+  }
+  if (ready < count) {
+    for (size_t i = 0; results != NULL && i < ready; i++) {
+      free(results[i].block);
+    }
+    free(levels);
+    free(order);
+    free(results);
+    free(starts);
+    return 1;
+  }
+
+  // Ordena os comandos por nível, mantendo a ordem do job dentro de cada um. Depois de os colocar,
+  // starts[level] é o fim do nível e starts[level - 1] o início
+  for (size_t i = 0; i < count; i++) {
+    starts[levels[i] + 1]++;
+  }
+  for (size_t level = 1; level <= top + 1; level++) {
+    starts[level] += starts[level - 1];
+  }
+  for (size_t i = 0; i < count; i++) {
+    order[starts[levels[i]]++] = i;
+  }
+
+  SegmentRun run = {program->ops + begin, results, NULL};
+  for (size_t level = 1; level <= top; level++) {
+    run.order = order + starts[level - 1];
+    pool_run(apply_item, &run, starts[level] - starts[level - 1]);
+  }
+  *now = jobstats_lap(stats, JOB_TABLE, *now);
+
+  // Os comandos sem chaves (HELP, inválidos) não têm nada para correr antes
+  for (size_t i = 0; i < count; i++) {
+    JobOp* op = &program->ops[begin + i];
+    if (levels[i] > 0) {
+      op_output(op, &results[i], out_fd, stats);
+      op_result_free(op, &results[i]);
+    } else {
+      run_op(op, out_fd, filename, file_backups, stats, now);
+    }
+  }
+  *now = jobstats_lap(stats, JOB_OUTPUT, *now);
+
+  free(levels);
+  free(order);
+  free(results);
+  free(starts);
+  return 0;
+}
+
+// Um job em curso, com tudo o que é preciso para o retomar depois de um WAIT
+typedef struct {
+  SchedEntry timer;  // primeiro membro: o job é obtido da entrada devolvida pelo sched_next com um cast
+  int in_fd;         // -1 depois de o job ser lido inteiro
+  int out_fd;
+  int compiled;                                 // 1 se é um .jobc
+  char filename[MAX_JOB_FILE_NAME_SIZE];        // nome no diretório, que o kvs_backup corta no '.'
+  char in_path[MAX_JOB_FILE_NAME_SIZE];
+  char out_path[MAX_JOB_FILE_NAME_SIZE];
+  char stats_path[MAX_JOB_FILE_NAME_SIZE + 2];  // ver entry_files
+  int loaded;                                   // 1 se o job foi lido inteiro para 'program'
+  int parallel;                                 // 1 se os comandos independentes correm em paralelo
+  JobProgram program;
+  size_t next;  // próximo comando de 'program'
+  size_t file_backups;
+  JobStats stats;
+  uint64_t now;  // último lap
+} Job;
+
+// Lê o job inteiro antes de o executar, para o reescrever com o job_program_optimize (-O) e/ou
+// correr os comandos independentes em várias threads (-P). Um job compilado (.jobc) é sempre lido
+// assim, já sem nada para analisar. Retorna 1 se não o conseguir ler
+static int load_job(Job* job) {
+  int failed = job->compiled ? jobc_load(job->in_fd, &job->program, job->stats.commands)
+                             : job_program_load(job->in_fd, &job->program, job->stats.commands);
+  if (failed) {
+    write_str(STDERR_FILENO, "Failed to load job\n");
+    return 1;
+  }
+  if (optimize_jobs) {
+    job->stats.commands_folded = job_program_optimize(&job->program);
+  }
+  job->now = jobstats_lap(&job->stats, JOB_PARSE, job->now);
+
+  // As versões dependem da ordem de todas as escritas do job, por isso esses jobs correm em série
+  job->parallel = parallel_jobs && !job_program_prints_versions(&job->program);
+  job->loaded = 1;
   return 0;
 }
 
-static int run_job(int in_fd, int out_fd, char* filename) {
-  size_t file_backups = 0;
+// Corre um job lido por inteiro a partir do comando onde ficou
+static enum JobStep run_loaded_job(Job* job, uint64_t* deadline) {
+  JobProgram* program = &job->program;
+  while (job->next < program->count) {
+    size_t i = job->next;
+    size_t end = i + 1;
+    while (job->parallel && end < program->count && !job_op_is_barrier(program->ops[i].cmd) &&
+           !job_op_is_barrier(program->ops[end].cmd)) {
+      end++;
+    }
+    if (end - i > 1 && run_segment(program, i, end, job->out_fd, job->filename, &job->file_backups, &job->stats,
+                                   &job->now) == 0) {
+      job->next = end;
+      continue;
+    }
+
+    while (job->next < end) {
+      JobOp* op = &program->ops[job->next++];
+      enum JobStep step = run_op(op, job->out_fd, job->filename, &job->file_backups, &job->stats, &job->now);
+      if (step == STEP_WAIT) {
+        *deadline = job->now + (uint64_t)op->arg * 1000000u;
+      }
+      // O filho de um BACKUP sai logo, sem precisar de libertar o programa
+      if (step != STEP_DONE) {
+        return step;
+      }
+    }
+  }
+  job_program_free(program);
+  jobstats_lap(&job->stats, JOB_PARSE, job->now);
+  printf("EOF\n");
+  return STEP_DONE;
+}
+
+// Corre um job até ao fim, até ao filho de um BACKUP ou até um WAIT, com 'deadline' no fim da espera
+static enum JobStep run_job(Job* job, uint64_t* deadline) {
+  if (job->loaded) {
+    return run_loaded_job(job, deadline);
+  }
+
+  // O job é lido à medida que corre, por isso a posição no ficheiro guarda onde ficou
   while (1) {
-    char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-    char values[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-    unsigned int delay;
-    size_t num_pairs;
-
-    switch (get_next(in_fd)) {
-      case CMD_WRITE:
-        num_pairs = parse_write(in_fd, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-        if (num_pairs == 0) {
-          write_str(STDERR_FILENO, "Invalid command. See HELP for usage\n");
-          continue;
-        }
+    JobOp op;
+    enum Command cmd = job_op_parse(job->in_fd, &op);
+    job->now = jobstats_lap(&job->stats, JOB_PARSE, job->now);
+    if (cmd == EOC) {
+      printf("EOF\n");
+      return STEP_DONE;
+    }
 
-        if (kvs_write(num_pairs, keys, values)) {
-          write_str(STDERR_FILENO, "Failed to write pair\n");
-        }
+    job->stats.commands[cmd]++;
+    enum JobStep step = run_op(&op, job->out_fd, job->filename, &job->file_backups, &job->stats, &job->now);
+    if (step == STEP_WAIT) {
+      *deadline = job->now + (uint64_t)op.arg * 1000000u;
+    }
+    job_op_clear(&op);
+    if (step != STEP_DONE) {
+      return step;
+    }
+  }
+}
+
+// Fecha um job que terminou e escreve as suas estatísticas
+static void finish_job(Job* job) {
+  if (job->in_fd != -1) {
+    close(job->in_fd);
+  }
+  close(job->out_fd);
+
+  // O kvs_backup corta o nome do ficheiro no '.', por isso o nome do job vem do caminho
+  if (jobstats_finish(&job->stats, strrchr(job->in_path, '/') + 1, job->stats_path) != 0) {
+    write_str(STDERR_FILENO, "Failed to write job stats\n");
+  }
+  free(job);
+  sched_job_finished();
+}
+
+// Tira o próximo job do diretório, no lugar reservado pelo SCHED_START. Retorna NULL quando não há
+// mais nenhum, devolvendo o lugar
+static Job* next_job(struct SharedData* thread_data) {
+  Job* job = calloc(1, sizeof(Job));
+  if (job == NULL) {
+    write_str(STDERR_FILENO, "Failed to allocate job\n");
+    sched_job_finished();
+    return NULL;
+  }
+
+  if (profiled_mutex_lock(&thread_data->directory_mutex, "directory_mutex") != 0) {
+    fprintf(stderr, "Thread failed to lock directory_mutex\n");
+    free(job);
+    sched_job_finished();
+    return NULL;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(thread_data->dir)) != NULL &&
+         entry_files(thread_data->dir_name, entry, job->in_path, job->out_path, job->stats_path, &job->compiled)) {
+  }
+  if (entry != NULL) {
+    snprintf(job->filename, sizeof(job->filename), "%s", entry->d_name);
+  } else {
+    // Ainda com o diretório, para que uma thread que o encontre vazio veja todos os jobs tirados dele
+    sched_no_more_jobs();
+  }
+  if (profiled_mutex_unlock(&thread_data->directory_mutex) != 0) {
+    fprintf(stderr, "Thread failed to unlock directory_mutex\n");
+  }
+  if (entry == NULL) {
+    free(job);
+    return NULL;
+  }
+  return job;
+}
+
+// Sem descritores livres o job não falha: fica adiado até outro job fechar os seus
+static int out_of_fds(void) {
+  return errno == EMFILE || errno == ENFILE;
+}
+
+// Abre os ficheiros de um job e, se for preciso, lê-o inteiro. Retorna 0 se o job pode correr, 1 se
+// foi adiado por falta de descritores e -1 se foi saltado: a thread pode ter outros jobs para retomar
+static int open_job(Job* job) {
+  job->in_fd = open(job->in_path, O_RDONLY);
+  if (job->in_fd == -1) {
+    if (out_of_fds()) {
+      sched_defer(&job->timer);
+      return 1;
+    }
+    write_str(STDERR_FILENO, "Failed to open input file: ");
+    write_str(STDERR_FILENO, job->in_path);
+    write_str(STDERR_FILENO, "\n");
+    free(job);
+    sched_job_finished();
+    return -1;
+  }
+
+  job->out_fd = open(job->out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (job->out_fd == -1) {
+    int deferred = out_of_fds();
+    if (!deferred) {
+      write_str(STDERR_FILENO, "Failed to open output file: ");
+      write_str(STDERR_FILENO, job->out_path);
+      write_str(STDERR_FILENO, "\n");
+    }
+    close(job->in_fd);
+    if (deferred) {
+      sched_defer(&job->timer);
+      return 1;
+    }
+    free(job);
+    sched_job_finished();
+    return -1;
+  }
+
+  // Cada troço do job termina com um jobstats_lap, que passa a medir o seguinte a partir daí
+  job->now = jobstats_start(&job->stats);
+  if (job->compiled || optimize_jobs || parallel_jobs) {
+    int failed = load_job(job);
+    // Um job lido inteiro já não precisa do ficheiro enquanto corre ou está suspenso
+    close(job->in_fd);
+    job->in_fd = -1;
+    if (failed) {
+      finish_job(job);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Uma thread sem mais jobs ajuda os que ainda correm comandos em paralelo (-P) antes de terminar
+static void leave_job_thread(void) {
+  if (parallel_jobs) {
+    pool_help(max_threads);
+  }
+  pthread_exit(NULL);
+}
+
+// Os jobs correm até um WAIT e são então suspensos, deixando a thread livre para outros. Os jobs cuja
+// espera terminou passam à frente dos que estão no diretório, que só é lido enquanto há menos de
+// max_jobs_in_progress jobs em curso; quando este se esgota, a thread espera pelos suspensos até não
+// haver nenhum job em curso
+static void* get_file(void* arguments) {
+  // Definir um conjunto de sinais a ser bloqueado
+  sigset_t set;
+  sigemptyset(&set);         // Inicializa o conjunto de sinais com nenhum sinal
+  sigaddset(&set, SIGUSR1);  // Adiciona SIGUSR1 ao conjunto de sinais
+  sigaddset(&set, SIGUSR2);  // Adiciona SIGUSR2 ao conjunto de sinais
+  sigaddset(&set, SIGINT);   // Adiciona SIGINT ao conjunto de sinais
+  sigaddset(&set, SIGTERM);  // Adiciona SIGTERM ao conjunto de sinais
+  sigaddset(&set, SIGPIPE);  // Adiciona SIGPIPE ao conjunto de sinais
+
+  // Bloquear os sinais definidos no conjunto
+  pthread_sigmask(SIG_BLOCK, &set, NULL);  // Bloqueia os sinais especificados no conjunto 'set' para a thread atual
+
+  struct SharedData* thread_data = (struct SharedData*)arguments;  // codigo do esqueleto (não comentado)
+
+  while (1) {
+    SchedEntry* entry = NULL;
+    Job* job = NULL;
+    enum SchedAction action = sched_next(&entry);
+    if (action == SCHED_DONE) {
+      break;
+    }
+    if (action == SCHED_RESUME) {
+      // O tempo em que o job esteve suspenso conta como espera
+      job = (Job*)entry;
+      job->now = jobstats_lap(&job->stats, JOB_SLEEP, job->now);
+    } else {
+      job = action == SCHED_RETRY ? (Job*)entry : next_job(thread_data);
+      if (job == NULL || open_job(job) != 0) {
+        continue;
+      }
+    }
+
+    uint64_t deadline = 0;
+    switch (run_job(job, &deadline)) {
+      case STEP_DONE:
+        finish_job(job);
         break;
 
-      case CMD_READ:
-        num_pairs = parse_read_delete(in_fd, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      case STEP_WAIT:
+        sched_suspend(&job->timer, deadline);
+        break;
 
-        if (num_pairs == 0) {
-          write_str(STDERR_FILENO, "Invalid command. See HELP for usage\n");
-          continue;
+      case STEP_CHILD:
+        if (job->in_fd != -1) {
+          close(job->in_fd);
         }
+        close(job->out_fd);
+        if (closedir(thread_data->dir) == -1) {
+          fprintf(stderr, "Failed to close directory\n");
+          return 0;
+        }
+        exit(0);
+    }
+  }
+
+  leave_job_thread();
+  return NULL;
+}
+
+// Função para lidar com desconexão súbita de um cliente
+int client_sudden_disconnect(Client* client) {
+  int client_req_fd = client->client_req_fd;
+  int client_resp_fd = client->client_resp_fd;
+  int client_notif_fd = client->client_notif_fd;
+
+  // Verificar se os FDs dos pipes são válidos
+  if (client_req_fd < 0 || client_resp_fd < 0 || client_notif_fd < 0) {
+    return 0;  // Retornar 0 se algum pipe não for válido
+  }
+
+  // Remover o cliente da lista de clientes, para que não comecem novas entregas
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  for (int i = 0; i < MAX_SESSION_COUNT; i++) {
+    if (clients_list[i] == client) {
+      clients_list[i] = NULL;  // Definir a posição do cliente como NULL
+      break;
+    }
+  }
+  profiled_mutex_unlock(&clients_lock);
+
+  unsubscribe_all(client);
+
+  // Fechar os anéis acorda as entregas à espera de espaço; a região continua mapeada até estas
+  // terminarem
+  if (client->shm != NULL) {
+    shm_region_close(client->shm);
+  }
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  while (client->deliveries > 0) {
+    profiled_cond_wait(&clients_cond, &clients_lock);
+  }
+  profiled_mutex_unlock(&clients_lock);
+
+  if (client->shm != NULL) {
+    shm_region_release(client->shm);
+  }
+  pthread_mutex_destroy(&client->notif_lock);
+  free(client);  // Libertar a memória associada ao cliente
+
+  // Fechar os FDs dos pipes do cliente (ou o socket, que é partilhado pelos três)
+  close(client_req_fd);
+  if (client_resp_fd != client_req_fd) {
+    close(client_resp_fd);
+    close(client_notif_fd);
+  }
+
+  return 0;  // Retornar 0 indicando que a desconexão foi processada com sucesso
+}
+
+// Lê os próximos pedidos do cliente, do anel de pedidos ou do FIFO
+static ssize_t session_read(Client* client, void* buffer, size_t size) {
+  if (client->shm != NULL) {
+    return shm_ring_read(&client->shm->requests, buffer, size, client->client_req_fd);
+  }
+
+  if (!client->socket) {
+    // O FIFO de pedidos foi aberto sem bloquear, possivelmente antes de o cliente o abrir para
+    // escrita. O poll só indica fim de ficheiro depois de o cliente o ter aberto e fechado.
+    struct pollfd pfd = {client->client_req_fd, POLLIN, 0};
+    if (poll(&pfd, 1, -1) == -1) {
+      return -1;
+    }
+  }
+  return read(client->client_req_fd, buffer, size);
+}
+
+// Escreve respostas para o cliente, no anel de respostas ou no FIFO
+static int session_write(Client* client, const void* buffer, size_t size) {
+  if (client->shm != NULL) {
+    return shm_ring_write(&client->shm->responses, buffer, size, client->client_resp_fd);
+  }
+  return write_all(client->client_resp_fd, buffer, size);
+}
+
+// Entrega uma notificação a um subscritor: clientes com memória partilhada recebem-na no anel de
+// notificações, clientes ligados por socket num frame OP_CODE_NOTIFY (o socket também transporta as
+// respostas), os restantes diretamente no FIFO. Um fd que já não é de nenhum cliente é ignorado
+static int deliver_notification(int notif_fd, const void* buffer, size_t size) {
+  // O cliente não pode ser libertado enquanto a entrega estiver contada
+  Client* client = NULL;
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  for (int i = 0; i < MAX_SESSION_COUNT && client == NULL; i++) {
+    if (clients_list[i] != NULL && clients_list[i]->client_notif_fd == notif_fd) {
+      client = clients_list[i];
+      client->deliveries++;
+    }
+  }
+  profiled_mutex_unlock(&clients_lock);
+  if (client == NULL) {
+    return 0;  // Falhar faria o notify_fds desistir dos restantes subscritores
+  }
+
+  int failed;
+  if (client->shm != NULL) {
+    profiled_mutex_lock(&client->notif_lock, "notif_lock");
+    failed = shm_ring_write(&client->shm->notifications, buffer, size, notif_fd) != 1;
+    profiled_mutex_unlock(&client->notif_lock);
+  } else if (client->socket) {
+    char frame[FRAME_HEADER_SIZE + sizeof(uint16_t) + MAX_STRING_SIZE];
+    frame_init(frame, OP_CODE_NOTIFY, 0, 0);
+    frame_add_field(frame, sizeof(frame), buffer, strnlen(buffer, size));
+    failed = send(notif_fd, frame, frame_size(frame), MSG_NOSIGNAL) == -1;
+  } else {
+    failed = write(notif_fd, buffer, size) == -1;
+  }
+
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  if (--client->deliveries == 0) {
+    pthread_cond_broadcast(&clients_cond);
+  }
+  profiled_mutex_unlock(&clients_lock);
+  return failed;
+}
 
-        if (kvs_read(num_pairs, keys, out_fd)) {
-          write_str(STDERR_FILENO, "Failed to read pair\n");
+// Verifica se todas as chaves de um pedido têm uma lista na tabela, ou seja, se começam por uma letra
+// ou um algarismo. Retorna 1 se sim, 0 caso contrário
+static int valid_keys(size_t num_pairs, char keys[][MAX_STRING_SIZE]) {
+  for (size_t i = 0; i < num_pairs; i++) {
+    if (hash(keys[i]) < 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Processa um pedido de um cliente e escreve o frame de resposta em 'response'.
+// Retorna 1 se o pedido terminou a sessão (DISCONNECT), 0 caso contrário.
+static int handle_request(Client* client, const FrameHeader* header, const char* payload, char* response) {
+  int client_notif_fd = client->client_notif_fd;
+  char key[MAX_STRING_SIZE];
+  char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  char values[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  KvsValue* stored[MAX_WRITE_SIZE];
+  int results[MAX_WRITE_SIZE];
+  uint64_t versions[MAX_WRITE_SIZE];
+  uint64_t expected[MAX_WRITE_SIZE];
+  int64_t deltas[MAX_WRITE_SIZE];
+  int64_t sums[MAX_WRITE_SIZE];
+  size_t offset = 0, num_pairs = 0;
+  int res;
+
+  // Processa o comando baseado no código de operação
+  switch (header->op_code) {
+    case OP_CODE_DISCONNECT:
+      // Remove todas as subscrições do cliente
+      frame_init(response, OP_CODE_DISCONNECT, (uint8_t)unsubscribe_all(client), header->request_id);
+      return 1;
+
+    case OP_CODE_SUBSCRIBE:
+      // Processamento do comando de subscrição
+      if (frame_next_string(payload, header->payload_len, &offset, key, MAX_STRING_SIZE) != 1) {
+        frame_init(response, OP_CODE_SUBSCRIBE, 0, header->request_id);
+        break;
+      }
+      res = kvs_subscription(key, client_notif_fd);
+
+      // Resposta sobre a subscrição
+      if (res == 0) {
+        profiled_mutex_lock(&clients_lock, "clients_lock");
+        res = key_insert(&client->subscriptions, key);
+        profiled_mutex_unlock(&clients_lock);
+        if (res != 0) {
+          fprintf(stderr, "Falha inserir chave\n");
         }
+      }
+      frame_init(response, OP_CODE_SUBSCRIBE, res == 0 ? 1 : 0, header->request_id);
+      break;
+
+    case OP_CODE_UNSUBSCRIBE:
+      // Processamento do comando de desinscrição
+      if (frame_next_string(payload, header->payload_len, &offset, key, MAX_STRING_SIZE) != 1) {
+        frame_init(response, OP_CODE_UNSUBSCRIBE, 1, header->request_id);
         break;
+      }
+      res = kvs_unsubscription(key, client_notif_fd);
+
+      // Resposta sobre a desinscrição
+      if (res == 0) {
+        profiled_mutex_lock(&clients_lock, "clients_lock");
+        res = key_delete(&client->subscriptions, key);
+        profiled_mutex_unlock(&clients_lock);
+        if (res != 0) {
+          fprintf(stderr, "Falha remover chave\n");
+        }
+      }
+      frame_init(response, OP_CODE_UNSUBSCRIBE, res == 0 ? 0 : 1, header->request_id);
+      break;
 
-      case CMD_DELETE:
-        num_pairs = parse_read_delete(in_fd, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+    case OP_CODE_READ:
+      // Leitura de várias chaves, usando as mesmas operações em lote dos ficheiros .job
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1) {
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys) ||
+          kvs_read_values(num_pairs, keys, stored) != 0) {
+        frame_init(response, OP_CODE_READ, 1, header->request_id);
+        break;
+      }
 
-        if (num_pairs == 0) {
-          write_str(STDERR_FILENO, "Invalid command. See HELP for usage\n");
-          continue;
+      // Cada campo da resposta é KEY_FOUND/KEY_MISSING seguido do valor. Os clientes guardam valores
+      // de até MAX_STRING_SIZE - 1 bytes, por isso valores maiores seguem truncados a MAX_STRING_SIZE
+      // bytes, um a mais do que cabe, para que o cliente saiba que foram cortados
+      frame_init(response, OP_CODE_READ, 0, header->request_id);
+      for (size_t i = 0; i < num_pairs; i++) {
+        char field[MAX_STRING_SIZE + 2];
+        size_t len = 0;
+        field[0] = stored[i] != NULL ? KEY_FOUND : KEY_MISSING;
+        if (stored[i] != NULL) {
+          len = value_prefix(stored[i], field + 1, MAX_STRING_SIZE + 1);
+          value_unref(stored[i]);
         }
+        frame_add_field(response, FRAME_MAX_SIZE, field, len + 1);
+      }
+      break;
+
+    case OP_CODE_READ_VERSION:
+      // Como o READ, mas cada campo leva também a versão da chave
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1) {
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys) ||
+          kvs_read_versions(num_pairs, keys, stored, versions) != 0) {
+        frame_init(response, OP_CODE_READ_VERSION, 1, header->request_id);
+        break;
+      }
 
-        if (kvs_delete(num_pairs, keys, out_fd)) {
-          write_str(STDERR_FILENO, "Failed to delete pair\n");
+      frame_init(response, OP_CODE_READ_VERSION, 0, header->request_id);
+      for (size_t i = 0; i < num_pairs; i++) {
+        char field[1 + VERSION_FIELD_SIZE + MAX_STRING_SIZE];
+        size_t len = 0;
+        field[0] = stored[i] != NULL ? KEY_FOUND : KEY_MISSING;
+        memcpy(field + 1, &versions[i], VERSION_FIELD_SIZE);
+        if (stored[i] != NULL) {
+          len = value_prefix(stored[i], field + 1 + VERSION_FIELD_SIZE, MAX_STRING_SIZE);
+          value_unref(stored[i]);
         }
+        frame_add_field(response, FRAME_MAX_SIZE, field, 1 + VERSION_FIELD_SIZE + len);
+      }
+      break;
 
-        // Iterar sobre todos os pares de chaves
-        for (size_t i = 0; i < num_pairs; i++) {
-          char* key = keys[i];  // Obter a chave atual
-          // Iterar sobre todos os clientes na lista
-          for (int j = 0; j < MAX_SESSION_COUNT; j++) {
-            if (clients_list[j] != NULL) {  // Verificar se o cliente existe
-              KeySubNode* current =
-                  clients_list[j]->subscriptions;  // Iniciar a iteração sobre as subscrições do cliente
-              // Iterar sobre as subscrições do cliente
-              while (current != NULL) {
-                if (strcmp(current->key, key) == 0) {  // Comparar as strings das chaves (não os ponteiros)
-                  key_delete(&(clients_list[j]->subscriptions),
-                             key);  // Eliminar a chave da lista de subscrições do cliente
-                  break;            // Sair do loop após a remoção da chave
-                }
-                current = current->next;  // Passar para a próxima subscrição
-              }
-            }
-          }
+    case OP_CODE_CAS:
+      // Trios (chave, versão esperada, valor), cada um escrito só se a chave ainda tiver essa versão
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1) {
+        const char* version;
+        size_t len;
+        if (frame_next_field(payload, header->payload_len, &offset, &version, &len) != 1 ||
+            len != VERSION_FIELD_SIZE ||
+            frame_next_string(payload, header->payload_len, &offset, values[num_pairs], MAX_STRING_SIZE) != 1) {
+          break;
         }
+        memcpy(&expected[num_pairs], version, VERSION_FIELD_SIZE);
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys)) {
+        frame_init(response, OP_CODE_CAS, 1, header->request_id);
         break;
+      }
 
-      case CMD_SHOW:
-        kvs_show(out_fd);
+      res = 0;
+      for (size_t i = 0; i < num_pairs; i++) {
+        stored[i] = value_create(values[i], strlen(values[i]));
+        res |= stored[i] == NULL;
+      }
+      if (res == 0) {
+        res = kvs_cas(num_pairs, keys, stored, expected, versions, results);
+      }
+      for (size_t i = 0; i < num_pairs; i++) {
+        value_unref(stored[i]);
+      }
+      if (res != 0) {
+        frame_init(response, OP_CODE_CAS, 1, header->request_id);
         break;
+      }
 
-      case CMD_WAIT:
-        if (parse_wait(in_fd, &delay, NULL) == -1) {
-          write_str(STDERR_FILENO, "Invalid command. See HELP for usage\n");
-          continue;
-        }
+      // Status 0 apenas se todos os pares foram escritos
+      for (size_t i = 0; i < num_pairs; i++) {
+        res |= !results[i];
+      }
+      frame_init(response, OP_CODE_CAS, (uint8_t)res, header->request_id);
+      for (size_t i = 0; i < num_pairs; i++) {
+        char field[1 + VERSION_FIELD_SIZE];
+        field[0] = results[i] ? CAS_WRITTEN : CAS_CONFLICT;
+        memcpy(field + 1, &versions[i], VERSION_FIELD_SIZE);
+        frame_add_field(response, FRAME_MAX_SIZE, field, sizeof(field));
+      }
+      break;
 
-        if (delay > 0) {
-          printf("Waiting %d seconds\n", delay / 1000);
-          kvs_wait(delay);
+    case OP_CODE_INCR:
+      // Pares (chave, incremento), somados no servidor sem o cliente ler o valor antes
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1) {
+        const char* delta;
+        size_t len;
+        if (frame_next_field(payload, header->payload_len, &offset, &delta, &len) != 1 ||
+            len != DELTA_FIELD_SIZE) {
+          break;
         }
+        memcpy(&deltas[num_pairs], delta, DELTA_FIELD_SIZE);
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys) ||
+          kvs_incr(num_pairs, keys, deltas, sums, results) != 0) {
+        frame_init(response, OP_CODE_INCR, 1, header->request_id);
         break;
+      }
 
-      case CMD_BACKUP:
-        pthread_mutex_lock(&n_current_backups_lock);
-        if (active_backups >= max_backups) {
-          wait(NULL);
-        } else {
-          active_backups++;
-        }
-        pthread_mutex_unlock(&n_current_backups_lock);
-        int aux = kvs_backup(++file_backups, filename, jobs_directory);
+      // Status 0 apenas se todas as chaves foram atualizadas
+      res = 0;
+      for (size_t i = 0; i < num_pairs; i++) {
+        res |= !results[i];
+      }
+      frame_init(response, OP_CODE_INCR, (uint8_t)res, header->request_id);
+      for (size_t i = 0; i < num_pairs; i++) {
+        char field[1 + DELTA_FIELD_SIZE];
+        field[0] = results[i] ? INCR_DONE : INCR_FAILED;
+        memcpy(field + 1, &sums[i], DELTA_FIELD_SIZE);
+        frame_add_field(response, FRAME_MAX_SIZE, field, sizeof(field));
+      }
+      break;
 
-        if (aux < 0) {
-          write_str(STDERR_FILENO, "Failed to do backup\n");
-        } else if (aux == 1) {
-          return 1;
-        }
+    case OP_CODE_APPEND:
+      // Pares (chave, sufixo); status 0 apenas se todos os sufixos foram acrescentados
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1 &&
+             frame_next_string(payload, header->payload_len, &offset, values[num_pairs], MAX_STRING_SIZE) == 1) {
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys)) {
+        frame_init(response, OP_CODE_APPEND, 1, header->request_id);
         break;
+      }
+
+      res = 0;
+      for (size_t i = 0; i < num_pairs; i++) {
+        stored[i] = value_create(values[i], strlen(values[i]));
+        res |= stored[i] == NULL;
+      }
+      if (res == 0 && kvs_append(num_pairs, keys, stored, results) == 0) {
+        for (size_t i = 0; i < num_pairs; i++) {
+          res |= !results[i];
+        }
+      } else {
+        res = 1;
+      }
+      for (size_t i = 0; i < num_pairs; i++) {
+        value_unref(stored[i]);
+      }
+      frame_init(response, OP_CODE_APPEND, res == 0 ? 0 : 1, header->request_id);
+      break;
 
-      case CMD_INVALID:
-        write_str(STDERR_FILENO, "Invalid command. See HELP for usage\n");
+    case OP_CODE_WRITE:
+      // Escrita de vários pares (chave, valor)
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1 &&
+             frame_next_string(payload, header->payload_len, &offset, values[num_pairs], MAX_STRING_SIZE) == 1) {
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys)) {
+        frame_init(response, OP_CODE_WRITE, 1, header->request_id);
         break;
+      }
 
-      case CMD_HELP:
-        write_str(STDOUT_FILENO,
-                  "Available commands:\n"
-                  "  WRITE [(key,value)(key2,value2),...]\n"
-                  "  READ [key,key2,...]\n"
-                  "  DELETE [key,key2,...]\n"
-                  "  SHOW\n"
-                  "  WAIT <delay_ms>\n"
-                  "  BACKUP\n"
-                  "  HELP\n");
+      res = 0;
+      for (size_t i = 0; i < num_pairs; i++) {
+        stored[i] = value_create(values[i], strlen(values[i]));
+        res |= stored[i] == NULL;
+      }
+      if (res == 0) {
+        res = kvs_write(num_pairs, keys, stored);
+      }
+      for (size_t i = 0; i < num_pairs; i++) {
+        value_unref(stored[i]);
+      }
+      frame_init(response, OP_CODE_WRITE, res == 0 ? 0 : 1, header->request_id);
+      break;
 
+    case OP_CODE_DELETE:
+      // Remoção de várias chaves
+      while (num_pairs < MAX_WRITE_SIZE &&
+             frame_next_string(payload, header->payload_len, &offset, keys[num_pairs], MAX_STRING_SIZE) == 1) {
+        num_pairs++;
+      }
+      if (num_pairs == 0 || offset != header->payload_len || !valid_keys(num_pairs, keys) ||
+          kvs_delete_keys(num_pairs, keys, results) != 0) {
+        frame_init(response, OP_CODE_DELETE, 1, header->request_id);
         break;
+      }
+      forget_deleted_subscriptions(num_pairs, keys);
 
-      case CMD_EMPTY:
-        break;
+      // Status 0 apenas se todas as chaves existiam
+      res = 0;
+      for (size_t i = 0; i < num_pairs; i++) {
+        res |= !results[i];
+      }
+      frame_init(response, OP_CODE_DELETE, (uint8_t)res, header->request_id);
+      for (size_t i = 0; i < num_pairs; i++) {
+        char field = results[i] ? KEY_FOUND : KEY_MISSING;
+        frame_add_field(response, FRAME_MAX_SIZE, &field, 1);
+      }
+      break;
 
-      case EOC:
-        printf("EOF\n");
-        return 0;
-    }
+    default:
+      // Responde mesmo assim, para que o cliente não fique à espera deste pedido
+      fprintf(stderr, "Opcode inválido\n");
+      frame_init(response, header->op_code, 1, header->request_id);
+      break;
   }
+  return 0;
 }
 
-// frees arguments
-static void* get_file(void* arguments) {
-  // Definir um conjunto de sinais a ser bloqueado
-  sigset_t set;
-  sigemptyset(&set);         // Inicializa o conjunto de sinais com nenhum sinal
-  sigaddset(&set, SIGUSR1);  // Adiciona SIGUSR1 ao conjunto de sinais
-  sigaddset(&set, SIGPIPE);  // Adiciona SIGPIPE ao conjunto de sinais
+// Envia ao cliente todas as respostas acumuladas no buffer de saída
+static int flush_responses(Client* client, const char* out, size_t* out_len) {
+  if (*out_len == 0) {
+    return 0;
+  }
 
-  // Bloquear os sinais definidos no conjunto
-  pthread_sigmask(SIG_BLOCK, &set, NULL);  // Bloqueia os sinais especificados no conjunto 'set' para a thread atual
+  int res = session_write(client, out, *out_len);
+  *out_len = 0;
+  if (res != 1) {
+    if (errno == EPIPE) {
+      fprintf(stderr, "Houve um Kill, Epipe foi lancado\n");
+    }
+    return 1;
+  }
+  return 0;
+}
 
-  struct SharedData* thread_data = (struct SharedData*)arguments;  // codigo do esqueleto (não comentado)
-  DIR* dir = thread_data->dir;
-  char* dir_name = thread_data->dir_name;
+static void* manage_clients(Client* temp_client) {
+  // O cliente pode enviar vários pedidos sem esperar pelas respostas: cada leitura pode trazer
+  // vários frames (ou parte de um), que são todos processados por ordem antes de responder
+  char in[PROTOCOL_MAX_MESSAGE], out[PROTOCOL_MAX_MESSAGE];
+  size_t in_len = 0, out_len = 0;
 
-  if (pthread_mutex_lock(&thread_data->directory_mutex) != 0) {
-    fprintf(stderr, "Thread failed to lock directory_mutex\n");
-    return NULL;
-  }
+  while (1) {
+    // Lemos os pedidos do cliente
+    ssize_t bytes_read = session_read(temp_client, in + in_len, PROTOCOL_MAX_MESSAGE - in_len);
 
-  struct dirent* entry;
-  char in_path[MAX_JOB_FILE_NAME_SIZE], out_path[MAX_JOB_FILE_NAME_SIZE];
-  while ((entry = readdir(dir)) != NULL) {
-    if (entry_files(dir_name, entry, in_path, out_path)) {
+    if (bytes_read < 0 && (errno == EINTR || errno == EAGAIN)) {
       continue;
     }
 
-    if (pthread_mutex_unlock(&thread_data->directory_mutex) != 0) {
-      fprintf(stderr, "Thread failed to unlock directory_mutex\n");
-      return NULL;
+    // Se o cliente desconectar-se
+    if (bytes_read <= 0) {
+      client_sudden_disconnect(temp_client);
+      return 0;
     }
+    in_len += (size_t)bytes_read;
+
+    FrameHeader header;
+    size_t processed = 0;
+    int parsed = 0, ended = 0;
+    while (!ended && (parsed = frame_parse(in + processed, in_len - processed, &header)) == 1) {
+      const char* payload = in + processed + FRAME_HEADER_SIZE;
+      processed += FRAME_HEADER_SIZE + header.payload_len;
+
+      // Garante espaço no buffer de saída para mais uma resposta
+      if (out_len + FRAME_MAX_SIZE > PROTOCOL_MAX_MESSAGE && flush_responses(temp_client, out, &out_len) != 0) {
+        client_sudden_disconnect(temp_client);
+        return 0;
+      }
 
-    int in_fd = open(in_path, O_RDONLY);
-    if (in_fd == -1) {
-      write_str(STDERR_FILENO, "Failed to open input file: ");
-      write_str(STDERR_FILENO, in_path);
-      write_str(STDERR_FILENO, "\n");
-      pthread_exit(NULL);
+      ended = handle_request(temp_client, &header, payload, out + out_len);
+      out_len += frame_size(out + out_len);
     }
 
-    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (out_fd == -1) {
-      write_str(STDERR_FILENO, "Failed to open output file: ");
-      write_str(STDERR_FILENO, out_path);
-      write_str(STDERR_FILENO, "\n");
-      pthread_exit(NULL);
+    // Envia numa só escrita as respostas a todos os pedidos processados
+    if (flush_responses(temp_client, out, &out_len) != 0 || ended) {
+      client_sudden_disconnect(temp_client);
+      return 0;
     }
 
-    int out = run_job(in_fd, out_fd, entry->d_name);
+    if (parsed == -1) {
+      fprintf(stderr, "Frame inválido\n");
+      client_sudden_disconnect(temp_client);
+      return 0;
+    }
 
-    close(in_fd);
-    close(out_fd);
+    // Guarda os bytes de um frame incompleto para a próxima leitura
+    memmove(in, in + processed, in_len - processed);
+    in_len -= processed;
+  }
+  return 0;
+}
 
-    if (out) {
-      if (closedir(dir) == -1) {
-        fprintf(stderr, "Failed to close directory\n");
-        return 0;
-      }
+void consume() {
+  // Espera por um cliente na fila (adormece apenas se estiver vazia)
+  Client* C = mpmc_pop(&session_queue);
 
-      exit(0);
-    }
+  // Processa o cliente lido (chama a função para gerenciar o cliente)
+  manage_clients(C);
+}
 
-    if (pthread_mutex_lock(&thread_data->directory_mutex) != 0) {
-      fprintf(stderr, "Thread failed to lock directory_mutex\n");
-      return NULL;
-    }
+void produce(Client* c) {
+  // Coloca o cliente na fila sem esperar que uma thread gestora o receba
+  mpmc_push(&session_queue, c);
+}
+
+void* clients_loop() {
+  // Define o conjunto de sinais a bloquear
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);  // Bloqueia SIGUSR1
+  sigaddset(&set, SIGUSR2);  // Bloqueia SIGUSR2
+  sigaddset(&set, SIGINT);   // Bloqueia SIGINT
+  sigaddset(&set, SIGTERM);  // Bloqueia SIGTERM
+  sigaddset(&set, SIGPIPE);  // Bloqueia SIGPIPE
+
+  // Bloqueia os sinais SIGUSR1, SIGUSR2, SIGINT, SIGTERM e SIGPIPE na thread atual
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  // Loop infinito para consumir os itens do buffer
+  while (1) {
+    consume();  // Chama a função 'consume' para processar o próximo cliente
   }
+}
 
-  if (pthread_mutex_unlock(&thread_data->directory_mutex) != 0) {
-    fprintf(stderr, "Thread failed to unlock directory_mutex\n");
+// Aloca um cliente para uma nova sessão, ainda sem subscrições nem memória partilhada
+static Client* client_create(int req_fd, int resp_fd, int notif_fd, int use_socket) {
+  Client* new_client = malloc(sizeof(Client));
+  if (new_client == NULL) {
+    fprintf(stderr, "Falha ao alocar memória para o cliente\n");
     return NULL;
   }
 
-  pthread_exit(NULL);
+  new_client->client_req_fd = req_fd;
+  new_client->client_resp_fd = resp_fd;
+  new_client->client_notif_fd = notif_fd;
+  new_client->socket = use_socket;
+  new_client->subscriptions = NULL;
+  new_client->shm = NULL;
+  pthread_mutex_init(&new_client->notif_lock, NULL);
+  new_client->deliveries = 0;
+  return new_client;
 }
 
-// Função para lidar com desconexão súbita de um cliente
-int client_sudden_disconnect(Client* client) {
-  int client_req_fd = client->client_req_fd;
-  int client_resp_fd = client->client_resp_fd;
-  int client_notif_fd = client->client_notif_fd;
+// Ligação cujo handshake ainda não terminou. O listener nunca bloqueia por causa de um cliente:
+// os FIFOs do cliente são abertos sem bloquear e as tentativas repetem-se a cada passagem do
+// ciclo, até o handshake terminar ou expirar.
+typedef struct {
+  Client* client;  // NULL se a posição está livre
+  char resp_path[MAX_PIPE_PATH_LENGTH];
+  char notif_path[MAX_PIPE_PATH_LENGTH];
+  uint32_t request_id;
+  int awaiting_connect;     // socket aceite cujo CONNECT ainda não chegou
+  struct timespec started;  // início do handshake
+} PendingSession;
+
+PendingSession pending_sessions[MAX_PENDING_SESSIONS];
+
+static long elapsed_ms(const struct timespec* since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
 
-  // Verificar se os FDs dos pipes são válidos
-  if (client_req_fd < 0 || client_resp_fd < 0 || client_notif_fd < 0) {
-    return 0;  // Retornar 0 se algum pipe não for válido
+// Liberta um cliente que nunca chegou a ser entregue a uma thread gestora
+static void client_discard(Client* client) {
+  if (client->shm != NULL) {
+    shm_region_release(client->shm);
   }
-
-  // Percorrer a lista de subscrições do cliente e tentar cancelar todas as subscrições
-  KeySubNode* current = client->subscriptions;
-  KeySubNode* next;
-
-  while (current != NULL) {
-    next = current->next;
-
-    // Tentar cancelar a subscrição do cliente para a chave atual
-    if (kvs_unsubscription(current->key, client->client_notif_fd) != 0) {
-      fprintf(stderr, "Falha ao cancelar subscrição da chave: %s\n", current->key);
+  if (client->client_req_fd >= 0) {
+    close(client->client_req_fd);
+  }
+  if (!client->socket) {
+    if (client->client_resp_fd >= 0) {
+      close(client->client_resp_fd);
+    }
+    if (client->client_notif_fd >= 0) {
+      close(client->client_notif_fd);
     }
+  }
+  pthread_mutex_destroy(&client->notif_lock);
+  free(client);
+}
 
-    // Tentar eliminar a chave da lista de subscrições
-    if (key_delete(&client->subscriptions, current->key) != 0) {
-      fprintf(stderr, "Falha ao eliminar subscrição da chave: %s\n", current->key);
+// Guarda um handshake por terminar. Retorna a posição ocupada, ou NULL se não houver espaço
+static PendingSession* pending_add(Client* client, uint32_t request_id, int awaiting_connect) {
+  for (int i = 0; i < MAX_PENDING_SESSIONS; i++) {
+    if (pending_sessions[i].client == NULL) {
+      PendingSession* pending = &pending_sessions[i];
+      pending->client = client;
+      pending->request_id = request_id;
+      pending->awaiting_connect = awaiting_connect;
+      clock_gettime(CLOCK_MONOTONIC, &pending->started);
+      return pending;
     }
+  }
 
-    current = next;  // Avançar para a próxima subscrição
+  write_str(STDERR_FILENO, "Demasiadas ligações pendentes\n");
+  client_discard(client);
+  return NULL;
+}
+
+// Abre sem bloquear a extremidade de escrita de um FIFO do cliente. Retorna 1 se já está aberto,
+// 0 se o cliente ainda não abriu o FIFO para leitura, -1 em caso de erro
+static int open_client_fifo(int* fd, const char* path) {
+  if (*fd >= 0) {
+    return 1;
   }
 
-  // Remover o cliente da lista de clientes
-  for (int i = 0; i < MAX_SESSION_COUNT; i++) {
-    if (clients_list[i] == client) {
-      clients_list[i] = NULL;  // Definir a posição do cliente como NULL
-      free(client);            // Libertar a memória associada ao cliente
-      break;
+  *fd = open(path, O_WRONLY | O_NONBLOCK);
+  if (*fd == -1) {
+    return errno == ENXIO ? 0 : -1;
+  }
+
+  // A partir daqui as escritas (respostas e notificações) voltam a ser bloqueantes
+  int flags = fcntl(*fd, F_GETFL);
+  fcntl(*fd, F_SETFL, flags & ~O_NONBLOCK);
+  return 1;
+}
+
+// Responde ao CONNECT e entrega o cliente a uma thread gestora, sem esperar que esta o receba.
+// O cliente só é aceite quando há uma posição livre na lista de clientes, pelo que a fila
+// partilhada com as threads gestoras nunca está cheia.
+// Retorna 1 se a sessão começou, 0 se ainda não há posição livre, -1 em caso de erro
+static int start_session(Client* new_client, uint32_t request_id) {
+  // Procura uma posição vazia na lista de clientes (clients_list) e adiciona o novo cliente
+  int slot = -1;
+  profiled_mutex_lock(&clients_lock, "clients_lock");
+  for (int i = 0; i < MAX_SESSION_COUNT && slot == -1; i++) {
+    if (clients_list[i] == NULL) {
+      clients_list[i] = new_client;  // Adiciona o cliente na primeira posição vazia
+      slot = i;
     }
   }
+  profiled_mutex_unlock(&clients_lock);
+  if (slot == -1) {
+    return 0;
+  }
 
-  // Fechar os FDs dos pipes do cliente
-  close(client_req_fd);
-  close(client_resp_fd);
-  close(client_notif_fd);
+  // Resposta de conexão com código de operação e status (0)
+  char answer[FRAME_HEADER_SIZE];
+  frame_init(answer, OP_CODE_CONNECT, 0, request_id);
+  frame_set_flags(answer, new_client->shm != NULL ? FRAME_FLAG_SHM : 0);
+
+  // Envia a resposta ao cliente via o descritor de arquivo de resposta
+  if (write_all(new_client->client_resp_fd, answer, FRAME_HEADER_SIZE) != 1) {
+    fprintf(stderr, "Falha ao escrever resposta no fd: %s\n", CONNECT);
+    // Uma entrega pode já ter encontrado o cliente pelo seu fd
+    profiled_mutex_lock(&clients_lock, "clients_lock");
+    clients_list[slot] = NULL;
+    while (new_client->deliveries > 0) {
+      profiled_cond_wait(&clients_cond, &clients_lock);
+    }
+    profiled_mutex_unlock(&clients_lock);
+    return -1;
+  }
 
-  return 0;  // Retornar 0 indicando que a desconexão foi processada com sucesso
+  // Coloca o novo cliente na fila de produção (adiciona ao buffer compartilhado)
+  produce(new_client);
+  return 1;
 }
 
-static void* manage_clients(Client* temp_client) {
-  // Obtemos os descritores de ficheiro do cliente
-  int client_req_fd = temp_client->client_req_fd;
-  int client_resp_fd = temp_client->client_resp_fd;
-  int client_notif_fd = temp_client->client_notif_fd;
+// Avança um handshake tanto quanto possível sem bloquear
+static void pending_advance(PendingSession* pending) {
+  Client* client = pending->client;
+  int res = 0;
 
-  while (1) {
-    char buffer[MAX_READ_SIZE];
-    ssize_t bytes_read;
+  if (!pending->awaiting_connect) {
+    // O cliente abre primeiro o FIFO de respostas e depois o de notificações
+    res = open_client_fifo(&client->client_resp_fd, pending->resp_path);
+    if (res == 1) {
+      res = open_client_fifo(&client->client_notif_fd, pending->notif_path);
+    }
+    if (res == 1) {
+      // Com o handshake completo, um cliente à espera de uma posição livre não expira: fica
+      // apenas a aguardar, como aconteceria com qualquer servidor cheio
+      res = start_session(client, pending->request_id);
+      if (res == 0) {
+        return;
+      }
+    }
+  }
+
+  if (res == 1) {
+    pending->client = NULL;
+    return;
+  }
 
-    // Lemos o pedido do cliente
-    bytes_read = read(client_req_fd, buffer, MAX_READ_SIZE);
+  if (res == 0 && elapsed_ms(&pending->started) < HANDSHAKE_TIMEOUT_MS) {
+    return;
+  }
 
-    // Se o cliente desconectar-se
-    if (bytes_read == 0) {
-      client_sudden_disconnect(temp_client);
-      return 0;
+  // Handshake falhado ou expirado: se for possível, avisa o cliente antes de o descartar
+  if (res == 0) {
+    write_str(STDERR_FILENO, "Handshake expirado\n");
+    if (!pending->awaiting_connect && client->client_resp_fd >= 0) {
+      char answer[FRAME_HEADER_SIZE];
+      frame_init(answer, OP_CODE_CONNECT, 1, pending->request_id);
+      write_all(client->client_resp_fd, answer, FRAME_HEADER_SIZE);
     }
+  }
+  client_discard(client);
+  pending->client = NULL;
+}
 
-    // Se foram lidos dados do cliente
-    if (bytes_read > 0) {
-      int res, cleanup_success;
-      char *saveptr = NULL, answer[MAX_WRITE_SIZE];
-      char* token = strtok_r(buffer, "|", &saveptr);
-      const char* key = NULL;
-
-      // Processa o comando baseado no código de operação
-      switch (atoi(token)) {
-        case OP_CODE_DISCONNECT:
-          cleanup_success = 1;
-
-          KeySubNode* current = temp_client->subscriptions;
-          KeySubNode* next;
-
-          // Remove todas as subscrições do cliente
-          while (current != NULL) {
-            next = current->next;
-            if (kvs_unsubscription(current->key, temp_client->client_notif_fd) != 0) {
-              cleanup_success = 0;
-            }
-
-            if (key_delete(&temp_client->subscriptions, current->key) != 0) {
-              cleanup_success = 0;
-            }
-            current = next;
-          }
-
-          // Envia a resposta ao cliente
-          snprintf(answer, MAX_WRITE_SIZE, "%d|%d", OP_CODE_DISCONNECT, cleanup_success ? 0 : 1);
-
-          if (write(client_resp_fd, answer, strlen(answer)) == -1) {
-            if (errno == EPIPE) {
-              return 0;
-            }
-            fprintf(stderr, "Falha enviar resposta disconnect\n");
-            return 0;
-          }
-
-          // Remover o cliente da lista de clientes
-          for (int i = 0; i < MAX_SESSION_COUNT; i++) {
-            if (clients_list[i] == temp_client) {
-              clients_list[i] = NULL;
-              free(temp_client);
-              break;
-            }
-          }
-
-          // Fechar as conexões com o cliente
-          close(client_req_fd);
-          close(client_resp_fd);
-          close(client_notif_fd);
-          return 0;
+// Regista um novo cliente a partir de um frame de CONNECT recebido no FIFO do servidor
+static int register_client(const FrameHeader* header, const char* payload) {
+  // Os nomes são relativos a /tmp/, pelo que têm de caber no caminho completo
+  char req_name[MAX_PIPE_PATH_LENGTH - 5], resp_name[MAX_PIPE_PATH_LENGTH - 5], notif_name[MAX_PIPE_PATH_LENGTH - 5];
+  char shm_name[MAX_PIPE_PATH_LENGTH];
+  size_t offset = 0;
+
+  // Verifica se a mensagem é um connect com os três nomes dos FIFOs do cliente
+  if (header->op_code != OP_CODE_CONNECT ||
+      frame_next_string(payload, header->payload_len, &offset, req_name, sizeof(req_name)) != 1 ||
+      frame_next_string(payload, header->payload_len, &offset, resp_name, sizeof(resp_name)) != 1 ||
+      frame_next_string(payload, header->payload_len, &offset, notif_name, sizeof(notif_name)) != 1) {
+    write_str(STDERR_FILENO, "Mensagem inválida\n");
+    return 1;
+  }
 
-        case OP_CODE_SUBSCRIBE:
-
-          // Processamento do comando de subscrição
-          key = strtok_r(NULL, "|", &saveptr);
-          res = kvs_subscription(key, client_notif_fd);
-
-          // Resposta sobre a subscrição
-          if (res == 0) {
-            if (key_insert(&temp_client->subscriptions, key) != 0) {
-              fprintf(stderr, "Falha inserir chave\n");
-              return 0;
-            }
-            snprintf(answer, MAX_WRITE_SIZE, "%d|1", OP_CODE_SUBSCRIBE);
-          } else {
-            snprintf(answer, MAX_WRITE_SIZE, "%d|0", OP_CODE_SUBSCRIBE);
-          }
-
-          if (write(client_resp_fd, answer, strlen(answer)) == -1) {
-            if (errno == EPIPE) {
-              fprintf(stderr, "Houve um Kill, Epipe foi lancado\n");
-              return 0;
-            }
-
-            fprintf(stderr, "Falha enviar resposta subscribe\n");
-            return 0;
-          }
+  char full_req_path[MAX_PIPE_PATH_LENGTH];
+  snprintf(full_req_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s", req_name);
 
-          break;
+  // O FIFO de pedidos abre-se já, sem bloquear: assim o cliente não fica à espera de um leitor
+  // quando o abrir para escrita. Os outros dois só abrem depois de o cliente os abrir para leitura.
+  int req_fd = open(full_req_path, O_RDONLY | O_NONBLOCK);
+  if (req_fd == -1) {
+    write_str(STDERR_FILENO, "Falha ao abrir o FIFO de pedidos\n");
+    return 1;
+  }
 
-        case OP_CODE_UNSUBSCRIBE:
-          // Processamento do comando de desinscrição
-          key = strtok_r(NULL, "|", &saveptr);
-          res = kvs_unsubscription(key, client_notif_fd);
-
-          // Resposta sobre a desinscrição
-          if (res == 0) {
-            if (key_delete(&temp_client->subscriptions, key) != 0) {
-              fprintf(stderr, "Falha remover chave\n");
-              return 0;
-            }
-            snprintf(answer, MAX_WRITE_SIZE, "%d|0", OP_CODE_UNSUBSCRIBE);
-          } else {
-            snprintf(answer, MAX_WRITE_SIZE, "%d|1", OP_CODE_UNSUBSCRIBE);
-          }
-
-          if (write(client_resp_fd, answer, strlen(answer)) == -1) {
-            if (errno == EPIPE) {
-              fprintf(stderr, "Houve um Kill, Epipe foi lancado\n");
-              return 0;
-            }
-
-            fprintf(stderr, "Falha enviar resposta unsubscribe\n");
-            return 0;
-          }
+  Client* new_client = client_create(req_fd, -1, -1, 0);
+  if (new_client == NULL) {
+    close(req_fd);
+    return 1;
+  }
 
-          break;
+  // Se o cliente propôs memória partilhada, tenta mapear a região; caso falhe, a sessão continua
+  // pelos FIFOs e o cliente percebe-o pela ausência da flag na resposta
+  if ((header->flags & FRAME_FLAG_SHM) &&
+      frame_next_string(payload, header->payload_len, &offset, shm_name, sizeof(shm_name)) == 1) {
+    new_client->shm = shm_region_attach(shm_name);
+  }
 
-        default:
-          fprintf(stderr, "Opcode inválido\n");
-          break;
-      }
-    }
+  PendingSession* pending = pending_add(new_client, header->request_id, 0);
+  if (pending == NULL) {
+    return 1;
   }
+  snprintf(pending->resp_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s", resp_name);
+  snprintf(pending->notif_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s", notif_name);
+
+  pending_advance(pending);
   return 0;
 }
 
-void consume() {
-  // Espera por um item disponível (não vazio) no buffer
-  if (sem_wait(&full) != 0) {
-    perror("sem_wait(&full) failed");
+// Aceita uma ligação no socket do servidor. O CONNECT é lido mais tarde, quando chegar, para que
+// um cliente que se liga e não envia nada não bloqueie o listener
+static int accept_socket_client(int listen_fd) {
+  int sock = accept(listen_fd, NULL, NULL);
+  if (sock == -1) {
+    if (errno != EINTR && errno != EAGAIN) {
+      write_str(STDERR_FILENO, "Falha ao aceitar ligação\n");
+    }
+    return 1;
+  }
+
+  Client* new_client = client_create(sock, sock, sock, 1);
+  if (new_client == NULL) {
+    close(sock);
+    return 1;
+  }
+  return pending_add(new_client, 0, 1) == NULL;
+}
+
+// Lê o CONNECT de um socket aceite. O primeiro frame não tem nomes de FIFOs: o próprio socket
+// transporta pedidos, respostas e notificações. Se o cliente propuser memória partilhada, o
+// descritor da região vem anexado à mensagem (SCM_RIGHTS).
+static void register_socket_client(PendingSession* pending) {
+  Client* new_client = pending->client;
+  char frame[FRAME_MAX_SIZE];
+  FrameHeader header;
+  int shm_fd;
+  ssize_t received = recv_with_fd(new_client->client_req_fd, frame, sizeof(frame), &shm_fd);
+
+  if (received <= 0 || frame_parse(frame, (size_t)received, &header) != 1 || header.op_code != OP_CODE_CONNECT) {
+    write_str(STDERR_FILENO, "Mensagem inválida\n");
+    if (shm_fd >= 0) {
+      close(shm_fd);
+    }
+    client_discard(new_client);
+    pending->client = NULL;
+    return;
   }
 
-  // Bloqueia o mutex para acessar de forma segura o índice e o buffer
-  if (pthread_mutex_lock(&semExMut) != 0) {
-    perror("pthread_mutex_lock(&semExMut) failed");
+  if (shm_fd >= 0) {
+    if (header.flags & FRAME_FLAG_SHM) {
+      new_client->shm = shm_region_attach_fd(shm_fd);
+    }
+    close(shm_fd);
   }
 
-  // Lê o cliente presente na posição 'read_index' no buffer
-  Client* C = client_server_buffer[read_index];
-  // Atualiza o índice de leitura (circular)
-  read_index = (read_index + 1) % MAX_SESSION_COUNT;
+  pending->request_id = header.request_id;
+  pending->awaiting_connect = 0;
+  pending_advance(pending);
+}
 
-  // Liberta o mutex após atualizar o índice
-  if (pthread_mutex_unlock(&semExMut) != 0) {
-    perror("pthread_mutex_unlock(&semExMut) failed");
+// Cria o socket UNIX (SOCK_SEQPACKET) onde os clientes se podem ligar em alternativa ao FIFO
+static int open_server_socket(const char* path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
   }
+  strcpy(addr.sun_path, path);
 
-  // Liberta o semáforo que indica que o buffer tem espaço para mais itens
-  if (sem_post(&empty) != 0) {
-    perror("sem_post(&empty) failed");
+  // Remove o socket caso já exista
+  if (unlink(path) != 0 && errno != ENOENT) {
+    return -1;
   }
 
-  // Indica que o item foi consumido
-  if (sem_post(&consumed) != 0) {
-    perror("sem_post(&consumed) failed");
+  int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (listen_fd == -1) {
+    return -1;
   }
 
-  // Processa o cliente lido (chama a função para gerenciar o cliente)
-  manage_clients(C);
+  if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, MAX_SESSION_COUNT) != 0) {
+    close(listen_fd);
+    return -1;
+  }
+  return listen_fd;
 }
 
-void produce(Client* c) {
-  // Espera por um espaço disponível (não cheio) no buffer
-  if (sem_wait(&empty) != 0) {
-    perror("sem_wait(&empty) failed");
+// Desconecta todos os clientes após um SIGUSR1
+static void handle_signal_flag() {
+  if (sig_flag == 1) {
+    for (int i = 0; i < MAX_SESSION_COUNT; i++) {
+      profiled_mutex_lock(&clients_lock, "clients_lock");
+      Client* client = clients_list[i];
+      profiled_mutex_unlock(&clients_lock);
+      if (client != NULL) {
+        client_sudden_disconnect(client);
+      }
+    }
+    // Reseta a flag
+    sig_flag = 0;
   }
+}
 
-  // Bloqueia o mutex para acessar de forma segura o índice e o buffer
-  if (pthread_mutex_lock(&semExMut) != 0) {
-    perror("pthread_mutex_lock(&semExMut) failed");
+// Escreve as latências das operações, a contenção dos trincos e o resumo dos jobs na diretoria
+// dos jobs
+static void write_reports() {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", jobs_directory, STATS_FILE_NAME);
+  if (stats_dump(path) != 0) {
+    write_str(STDERR_FILENO, "Falha ao escrever as latências\n");
   }
 
-  // Adiciona o cliente à posição 'write_index' no buffer
-  client_server_buffer[write_index] = c;
-  // Atualiza o índice de escrita (circular)
-  write_index = (write_index + 1) % MAX_SESSION_COUNT;
+  snprintf(path, sizeof(path), "%s/%s", jobs_directory, LOCKPROF_FILE_NAME);
+  if (lockprof_dump(path) != 0) {
+    write_str(STDERR_FILENO, "Falha ao escrever a contenção dos trincos\n");
+  }
 
-  // Liberta o mutex após atualizar o índice
-  if (pthread_mutex_unlock(&semExMut) != 0) {
-    perror("pthread_mutex_unlock(&semExMut) failed");
+  snprintf(path, sizeof(path), "%s/%s", jobs_directory, JOBSTATS_FILE_NAME);
+  if (jobstats_dump(path) != 0) {
+    write_str(STDERR_FILENO, "Falha ao escrever o resumo dos jobs\n");
   }
+}
 
-  // Liberta o semáforo que indica que o buffer tem itens disponíveis para consumir
-  if (sem_post(&full) != 0) {
-    perror("sem_post(&full) failed");
+// Escreve os relatórios após um SIGUSR2
+static void handle_stats_flag() {
+  if (stats_flag == 1) {
+    stats_flag = 0;
+    write_reports();
   }
+}
+
+// Após um SIGINT ou SIGTERM escreve os relatórios e termina o servidor
+static void handle_terminate_flag() {
+  if (terminate_flag == 1) {
+    write_reports();
 
-  // Espera até que o item seja consumido
-  if (sem_wait(&consumed) != 0) {
-    perror("sem_wait(&consumed) failed");
+    char server_socket_path[sizeof(server_pipe_path) + 5];
+    snprintf(server_socket_path, sizeof(server_socket_path), "%s.sock", server_pipe_path);
+    unlink(server_socket_path);
+    unlink(server_pipe_path);
+    exit(0);
   }
 }
 
-void* clients_loop() {
-  // Define o conjunto de sinais a bloquear
-  sigset_t set;
-  sigemptyset(&set);
-  sigaddset(&set, SIGUSR1);  // Bloqueia SIGUSR1
-  sigaddset(&set, SIGPIPE);  // Bloqueia SIGPIPE
+// Lê um tamanho em bytes, com um sufixo K, M ou G opcional
+static int parse_memory_size(const char* str, size_t* bytes) {
+  char* endptr;
+  errno = 0;
+  unsigned long long value = strtoull(str, &endptr, 10);
+  if (endptr == str || errno != 0) {
+    return 1;
+  }
 
-  // Bloqueia os sinais SIGUSR1 e SIGPIPE na thread atual
-  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  unsigned shift = 0;
+  switch (*endptr) {
+    case 'G':
+    case 'g':
+      shift += 10;
+      /* fall through */
+    case 'M':
+    case 'm':
+      shift += 10;
+      /* fall through */
+    case 'K':
+    case 'k':
+      shift += 10;
+      endptr++;
+      break;
+    default:
+      break;
+  }
+  if (*endptr != '\0' || value > (SIZE_MAX >> shift)) {
+    return 1;
+  }
+  *bytes = (size_t)value << shift;
+  return 0;
+}
 
-  // Loop infinito para consumir os itens do buffer
-  while (1) {
-    consume();  // Chama a função 'consume' para processar o próximo cliente
+// Cada job em curso pode ter dois ficheiros abertos, por isso o limite também deixa descritores para
+// as sessões e os backups. Um job que ainda assim fique sem descritores é adiado, não saltado
+static size_t max_jobs_in_progress(void) {
+  size_t max_jobs = max_threads * JOBS_PER_THREAD;
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+      limit.rlim_cur / 4 < max_jobs) {
+    max_jobs = limit.rlim_cur / 4;
   }
+  return max_jobs < max_threads ? max_threads : max_jobs;
 }
 
 static int dispatch_threads(DIR* dir) {
@@ -632,6 +1818,12 @@ static int dispatch_threads(DIR* dir) {
 
   struct SharedData thread_data = {dir, jobs_directory, PTHREAD_MUTEX_INITIALIZER};
 
+  if (sched_init(max_jobs_in_progress()) != 0) {
+    fprintf(stderr, "Falha ao alocar memória para os jobs\n");
+    free(threads);
+    return 1;
+  }
+
   for (size_t i = 0; i < max_threads; i++) {
     if (pthread_create(&threads[i], NULL, get_file, (void*)&thread_data) != 0) {
       fprintf(stderr, "Falha ao criar thread %zu\n", i);
@@ -663,104 +1855,112 @@ static int dispatch_threads(DIR* dir) {
     return 1;
   }
 
-  // Abre o FIFO para leitura
-  int fifo_fd_read = open(server_pipe_path, O_RDONLY);
+  // Abre o FIFO para leitura sem bloquear à espera do primeiro cliente, para que o socket possa ser
+  // atendido entretanto
+  int fifo_fd_read = open(server_pipe_path, O_RDONLY | O_NONBLOCK);
   if (fifo_fd_read == -1) {
     write_str(STDERR_FILENO, "Falha ao abrir o FIFO\n");
     return 1;
   }
 
-  // Abrir para escrita para mais clientes
+  // Abrir para escrita para mais clientes: com um escritor sempre presente, o FIFO nunca chega ao
+  // fim de ficheiro quando os clientes o fecham
+  int fifo_fd_write = open(server_pipe_path, O_WRONLY);
+  if (fifo_fd_write == -1) {
+    write_str(STDERR_FILENO, "Falha ao abrir FIFO\n");
+    return 1;
+  }
+
+  // O socket é opcional: se não puder ser criado, o servidor aceita apenas clientes pelo FIFO
+  char server_socket_path[sizeof(server_pipe_path) + 5];
+  snprintf(server_socket_path, sizeof(server_socket_path), "%s.sock", server_pipe_path);
+  int listen_fd = open_server_socket(server_socket_path);
+  if (listen_fd == -1) {
+    write_str(STDERR_FILENO, "Falha ao criar o socket do servidor\n");
+  }
 
   // LER A MENSAGEM DE CONNECT
+  // Vários clientes podem escrever no FIFO ao mesmo tempo, pelo que uma leitura pode conter
+  // mais do que um frame de connect
+  char buffer[PROTOCOL_MAX_MESSAGE];
+  size_t buffer_len = 0;
+  // Para além dos pontos de entrada, espera também pelo CONNECT dos sockets já aceites
+  struct pollfd fds[2 + MAX_PENDING_SESSIONS];
+  fds[0] = (struct pollfd){fifo_fd_read, POLLIN, 0};
+  fds[1] = (struct pollfd){listen_fd, POLLIN, 0};
   while (1) {
-    char buffer[MAX_READ_SIZE];
+    int has_pending = 0;
+    for (int i = 0; i < MAX_PENDING_SESSIONS; i++) {
+      PendingSession* pending = &pending_sessions[i];
+      fds[2 + i].fd = pending->client != NULL && pending->awaiting_connect ? pending->client->client_req_fd : -1;
+      fds[2 + i].events = POLLIN;
+      fds[2 + i].revents = 0;
+      has_pending |= pending->client != NULL;
+    }
 
-    // Loop para processar mais clientes
-    if (read(fifo_fd_read, buffer, MAX_READ_SIZE) == -1) {
-      // Verifica se houve erro ao ler do FIFO, especificamente se foi causado por um sinal interrompido (EINTR)
+    // Espera por clientes em qualquer um dos pontos de entrada (fds negativos são ignorados). Com
+    // handshakes pendentes acorda periodicamente para voltar a tentar abrir os FIFOs dos clientes
+    if (poll(fds, 2 + MAX_PENDING_SESSIONS, has_pending ? HANDSHAKE_RETRY_MS : -1) == -1) {
+      // Verifica se a espera foi interrompida por um sinal (EINTR)
       if (errno == EINTR) {
         // Se a flag de sinal (sig_flag) estiver ativada, processa a desconexão súbita dos clientes
-        if (sig_flag == 1) {
-          for (int i = 0; i < MAX_SESSION_COUNT; i++) {
-            if (clients_list[i] != NULL) {
-              client_sudden_disconnect(clients_list[i]);
-            }
-          }
-          // Reseta a flag e continua o loop
-          sig_flag = 0;
-          continue;
-        }
+        handle_signal_flag();
+        handle_stats_flag();
+        handle_terminate_flag();
       } else {
-        write_str(STDERR_FILENO, "Erro ao ler do FIFO\n");
+        write_str(STDERR_FILENO, "Erro ao esperar por clientes\n");
       }
+      continue;
     }
 
-    // Verifica se o servidor já foi configurado para escrita no FIFO
-    if (write_server_flag == 0) {
-      // Tenta abrir o FIFO para escrita
-      int fifo_fd_write = open(server_pipe_path, O_WRONLY);
-      if (fifo_fd_write == -1) {
-        write_str(STDERR_FILENO, "Falha ao abrir FIFO\n");
-        return 1;
+    for (int i = 0; i < MAX_PENDING_SESSIONS; i++) {
+      if (fds[2 + i].revents != 0 && pending_sessions[i].client != NULL) {
+        register_socket_client(&pending_sessions[i]);
       }
-      // Marca que o servidor está aberto para escrever no FIFO
-      write_server_flag = 1;
     }
 
-    // Processamento da mensagem recebida no buffer
-    char* saveptr = NULL;
-    char* token = strtok_r(buffer, "|", &saveptr);
-
-    // Verifica se a primeira parte da mensagem é o OP_CODE do connect
-    if (token == NULL || strcmp(token, "1") != 0) {
-      write_str(STDERR_FILENO, "Mensagem inválida\n");
-      return 1;
+    if (fds[1].revents & POLLIN) {
+      accept_socket_client(listen_fd);
     }
 
-    // Divisão da mensagem recebida em três partes, utilizando o delimitador '|'
-    char* token1 = strtok_r(NULL, "|", &saveptr);  // Token 1: o caminho do arquivo de pedidos do cliente
-    char* token2 = strtok_r(NULL, "|", &saveptr);  // Token 2: o caminho do arquivo de respostas do cliente
-    char* token3 = strtok_r(NULL, "|", &saveptr);  // Token 3: o caminho do arquivo de notificações do cliente
-
-    char full_req_path[MAX_PIPE_PATH_LENGTH];
-    char full_resp_path[MAX_PIPE_PATH_LENGTH];
-    char full_notif_path[MAX_PIPE_PATH_LENGTH];
-
-    snprintf(full_req_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s", token1);
-    snprintf(full_resp_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s", token2);
-    snprintf(full_notif_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s", token3);
-
-    // Aloca memória para um novo cliente
-    Client* new_client = malloc(sizeof(Client));
-
-    // Abre os arquivos correspondentes aos descritores de arquivo de leitura e escrita para o novo cliente
-    new_client->client_resp_fd = open(full_resp_path, O_WRONLY);
-    new_client->client_notif_fd = open(full_notif_path, O_WRONLY);
-    new_client->client_req_fd = open(full_req_path, O_RDONLY);
-
-    // Inicializa a lista de subscrições do cliente (inicialmente vazia)
-    new_client->subscriptions = NULL;
-
-    // Prepara uma resposta que será enviada ao cliente
-    char answer[MAX_WRITE_SIZE];
-    snprintf(answer, MAX_WRITE_SIZE, "%d|0",
-             OP_CODE_CONNECT);  // Resposta de conexão com código de operação e status (0)
+    // Loop para processar mais clientes
+    ssize_t bytes_read = (fds[0].revents & POLLIN)
+                             ? read(fifo_fd_read, buffer + buffer_len, PROTOCOL_MAX_MESSAGE - buffer_len)
+                             : 0;
+    if (bytes_read == -1) {
+      if (errno == EINTR) {
+        handle_signal_flag();
+        handle_stats_flag();
+        handle_terminate_flag();
+      } else if (errno != EAGAIN) {
+        write_str(STDERR_FILENO, "Erro ao ler do FIFO\n");
+      }
+    } else if (bytes_read > 0) {
+      buffer_len += (size_t)bytes_read;
+
+      // Processamento dos frames recebidos no buffer
+      FrameHeader header;
+      size_t processed = 0;
+      int parsed;
+      while ((parsed = frame_parse(buffer + processed, buffer_len - processed, &header)) == 1) {
+        register_client(&header, buffer + processed + FRAME_HEADER_SIZE);
+        processed += FRAME_HEADER_SIZE + header.payload_len;
+      }
 
-    // Coloca o novo cliente na fila de produção (adiciona ao buffer compartilhado)
-    produce(new_client);
+      if (parsed == -1) {
+        // Não é possível ressincronizar com um frame inválido, descarta o que foi recebido
+        write_str(STDERR_FILENO, "Mensagem inválida\n");
+        processed = buffer_len;
+      }
 
-    // Envia a resposta ao cliente via o descritor de arquivo de resposta
-    if (write(new_client->client_resp_fd, answer, strlen(answer)) == -1) {
-      fprintf(stderr, "Falha ao escrever resposta no fd: %s\n", CONNECT);
-      return 1;  // Retorna em caso de erro
+      memmove(buffer, buffer + processed, buffer_len - processed);
+      buffer_len -= processed;
     }
 
-    // Procura uma posição vazia na lista de clientes (clients_list) e adiciona o novo cliente
-    for (int i = 0; i < MAX_SESSION_COUNT; i++) {
-      if (clients_list[i] == NULL) {
-        clients_list[i] = new_client;  // Adiciona o cliente na primeira posição vazia
-        break;
+    // Volta a tentar os handshakes pendentes e descarta os que expiraram
+    for (int i = 0; i < MAX_PENDING_SESSIONS; i++) {
+      if (pending_sessions[i].client != NULL) {
+        pending_advance(&pending_sessions[i]);
       }
     }
   }
@@ -784,6 +1984,7 @@ static int dispatch_threads(DIR* dir) {
   if (pthread_mutex_destroy(&thread_data.directory_mutex) != 0) {
     fprintf(stderr, "Failed to destroy directory_mutex\n");
   }
+  sched_destroy();
 
   free(threads);
   return 0;
@@ -794,14 +1995,41 @@ int main(int argc, char** argv) {
     perror("signal could not be resolved\n");
     exit(EXIT_FAILURE);
   }
+  if (signal(SIGUSR2, stats_handle) == SIG_ERR) {
+    perror("signal could not be resolved\n");
+    exit(EXIT_FAILURE);
+  }
+  if (signal(SIGINT, terminate_handle) == SIG_ERR || signal(SIGTERM, terminate_handle) == SIG_ERR) {
+    perror("signal could not be resolved\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // As opções vêm antes dos argumentos posicionais
+  int opt, usage_error = 0;
+  while ((opt = getopt(argc, argv, "OP")) != -1) {
+    switch (opt) {
+      case 'O':
+        optimize_jobs = 1;
+        break;
+      case 'P':
+        parallel_jobs = 1;
+        break;
+      default:
+        usage_error = 1;
+    }
+  }
+  // Daqui em diante argv[1] é o primeiro argumento posicional, como se não houvesse opções
+  char* program_name = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
 
-  if (argc < 5) {
+  if (usage_error || argc < 5) {
     write_str(STDERR_FILENO, "Usage: ");
-    write_str(STDERR_FILENO, argv[0]);
-    write_str(STDERR_FILENO, " <jobs_dir>");
+    write_str(STDERR_FILENO, program_name);
+    write_str(STDERR_FILENO, " [-O] [-P] <jobs_dir>");
     write_str(STDERR_FILENO, " <max_threads>");
     write_str(STDERR_FILENO, " <max_backups>");
-    write_str(STDERR_FILENO, " <fifo_register_name> \n");
+    write_str(STDERR_FILENO, " <fifo_register_name> [max_memory]\n");
     return 1;
   }
 
@@ -823,6 +2051,12 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  size_t max_memory = 0;
+  if (argc > 5 && parse_memory_size(argv[5], &max_memory) != 0) {
+    fprintf(stderr, "Invalid max_memory value\n");
+    return 1;
+  }
+
   if (max_backups <= 0) {
     write_str(STDERR_FILENO, "Invalid number of backups\n");
     return 0;
@@ -837,10 +2071,18 @@ int main(int argc, char** argv) {
     write_str(STDERR_FILENO, "Failed to initialize KVS\n");
     return 1;
   }
+  set_notification_sink(deliver_notification);
+  // Corre na thread de manutenção, ao mesmo tempo que os jobs e as sessões; as listas de subscrições
+  // ficam protegidas pelo clients_lock, que o forget_deleted_subscriptions pede
+  kvs_set_removal_callback(forget_deleted_subscriptions);
+  if (max_memory != 0) {
+    kvs_set_memory_budget(max_memory);
+  }
 
-  sem_init(&consumed, 0, 0);
-  sem_init(&empty, 0, MAX_SESSION_COUNT);
-  sem_init(&full, 0, 0);
+  if (mpmc_init(&session_queue, SESSION_QUEUE_SIZE) != 0) {
+    write_str(STDERR_FILENO, "Failed to initialize session queue\n");
+    return 1;
+  }
 
   DIR* dir = opendir(argv[1]);
   if (dir == NULL) {
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE  // syscall()
+
+#include "mpmc.h"
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Número de tentativas antes de adormecer: numa rajada de ligações o próximo item chega quase
+// sempre dentro deste intervalo
+#define MPMC_SPIN_LIMIT 128
+
+static uint32_t eventcount_prepare_wait(EventCount *ec) {
+  atomic_fetch_add(&ec->waiters, 1);
+  return atomic_load(&ec->epoch);
+}
+
+static void eventcount_cancel_wait(EventCount *ec) { atomic_fetch_sub(&ec->waiters, 1); }
+
+// Dorme até que a época mude em relação a 'key', obtida antes de voltar a verificar a condição
+static void eventcount_wait(EventCount *ec, uint32_t key) {
+  while (atomic_load(&ec->epoch) == key) {
+    syscall(SYS_futex, (uint32_t *)&ec->epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+  }
+  atomic_fetch_sub(&ec->waiters, 1);
+}
+
+static void eventcount_notify(EventCount *ec) {
+  // Garante que a alteração feita pelo chamador é vista antes de ler 'waiters'
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ec->waiters, memory_order_relaxed) == 0) {
+    return;
+  }
+  atomic_fetch_add(&ec->epoch, 1);
+  syscall(SYS_futex, (uint32_t *)&ec->epoch, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+int mpmc_init(MpmcQueue *queue, size_t capacity) {
+  if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+    return 1;
+  }
+
+  queue->cells = malloc(capacity * sizeof(MpmcCell));
+  if (queue->cells == NULL) {
+    return 1;
+  }
+
+  // Cada célula começa livre para a primeira volta do produtor
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&queue->cells[i].sequence, i);
+    queue->cells[i].data = NULL;
+  }
+  queue->mask = capacity - 1;
+  atomic_init(&queue->enqueue_pos, 0);
+  atomic_init(&queue->dequeue_pos, 0);
+  atomic_init(&queue->not_empty.epoch, 0);
+  atomic_init(&queue->not_empty.waiters, 0);
+  atomic_init(&queue->not_full.epoch, 0);
+  atomic_init(&queue->not_full.waiters, 0);
+  return 0;
+}
+
+void mpmc_destroy(MpmcQueue *queue) {
+  free(queue->cells);
+  queue->cells = NULL;
+}
+
+int mpmc_try_push(MpmcQueue *queue, void *item) {
+  size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+  MpmcCell *cell;
+
+  while (1) {
+    cell = &queue->cells[pos & queue->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      // Célula livre nesta volta: tenta reservá-la
+      if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // O consumidor ainda não libertou a célula da volta anterior: fila cheia
+      return 1;
+    } else {
+      pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    }
+  }
+
+  cell->data = item;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+  eventcount_notify(&queue->not_empty);
+  return 0;
+}
+
+int mpmc_try_pop(MpmcQueue *queue, void **item) {
+  size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+  MpmcCell *cell;
+
+  while (1) {
+    cell = &queue->cells[pos & queue->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // O produtor ainda não publicou esta célula: fila vazia
+      return 1;
+    } else {
+      pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    }
+  }
+
+  *item = cell->data;
+  // Liberta a célula para a próxima volta do produtor
+  atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+  eventcount_notify(&queue->not_full);
+  return 0;
+}
+
+void mpmc_push(MpmcQueue *queue, void *item) {
+  for (int spins = 0; spins < MPMC_SPIN_LIMIT; spins++) {
+    if (mpmc_try_push(queue, item) == 0) {
+      return;
+    }
+  }
+
+  while (1) {
+    uint32_t key = eventcount_prepare_wait(&queue->not_full);
+    if (mpmc_try_push(queue, item) == 0) {
+      eventcount_cancel_wait(&queue->not_full);
+      return;
+    }
+    eventcount_wait(&queue->not_full, key);
+  }
+}
+
+void *mpmc_pop(MpmcQueue *queue) {
+  void *item;
+  for (int spins = 0; spins < MPMC_SPIN_LIMIT; spins++) {
+    if (mpmc_try_pop(queue, &item) == 0) {
+      return item;
+    }
+  }
+
+  while (1) {
+    uint32_t key = eventcount_prepare_wait(&queue->not_empty);
+    if (mpmc_try_pop(queue, &item) == 0) {
+      eventcount_cancel_wait(&queue->not_empty);
+      return item;
+    }
+    eventcount_wait(&queue->not_empty, key);
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef KVS_MPMC_H
+#define KVS_MPMC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Contador de eventos: permite adormecer à espera de uma condição verificada fora de qualquer
+// trinco, sem perder acordares. Quem notifica só faz uma chamada ao sistema se houver alguém a
+// dormir.
+typedef struct {
+  _Atomic uint32_t epoch;    // incrementado a cada notificação; é também a palavra do futex
+  _Atomic uint32_t waiters;  // threads entre prepare_wait e o fim da espera
+} EventCount;
+
+// Célula do anel: 'sequence' indica se a célula está livre para a volta atual do produtor ou
+// preenchida para a do consumidor
+typedef struct {
+  _Atomic size_t sequence;
+  void *data;
+} MpmcCell;
+
+// Fila limitada com vários produtores e vários consumidores (algoritmo de Vyukov). Cada operação
+// reserva uma posição com um CAS e publica-a pela sequência da célula, sem trincos.
+typedef struct {
+  MpmcCell *cells;
+  size_t mask;
+  char pad_head[64];
+  _Atomic size_t enqueue_pos;
+  char pad_enqueue[64];
+  _Atomic size_t dequeue_pos;
+  char pad_dequeue[64];
+  EventCount not_empty;  // consumidores à espera de itens
+  EventCount not_full;   // produtores à espera de espaço
+} MpmcQueue;
+
+/// Initializes a queue.
+/// @param queue Queue to initialize.
+/// @param capacity Number of slots, must be a power of 2.
+/// @return 0 if the queue was initialized, 1 otherwise.
+int mpmc_init(MpmcQueue *queue, size_t capacity);
+
+/// Frees the slots of a queue. Items still queued are not freed.
+/// @param queue Queue to destroy.
+void mpmc_destroy(MpmcQueue *queue);
+
+/// Adds an item to the queue without blocking.
+/// @param queue Queue to add to.
+/// @param item Item to add.
+/// @return 0 if the item was added, 1 if the queue is full.
+int mpmc_try_push(MpmcQueue *queue, void *item);
+
+/// Removes the oldest item from the queue without blocking.
+/// @param queue Queue to remove from.
+/// @param item Where the removed item is stored.
+/// @return 0 if an item was removed, 1 if the queue is empty.
+int mpmc_try_pop(MpmcQueue *queue, void **item);
+
+/// Adds an item to the queue, sleeping while the queue is full.
+/// @param queue Queue to add to.
+/// @param item Item to add.
+void mpmc_push(MpmcQueue *queue, void *item);
+
+/// Removes the oldest item from the queue, sleeping while the queue is empty.
+/// @param queue Queue to remove from.
+/// @return The removed item.
+void *mpmc_pop(MpmcQueue *queue);
+
+#endif  // KVS_MPMC_H
@@ -1,6 +1,10 @@
 #include "operations.h"
 
 #include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,14 +15,73 @@
 #include "constants.h"
 #include "io.h"
 #include "kvs.h"
+#include "lockprof.h"
+#include "stats.h"
 
 static struct HashTable* kvs_table = NULL;
 
-/// Calculates a timespec from a delay in milliseconds.
-/// @param delay_ms Delay in milliseconds.
-/// @return Timespec with the given delay.
-static struct timespec delay_to_timespec(unsigned int delay_ms) {
-  return (struct timespec){delay_ms / 1000, (delay_ms % 1000) * 1000000};
+static pthread_t maintenance_thread;
+static atomic_int maintenance_stop = 0;
+static RemovalCallback removal_callback = NULL;
+// Só servem para acordar a thread antes do tick quando uma escrita passa o limite de memória
+static pthread_mutex_t maintenance_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t maintenance_cond;
+
+// Remove chaves em lotes de MAX_WRITE_SIZE, largando o trinco entre lotes para não bloquear os
+// jobs durante muito tempo
+static void remove_pairs(size_t (*remove)(HashTable*, char[][MAX_STRING_SIZE], size_t),
+                         char keys[][MAX_STRING_SIZE]) {
+  size_t count;
+  do {
+    profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+    count = remove(kvs_table, keys, MAX_WRITE_SIZE);
+    profiled_rwlock_unlock(&kvs_table->tablelock);
+
+    if (count > 0 && removal_callback != NULL) {
+      removal_callback(count, keys);
+    }
+  } while (count == MAX_WRITE_SIZE);
+}
+
+// Thread que remove as chaves cujo TTL terminou e despeja chaves quando a tabela passa o limite de
+// memória. Acorda a cada tick da roda (ou quando uma escrita passa o limite), mas só pede o trinco
+// quando há trabalho; cada chave custa O(1) na roda e no anel do CLOCK, sem percorrer a tabela
+static void* maintenance_loop(void* arg) {
+  (void)arg;
+  sigset_t set;
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);  // Os sinais são tratados pela thread principal
+
+  char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  while (!atomic_load(&maintenance_stop)) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += EXPIRY_TICK_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    profiled_mutex_lock(&maintenance_lock, "maintenance_lock");
+    if (!atomic_load(&maintenance_stop) && !eviction_pending(kvs_table)) {
+      profiled_cond_timedwait(&maintenance_cond, &maintenance_lock, &deadline);
+    }
+    profiled_mutex_unlock(&maintenance_lock);
+
+    if (expiry_pending(kvs_table)) {
+      remove_pairs(expire_pairs, keys);
+    }
+    if (eviction_pending(kvs_table)) {
+      remove_pairs(evict_pairs, keys);
+    }
+  }
+  return NULL;
+}
+
+// Acorda a thread de manutenção
+static void wake_maintenance(void) {
+  profiled_mutex_lock(&maintenance_lock, "maintenance_lock");
+  pthread_cond_signal(&maintenance_cond);
+  profiled_mutex_unlock(&maintenance_lock);
 }
 
 int kvs_init() {
@@ -28,7 +91,32 @@ int kvs_init() {
   }
 
   kvs_table = create_hash_table();
-  return kvs_table == NULL;
+  if (kvs_table == NULL) {
+    return 1;
+  }
+  if (enable_ordered_index(kvs_table) != 0) {
+    fprintf(stderr, "Failed to create the ordered index\n");
+    free_table(kvs_table);
+    kvs_table = NULL;
+    return 1;
+  }
+
+  // O prazo da espera é medido no relógio monótono, como o resto do servidor
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&maintenance_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  atomic_store(&maintenance_stop, 0);
+  if (pthread_create(&maintenance_thread, NULL, maintenance_loop, NULL) != 0) {
+    fprintf(stderr, "Failed to start the maintenance thread\n");
+    pthread_cond_destroy(&maintenance_cond);
+    free_table(kvs_table);
+    kvs_table = NULL;
+    return 1;
+  }
+  return 0;
 }
 
 int kvs_terminate() {
@@ -37,40 +125,65 @@ int kvs_terminate() {
     return 1;
   }
 
+  atomic_store(&maintenance_stop, 1);
+  wake_maintenance();
+  pthread_join(maintenance_thread, NULL);
+  pthread_cond_destroy(&maintenance_cond);
   free_table(kvs_table);
   kvs_table = NULL;
   return 0;
 }
 
-int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]) {
+void kvs_set_removal_callback(RemovalCallback callback) { removal_callback = callback; }
+
+int kvs_set_memory_budget(size_t bytes) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
-  pthread_rwlock_wrlock(&kvs_table->tablelock);
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+  set_memory_budget(kvs_table, bytes);
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  return 0;
+}
+
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[]) {
+  return kvs_write_ttl(num_pairs, keys, values, 0);
+}
+
+int kvs_write_ttl(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[], unsigned int ttl_ms) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  uint64_t start = stats_now();
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
 
   for (size_t i = 0; i < num_pairs; i++) {
-    if (write_pair(kvs_table, keys[i], values[i]) != 0) {
-      fprintf(stderr, "Failed to write key pair (%s,%s)\n", keys[i], values[i]);
+    if (write_pair_ttl(kvs_table, keys[i], values[i], ttl_ms) != 0) {
+      fprintf(stderr, "Failed to write key %s\n", keys[i]);
     }
   }
 
-  pthread_rwlock_unlock(&kvs_table->tablelock);
-  return 0;
-}
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_WRITE, start);
 
-int kvs_subscription(const char* key, int notif_fd) {
-  if (kvs_table == NULL) {
-    fprintf(stderr, "KVS state must be initialized\n");
-    return 1;  // Retorna erro se a tabela KVS não foi inicializada.
+  if (eviction_pending(kvs_table)) {
+    wake_maintenance();
   }
+  return 0;
+}
 
+// Acrescenta um fd à lista de notificações de uma chave. Chamado com o trinco da tabela
+static int add_subscription(const char* key, int notif_fd) {
   // Verifica se a chave existe na tabela chamando 'read_pair'.
-  char* value = read_pair(kvs_table, key);
+  KvsValue* value = read_pair(kvs_table, key);
   if (value == NULL) {
     return 1;  // Retorna erro se a chave não for encontrada.
   }
+  value_unref(value);
 
   int hsh = hash(key);  // Calcula o índice da chave na tabela hash.
   KeyNode* keyNode = kvs_table->table[hsh];
@@ -104,17 +217,27 @@ int kvs_subscription(const char* key, int notif_fd) {
   return 1;  // Retorna erro se a chave não for encontrada na tabela hash.
 }
 
-int kvs_unsubscription(const char* key, int notif_fd) {
+int kvs_subscription(const char* key, int notif_fd) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;  // Retorna erro se a tabela KVS não foi inicializada.
   }
 
+  // As escritas percorrem os fds subscritos de uma chave com o trinco da tabela
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+  int res = add_subscription(key, notif_fd);
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  return res;
+}
+
+// Retira um fd da lista de notificações de uma chave. Chamado com o trinco da tabela
+static int remove_subscription(const char* key, int notif_fd) {
   // Verifica se a chave existe na tabela chamando 'read_pair'.
-  char* value = read_pair(kvs_table, key);
+  KvsValue* value = read_pair(kvs_table, key);
   if (value == NULL) {
     return 1;
   }
+  value_unref(value);
 
   int hsh = hash(key);  // Calcula o índice da chave na tabela hash.
   KeyNode* keyNode = kvs_table->table[hsh];
@@ -137,79 +260,358 @@ int kvs_unsubscription(const char* key, int notif_fd) {
   return 1;  // Retorna erro se a chave ou o 'notif_fd' não forem encontrados.
 }
 
-int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd) {
+int kvs_unsubscription(const char* key, int notif_fd) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;  // Retorna erro se a tabela KVS não foi inicializada.
+  }
+
+  // As escritas percorrem os fds subscritos de uma chave com o trinco da tabela
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+  int res = remove_subscription(key, notif_fd);
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  return res;
+}
+
+int kvs_read_values(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[]) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
-  pthread_rwlock_rdlock(&kvs_table->tablelock);
+  uint64_t start = stats_now();
+  profiled_rwlock_rdlock(&kvs_table->tablelock, "tablelock");
+
+  // Só são copiadas as referências: os valores são escritos depois de libertar o trinco
+  for (size_t i = 0; i < num_pairs; i++) {
+    values[i] = read_pair(kvs_table, keys[i]);
+  }
+
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_READ, start);
+  return 0;
+}
+
+// Acrescenta os blocos de um valor a um lote de escrita, sem os copiar
+static void batch_add_value(IovBatch* batch, const KvsValue* value) {
+  for (size_t i = 0; i < value->chunk_count; i++) {
+    iov_batch_add(batch, value->chunks[i], value_chunk_len(value, i));
+  }
+}
 
-  write_str(fd, "[");
+void kvs_print_read(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[]) {
+  IovBatch batch;
+  iov_batch_init(&batch, fd);
+  iov_batch_add(&batch, "[", 1);
   for (size_t i = 0; i < num_pairs; i++) {
-    char* result = read_pair(kvs_table, keys[i]);
-    char aux[MAX_STRING_SIZE];
-    if (result == NULL) {
-      snprintf(aux, MAX_STRING_SIZE, "(%s,KVSERROR)", keys[i]);
+    iov_batch_add(&batch, "(", 1);
+    iov_batch_add(&batch, keys[i], strlen(keys[i]));
+    iov_batch_add(&batch, ",", 1);
+    if (values[i] != NULL) {
+      batch_add_value(&batch, values[i]);
     } else {
-      snprintf(aux, MAX_STRING_SIZE, "(%s,%s)", keys[i], result);
+      iov_batch_add(&batch, "KVSERROR", 8);
     }
-    write_str(fd, aux);
-    free(result);
+    iov_batch_add(&batch, ")", 1);
+  }
+  iov_batch_add(&batch, "]\n", 2);
+  if (iov_batch_flush(&batch) != 0) {
+    perror("Error writing read result");
+  }
+}
+
+int kvs_read_versions(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[], uint64_t versions[]) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
   }
-  write_str(fd, "]\n");
 
-  pthread_rwlock_unlock(&kvs_table->tablelock);
+  uint64_t start = stats_now();
+  profiled_rwlock_rdlock(&kvs_table->tablelock, "tablelock");
+  for (size_t i = 0; i < num_pairs; i++) {
+    KvsValue* value = read_pair_version(kvs_table, keys[i], &versions[i]);
+    if (values != NULL) {
+      values[i] = value;
+    } else {
+      value_unref(value);
+    }
+  }
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_READ, start);
   return 0;
 }
 
-int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd) {
+// Escreve uma lista "[(chave,resultado)...]" em que o resultado é um número já formatado, ou
+// 'missing' para as chaves assinaladas em 'ok' com 0
+static void print_numbers(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], char numbers[][24],
+                          const int ok[], const char* missing) {
+  IovBatch batch;
+  iov_batch_init(&batch, fd);
+  iov_batch_add(&batch, "[", 1);
+  for (size_t i = 0; i < num_pairs; i++) {
+    iov_batch_add(&batch, "(", 1);
+    iov_batch_add(&batch, keys[i], strlen(keys[i]));
+    iov_batch_add(&batch, ",", 1);
+    if (ok[i]) {
+      iov_batch_add(&batch, numbers[i], strlen(numbers[i]));
+    } else {
+      iov_batch_add(&batch, missing, strlen(missing));
+    }
+    iov_batch_add(&batch, ")", 1);
+  }
+  iov_batch_add(&batch, "]\n", 2);
+  if (iov_batch_flush(&batch) != 0) {
+    perror("Error writing versions");
+  }
+}
+
+static void print_versions(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t versions[],
+                           const int ok[], const char* missing) {
+  // Os números têm de existir até ao flush, por isso cada um tem o seu espaço
+  char numbers[num_pairs][24];
+  for (size_t i = 0; i < num_pairs; i++) {
+    snprintf(numbers[i], sizeof(numbers[i]), "%" PRIu64, versions[i]);
+  }
+  print_numbers(fd, num_pairs, keys, numbers, ok, missing);
+}
+
+void kvs_print_versions(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t versions[]) {
+  int found[num_pairs];
+  for (size_t i = 0; i < num_pairs; i++) {
+    found[i] = versions[i] != 0;
+  }
+  print_versions(fd, num_pairs, keys, versions, found, "KVSERROR");
+}
+
+int kvs_cas(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[], const uint64_t expected[],
+            uint64_t versions[], int written[]) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
-  pthread_rwlock_wrlock(&kvs_table->tablelock);
+  uint64_t start = stats_now();
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+  for (size_t i = 0; i < num_pairs; i++) {
+    written[i] = cas_pair(kvs_table, keys[i], values[i], expected[i], &versions[i]) == 0;
+  }
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_WRITE, start);
+
+  if (eviction_pending(kvs_table)) {
+    wake_maintenance();
+  }
+  return 0;
+}
 
+void kvs_print_cas(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t versions[],
+                   const int written[]) {
+  print_versions(fd, num_pairs, keys, versions, written, "KVSCONFLICT");
+}
+
+int kvs_incr(size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t deltas[], int64_t results[], int ok[]) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  uint64_t start = stats_now();
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+  for (size_t i = 0; i < num_pairs; i++) {
+    ok[i] = incr_pair(kvs_table, keys[i], deltas[i], &results[i]) == 0;
+  }
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_WRITE, start);
+
+  if (eviction_pending(kvs_table)) {
+    wake_maintenance();
+  }
+  return 0;
+}
+
+void kvs_print_incr(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t results[], const int ok[]) {
+  char numbers[num_pairs][24];
+  for (size_t i = 0; i < num_pairs; i++) {
+    snprintf(numbers[i], sizeof(numbers[i]), "%" PRId64, results[i]);
+  }
+  print_numbers(fd, num_pairs, keys, numbers, ok, "KVSERROR");
+}
+
+int kvs_append(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* suffixes[], int appended[]) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  uint64_t start = stats_now();
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+  for (size_t i = 0; i < num_pairs; i++) {
+    appended[i] = append_pair(kvs_table, keys[i], suffixes[i], MAX_VALUE_SIZE) == 0;
+  }
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_WRITE, start);
+
+  if (eviction_pending(kvs_table)) {
+    wake_maintenance();
+  }
+  return 0;
+}
+
+void kvs_print_append(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int appended[]) {
   int aux = 0;
   for (size_t i = 0; i < num_pairs; i++) {
-    if (delete_pair(kvs_table, keys[i]) != 0) {
+    if (!appended[i]) {
       if (!aux) {
         write_str(fd, "[");
         aux = 1;
       }
-      char str[MAX_STRING_SIZE];
-      snprintf(str, MAX_STRING_SIZE, "(%s,KVSMISSING)", keys[i]);
+      char str[MAX_STRING_SIZE + 16];
+      snprintf(str, sizeof(str), "(%s,KVSERROR)", keys[i]);
       write_str(fd, str);
     }
   }
   if (aux) {
     write_str(fd, "]\n");
   }
+}
+
+int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd) {
+  KvsValue* values[num_pairs];
+
+  if (kvs_read_values(num_pairs, keys, values) != 0) {
+    return 1;
+  }
 
-  pthread_rwlock_unlock(&kvs_table->tablelock);
+  kvs_print_read(fd, num_pairs, keys, values);
+  for (size_t i = 0; i < num_pairs; i++) {
+    value_unref(values[i]);
+  }
   return 0;
 }
 
-void kvs_show(int fd) {
+int kvs_delete_keys(size_t num_pairs, char keys[][MAX_STRING_SIZE], int deleted[]) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
-    return;
+    return 1;
+  }
+
+  uint64_t start = stats_now();
+  profiled_rwlock_wrlock(&kvs_table->tablelock, "tablelock");
+
+  for (size_t i = 0; i < num_pairs; i++) {
+    deleted[i] = delete_pair(kvs_table, keys[i]) == 0;
+  }
+
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  stats_record(STATS_DELETE, start);
+  return 0;
+}
+
+void kvs_print_delete(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int deleted[]) {
+  int aux = 0;
+  for (size_t i = 0; i < num_pairs; i++) {
+    if (!deleted[i]) {
+      if (!aux) {
+        write_str(fd, "[");
+        aux = 1;
+      }
+      char str[MAX_STRING_SIZE];
+      snprintf(str, MAX_STRING_SIZE, "(%s,KVSMISSING)", keys[i]);
+      write_str(fd, str);
+    }
+  }
+  if (aux) {
+    write_str(fd, "]\n");
+  }
+}
+
+int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd) {
+  int deleted[num_pairs];
+
+  if (kvs_delete_keys(num_pairs, keys, deleted) != 0) {
+    return 1;
   }
 
-  pthread_rwlock_rdlock(&kvs_table->tablelock);
-  char aux[MAX_STRING_SIZE];
+  kvs_print_delete(fd, num_pairs, keys, deleted);
+  return 0;
+}
 
+// Escreve "(chave, valor)\n" para cada par da tabela. Só usa writev, por isso pode correr no
+// processo filho de um backup
+static int write_table(int fd) {
+  IovBatch batch;
+  iov_batch_init(&batch, fd);
+  uint64_t now = stats_now();  // clock_gettime também é async signal safe
   for (int i = 0; i < TABLE_SIZE; i++) {
     KeyNode* keyNode = kvs_table->table[i];  // Get the next list head
     while (keyNode != NULL) {
-      snprintf(aux, MAX_STRING_SIZE, "(%s, %s)\n", keyNode->key, keyNode->value);
-      write_str(fd, aux);
+      if (pair_expired(keyNode, now)) {
+        keyNode = keyNode->next;  // Expired but not removed yet
+        continue;
+      }
+      iov_batch_add(&batch, "(", 1);
+      iov_batch_add(&batch, keyNode->key, strlen(keyNode->key));
+      iov_batch_add(&batch, ", ", 2);
+      batch_add_value(&batch, keyNode->value);
+      iov_batch_add(&batch, ")\n", 2);
       keyNode = keyNode->next;  // Move to the next node of the list
     }
   }
+  return iov_batch_flush(&batch);
+}
+
+int kvs_scan(int fd, const char* first, const char* last, size_t* num_pairs) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  IovBatch batch;
+  iov_batch_init(&batch, fd);
+  size_t prefix_len = strlen(first);
+  *num_pairs = 0;
+
+  // Como no SHOW, o lote aponta para a tabela e é escrito antes de largar o trinco
+  profiled_rwlock_rdlock(&kvs_table->tablelock, "tablelock");
+  uint64_t now = stats_now();
+  iov_batch_add(&batch, "[", 1);
+  for (SkipNode* node = skiplist_seek(kvs_table->ordered, first); node != NULL; node = node->next[0]) {
+    if (last == NULL ? strncmp(node->key, first, prefix_len) != 0 : strcmp(node->key, last) > 0) {
+      break;
+    }
+    const KeyNode* keyNode = node->item;
+    if (pair_expired(keyNode, now)) {
+      continue;
+    }
+    iov_batch_add(&batch, "(", 1);
+    iov_batch_add(&batch, keyNode->key, strlen(keyNode->key));
+    iov_batch_add(&batch, ",", 1);
+    batch_add_value(&batch, keyNode->value);
+    iov_batch_add(&batch, ")", 1);
+    (*num_pairs)++;
+  }
+  iov_batch_add(&batch, "]\n", 2);
+  int failed = iov_batch_flush(&batch);
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+
+  if (failed) {
+    perror("Error writing scan result");
+  }
+  return failed;
+}
+
+void kvs_show(int fd) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return;
+  }
 
-  pthread_rwlock_unlock(&kvs_table->tablelock);
+  // O lote aponta para as chaves e valores da tabela, por isso é escrito antes de largar o trinco
+  profiled_rwlock_rdlock(&kvs_table->tablelock, "tablelock");
+  if (write_table(fd) != 0) {
+    perror("Error writing table");
+  }
+  profiled_rwlock_unlock(&kvs_table->tablelock);
 }
 
 int kvs_backup(size_t num_backup, char* job_filename, char* directory) {
@@ -217,37 +619,23 @@ int kvs_backup(size_t num_backup, char* job_filename, char* directory) {
   char bck_name[50];
   snprintf(bck_name, sizeof(bck_name), "%s/%s-%ld.bck", directory, strtok(job_filename, "."), num_backup);
 
-  pthread_rwlock_rdlock(&kvs_table->tablelock);
+  // Mede o tempo que a tarefa fica parada: a espera pelo trinco e o fork. A escrita do ficheiro
+  // acontece no processo filho
+  uint64_t start = stats_now();
+  profiled_rwlock_rdlock(&kvs_table->tablelock, "tablelock");
   pid = fork();
-  pthread_rwlock_unlock(&kvs_table->tablelock);
+  profiled_rwlock_unlock(&kvs_table->tablelock);
+  if (pid > 0) {
+    stats_record(STATS_BACKUP, start);
+  }
   if (pid == 0) {
     // functions used here have to be async signal safe, since this
     // fork happens in a multi thread context (see man fork)
     int fd = open(bck_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    for (int i = 0; i < TABLE_SIZE; i++) {
-      KeyNode* keyNode = kvs_table->table[i];  // Get the next list head
-      while (keyNode != NULL) {
-        char aux[MAX_STRING_SIZE];
-        aux[0] = '(';
-        size_t num_bytes_copied = 1;  // the "("
-        // the - 1 are all to leave space for the '/0'
-        num_bytes_copied += strn_memcpy(aux + num_bytes_copied, keyNode->key, MAX_STRING_SIZE - num_bytes_copied - 1);
-        num_bytes_copied += strn_memcpy(aux + num_bytes_copied, ", ", MAX_STRING_SIZE - num_bytes_copied - 1);
-        num_bytes_copied += strn_memcpy(aux + num_bytes_copied, keyNode->value, MAX_STRING_SIZE - num_bytes_copied - 1);
-        num_bytes_copied += strn_memcpy(aux + num_bytes_copied, ")\n", MAX_STRING_SIZE - num_bytes_copied - 1);
-        aux[num_bytes_copied] = '\0';
-        write_str(fd, aux);
-        keyNode = keyNode->next;  // Move to the next node of the list
-      }
-    }
+    write_table(fd);
     exit(1);
   } else if (pid < 0) {
     return -1;
   }
   return 0;
 }
-
-void kvs_wait(unsigned int delay_ms) {
-  struct timespec delay = delay_to_timespec(delay_ms);
-  nanosleep(&delay, NULL);
-}
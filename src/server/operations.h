@@ -2,23 +2,56 @@
 #define KVS_OPERATIONS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "constants.h"
+#include "value.h"
 
-/// Initializes the KVS state.
+/// Called with the keys removed because their TTL ran out or to keep the
+/// table within its memory budget. It runs on the expiry thread, at the same
+/// time as jobs and sessions, so it must lock whatever it changes; the table
+/// lock is not held, so it may take locks that are taken under it.
+typedef void (*RemovalCallback)(size_t num_keys, char keys[][MAX_STRING_SIZE]);
+
+/// Initializes the KVS state and starts the thread that expires and evicts
+/// keys.
 /// @return 0 if the KVS state was initialized successfully, 1 otherwise.
 int kvs_init();
 
-/// Destroys the KVS state.
+/// Destroys the KVS state, stopping the expiry and eviction thread.
 /// @return 0 if the KVS state was terminated successfully, 1 otherwise.
 int kvs_terminate();
 
 /// Writes a key value pair to the KVS. If key already exists it is updated.
 /// @param num_pairs Number of pairs being written.
 /// @param keys Array of keys' strings.
-/// @param values Array of values' strings.
+/// @param values Array of values. The table takes its own references, so the
+///               caller still releases them.
+/// @return 0 if the pairs were written successfully, 1 otherwise.
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[]);
+
+/// Writes key value pairs that are removed after a time to live, as if
+/// deleted (subscribers get the same notification). Expiry is checked when a
+/// key is read, so an expired key is never returned even before it is removed.
+/// @param num_pairs Number of pairs being written.
+/// @param keys Array of keys' strings.
+/// @param values Array of values, referenced as in kvs_write.
+/// @param ttl_ms Time to live in milliseconds.
 /// @return 0 if the pairs were written successfully, 1 otherwise.
-int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]);
+int kvs_write_ttl(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[], unsigned int ttl_ms);
+
+/// Sets the function called (without any lock held) with the keys removed
+/// because their TTL ran out or they were evicted.
+/// @param callback Function to call, NULL for none.
+void kvs_set_removal_callback(RemovalCallback callback);
+
+/// Limits the memory taken by keys and values. Over the budget, the least
+/// recently read keys are evicted in the background (approximated with
+/// CLOCK) and their subscribers are notified as for a DELETE. Writes are never
+/// refused, so the table can go over the budget until the eviction catches up.
+/// @param bytes Budget in bytes, 0 for none (the default).
+/// @return 0 if the budget was set, 1 otherwise.
+int kvs_set_memory_budget(size_t bytes);
 
 int kvs_subscription(const char* key, int notif_fd);
 
@@ -31,16 +64,132 @@ int kvs_unsubscription(const char* key, int notif_fd);
 /// @return 0 if the key reading, 1 otherwise.
 int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd);
 
+/// Reads values from the KVS without copying them.
+/// @param num_pairs Number of pairs to read.
+/// @param keys Array of keys' strings.
+/// @param values Array set to a reference to each value (NULL for missing
+///               keys), to be released with value_unref.
+/// @return 0 if the keys were read, 1 otherwise.
+int kvs_read_values(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[]);
+
+/// Reads the versions of keys, and optionally their values.
+/// @param num_pairs Number of keys to read.
+/// @param keys Array of keys' strings.
+/// @param values NULL, or set as in kvs_read_values.
+/// @param versions Array set to the version of each key, 0 for missing keys.
+/// @return 0 if the keys were read, 1 otherwise.
+int kvs_read_versions(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[], uint64_t versions[]);
+
+/// Writes the result of a VERSION in the job output format.
+/// @param fd File descriptor to write the output.
+/// @param num_pairs Number of keys read.
+/// @param keys Array of keys' strings.
+/// @param versions Versions read by kvs_read_versions.
+void kvs_print_versions(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t versions[]);
+
+/// Writes each pair whose key is still at the expected version. Each pair is
+/// compared and written atomically, independently of the others.
+/// @param num_pairs Number of pairs.
+/// @param keys Array of keys' strings.
+/// @param values Array of values, referenced as in kvs_write.
+/// @param expected Version each key must have, 0 if it must not exist.
+/// @param versions Array set to the new version of the pairs written, and to
+///                 the current version (0 if missing) of the others.
+/// @param written Array set to 1 for the pairs written, 0 otherwise.
+/// @return 0 if the pairs were processed, 1 otherwise.
+int kvs_cas(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[], const uint64_t expected[],
+            uint64_t versions[], int written[]);
+
+/// Writes the result of a CAS in the job output format: the new version of
+/// each pair written, KVSCONFLICT for the others.
+/// @param fd File descriptor to write the output.
+/// @param num_pairs Number of pairs.
+/// @param keys Array of keys' strings.
+/// @param versions Versions set by kvs_cas.
+/// @param written Array set by kvs_cas.
+void kvs_print_cas(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const uint64_t versions[],
+                   const int written[]);
+
+/// Adds a delta to the integer stored in each key, without the read and write
+/// round trip. Each key is updated atomically, independently of the others; a
+/// missing key counts as 0.
+/// @param num_pairs Number of keys.
+/// @param keys Array of keys' strings.
+/// @param deltas Amount to add to each key.
+/// @param results Array set to the new value of each key updated.
+/// @param ok Array set to 1 for the keys updated, 0 for those whose value is
+///           not an integer or would overflow.
+/// @return 0 if the keys were processed, 1 otherwise.
+int kvs_incr(size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t deltas[], int64_t results[], int ok[]);
+
+/// Writes the result of an INCR in the job output format: the new value of
+/// each key updated, KVSERROR for the others.
+/// @param fd File descriptor to write the output.
+/// @param num_pairs Number of keys.
+/// @param keys Array of keys' strings.
+/// @param results Values set by kvs_incr.
+/// @param ok Array set by kvs_incr.
+void kvs_print_incr(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int64_t results[], const int ok[]);
+
+/// Appends a suffix to the value of each key, creating missing keys. Each key
+/// is updated atomically, independently of the others.
+/// @param num_pairs Number of keys.
+/// @param keys Array of keys' strings.
+/// @param suffixes Array of suffixes, referenced as values are in kvs_write.
+/// @param appended Array set to 1 for the keys updated, 0 for those that would
+///                 grow past MAX_VALUE_SIZE.
+/// @return 0 if the keys were processed, 1 otherwise.
+int kvs_append(size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* suffixes[], int appended[]);
+
+/// Writes the keys an APPEND could not update, in the job output format.
+/// @param fd File descriptor to write the output.
+/// @param num_pairs Number of keys.
+/// @param keys Array of keys' strings.
+/// @param appended Array set by kvs_append.
+void kvs_print_append(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int appended[]);
+
+/// Writes the result of a READ in the job output format.
+/// @param fd File descriptor to write the output.
+/// @param num_pairs Number of keys read.
+/// @param keys Array of keys' strings.
+/// @param values Values read by kvs_read_values.
+void kvs_print_read(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], KvsValue* values[]);
+
 /// Deletes key value pairs from the KVS.
 /// @param num_pairs Number of pairs to read.
 /// @param keys Array of keys' strings.
 /// @return 0 if the pairs were deleted successfully, 1 otherwise.
 int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd);
 
+/// Deletes key value pairs from the KVS, reporting which keys existed.
+/// @param num_pairs Number of pairs to delete.
+/// @param keys Array of keys' strings.
+/// @param deleted Array set to 1 for each key that was deleted, 0 if it was missing.
+/// @return 0 if the keys were processed, 1 otherwise.
+int kvs_delete_keys(size_t num_pairs, char keys[][MAX_STRING_SIZE], int deleted[]);
+
+/// Writes the keys a DELETE did not find, in the job output format.
+/// @param fd File descriptor to write the output.
+/// @param num_pairs Number of keys deleted.
+/// @param keys Array of keys' strings.
+/// @param deleted Array set by kvs_delete_keys.
+void kvs_print_delete(int fd, size_t num_pairs, char keys[][MAX_STRING_SIZE], const int deleted[]);
+
 /// Writes the state of the KVS.
 /// @param fd File descriptor to write the output.
 void kvs_show(int fd);
 
+/// Writes, in key order and in the READ output format, the pairs whose key
+/// starts with a prefix or falls in a range. Keys are found through the
+/// ordered index, so the cost depends on the pairs written and not on the
+/// size of the table. Scanned pairs do not count as read for eviction.
+/// @param fd File descriptor to write the output.
+/// @param first Prefix, or first key of the range.
+/// @param last Last key of the range (included), NULL to scan a prefix.
+/// @param num_pairs Set to the number of pairs written.
+/// @return 0 if the pairs were written, 1 otherwise.
+int kvs_scan(int fd, const char* first, const char* last, size_t* num_pairs);
+
 /// Creates a backup of the KVS state and stores it in the correspondent
 /// backup file
 /// @return 0 if the backup was successful, 1 otherwise.
@@ -49,10 +198,6 @@ int kvs_backup(size_t num_backup, char* job_filename, char* directory);
 /// Waits for the last backup to be called.
 void kvs_wait_backup();
 
-/// Waits for a given amount of time.
-/// @param delay_us Delay in milliseconds.
-void kvs_wait(unsigned int delay_ms);
-
 // Setter for max_backups
 // @param _max_backups
 void set_max_backups(int _max_backups);
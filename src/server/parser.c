@@ -1,5 +1,6 @@
 #include "parser.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,6 +50,49 @@ static int read_string(int fd, char *buffer, size_t max) {
   return value;
 }
 
+// Lê um valor até ao ')' que o termina, diretamente para os blocos do valor. Em ficheiros lê em
+// blocos (a começar pequenos, para os valores curtos do costume) e recua o descritor até logo a
+// seguir ao delimitador; em pipes continua a ler um byte de cada vez.
+// @param fd File to read from.
+// @param builder Builder the value is appended to.
+// @return The same codes as read_string.
+static int read_value(int fd, ValueBuilder *builder) {
+  int seekable = lseek(fd, 0, SEEK_CUR) != -1;
+  size_t block = 64;
+
+  while (builder->len <= MAX_VALUE_SIZE) {
+    size_t available;
+    char *space = value_builder_space(builder, &available);
+    if (space == NULL) {
+      return -1;
+    }
+
+    size_t want = seekable ? (block < available ? block : available) : 1;
+    ssize_t bytes_read = read(fd, space, want);
+    if (bytes_read <= 0) {
+      return -1;
+    }
+
+    for (size_t i = 0; i < (size_t)bytes_read; i++) {
+      char ch = space[i];
+      if (ch != ' ' && ch != ',' && ch != ')' && ch != ']') {
+        continue;
+      }
+
+      value_builder_commit(builder, i);
+      off_t excess = (off_t)((size_t)bytes_read - i - 1);
+      if ((excess > 0 && lseek(fd, -excess, SEEK_CUR) == -1) || builder->len > MAX_VALUE_SIZE) {
+        return -1;
+      }
+      return ch == ',' ? 0 : ch == ')' ? 1 : ch == ']' ? 2 : -1;
+    }
+
+    value_builder_commit(builder, (size_t)bytes_read);
+    block = block < VALUE_CHUNK_SIZE ? block * 2 : block;
+  }
+  return -1;
+}
+
 // Reads a number and stores it in an unsigned integer
 // variable.
 // @param fd File to read from.
@@ -102,11 +146,18 @@ enum Command get_next(int fd) {
   switch (buf[0]) {
     case 'W':
       if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        if (read(fd, buf + 5, 1) != 1 || strncmp(buf, "WRITE ", 6) != 0) {
+        if (read(fd, buf + 5, 1) != 1 || strncmp(buf, "WRITE", 5) != 0) {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+        if (buf[5] == ' ') {
+          return CMD_WRITE;
+        }
+        if (read(fd, buf + 6, 4) != 4 || strncmp(buf, "WRITE_TTL ", 10) != 0) {
           cleanup(fd);
           return CMD_INVALID;
         }
-        return CMD_WRITE;
+        return CMD_WRITE_TTL;
       }
 
       return CMD_WAIT;
@@ -119,6 +170,38 @@ enum Command get_next(int fd) {
 
       return CMD_READ;
 
+    case 'V':
+      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "VERSION ", 8) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_VERSION;
+
+    case 'C':
+      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "CAS ", 4) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_CAS;
+
+    case 'I':
+      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "INCR ", 5) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_INCR;
+
+    case 'A':
+      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "APPEND ", 7) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_APPEND;
+
     case 'D':
       if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
         cleanup(fd);
@@ -128,7 +211,20 @@ enum Command get_next(int fd) {
       return CMD_DELETE;
 
     case 'S':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "SHOW", 4) != 0) {
+      if (read(fd, buf + 1, 3) != 3) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (strncmp(buf, "SCAN", 4) == 0) {
+        if (read(fd, buf + 4, 1) != 1 || buf[4] != ' ') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+        return CMD_SCAN;
+      }
+
+      if (strncmp(buf, "SHOW", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -184,22 +280,78 @@ enum Command get_next(int fd) {
 // @param key Pointer where the key will be stored
 // @param value Pointer where the value will be stored
 // @return 1 if successful, 0 otherwise.
-int parse_pair(int fd, char *key, char *value) {
+int parse_pair(int fd, char *key, KvsValue **value) {
   if (read_string(fd, key, MAX_STRING_SIZE) != 0) {
     cleanup(fd);
     return 0;
   }
 
-  if (read_string(fd, value, MAX_STRING_SIZE) != 1) {
+  ValueBuilder builder;
+  value_builder_init(&builder);
+  if (read_value(fd, &builder) != 1) {
+    value_builder_discard(&builder);
     cleanup(fd);
     return 0;
   }
 
-  return 1;
+  *value = value_builder_finish(&builder);
+  return *value != NULL;
 }
 
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs,
-                   size_t max_string_size) {
+// Lê a versão esperada de um CAS, terminada por ','
+static int read_version(int fd, uint64_t *version) {
+  char buf[24];
+  size_t i = 0;
+  while (i < sizeof(buf) - 1) {
+    if (read(fd, buf + i, 1) != 1) {
+      return 1;
+    }
+    if (buf[i] == ',') {
+      break;
+    }
+    if (buf[i] > '9' || buf[i] < '0') {
+      return 1;
+    }
+    i++;
+  }
+  if (i == 0 || buf[i] != ',') {
+    return 1;
+  }
+  buf[i] = '\0';
+  *version = strtoull(buf, NULL, 10);
+  return 0;
+}
+
+// Lê um trio (chave,versão,valor) de um CAS, sem o '(' inicial
+static int parse_triple(int fd, char *key, uint64_t *version, KvsValue **value) {
+  if (read_string(fd, key, MAX_STRING_SIZE) != 0 || read_version(fd, version) != 0) {
+    cleanup(fd);
+    return 0;
+  }
+
+  ValueBuilder builder;
+  value_builder_init(&builder);
+  if (read_value(fd, &builder) != 1) {
+    value_builder_discard(&builder);
+    cleanup(fd);
+    return 0;
+  }
+
+  *value = value_builder_finish(&builder);
+  return *value != NULL;
+}
+
+// Liberta os valores já lidos de um WRITE que acabou por ser inválido
+static size_t discard_values(KvsValue *values[], size_t num_pairs) {
+  for (size_t i = 0; i < num_pairs; i++) {
+    value_unref(values[i]);
+  }
+  return 0;
+}
+
+// Lê a lista de um WRITE ou, com 'versions', de um CAS
+static size_t parse_pair_list(int fd, char keys[][MAX_STRING_SIZE], KvsValue *values[], uint64_t versions[],
+                              size_t max_pairs, size_t max_string_size) {
   char ch;
 
   if (read(fd, &ch, 1) != 1 || ch != '[') {
@@ -214,19 +366,19 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRIN
 
   size_t num_pairs = 0;
   char key[max_string_size];
-  char value[max_string_size];
   while (num_pairs < max_pairs) {
-    if (parse_pair(fd, key, value) == 0) {
+    int parsed = versions == NULL ? parse_pair(fd, key, &values[num_pairs])
+                                  : parse_triple(fd, key, &versions[num_pairs], &values[num_pairs]);
+    if (parsed == 0) {
       cleanup(fd);
-      return 0;
+      return discard_values(values, num_pairs);
     }
 
-    strcpy(keys[num_pairs], key);
-    strcpy(values[num_pairs++], value);
+    strcpy(keys[num_pairs++], key);
 
     if (read(fd, &ch, 1) != 1 || (ch != '(' && ch != ']')) {
       cleanup(fd);
-      return 0;
+      return discard_values(values, num_pairs);
     }
 
     if (ch == ']') {
@@ -236,17 +388,70 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRIN
 
   if (num_pairs == max_pairs) {
     cleanup(fd);
-    return 0;
+    return discard_values(values, num_pairs);
   }
 
   if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
     cleanup(fd);
-    return 0;
+    return discard_values(values, num_pairs);
   }
 
   return num_pairs;
 }
 
+size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], KvsValue *values[], size_t max_pairs,
+                   size_t max_string_size) {
+  return parse_pair_list(fd, keys, values, NULL, max_pairs, max_string_size);
+}
+
+size_t parse_cas(int fd, char keys[][MAX_STRING_SIZE], uint64_t versions[], KvsValue *values[], size_t max_pairs,
+                 size_t max_string_size) {
+  return parse_pair_list(fd, keys, values, versions, max_pairs, max_string_size);
+}
+
+size_t parse_incr(int fd, char keys[][MAX_STRING_SIZE], int64_t deltas[], size_t max_pairs,
+                  size_t max_string_size) {
+  KvsValue *values[max_pairs];
+  size_t num_pairs = parse_write(fd, keys, values, max_pairs, max_string_size);
+
+  // O resto da linha já foi lido, por isso um incremento inválido só descarta os valores
+  int valid = 1;
+  for (size_t i = 0; i < num_pairs; i++) {
+    char buf[24];
+    char *end;
+    errno = 0;
+    if (values[i]->len == 0 || values[i]->len >= sizeof(buf)) {
+      valid = 0;
+    } else {
+      value_prefix(values[i], buf, sizeof(buf));
+      deltas[i] = strtoll(buf, &end, 10);
+      valid = valid && errno == 0 && *end == '\0';
+    }
+  }
+  discard_values(values, num_pairs);
+  return valid ? num_pairs : 0;
+}
+
+size_t parse_write_ttl(int fd, unsigned int *ttl_ms, char keys[][MAX_STRING_SIZE], KvsValue *values[],
+                       size_t max_pairs, size_t max_string_size) {
+  char ch;
+  if (read_uint(fd, ttl_ms, &ch) != 0 || ch != ' ' || *ttl_ms == 0) {
+    cleanup(fd);
+    return 0;
+  }
+  return parse_write(fd, keys, values, max_pairs, max_string_size);
+}
+
+size_t parse_scan(int fd, char keys[2][MAX_STRING_SIZE], size_t max_string_size) {
+  // Com espaço para três chaves, o parse_read_delete rejeita as listas com mais de duas
+  char parsed[3][MAX_STRING_SIZE];
+  size_t num_keys = parse_read_delete(fd, parsed, 3, max_string_size);
+  for (size_t i = 0; i < num_keys; i++) {
+    strcpy(keys[i], parsed[i]);
+  }
+  return num_keys;
+}
+
 size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size) {
   char ch;
 
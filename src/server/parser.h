@@ -2,14 +2,22 @@
 #define KVS_PARSER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "constants.h"
+#include "value.h"
 
 enum Command {
   CMD_WRITE,
+  CMD_WRITE_TTL,
+  CMD_CAS,
+  CMD_INCR,
+  CMD_APPEND,
   CMD_READ,
+  CMD_VERSION,
   CMD_DELETE,
   CMD_SHOW,
+  CMD_SCAN,
   CMD_WAIT,
   CMD_BACKUP,
   CMD_HELP,
@@ -24,18 +32,65 @@ enum Command {
 // @return enum Command Command code.
 enum Command get_next(int fd);
 
-/// Parses a WRITE command.
+/// Parses a WRITE command. Values can be up to MAX_VALUE_SIZE bytes long.
 /// @param fd File descriptor to read from.
 /// @param keys Array to store the keys
-/// @param values Array to store the values
+/// @param values Array set to the values read, each with one reference
 /// @param max_pairs Maximum number of pairs it will write.
 /// @param max_string_size Maximum string size allowed.
 /// @return 0 if the command was not parsed successfully, otherwise return the
 //          of pairs parsed.
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs,
+size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], KvsValue *values[], size_t max_pairs,
                    size_t max_string_size);
 
-// Parses a READ or a DELETE command.
+/// Parses a CAS command: a list of (key,version,value) triples, each written
+/// only if the key is still at the given version (0 for a key that must not
+/// exist).
+/// @param fd File descriptor to read from.
+/// @param keys Array to store the keys
+/// @param versions Array to store the expected versions
+/// @param values Array set to the values read, each with one reference
+/// @param max_pairs Maximum number of triples it will read.
+/// @param max_string_size Maximum string size allowed.
+/// @return 0 if the command was not parsed successfully, otherwise the number
+///         of triples parsed.
+size_t parse_cas(int fd, char keys[][MAX_STRING_SIZE], uint64_t versions[], KvsValue *values[], size_t max_pairs,
+                 size_t max_string_size);
+
+/// Parses an INCR command: a list of (key,delta) pairs, the deltas being
+/// 64-bit decimal integers. APPEND takes the same pairs as a WRITE.
+/// @param fd File descriptor to read from.
+/// @param keys Array to store the keys
+/// @param deltas Array to store the deltas
+/// @param max_pairs Maximum number of pairs it will read.
+/// @param max_string_size Maximum string size allowed.
+/// @return 0 if the command was not parsed successfully, otherwise the number
+///         of pairs parsed.
+size_t parse_incr(int fd, char keys[][MAX_STRING_SIZE], int64_t deltas[], size_t max_pairs,
+                  size_t max_string_size);
+
+/// Parses a WRITE_TTL command: a time to live in milliseconds followed by the
+/// same pairs as a WRITE.
+/// @param fd File descriptor to read from.
+/// @param ttl_ms Set to the time to live.
+/// @param keys Array to store the keys
+/// @param values Array set to the values read, each with one reference
+/// @param max_pairs Maximum number of pairs it will write.
+/// @param max_string_size Maximum string size allowed.
+/// @return 0 if the command was not parsed successfully (or the time to live
+///         is 0), otherwise the number of pairs parsed.
+size_t parse_write_ttl(int fd, unsigned int *ttl_ms, char keys[][MAX_STRING_SIZE], KvsValue *values[],
+                       size_t max_pairs, size_t max_string_size);
+
+/// Parses a SCAN command: "SCAN [prefix]" or "SCAN [first,last]".
+/// @param fd File descriptor to read from.
+/// @param keys Array set to the prefix, or to the first and last keys.
+/// @param max_string_size Maximum string size allowed.
+/// @return 0 if the command was not parsed successfully, 1 for a prefix and
+///         2 for a range.
+size_t parse_scan(int fd, char keys[2][MAX_STRING_SIZE], size_t max_string_size);
+
+// Parses a READ, VERSION or DELETE command.
 // @param fd File descriptor to read from.
 // @param keys Array to store the keys
 // @param max_pairs Maximum number of pairs it will write.
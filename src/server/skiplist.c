@@ -0,0 +1,120 @@
+#include "skiplist.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static SkipNode *node_create(int height) {
+  SkipNode *node = malloc(sizeof(SkipNode) + (size_t)height * sizeof(SkipNode *));
+  if (node == NULL) {
+    return NULL;
+  }
+  node->height = height;
+  for (int i = 0; i < height; i++) {
+    node->next[i] = NULL;
+  }
+  return node;
+}
+
+int skiplist_init(SkipList *list) {
+  list->head = node_create(SKIPLIST_MAX_LEVEL);
+  if (list->head == NULL) {
+    return 1;
+  }
+  list->head->key = NULL;
+  list->head->item = NULL;
+  list->level = 1;
+  list->count = 0;
+  list->seed = 0x9e3779b97f4a7c15u;
+  return 0;
+}
+
+void skiplist_destroy(SkipList *list) {
+  SkipNode *node = list->head;
+  while (node != NULL) {
+    SkipNode *next = node->next[0];
+    free(node);
+    node = next;
+  }
+  list->head = NULL;
+  list->count = 0;
+}
+
+// Altura de um nó novo: cada nível a mais tem probabilidade 1/4, o que dá em média 1.33 ligações
+// por nó
+static int random_height(SkipList *list) {
+  // xorshift64; só é chamado com a lista exclusiva, por isso o estado não precisa de ser atómico
+  list->seed ^= list->seed << 13;
+  list->seed ^= list->seed >> 7;
+  list->seed ^= list->seed << 17;
+
+  uint64_t bits = list->seed;
+  int height = 1;
+  while (height < SKIPLIST_MAX_LEVEL && (bits & 3) == 0) {
+    height++;
+    bits >>= 2;
+  }
+  return height;
+}
+
+// Preenche 'update' com o último nó de cada nível cuja chave é menor que 'key'
+static void find_predecessors(const SkipList *list, const char *key, SkipNode *update[SKIPLIST_MAX_LEVEL]) {
+  SkipNode *node = list->head;
+  for (int level = list->level - 1; level >= 0; level--) {
+    while (node->next[level] != NULL && strcmp(node->next[level]->key, key) < 0) {
+      node = node->next[level];
+    }
+    update[level] = node;
+  }
+}
+
+int skiplist_insert(SkipList *list, const char *key, void *item) {
+  SkipNode *update[SKIPLIST_MAX_LEVEL];
+  find_predecessors(list, key, update);
+
+  int height = random_height(list);
+  SkipNode *node = node_create(height);
+  if (node == NULL) {
+    return 1;
+  }
+  node->key = key;
+  node->item = item;
+
+  for (int level = list->level; level < height; level++) {
+    update[level] = list->head;
+  }
+  if (height > list->level) {
+    list->level = height;
+  }
+
+  for (int level = 0; level < height; level++) {
+    node->next[level] = update[level]->next[level];
+    update[level]->next[level] = node;
+  }
+  list->count++;
+  return 0;
+}
+
+void skiplist_remove(SkipList *list, const char *key) {
+  SkipNode *update[SKIPLIST_MAX_LEVEL];
+  find_predecessors(list, key, update);
+
+  SkipNode *node = update[0]->next[0];
+  if (node == NULL || strcmp(node->key, key) != 0) {
+    return;
+  }
+
+  for (int level = 0; level < node->height; level++) {
+    update[level]->next[level] = node->next[level];
+  }
+  while (list->level > 1 && list->head->next[list->level - 1] == NULL) {
+    list->level--;
+  }
+  list->count--;
+  free(node);
+}
+
+SkipNode *skiplist_seek(const SkipList *list, const char *key) {
+  SkipNode *update[SKIPLIST_MAX_LEVEL];
+  find_predecessors(list, key, update);
+  return update[0]->next[0];
+}
@@ -0,0 +1,55 @@
+#ifndef KVS_SKIPLIST_H
+#define KVS_SKIPLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Maximum height of a node; enough for 4^16 keys.
+#define SKIPLIST_MAX_LEVEL 16
+
+typedef struct SkipNode {
+  const char *key;  // not copied: owned by whoever inserted it
+  void *item;
+  int height;
+  struct SkipNode *next[];  // one link per level, next[0] is the next key
+} SkipNode;
+
+/// Skip list of string keys in strcmp order. Searches, inserts and removals
+/// take O(log n) expected time. The list does no locking: readers may share
+/// it, writers need it to themselves.
+typedef struct {
+  SkipNode *head;  // sentinel with SKIPLIST_MAX_LEVEL links
+  int level;       // height of the tallest node
+  size_t count;
+  uint64_t seed;   // state of the generator of node heights
+} SkipList;
+
+/// Initializes an empty list.
+/// @param list List to initialize.
+/// @return 0 on success, 1 if memory ran out.
+int skiplist_init(SkipList *list);
+
+/// Frees the nodes of a list (not the keys or items).
+/// @param list List to destroy.
+void skiplist_destroy(SkipList *list);
+
+/// Inserts a key that is not in the list yet.
+/// @param list List.
+/// @param key Key, which must stay valid until it is removed.
+/// @param item Item stored with the key.
+/// @return 0 on success, 1 if memory ran out.
+int skiplist_insert(SkipList *list, const char *key, void *item);
+
+/// Removes a key. Does nothing if it is not in the list.
+/// @param list List.
+/// @param key Key to remove.
+void skiplist_remove(SkipList *list, const char *key);
+
+/// Finds the first key that is not smaller than the given one.
+/// @param list List.
+/// @param key Key to look for.
+/// @return The node, NULL if every key is smaller. The following keys are
+///         reached through next[0].
+SkipNode *skiplist_seek(const SkipList *list, const char *key);
+
+#endif  // KVS_SKIPLIST_H
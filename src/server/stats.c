@@ -0,0 +1,221 @@
+#include "stats.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Histogramas log-lineares: cada potência de 2 é dividida em STATS_SUB_BUCKETS intervalos
+// iguais, o que dá um erro relativo de no máximo 1/32 em qualquer valor
+#define STATS_SUB_BITS 5
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_MAX_EXPONENT 40  // ~18 minutos; valores maiores ficam no último intervalo
+#define STATS_BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BITS + 2) * STATS_SUB_BUCKETS)
+
+static const char* const op_names[STATS_OP_COUNT] = {"write", "read", "delete", "backup", "notify"};
+
+// Histogramas de uma thread. Só a própria thread escreve, por isso os contadores são atualizados
+// com leituras e escritas relaxadas, sem instruções atómicas de leitura-modificação-escrita; o
+// dump lê-os sem parar quem está a registar
+typedef struct ThreadStats {
+  struct ThreadStats* next;
+  _Atomic uint64_t counts[STATS_OP_COUNT][STATS_BUCKETS];
+  _Atomic uint64_t total[STATS_OP_COUNT];
+  _Atomic uint64_t min[STATS_OP_COUNT];
+  _Atomic uint64_t max[STATS_OP_COUNT];
+} ThreadStats;
+
+// Os blocos nunca são libertados: as medições de threads que já terminaram continuam no dump
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadStats* registry = NULL;
+
+static _Thread_local ThreadStats* local_stats = NULL;
+
+const char* stats_op_name(enum StatsOp op) { return op_names[op]; }
+
+uint64_t stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static size_t bucket_of(uint64_t value) {
+  if (value < STATS_SUB_BUCKETS) {
+    return (size_t)value;
+  }
+
+  unsigned exponent = 63u - (unsigned)__builtin_clzll(value);
+  if (exponent > STATS_MAX_EXPONENT) {
+    return STATS_BUCKETS - 1;
+  }
+  size_t sub = (size_t)(value >> (exponent - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1);
+  return (exponent - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS + sub;
+}
+
+// Menor valor que cai no intervalo
+static uint64_t bucket_low(size_t bucket) {
+  if (bucket < STATS_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned exponent = (unsigned)(bucket / STATS_SUB_BUCKETS) + STATS_SUB_BITS - 1;
+  uint64_t sub = bucket % STATS_SUB_BUCKETS;
+  return (STATS_SUB_BUCKETS + sub) << (exponent - STATS_SUB_BITS);
+}
+
+// Maior valor que cai no intervalo
+static uint64_t bucket_high(size_t bucket) {
+  if (bucket == STATS_BUCKETS - 1) {
+    return UINT64_MAX;
+  }
+  return bucket_low(bucket + 1) - 1;
+}
+
+static ThreadStats* thread_stats(void) {
+  if (local_stats != NULL) {
+    return local_stats;
+  }
+
+  ThreadStats* stats = calloc(1, sizeof(ThreadStats));
+  if (stats == NULL) {
+    return NULL;
+  }
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    atomic_init(&stats->min[op], UINT64_MAX);
+  }
+
+  pthread_mutex_lock(&registry_lock);
+  stats->next = registry;
+  registry = stats;
+  pthread_mutex_unlock(&registry_lock);
+
+  local_stats = stats;
+  return stats;
+}
+
+static void add_relaxed(_Atomic uint64_t* counter, uint64_t value) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void stats_record(enum StatsOp op, uint64_t start) {
+  uint64_t elapsed = stats_now() - start;
+
+  ThreadStats* stats = thread_stats();
+  if (stats == NULL) {
+    return;  // Sem memória a medição perde-se, mas a operação não é afetada
+  }
+
+  add_relaxed(&stats->counts[op][bucket_of(elapsed)], 1);
+  add_relaxed(&stats->total[op], elapsed);
+  if (elapsed < atomic_load_explicit(&stats->min[op], memory_order_relaxed)) {
+    atomic_store_explicit(&stats->min[op], elapsed, memory_order_relaxed);
+  }
+  if (elapsed > atomic_load_explicit(&stats->max[op], memory_order_relaxed)) {
+    atomic_store_explicit(&stats->max[op], elapsed, memory_order_relaxed);
+  }
+}
+
+// Histograma de uma operação somado sobre todas as threads
+typedef struct {
+  uint64_t counts[STATS_BUCKETS];
+  uint64_t count;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+} Merged;
+
+static void merge(enum StatsOp op, Merged* merged) {
+  memset(merged, 0, sizeof(Merged));
+  merged->min = UINT64_MAX;
+
+  pthread_mutex_lock(&registry_lock);
+  for (ThreadStats* stats = registry; stats != NULL; stats = stats->next) {
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+      uint64_t count = atomic_load_explicit(&stats->counts[op][i], memory_order_relaxed);
+      merged->counts[i] += count;
+      merged->count += count;
+    }
+    merged->total += atomic_load_explicit(&stats->total[op], memory_order_relaxed);
+
+    uint64_t min = atomic_load_explicit(&stats->min[op], memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&stats->max[op], memory_order_relaxed);
+    merged->min = min < merged->min ? min : merged->min;
+    merged->max = max > merged->max ? max : merged->max;
+  }
+  pthread_mutex_unlock(&registry_lock);
+
+  if (merged->count == 0) {
+    merged->min = 0;
+  }
+}
+
+// Valor abaixo do qual estão 'permille' milésimas das medições. Devolve o limite superior do
+// intervalo onde o percentil cai, limitado pelo máximo observado
+static uint64_t percentile(const Merged* merged, uint64_t permille) {
+  if (merged->count == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (merged->count * permille + 999) / 1000;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < STATS_BUCKETS; i++) {
+    seen += merged->counts[i];
+    if (seen >= rank) {
+      uint64_t high = bucket_high(i);
+      return high < merged->max ? high : merged->max;
+    }
+  }
+  return merged->max;
+}
+
+int stats_dump(const char* path) {
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+    fprintf(stderr, "Stats path too long: %s\n", path);
+    return 1;
+  }
+
+  FILE* file = fopen(tmp_path, "w");
+  if (file == NULL) {
+    perror("Failed to open stats file");
+    return 1;
+  }
+
+  Merged* merged = malloc(STATS_OP_COUNT * sizeof(Merged));
+  if (merged == NULL) {
+    fclose(file);
+    unlink(tmp_path);
+    return 1;
+  }
+
+  fprintf(file, "# op count min_ns mean_ns p50_ns p90_ns p99_ns p999_ns max_ns\n");
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    merge((enum StatsOp)op, &merged[op]);
+    Merged* m = &merged[op];
+    fprintf(file,
+            "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+            op_names[op], m->count, m->min, m->count == 0 ? 0 : m->total / m->count, percentile(m, 500),
+            percentile(m, 900), percentile(m, 990), percentile(m, 999), m->max);
+  }
+
+  fprintf(file, "# bucket op low_ns high_ns count\n");
+  for (int op = 0; op < STATS_OP_COUNT; op++) {
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+      if (merged[op].counts[i] != 0) {
+        fprintf(file, "bucket %s %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", op_names[op], bucket_low(i),
+                bucket_high(i), merged[op].counts[i]);
+      }
+    }
+  }
+  free(merged);
+
+  if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+    perror("Failed to write stats file");
+    return 1;
+  }
+  return 0;
+}
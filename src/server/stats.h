@@ -0,0 +1,40 @@
+#ifndef KVS_STATS_H
+#define KVS_STATS_H
+
+#include <stdint.h>
+
+/// Operations whose latency is recorded.
+enum StatsOp {
+  STATS_WRITE,
+  STATS_READ,
+  STATS_DELETE,
+  STATS_BACKUP,
+  STATS_NOTIFY,
+  STATS_OP_COUNT,
+};
+
+/// Name of an operation in the dump ("write", "read", ...).
+/// @param op Operation.
+/// @return The name.
+const char* stats_op_name(enum StatsOp op);
+
+/// Reads the clock used to time operations.
+/// @return Current time in nanoseconds.
+uint64_t stats_now(void);
+
+/// Records the latency of an operation in the histogram of the calling thread.
+/// Each thread only touches its own histograms, so this never blocks, except
+/// the first time a thread records something.
+/// @param op Operation that finished.
+/// @param start Value of stats_now() when the operation started.
+void stats_record(enum StatsOp op, uint64_t start);
+
+/// Merges the histograms of every thread and writes them to a file: a summary
+/// line per operation (count, min, mean, p50, p90, p99, p999 and max, all in
+/// nanoseconds) followed by the non-empty buckets. The file is replaced
+/// atomically, so readers never see a partial dump.
+/// @param path Path of the file to write.
+/// @return 0 if the file was written, 1 otherwise.
+int stats_dump(const char* path);
+
+#endif  // KVS_STATS_H
@@ -0,0 +1,133 @@
+#include "timerwheel.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+// Distância máxima que a roda cobre; timers mais distantes ficam no fim e são reinseridos
+#define TIMER_WHEEL_RANGE ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+static void list_init(TimerEntry *head) {
+  head->next = head;
+  head->prev = head;
+}
+
+static void list_append(TimerEntry *head, TimerEntry *entry) {
+  entry->prev = head->prev;
+  entry->next = head;
+  head->prev->next = entry;
+  head->prev = entry;
+}
+
+static void list_unlink(TimerEntry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  entry->next = NULL;
+  entry->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t now) {
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      list_init(&wheel->slots[level][slot]);
+    }
+  }
+  list_init(&wheel->expired);
+  wheel->now = now;
+  wheel->count = 0;
+}
+
+void timer_entry_init(TimerEntry *entry) {
+  entry->next = NULL;
+  entry->prev = NULL;
+  entry->expires = 0;
+}
+
+int timer_entry_armed(const TimerEntry *entry) { return entry->next != NULL; }
+
+// Põe um timer no intervalo que lhe corresponde, sem mexer na contagem
+static void place(TimerWheel *wheel, TimerEntry *entry) {
+  if (entry->expires <= wheel->now) {
+    list_append(&wheel->expired, entry);
+    return;
+  }
+
+  uint64_t delta = entry->expires - wheel->now;
+  uint64_t at = delta < TIMER_WHEEL_RANGE ? entry->expires : wheel->now + TIMER_WHEEL_RANGE - 1;
+  if (delta >= TIMER_WHEEL_RANGE) {
+    delta = TIMER_WHEEL_RANGE - 1;
+  }
+
+  // O nível é o primeiro cujos intervalos cobrem a distância até ao disparo
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1)))) {
+    level++;
+  }
+  size_t slot = (size_t)(at >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+  list_append(&wheel->slots[level][slot], entry);
+}
+
+void timer_wheel_add(TimerWheel *wheel, TimerEntry *entry, uint64_t expires) {
+  if (timer_entry_armed(entry)) {
+    list_unlink(entry);
+  } else {
+    wheel->count++;
+  }
+  entry->expires = expires;
+  place(wheel, entry);
+}
+
+void timer_wheel_remove(TimerWheel *wheel, TimerEntry *entry) {
+  if (timer_entry_armed(entry)) {
+    list_unlink(entry);
+    wheel->count--;
+  }
+}
+
+// Redistribui os timers de um intervalo pelos níveis de baixo (ou pelos expirados)
+static void cascade(TimerWheel *wheel, TimerEntry *head) {
+  TimerEntry pending;
+  list_init(&pending);
+  if (head->next != head) {
+    pending.next = head->next;
+    pending.prev = head->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    list_init(head);
+  }
+
+  while (pending.next != &pending) {
+    TimerEntry *entry = pending.next;
+    list_unlink(entry);
+    place(wheel, entry);
+  }
+}
+
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now) {
+  // Sem timers a roda pode saltar diretamente para o tick atual
+  if (wheel->count == 0 || now < wheel->now) {
+    wheel->now = now > wheel->now ? now : wheel->now;
+    return;
+  }
+
+  while (wheel->now < now) {
+    wheel->now++;
+
+    // Quando um nível dá a volta, o intervalo seguinte do nível de cima desce
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      if (((wheel->now >> (TIMER_WHEEL_BITS * (level - 1))) & TIMER_WHEEL_MASK) != 0) {
+        break;
+      }
+      cascade(wheel, &wheel->slots[level][(wheel->now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK]);
+    }
+    cascade(wheel, &wheel->slots[0][wheel->now & TIMER_WHEEL_MASK]);
+  }
+}
+
+TimerEntry *timer_wheel_pop_expired(TimerWheel *wheel) {
+  if (wheel->expired.next == &wheel->expired) {
+    return NULL;
+  }
+
+  TimerEntry *entry = wheel->expired.next;
+  list_unlink(entry);
+  wheel->count--;
+  return entry;
+}
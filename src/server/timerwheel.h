@@ -0,0 +1,67 @@
+#ifndef KVS_TIMERWHEEL_H
+#define KVS_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+/// A timer embedded in the object it belongs to. Times are in ticks.
+typedef struct TimerEntry {
+  struct TimerEntry *next;  // NULL while the timer is not armed
+  struct TimerEntry *prev;
+  uint64_t expires;
+} TimerEntry;
+
+/// Hierarchical timing wheel: level i has TIMER_WHEEL_SLOTS slots of
+/// TIMER_WHEEL_SLOTS^i ticks each. Adding and removing a timer is O(1); a
+/// timer moves down a level at most TIMER_WHEEL_LEVELS - 1 times before it
+/// fires. Timers further away than the wheel covers are parked in the last
+/// level and re-inserted when they come round. The wheel does no locking.
+typedef struct {
+  TimerEntry slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // list heads
+  TimerEntry expired;  // timers that fired and were not taken yet
+  uint64_t now;
+  size_t count;  // armed timers, expired ones included
+} TimerWheel;
+
+/// Initializes an empty wheel.
+/// @param wheel Wheel to initialize.
+/// @param now Current tick.
+void timer_wheel_init(TimerWheel *wheel, uint64_t now);
+
+/// Marks a timer as not armed. Must be called once before the timer is used.
+/// @param entry Timer to initialize.
+void timer_entry_init(TimerEntry *entry);
+
+/// Checks whether a timer is armed (in the wheel or expired and not taken).
+/// @param entry Timer to check.
+/// @return 1 if armed, 0 otherwise.
+int timer_entry_armed(const TimerEntry *entry);
+
+/// Arms a timer. A timer that is already armed is moved.
+/// @param wheel Wheel.
+/// @param entry Timer to arm.
+/// @param expires Tick at which it fires; ticks already past fire on the next
+///                timer_wheel_advance.
+void timer_wheel_add(TimerWheel *wheel, TimerEntry *entry, uint64_t expires);
+
+/// Disarms a timer. Does nothing if it is not armed.
+/// @param wheel Wheel.
+/// @param entry Timer to disarm.
+void timer_wheel_remove(TimerWheel *wheel, TimerEntry *entry);
+
+/// Moves the wheel forward, putting every timer due up to 'now' in the list of
+/// expired timers.
+/// @param wheel Wheel.
+/// @param now Current tick.
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now);
+
+/// Takes an expired timer, which is no longer armed afterwards.
+/// @param wheel Wheel.
+/// @return The timer, NULL if none expired.
+TimerEntry *timer_wheel_pop_expired(TimerWheel *wheel);
+
+#endif  // KVS_TIMERWHEEL_H
@@ -0,0 +1,317 @@
+#include "value.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Valor pequeno: os dados ficam logo a seguir ao único ponteiro de bloco, na mesma alocação
+static int is_inline(const KvsValue *value) {
+  return value->chunk_count == 1 && value->chunks[0] == (const char *)&value->chunks[1];
+}
+
+KvsValue *value_create(const char *data, size_t len) {
+  KvsValue *value = malloc(sizeof(KvsValue) + sizeof(char *) + len + 1);
+  if (value == NULL) {
+    return NULL;
+  }
+
+  atomic_init(&value->refs, 1);
+  value->len = len;
+  value->chunk_count = 1;
+  value->chunks[0] = (char *)&value->chunks[1];
+  memcpy(value->chunks[0], data, len);
+  value->chunks[0][len] = '\0';
+  return value;
+}
+
+KvsValue *value_ref(KvsValue *value) {
+  atomic_fetch_add_explicit(&value->refs, 1, memory_order_relaxed);
+  return value;
+}
+
+void value_unref(KvsValue *value) {
+  if (value == NULL || atomic_fetch_sub_explicit(&value->refs, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  if (!is_inline(value)) {
+    for (size_t i = 0; i < value->chunk_count; i++) {
+      free(value->chunks[i]);
+    }
+  }
+  free(value);
+}
+
+size_t value_chunk_len(const KvsValue *value, size_t index) {
+  if (index + 1 < value->chunk_count) {
+    return VALUE_CHUNK_SIZE;
+  }
+  return value->len - (value->chunk_count - 1) * VALUE_CHUNK_SIZE;
+}
+
+size_t value_prefix(const KvsValue *value, char *buffer, size_t size) {
+  size_t len = value->len < size - 1 ? value->len : size - 1;
+  size_t copied = 0;
+  for (size_t i = 0; copied < len; i++) {
+    size_t part = value_chunk_len(value, i);
+    part = part < len - copied ? part : len - copied;
+    memcpy(buffer + copied, value->chunks[i], part);
+    copied += part;
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+size_t value_size(const KvsValue *value) {
+  if (is_inline(value)) {
+    return sizeof(KvsValue) + sizeof(char *) + value->len + 1;
+  }
+  return sizeof(KvsValue) + value->chunk_count * sizeof(char *) + value->len;
+}
+
+// Só quem tem a única referência pode alterar um valor: mais nenhuma thread o está a ler, e com o
+// trinco da tabela ninguém pode obter uma referência nova entretanto
+static int is_exclusive(const KvsValue *value) {
+  return atomic_load_explicit(&value->refs, memory_order_acquire) == 1;
+}
+
+// Copia 'len' bytes de um valor, a partir da posição 'offset', para 'dest'
+static void copy_out(const KvsValue *value, size_t offset, char *dest, size_t len) {
+  size_t index = offset / VALUE_CHUNK_SIZE;
+  size_t skip = offset % VALUE_CHUNK_SIZE;
+  while (len > 0) {
+    size_t part = value_chunk_len(value, index) - skip;
+    part = part < len ? part : len;
+    memcpy(dest, value->chunks[index] + skip, part);
+    dest += part;
+    len -= part;
+    index++;
+    skip = 0;
+  }
+}
+
+// Valor pequeno com outros bytes, na mesma alocação
+static KvsValue *resize_inline(KvsValue *value, size_t len) {
+  KvsValue *resized = realloc(value, sizeof(KvsValue) + sizeof(char *) + len + 1);
+  if (resized == NULL) {
+    return NULL;
+  }
+  resized->chunks[0] = (char *)&resized->chunks[1];
+  resized->len = len;
+  resized->chunks[0][len] = '\0';
+  return resized;
+}
+
+KvsValue *value_replace(KvsValue *value, const char *data, size_t len) {
+  if (is_exclusive(value) && is_inline(value)) {
+    KvsValue *resized = resize_inline(value, len);
+    if (resized != NULL) {
+      memcpy(resized->chunks[0], data, len);
+    }
+    return resized;
+  }
+
+  KvsValue *replaced = value_create(data, len);
+  if (replaced != NULL) {
+    value_unref(value);
+  }
+  return replaced;
+}
+
+// Acrescenta bytes a um valor em construção
+static int builder_put(ValueBuilder *builder, const KvsValue *value) {
+  size_t copied = 0;
+  while (copied < value->len) {
+    size_t available;
+    char *space = value_builder_space(builder, &available);
+    if (space == NULL) {
+      return 1;
+    }
+    size_t part = value->len - copied < available ? value->len - copied : available;
+    copy_out(value, copied, space, part);
+    value_builder_commit(builder, part);
+    copied += part;
+  }
+  return 0;
+}
+
+// Acrescenta a um valor em blocos de que se tem a única referência: o último bloco cresce até
+// VALUE_CHUNK_SIZE e o resto vai para blocos novos. Todas as alocações são feitas antes de mexer
+// no conteúdo, para que uma falha deixe o valor como estava e no mesmo endereço
+static KvsValue *append_chunks(KvsValue *value, const KvsValue *suffix) {
+  size_t last = value->chunk_count - 1;
+  size_t used = value_chunk_len(value, last);
+  size_t first = VALUE_CHUNK_SIZE - used < suffix->len ? VALUE_CHUNK_SIZE - used : suffix->len;
+  size_t extra = (suffix->len - first + VALUE_CHUNK_SIZE - 1) / VALUE_CHUNK_SIZE;
+
+  char *fresh[extra + 1];
+  for (size_t i = 0; i < extra; i++) {
+    size_t rest = suffix->len - first - i * VALUE_CHUNK_SIZE;
+    fresh[i] = malloc(rest < VALUE_CHUNK_SIZE ? rest : VALUE_CHUNK_SIZE);
+    if (fresh[i] == NULL) {
+      while (i > 0) {
+        free(fresh[--i]);
+      }
+      return NULL;
+    }
+  }
+
+  // O último bloco cresce primeiro: guardado já no valor, continua válido mesmo que o cabeçalho não
+  // consiga crescer, só com espaço a mais
+  if (first > 0) {
+    char *chunk = realloc(value->chunks[last], used + first);
+    if (chunk == NULL) {
+      for (size_t i = 0; i < extra; i++) {
+        free(fresh[i]);
+      }
+      return NULL;
+    }
+    value->chunks[last] = chunk;
+  }
+
+  KvsValue *grown = value;
+  if (extra > 0) {
+    grown = realloc(value, sizeof(KvsValue) + (value->chunk_count + extra) * sizeof(char *));
+    if (grown == NULL) {
+      for (size_t i = 0; i < extra; i++) {
+        free(fresh[i]);
+      }
+      return NULL;
+    }
+  }
+
+  if (first > 0) {
+    copy_out(suffix, 0, grown->chunks[last] + used, first);
+  }
+  for (size_t i = 0; i < extra; i++) {
+    size_t offset = first + i * VALUE_CHUNK_SIZE;
+    size_t rest = suffix->len - offset;
+    grown->chunks[grown->chunk_count++] = fresh[i];
+    copy_out(suffix, offset, fresh[i], rest < VALUE_CHUNK_SIZE ? rest : VALUE_CHUNK_SIZE);
+  }
+  grown->len += suffix->len;
+  return grown;
+}
+
+KvsValue *value_append(KvsValue *value, const KvsValue *suffix) {
+  if (suffix->len == 0) {
+    return value;
+  }
+
+  if (is_exclusive(value)) {
+    if (!is_inline(value)) {
+      return append_chunks(value, suffix);
+    }
+    if (value->len + suffix->len < VALUE_INLINE_MAX) {
+      size_t len = value->len;
+      KvsValue *resized = resize_inline(value, len + suffix->len);
+      if (resized != NULL) {
+        copy_out(suffix, 0, resized->chunks[0] + len, suffix->len);
+      }
+      return resized;
+    }
+  }
+
+  // Partilhado (ou pequeno demais para ficar inline): o valor novo é construído ao lado
+  ValueBuilder builder;
+  value_builder_init(&builder);
+  if (builder_put(&builder, value) != 0 || builder_put(&builder, suffix) != 0) {
+    value_builder_discard(&builder);
+    return NULL;
+  }
+  KvsValue *appended = value_builder_finish(&builder);
+  if (appended != NULL) {
+    value_unref(value);
+  }
+  return appended;
+}
+
+void value_builder_init(ValueBuilder *builder) {
+  builder->chunks = NULL;
+  builder->chunk_count = 0;
+  builder->chunk_capacity = 0;
+  builder->len = 0;
+}
+
+// Acrescenta um bloco vazio ao valor em construção
+static int add_chunk(ValueBuilder *builder) {
+  if (builder->chunk_count == builder->chunk_capacity) {
+    size_t capacity = builder->chunk_capacity == 0 ? 4 : builder->chunk_capacity * 2;
+    char **chunks = realloc(builder->chunks, capacity * sizeof(char *));
+    if (chunks == NULL) {
+      return 1;
+    }
+    builder->chunks = chunks;
+    builder->chunk_capacity = capacity;
+  }
+
+  char *chunk = malloc(VALUE_CHUNK_SIZE);
+  if (chunk == NULL) {
+    return 1;
+  }
+  builder->chunks[builder->chunk_count++] = chunk;
+  return 0;
+}
+
+char *value_builder_space(ValueBuilder *builder, size_t *available) {
+  if (builder->chunk_count == 0) {
+    if (builder->len < VALUE_INLINE_MAX) {
+      *available = VALUE_INLINE_MAX - builder->len;
+      return builder->small + builder->len;
+    }
+
+    // O valor deixou de ser pequeno: o que já foi lido passa para o primeiro bloco
+    if (add_chunk(builder) != 0) {
+      return NULL;
+    }
+    memcpy(builder->chunks[0], builder->small, builder->len);
+  }
+
+  size_t used = builder->len - (builder->chunk_count - 1) * VALUE_CHUNK_SIZE;
+  if (used == VALUE_CHUNK_SIZE) {
+    if (add_chunk(builder) != 0) {
+      return NULL;
+    }
+    used = 0;
+  }
+  *available = VALUE_CHUNK_SIZE - used;
+  return builder->chunks[builder->chunk_count - 1] + used;
+}
+
+void value_builder_commit(ValueBuilder *builder, size_t len) { builder->len += len; }
+
+KvsValue *value_builder_finish(ValueBuilder *builder) {
+  if (builder->chunk_count == 0) {
+    KvsValue *value = value_create(builder->small, builder->len);
+    value_builder_init(builder);
+    return value;
+  }
+
+  KvsValue *value = malloc(sizeof(KvsValue) + builder->chunk_count * sizeof(char *));
+  if (value == NULL) {
+    value_builder_discard(builder);
+    return NULL;
+  }
+  atomic_init(&value->refs, 1);
+  value->len = builder->len;
+  value->chunk_count = builder->chunk_count;
+  memcpy(value->chunks, builder->chunks, builder->chunk_count * sizeof(char *));
+
+  // O último bloco só fica com o tamanho que usa
+  size_t last = value_chunk_len(value, value->chunk_count - 1);
+  char *shrunk = realloc(value->chunks[value->chunk_count - 1], last == 0 ? 1 : last);
+  if (shrunk != NULL) {
+    value->chunks[value->chunk_count - 1] = shrunk;
+  }
+
+  free(builder->chunks);
+  value_builder_init(builder);
+  return value;
+}
+
+void value_builder_discard(ValueBuilder *builder) {
+  for (size_t i = 0; i < builder->chunk_count; i++) {
+    free(builder->chunks[i]);
+  }
+  free(builder->chunks);
+  value_builder_init(builder);
+}
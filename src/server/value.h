@@ -0,0 +1,113 @@
+#ifndef KVS_VALUE_H
+#define KVS_VALUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/// Size of the chunks large values are split into.
+#define VALUE_CHUNK_SIZE 4096
+
+/// Values up to this size are built in a single allocation with the header.
+#define VALUE_INLINE_MAX 256
+
+/// A value shared by reference. The table, readers that are writing it out and
+/// pending notifications each hold a reference, so a value can be overwritten
+/// or deleted while it is still being written to a file. A shared value never
+/// changes; only the holder of the last reference may modify it.
+/// Small values live right after the header (and are null terminated); large
+/// ones are split into VALUE_CHUNK_SIZE chunks, all full except the last.
+typedef struct KvsValue {
+  _Atomic unsigned refs;
+  size_t len;
+  size_t chunk_count;
+  char *chunks[];
+} KvsValue;
+
+/// Builds a value incrementally, so bytes read from a file go straight into
+/// the chunks of the value without an intermediate buffer.
+typedef struct {
+  char small[VALUE_INLINE_MAX];
+  char **chunks;  // NULL while the value fits in 'small'
+  size_t chunk_count;
+  size_t chunk_capacity;
+  size_t len;
+} ValueBuilder;
+
+/// Creates a value with a copy of the given bytes.
+/// @param data Bytes of the value.
+/// @param len Number of bytes.
+/// @return The value, with one reference, or NULL on failure.
+KvsValue *value_create(const char *data, size_t len);
+
+/// Takes another reference to a value.
+/// @param value Value to reference.
+/// @return The same value.
+KvsValue *value_ref(KvsValue *value);
+
+/// Drops a reference to a value, freeing it with the last one.
+/// @param value Value to release (may be NULL).
+void value_unref(KvsValue *value);
+
+/// Copies the start of a value into a null terminated string.
+/// @param value Value to copy.
+/// @param buffer Destination buffer.
+/// @param size Size of the destination buffer.
+/// @return Number of bytes copied, without the '\0'.
+size_t value_prefix(const KvsValue *value, char *buffer, size_t size);
+
+/// Size of a chunk of a value.
+/// @param value Value to inspect.
+/// @param index Index of the chunk.
+/// @return Number of bytes in the chunk.
+size_t value_chunk_len(const KvsValue *value, size_t index);
+
+/// Replaces the bytes of a value. When the caller holds the only reference
+/// to a small value, its allocation is reused; otherwise a new value is made.
+/// @param value Value whose reference is taken over by the call on success.
+/// @param data New bytes.
+/// @param len Number of new bytes.
+/// @return The value with the new bytes, NULL if memory ran out (in which
+///         case 'value' is left untouched).
+KvsValue *value_replace(KvsValue *value, const char *data, size_t len);
+
+/// Appends another value to a value. When the caller holds the only
+/// reference, the value is extended in place (growing its last chunk and
+/// adding chunks as needed); otherwise a new value is made and the old one is
+/// left to its other holders.
+/// @param value Value whose reference is taken over by the call on success.
+/// @param suffix Value to append.
+/// @return The value with the suffix appended, NULL if memory ran out (in
+///         which case 'value' is left untouched).
+KvsValue *value_append(KvsValue *value, const KvsValue *suffix);
+
+/// Memory taken by a value: header, chunk pointers and bytes.
+/// @param value Value to inspect.
+/// @return Number of bytes allocated for it.
+size_t value_size(const KvsValue *value);
+
+/// Starts building a value.
+/// @param builder Builder to initialize.
+void value_builder_init(ValueBuilder *builder);
+
+/// Returns the free space at the end of the value being built, allocating a
+/// new chunk if the current one is full.
+/// @param builder Builder.
+/// @param available Set to the number of bytes that can be written.
+/// @return Where the next bytes go, NULL on failure.
+char *value_builder_space(ValueBuilder *builder, size_t *available);
+
+/// Adds bytes written to the space returned by value_builder_space.
+/// @param builder Builder.
+/// @param len Number of bytes written.
+void value_builder_commit(ValueBuilder *builder, size_t len);
+
+/// Ends building a value.
+/// @param builder Builder, which can be initialized again afterwards.
+/// @return The value, with one reference, or NULL on failure.
+KvsValue *value_builder_finish(ValueBuilder *builder);
+
+/// Frees a value that was being built.
+/// @param builder Builder.
+void value_builder_discard(ValueBuilder *builder);
+
+#endif  // KVS_VALUE_H
@@ -0,0 +1,125 @@
+#!/bin/sh
+# Corre os jobs de cada diretório em todos os modos do servidor (-O, -P, -O -P e .jobc) e
+# compara os .out e .bck de cada modo com os de uma execução sem opções. Cada job corre num
+# servidor só seu, já que os jobs de um diretório partilham a tabela e o que um vê dos outros
+# depende da ordem em que as threads os correm.
+# Uso: src/tests/check_jobs.sh [-t max_threads] [jobs_dir...]  (a partir da raiz do repositório)
+
+KVS=src/server/kvs
+COMPILE=src/server/kvs-compile
+FIFO_PREFIX=/tmp/server033
+TIMEOUT_S=120  # tempo máximo de cada modo (os jobs de exemplo esperam 20 s)
+
+threads=2
+if [ "$1" = "-t" ]; then
+  threads=$2
+  shift 2
+fi
+if [ $# -eq 0 ]; then
+  set -- src/server/jobs
+fi
+
+if [ ! -x "$KVS" ] || [ ! -x "$COMPILE" ]; then
+  echo "Build the server first (make)" >&2
+  exit 1
+fi
+
+work=$(mktemp -d /tmp/kvscheck.XXXXXX) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+# Corre o servidor num diretório até todos os jobs terem deixado o seu .stats, que é escrito
+# quando o job termina, e pára-o com SIGTERM. O stderr fica em <dir>.err
+# $1: diretório dos jobs; $2: nome do FIFO; restantes: opções do servidor
+run_mode() {
+  dir=$1
+  fifo=$2
+  shift 2
+  jobs=$(ls "$dir" | grep -c '\.jobc\?$')
+  "$KVS" "$@" "$dir" "$threads" 1 "$fifo" >/dev/null 2>"$dir.err" &
+  pid=$!
+  waited=0
+  while [ "$(ls "$dir" | grep -c '\.stats$')" -lt "$jobs" ]; do
+    if ! kill -0 $pid 2>/dev/null || [ $waited -ge $((TIMEOUT_S * 10)) ]; then
+      echo "$dir: server did not finish the jobs" >&2
+      kill $pid 2>/dev/null
+      wait $pid
+      rm -f "$FIFO_PREFIX$fifo"
+      return 1
+    fi
+    sleep 0.1
+    waited=$((waited + 1))
+  done
+  # Os backups são escritos por processos filhos, que o servidor espera antes de terminar
+  kill -TERM $pid
+  wait $pid
+  rm -f "$FIFO_PREFIX$fifo"
+  return 0
+}
+
+failed=0
+modes="base O P OP jobc jobcOP"
+servers=""
+id=0
+for jobs_dir in "$@"; do
+  for job in "$jobs_dir"/*.job; do
+    [ -e "$job" ] || continue
+    name=${job##*/}
+    id=$((id + 1))
+    for mode in $modes; do
+      dir=$work/$id/$mode
+      mkdir -p "$dir"
+      cp "$job" "$dir/" || exit 1
+      case $mode in
+        jobc*) "$COMPILE" "$dir/$name" >/dev/null && rm -f "$dir/$name" || {
+          echo "$job: compile failed" >&2
+          failed=1
+        } ;;
+      esac
+    done
+    servers="$servers $id:$job"
+  done
+done
+
+# Os servidores correm todos ao mesmo tempo, cada um com o seu FIFO
+pids=""
+for server in $servers; do
+  id=${server%%:*}
+  for mode in $modes; do
+    case $mode in
+      O) flags="-O" ;;
+      P) flags="-P" ;;
+      OP | jobcOP) flags="-O -P" ;;
+      *) flags="" ;;
+    esac
+    run_mode "$work/$id/$mode" "check$$.$id.$mode" $flags &
+    pids="$pids $!"
+  done
+done
+for pid in $pids; do
+  wait $pid || failed=1
+done
+
+for server in $servers; do
+  id=${server%%:*}
+  job=${server#*:}
+  base=$work/$id/base
+  for mode in $modes; do
+    [ "$mode" = base ] && continue
+    for f in "$base"/*.out "$base"/*.bck; do
+      [ -e "$f" ] || continue
+      if ! cmp -s "$f" "$work/$id/$mode/${f##*/}"; then
+        echo "$job: ${f##*/} differs with $mode" >&2
+        failed=1
+      fi
+    done
+    if ! cmp -s "$base.err" "$work/$id/$mode.err"; then
+      echo "$job: stderr differs with $mode" >&2
+      failed=1
+    fi
+  done
+done
+
+if [ $failed -eq 0 ]; then
+  echo "$(echo $servers | wc -w) jobs checked in $modes"
+fi
+exit $failed